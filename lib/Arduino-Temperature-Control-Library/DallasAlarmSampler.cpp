@@ -0,0 +1,159 @@
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+
+#include "DallasAlarmSampler.h"
+
+#if REQUIRESALARMS
+
+#include <string.h>
+
+DallasAlarmSampler::DallasAlarmSampler(DallasTemperature* sensors, uint8_t band) :
+	_sensors(sensors), _band(band), _refreshInterval(0), _cycle(0),
+	_handler(nullptr), _count(0) {
+}
+
+bool DallasAlarmSampler::addProbe(const uint8_t* deviceAddress) {
+
+	if (indexOf(deviceAddress) >= 0)
+		return true;
+	if (_count >= DALLAS_SAMPLER_MAX)
+		return false;
+
+	memcpy(_addresses[_count], deviceAddress, sizeof(DeviceAddress));
+	_raw[_count] = DEVICE_DISCONNECTED_RAW;
+	_armed[_count] = false;
+	_changed[_count] = false;
+	_count++;
+	return true;
+}
+
+void DallasAlarmSampler::removeProbe(const uint8_t* deviceAddress) {
+
+	int16_t i = indexOf(deviceAddress);
+	if (i < 0)
+		return;
+
+	// keep the order, indices are what callers publish under
+	for (uint8_t j = i + 1; j < _count; j++) {
+		memcpy(_addresses[j - 1], _addresses[j], sizeof(DeviceAddress));
+		_raw[j - 1] = _raw[j];
+		_armed[j - 1] = _armed[j];
+		_changed[j - 1] = _changed[j];
+	}
+	_count--;
+}
+
+uint8_t DallasAlarmSampler::getProbeCount(void) {
+	return _count;
+}
+
+const uint8_t* DallasAlarmSampler::getAddress(uint8_t index) {
+	return index < _count ? _addresses[index] : nullptr;
+}
+
+void DallasAlarmSampler::setBand(uint8_t band) {
+	_band = band;
+	// new thresholds are programmed as probes are read
+	for (uint8_t i = 0; i < _count; i++)
+		_armed[i] = false;
+}
+
+void DallasAlarmSampler::setRefreshInterval(uint8_t samples) {
+	_refreshInterval = samples;
+}
+
+void DallasAlarmSampler::setSampleHandler(SampleHandler* handler) {
+	_handler = handler;
+}
+
+int32_t DallasAlarmSampler::getTemp(uint8_t index) {
+	return index < _count ? _raw[index] : DEVICE_DISCONNECTED_RAW;
+}
+
+float DallasAlarmSampler::getTempC(uint8_t index) {
+	return DallasTemperature::rawToCelsius(getTemp(index));
+}
+
+bool DallasAlarmSampler::changed(uint8_t index) {
+	return index < _count && _changed[index];
+}
+
+int16_t DallasAlarmSampler::indexOf(const uint8_t* deviceAddress) {
+	for (uint8_t i = 0; i < _count; i++) {
+		if (memcmp(_addresses[i], deviceAddress, sizeof(DeviceAddress)) == 0)
+			return i;
+	}
+	return -1;
+}
+
+// read one probe and program its band around the new value
+void DallasAlarmSampler::readProbe(uint8_t i) {
+
+	int32_t raw = _sensors->getTemp(_addresses[i]);
+	_raw[i] = raw;
+	_changed[i] = true;
+
+	if (raw <= DEVICE_DISCONNECTED_RAW) {
+		// try again on the next sample
+		_armed[i] = false;
+	} else {
+		// TH/TL are compared against the whole degrees, rounded down
+		int16_t whole = raw >> 7;
+		int16_t high = whole + _band + 1;
+		int16_t low = whole - _band - 1;
+		_armed[i] = _sensors->setAlarmTemps(_addresses[i],
+		                                    constrain(low, -55, 125),
+		                                    constrain(high, -55, 125));
+	}
+
+	if (_handler)
+		_handler(i, _addresses[i], raw);
+}
+
+uint8_t DallasAlarmSampler::sample(void) {
+
+	DeviceAddress alarmAddr;
+	uint8_t reads = 0;
+	bool refresh = false;
+
+	if (_refreshInterval && ++_cycle >= _refreshInterval) {
+		_cycle = 0;
+		refresh = true;
+	}
+
+	for (uint8_t i = 0; i < _count; i++) {
+		_changed[i] = false;
+		_pending[i] = refresh || !_armed[i];
+	}
+
+	// one conversion for the whole bus
+	_sensors->requestTemperatures();
+
+	// the alarm flags are refreshed by every conversion, so this finds
+	// exactly the probes that left their band
+	_sensors->resetAlarmSearch();
+	while (_sensors->alarmSearch(alarmAddr)) {
+		if (!_sensors->validAddress(alarmAddr))
+			continue;
+		int16_t i = indexOf(alarmAddr);
+		if (i >= 0)
+			_pending[i] = true;
+	}
+
+	// keep re-arming out of the scratchpad EEPROM
+	bool autoSave = _sensors->getAutoSaveScratchPad();
+	_sensors->setAutoSaveScratchPad(false);
+	for (uint8_t i = 0; i < _count; i++) {
+		if (_pending[i]) {
+			readProbe(i);
+			reads++;
+		}
+	}
+	_sensors->setAutoSaveScratchPad(autoSave);
+
+	return reads;
+}
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef DallasAlarmSampler_h
+#define DallasAlarmSampler_h
+
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+
+// Exception based sampling using the devices' own alarm comparators.
+//
+// Every probe gets TH/TL programmed into its scratchpad around the last
+// value read from it.  A sample is then one Convert T for the whole bus
+// followed by an alarm search, and only the probes that report an alarm
+// (i.e. left their band) are read out and re-armed.  All other probes are
+// known to still be within their band and keep their last value.
+//
+// TH/TL only compare whole degrees, so a probe is silent while the integer
+// part of its temperature stays within 'band' degrees of the last value
+// read; with band 0 any change of the whole degree is reported.  Set a
+// refresh interval to read every probe once every so many samples anyway.
+//
+// The alarm registers are written to the scratchpad only, never copied to
+// EEPROM, so re-arming does not wear the devices.
+
+#include "DallasTemperature.h"
+
+#if REQUIRESALARMS
+
+#ifndef DALLAS_SAMPLER_MAX
+#define DALLAS_SAMPLER_MAX 64
+#endif
+
+class DallasAlarmSampler {
+public:
+
+	// called for every probe read out by sample()
+	typedef void SampleHandler(uint8_t index, const uint8_t* deviceAddress, int32_t raw);
+
+	DallasAlarmSampler(DallasTemperature*, uint8_t band = 0);
+
+	// add or remove a probe, e.g. from OneWireTopology events
+	bool addProbe(const uint8_t*);
+	void removeProbe(const uint8_t*);
+
+	uint8_t getProbeCount(void);
+	const uint8_t* getAddress(uint8_t);
+
+	// whole degrees of hysteresis around the last value
+	void setBand(uint8_t);
+
+	// read every probe every 'samples' samples, 0 to disable
+	void setRefreshInterval(uint8_t);
+
+	void setSampleHandler(SampleHandler*);
+
+	// one conversion and alarm search; returns the number of probes read
+	uint8_t sample(void);
+
+	// last value read from a probe in 1/128 degrees C
+	int32_t getTemp(uint8_t);
+	float getTempC(uint8_t);
+
+	// true if the probe was read out by the last sample()
+	bool changed(uint8_t);
+
+private:
+
+	int16_t indexOf(const uint8_t*);
+	void readProbe(uint8_t);
+
+	DallasTemperature* _sensors;
+	uint8_t _band;
+	uint8_t _refreshInterval;
+	uint8_t _cycle;
+	SampleHandler* _handler;
+
+	DeviceAddress _addresses[DALLAS_SAMPLER_MAX];
+	int32_t _raw[DALLAS_SAMPLER_MAX];
+	bool _armed[DALLAS_SAMPLER_MAX];
+	bool _changed[DALLAS_SAMPLER_MAX];
+	bool _pending[DALLAS_SAMPLER_MAX];
+	uint8_t _count;
+
+};
+
+#endif
+#endif
@@ -0,0 +1,204 @@
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+
+#include "DallasBusPipeline.h"
+
+DallasBusPipeline::DallasBusPipeline(void) :
+	_count(0), _cursor(0), _handler(nullptr) {
+}
+
+int8_t DallasBusPipeline::addBus(DallasTemperature* sensors) {
+
+	if (_count >= DALLAS_PIPELINE_MAX_BUSES)
+		return -1;
+
+	Bus& b = _buses[_count];
+	b.sensors = sensors;
+	b.probes = 0;
+	b.state = BUS_IDLE;
+	b.faulted = false;
+	b.since = 0;
+	b.wait = 0;
+	b.backoff = DALLAS_PIPELINE_BACKOFF;
+	b.samples = 0;
+	b.cycles = 0;
+	return _count++;
+}
+
+uint8_t DallasBusPipeline::getBusCount(void) {
+	return _count;
+}
+
+void DallasBusPipeline::setReadingHandler(ReadingHandler* handler) {
+	_handler = handler;
+}
+
+uint8_t DallasBusPipeline::getProbeCount(uint8_t bus) {
+	return bus < _count ? _buses[bus].probes : 0;
+}
+
+const uint8_t* DallasBusPipeline::getAddress(uint8_t bus, uint8_t index) {
+	if (bus >= _count || index >= _buses[bus].probes)
+		return nullptr;
+	return _buses[bus].addresses[index];
+}
+
+int32_t DallasBusPipeline::getTemp(uint8_t bus, uint8_t index) {
+	if (bus >= _count || index >= _buses[bus].probes)
+		return DEVICE_DISCONNECTED_RAW;
+	return _buses[bus].raw[index];
+}
+
+uint32_t DallasBusPipeline::getSampleCount(uint8_t bus) {
+	return bus < _count ? _buses[bus].samples : 0;
+}
+
+uint32_t DallasBusPipeline::getCycleCount(uint8_t bus) {
+	return bus < _count ? _buses[bus].cycles : 0;
+}
+
+bool DallasBusPipeline::isFaulted(uint8_t bus) {
+	return bus < _count && _buses[bus].faulted;
+}
+
+void DallasBusPipeline::listProbes(Bus& b) {
+
+	b.probes = 0;
+	for (uint8_t i = 0; i < b.sensors->getDeviceCount() && b.probes < DALLAS_PIPELINE_MAX_PROBES; i++) {
+		if (b.sensors->getAddress(b.addresses[b.probes], i) &&
+		    b.sensors->validFamily(b.addresses[b.probes])) {
+			b.raw[b.probes] = DEVICE_DISCONNECTED_RAW;
+			b.probes++;
+		}
+	}
+}
+
+void DallasBusPipeline::begin(void) {
+
+	unsigned long now = millis();
+	unsigned long window = 0;
+
+	for (uint8_t i = 0; i < _count; i++) {
+		Bus& b = _buses[i];
+		b.sensors->begin();
+		b.sensors->setWaitForConversion(false);
+		listProbes(b);
+		if (b.sensors->millisToWaitForConversion() > window)
+			window = b.sensors->millisToWaitForConversion();
+	}
+
+	// spread the first conversions over one window, the buses keep their
+	// offsets from then on
+	for (uint8_t i = 0; i < _count; i++) {
+		Bus& b = _buses[i];
+		b.state = BUS_WAITING;
+		b.since = now;
+		b.wait = window * i / _count;
+	}
+}
+
+void DallasBusPipeline::start(Bus& b) {
+
+	DallasTemperature::request_t req = b.sensors->requestTemperatures();
+	b.state = BUS_CONVERTING;
+	b.since = req.timestamp;
+	b.wait = b.sensors->millisToWaitForConversion();
+	// waitForConversion is off, so the library does not switch the
+	// external pullup; hold it for the whole window
+	if (b.sensors->isParasitePowerMode())
+		b.sensors->activateExternalPullup();
+}
+
+// nothing answered, bad cable or empty bus: retry later
+void DallasBusPipeline::fault(Bus& b, unsigned long now) {
+
+	b.faulted = true;
+	b.state = BUS_WAITING;
+	b.since = now;
+	b.wait = b.backoff;
+	b.backoff *= 2;
+	if (b.backoff > DALLAS_PIPELINE_BACKOFF_MAX)
+		b.backoff = DALLAS_PIPELINE_BACKOFF_MAX;
+}
+
+bool DallasBusPipeline::ready(Bus& b, unsigned long now) {
+
+	// millis() truncates, so only '>' guarantees the full window
+	if (now - b.since > b.wait)
+		return true;
+	// polling a read slot would cut the strong pullup
+	if (b.sensors->isParasitePowerMode() || !b.sensors->getCheckForConversion())
+		return false;
+	return b.sensors->isConversionComplete();
+}
+
+uint8_t DallasBusPipeline::harvest(uint8_t bus, unsigned long now) {
+
+	Bus& b = _buses[bus];
+	uint8_t good = 0;
+
+	if (b.sensors->isParasitePowerMode())
+		b.sensors->deactivateExternalPullup();
+
+	for (uint8_t i = 0; i < b.probes; i++) {
+		int32_t raw = b.sensors->getTemp(b.addresses[i]);
+		b.raw[i] = raw;
+		b.samples++;
+		if (raw > DEVICE_DISCONNECTED_RAW)
+			good++;
+		if (_handler)
+			_handler(bus, i, b.addresses[i], raw);
+	}
+	b.cycles++;
+
+	if (!good) {
+		fault(b, now);
+	} else {
+		b.faulted = false;
+		b.backoff = DALLAS_PIPELINE_BACKOFF;
+		start(b);
+	}
+	return b.probes;
+}
+
+uint8_t DallasBusPipeline::run(void) {
+
+	unsigned long now = millis();
+
+	for (uint8_t n = 0; n < _count; n++) {
+		uint8_t i = (_cursor + n) % _count;
+		Bus& b = _buses[i];
+
+		switch (b.state) {
+		case BUS_WAITING:
+			if (now - b.since < b.wait)
+				break;
+			if (b.faulted) {
+				// the bus may have come back with other probes
+				b.sensors->begin();
+				b.sensors->setWaitForConversion(false);
+				listProbes(b);
+			}
+			if (b.probes == 0)
+				fault(b, now);
+			else
+				start(b);
+			break;
+		case BUS_CONVERTING:
+			if (ready(b, now)) {
+				_cursor = i + 1;
+				return harvest(i, now);
+			}
+			break;
+		default:
+			if (b.probes == 0)
+				fault(b, now);
+			else
+				start(b);
+			break;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,106 @@
+#ifndef DallasBusPipeline_h
+#define DallasBusPipeline_h
+
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+
+// Conversion pipeline over several 1-Wire buses.
+//
+// Each bus has its own OneWire and DallasTemperature instance and runs
+// its own Convert T cycle: start, wait, read every probe, start again.
+// Conversions on different buses overlap, so while one bus is being read
+// out the others are converting and the aggregate sample rate grows with
+// the number of buses.  The first conversions are staggered over one
+// conversion window so that the read-outs, which keep the CPU busy
+// bit-banging, fall at different times.
+//
+// run() never blocks on a conversion and reads out at most one bus per
+// call, taking buses in round-robin order.  A conversion is over when the
+// bus reports it done (if checkForConversion is set) or when its window
+// has passed.  Parasite powered buses carry no traffic at all while they
+// convert; their strong pullup, and the external pullup pin if one is
+// set, is held for the whole window and released for the read-out.
+//
+// A bus on which no probe answers is considered faulted and is retried
+// with an increasing back-off, without delaying the other buses.
+
+#include "DallasTemperature.h"
+
+#ifndef DALLAS_PIPELINE_MAX_BUSES
+#define DALLAS_PIPELINE_MAX_BUSES 4
+#endif
+
+#ifndef DALLAS_PIPELINE_MAX_PROBES
+#define DALLAS_PIPELINE_MAX_PROBES 16
+#endif
+
+// first and longest retry delay for a faulted bus in ms
+#define DALLAS_PIPELINE_BACKOFF      1000
+#define DALLAS_PIPELINE_BACKOFF_MAX  60000
+
+class DallasBusPipeline {
+public:
+
+	// called for every probe read out
+	typedef void ReadingHandler(uint8_t bus, uint8_t index, const uint8_t* deviceAddress, int32_t raw);
+
+	DallasBusPipeline(void);
+
+	// returns the bus number or -1 if all slots are taken
+	int8_t addBus(DallasTemperature*);
+	uint8_t getBusCount(void);
+
+	// starts every bus and lists its probes
+	void begin(void);
+
+	void setReadingHandler(ReadingHandler*);
+
+	// reads out at most one bus and starts idle ones; returns the number
+	// of probes read
+	uint8_t run(void);
+
+	uint8_t getProbeCount(uint8_t bus);
+	const uint8_t* getAddress(uint8_t bus, uint8_t index);
+
+	// last value read in 1/128 degrees C
+	int32_t getTemp(uint8_t bus, uint8_t index);
+
+	// per bus statistics
+	uint32_t getSampleCount(uint8_t bus);
+	uint32_t getCycleCount(uint8_t bus);
+	bool isFaulted(uint8_t bus);
+
+private:
+
+	enum { BUS_IDLE, BUS_CONVERTING, BUS_WAITING };
+
+	struct Bus {
+		DallasTemperature* sensors;
+		DeviceAddress addresses[DALLAS_PIPELINE_MAX_PROBES];
+		int32_t raw[DALLAS_PIPELINE_MAX_PROBES];
+		uint8_t probes;
+		uint8_t state;
+		bool faulted;
+		unsigned long since;
+		unsigned long wait;
+		unsigned long backoff;
+		uint32_t samples;
+		uint32_t cycles;
+	};
+
+	void listProbes(Bus&);
+	void start(Bus&);
+	void fault(Bus&, unsigned long);
+	bool ready(Bus&, unsigned long);
+	uint8_t harvest(uint8_t, unsigned long);
+
+	Bus _buses[DALLAS_PIPELINE_MAX_BUSES];
+	uint8_t _count;
+	uint8_t _cursor;
+	ReadingHandler* _handler;
+
+};
+
+#endif
@@ -0,0 +1,169 @@
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+
+#include "DallasFilter.h"
+
+#include <string.h>
+
+DallasFilter::DallasFilter(uint8_t window) :
+	_hampel(0), _maxSlew(0), _faultLimit(3), _rejects(0) {
+	setWindow(window);
+}
+
+void DallasFilter::setWindow(uint8_t window) {
+	_window = constrain(window, 1, DALLAS_FILTER_MAX_WINDOW);
+	reset();
+}
+
+void DallasFilter::setHampel(float k) {
+	// 1.4826 turns the MAD into a standard deviation estimate
+	_hampel = k > 0 ? (uint16_t)(k * 1.4826f * 256) : 0;
+}
+
+void DallasFilter::setMaxSlew(float celsiusPerSecond) {
+	_maxSlew = celsiusPerSecond > 0 ? (int32_t)(celsiusPerSecond * 128) : 0;
+}
+
+void DallasFilter::setFaultLimit(uint8_t limit) {
+	_faultLimit = limit ? limit : 1;
+}
+
+int32_t DallasFilter::get(void) {
+	return _output;
+}
+
+uint32_t DallasFilter::getRejectCount(void) {
+	return _rejects;
+}
+
+void DallasFilter::reset(void) {
+	_count = 0;
+	_head = 0;
+	_faults = 0;
+	_powerOn = 0;
+	_output = DEVICE_DISCONNECTED_RAW;
+	_lastTime = 0;
+}
+
+// first position in the sorted window not less than value
+uint8_t DallasFilter::lowerBound(int32_t value) {
+	uint8_t lo = 0, hi = _count;
+	while (lo < hi) {
+		uint8_t mid = (lo + hi) / 2;
+		if (_sorted[mid] < value)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+void DallasFilter::push(int32_t raw) {
+
+	if (_count == _window) {
+		// drop the oldest sample from the sorted copy
+		int32_t old = _ring[_head];
+		uint8_t i = lowerBound(old);
+		memmove(&_sorted[i], &_sorted[i + 1], (_count - i - 1) * sizeof(int32_t));
+		_count--;
+	}
+	_ring[_head] = raw;
+	_head = (_head + 1) % _window;
+
+	uint8_t i = lowerBound(raw);
+	memmove(&_sorted[i + 1], &_sorted[i], (_count - i) * sizeof(int32_t));
+	_sorted[i] = raw;
+	_count++;
+}
+
+int32_t DallasFilter::median(void) {
+	if (_count & 1)
+		return _sorted[_count / 2];
+	return (_sorted[_count / 2 - 1] + _sorted[_count / 2]) / 2;
+}
+
+// median absolute deviation from m: the deviations grow outwards from
+// m in the sorted window, so merging both sides finds the middle ones
+int32_t DallasFilter::mad(int32_t m) {
+
+	int16_t left = lowerBound(m) - 1;
+	int16_t right = left + 1;
+	int32_t lower = 0, upper = 0;
+
+	for (uint8_t k = 0; k <= _count / 2; k++) {
+		int32_t d;
+		if (left < 0) {
+			d = _sorted[right++] - m;
+		} else if (right >= _count) {
+			d = m - _sorted[left--];
+		} else if (m - _sorted[left] <= _sorted[right] - m) {
+			d = m - _sorted[left--];
+		} else {
+			d = _sorted[right++] - m;
+		}
+		lower = upper;
+		upper = d;
+	}
+	return (_count & 1) ? upper : (lower + upper) / 2;
+}
+
+int32_t DallasFilter::add(int32_t raw) {
+	return add(raw, millis());
+}
+
+int32_t DallasFilter::add(int32_t raw, unsigned long now) {
+
+	if (raw <= DEVICE_DISCONNECTED_RAW) {
+		// a real disconnect shows up after faultLimit readings in a row
+		if (++_faults >= _faultLimit) {
+			_count = 0;
+			_head = 0;
+			_output = raw;
+		} else {
+			_rejects++;
+		}
+		return _output;
+	}
+	_faults = 0;
+
+	if (raw == DALLAS_FILTER_POWERON_RAW && _output > DEVICE_DISCONNECTED_RAW &&
+	    (raw - _output > DALLAS_FILTER_POWERON_JUMP || _output - raw > DALLAS_FILTER_POWERON_JUMP)) {
+		if (++_powerOn < _faultLimit) {
+			_rejects++;
+			return _output;
+		}
+	} else {
+		_powerOn = 0;
+	}
+
+	push(raw);
+
+	int32_t m = median();
+	int32_t y = m;
+	if (_hampel) {
+		y = raw;
+		if (_count >= 3) {
+			int32_t threshold = (int32_t)(((int64_t) mad(m) * _hampel) >> 8);
+			if (threshold < DALLAS_FILTER_HAMPEL_FLOOR)
+				threshold = DALLAS_FILTER_HAMPEL_FLOOR;
+			if (raw - m > threshold || m - raw > threshold) {
+				y = m;
+				_rejects++;
+			}
+		}
+	}
+
+	if (_maxSlew && _output > DEVICE_DISCONNECTED_RAW) {
+		int32_t step = (int32_t)((int64_t) _maxSlew * (now - _lastTime) / 1000);
+		if (y > _output + step)
+			y = _output + step;
+		else if (y < _output - step)
+			y = _output - step;
+	}
+
+	_output = y;
+	_lastTime = now;
+	return _output;
+}
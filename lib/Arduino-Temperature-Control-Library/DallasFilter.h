@@ -0,0 +1,96 @@
+#ifndef DallasFilter_h
+#define DallasFilter_h
+
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+
+// Streaming de-glitch filter for one temperature channel, working on raw
+// values (1/128 degrees C) as returned by DallasTemperature::getTemp().
+//
+// Each sample goes through these stages:
+//
+//  - fault codes (DEVICE_DISCONNECTED_RAW and the DEVICE_FAULT_*_RAW
+//    codes) never enter the window; the output only turns into the
+//    fault code once it has been seen faultLimit times in a row
+//  - the 85C power-on value is held back the same way when it arrives
+//    as a jump, since that is what a probe that browned out reports
+//  - median: the output is the median of the last 'window' samples, or
+//    with Hampel enabled the sample itself unless it lies more than
+//    k * 1.4826 * MAD from the median, in which case the median
+//  - slew: the output moves at most maxSlew degrees C per second
+//
+// The window is a fixed ring plus a sorted copy of it, so a sample costs
+// two binary searches and a move of at most DALLAS_FILTER_MAX_WINDOW
+// values, and the Hampel MAD one linear merge.  Nothing is allocated.
+
+#include "DallasTemperature.h"
+
+#ifndef DALLAS_FILTER_MAX_WINDOW
+#define DALLAS_FILTER_MAX_WINDOW 15
+#endif
+
+// smallest Hampel threshold, keeps single LSB noise from being replaced
+#define DALLAS_FILTER_HAMPEL_FLOOR 32
+
+// DS18B20 power-on reset value, 85C
+#define DALLAS_FILTER_POWERON_RAW  (85 * 128)
+// smallest jump to 85C that is treated as a power-on glitch
+#define DALLAS_FILTER_POWERON_JUMP (2 * 128)
+
+class DallasFilter {
+public:
+
+	DallasFilter(uint8_t window = 5);
+
+	// window length, at most DALLAS_FILTER_MAX_WINDOW; clears the filter
+	void setWindow(uint8_t);
+
+	// Hampel outlier threshold in MADs, 0 for a plain median
+	void setHampel(float);
+
+	// largest output change in degrees C per second, 0 to disable
+	void setMaxSlew(float);
+
+	// consecutive fault codes or power-on values before they are passed on
+	void setFaultLimit(uint8_t);
+
+	// feeds one raw reading and returns the filtered value
+	int32_t add(int32_t raw);
+	int32_t add(int32_t raw, unsigned long now);
+
+	// last filtered value, DEVICE_DISCONNECTED_RAW before the first sample
+	int32_t get(void);
+
+	// number of samples replaced or held back so far
+	uint32_t getRejectCount(void);
+
+	void reset(void);
+
+private:
+
+	void push(int32_t);
+	int32_t median(void);
+	int32_t mad(int32_t);
+	uint8_t lowerBound(int32_t);
+
+	int32_t _ring[DALLAS_FILTER_MAX_WINDOW];
+	int32_t _sorted[DALLAS_FILTER_MAX_WINDOW];
+	uint8_t _window;
+	uint8_t _count;
+	uint8_t _head;
+
+	uint16_t _hampel;	// threshold in 1/256 MADs, scale included
+	int32_t _maxSlew;	// raw per second
+	uint8_t _faultLimit;
+	uint8_t _faults;
+	uint8_t _powerOn;
+
+	int32_t _output;
+	unsigned long _lastTime;
+	uint32_t _rejects;
+
+};
+
+#endif
@@ -0,0 +1,268 @@
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+
+#include "DallasResolutionScheduler.h"
+
+#include <string.h>
+
+DallasResolutionScheduler::DallasResolutionScheduler(DallasTemperature* sensors, float errorBudget) :
+	_sensors(sensors), _budget(errorBudget * 128), _handler(nullptr),
+	_samples(0), _cursor(0), _count(0) {
+}
+
+bool DallasResolutionScheduler::addProbe(const uint8_t* deviceAddress) {
+
+	if (indexOf(deviceAddress) >= 0)
+		return true;
+	if (_count >= DALLAS_SCHEDULER_MAX)
+		return false;
+
+	Probe& p = _probes[_count];
+	memcpy(p.address, deviceAddress, sizeof(DeviceAddress));
+	p.raw = DEVICE_DISCONNECTED_RAW;
+	p.rate = 0;
+	p.budget = _budget;
+	p.lastRead = 0;
+	p.started = 0;
+	p.resolution = chooseResolution(0, p.budget);
+	p.programmed = 0;
+	p.converting = false;
+	p.valid = false;
+	_count++;
+
+	// the resolution is programmed on the first conversion
+	return true;
+}
+
+void DallasResolutionScheduler::removeProbe(const uint8_t* deviceAddress) {
+
+	int16_t i = indexOf(deviceAddress);
+	if (i < 0)
+		return;
+
+	for (uint8_t j = i + 1; j < _count; j++)
+		_probes[j - 1] = _probes[j];
+	_count--;
+}
+
+uint8_t DallasResolutionScheduler::getProbeCount(void) {
+	return _count;
+}
+
+const uint8_t* DallasResolutionScheduler::getAddress(uint8_t index) {
+	return index < _count ? _probes[index].address : nullptr;
+}
+
+void DallasResolutionScheduler::setErrorBudget(float celsius) {
+	_budget = celsius * 128;
+	for (uint8_t i = 0; i < _count; i++)
+		_probes[i].budget = _budget;
+}
+
+void DallasResolutionScheduler::setErrorBudget(uint8_t index, float celsius) {
+	if (index < _count)
+		_probes[index].budget = celsius * 128;
+}
+
+void DallasResolutionScheduler::setSampleHandler(SampleHandler* handler) {
+	_handler = handler;
+}
+
+int32_t DallasResolutionScheduler::getTemp(uint8_t index) {
+	return index < _count ? _probes[index].raw : DEVICE_DISCONNECTED_RAW;
+}
+
+float DallasResolutionScheduler::getTempC(uint8_t index) {
+	return DallasTemperature::rawToCelsius(getTemp(index));
+}
+
+uint8_t DallasResolutionScheduler::getResolution(uint8_t index) {
+	return index < _count ? _probes[index].resolution : 0;
+}
+
+float DallasResolutionScheduler::getRate(uint8_t index) {
+	return index < _count ? _probes[index].rate / 128.0f : 0;
+}
+
+uint32_t DallasResolutionScheduler::getSampleCount(void) {
+	return _samples;
+}
+
+uint8_t DallasResolutionScheduler::chooseResolution(int32_t rate, int32_t budget) {
+
+	uint8_t best = 12;
+	int32_t bestError = INT32_MAX;
+
+	if (rate < 0)
+		rate = -rate;
+
+	for (uint8_t res = 9; res <= 12; res++) {
+		int32_t step = 128 >> (res - 8);
+		int32_t error = step / 2 + rate * DallasTemperature::millisToWaitForConversion(res) / 1000;
+		if (error <= budget)
+			return res;
+		if (error < bestError) {
+			bestError = error;
+			best = res;
+		}
+	}
+	return best;
+}
+
+int16_t DallasResolutionScheduler::indexOf(const uint8_t* deviceAddress) {
+	for (uint8_t i = 0; i < _count; i++) {
+		if (memcmp(_probes[i].address, deviceAddress, sizeof(DeviceAddress)) == 0)
+			return i;
+	}
+	return -1;
+}
+
+bool DallasResolutionScheduler::converting(void) {
+	for (uint8_t i = 0; i < _count; i++) {
+		if (_probes[i].converting)
+			return true;
+	}
+	return false;
+}
+
+// program the resolution if needed and start a conversion, without waiting
+bool DallasResolutionScheduler::startProbe(uint8_t i) {
+
+	Probe& p = _probes[i];
+
+	if (p.programmed != p.resolution) {
+		if (!_sensors->setResolution(p.address, p.resolution, true))
+			p.programmed = 0;
+		else
+			p.programmed = p.resolution;
+	}
+
+	// the resolution is tracked, so no scratchpad read before Convert T;
+	// a probe that is gone shows up as a failed read afterwards
+	DallasTemperature::request_t req = _sensors->requestTemperaturesByAddress(p.address, p.resolution);
+	if (!req.result) {
+		p.programmed = 0;
+		p.raw = DEVICE_DISCONNECTED_RAW;
+		p.valid = false;
+		return false;
+	}
+	p.started = req.timestamp;
+	p.converting = true;
+	// a parasite probe converts on the strong pullup until it is read
+	if (_sensors->isParasitePowerMode() && !_sensors->getWaitForConversion())
+		_sensors->activateExternalPullup();
+	return true;
+}
+
+// read a finished probe, update its rate and pick its next resolution
+void DallasResolutionScheduler::readProbe(uint8_t i) {
+
+	Probe& p = _probes[i];
+	unsigned long now = millis();
+	int32_t raw = _sensors->getTemp(p.address);
+
+	p.converting = false;
+
+	if (raw <= DEVICE_DISCONNECTED_RAW) {
+		p.raw = raw;
+		p.valid = false;
+		p.rate = 0;
+		// it may come back from a power cycle with its EEPROM resolution
+		p.programmed = 0;
+	} else {
+		if (p.valid && now != p.lastRead) {
+			// exponential average over roughly the last four readings
+			int32_t rate = (int32_t)((int64_t)(raw - p.raw) * 1000 / (int32_t)(now - p.lastRead));
+			p.rate += (rate - p.rate) / 4;
+		}
+		p.raw = raw;
+		p.lastRead = now;
+		p.valid = true;
+		p.resolution = chooseResolution(p.rate, p.budget);
+	}
+	_samples++;
+
+	if (_handler)
+		_handler(i, p.address, raw);
+}
+
+// start every idle probe whose resolution group is not converting
+void DallasResolutionScheduler::startGroups(void) {
+
+	bool busy[4] = { false, false, false, false };
+
+	for (uint8_t i = 0; i < _count; i++) {
+		if (_probes[i].converting)
+			busy[_probes[i].resolution - 9] = true;
+	}
+	for (uint8_t i = 0; i < _count; i++) {
+		if (!_probes[i].converting && !busy[_probes[i].resolution - 9])
+			startProbe(i);
+	}
+}
+
+// parasite power: one conversion at a time, round robin
+void DallasResolutionScheduler::startNext(void) {
+
+	for (uint8_t n = 0; n < _count; n++) {
+		uint8_t i = _cursor++ % _count;
+		if (startProbe(i))
+			return;
+	}
+}
+
+uint8_t DallasResolutionScheduler::run(void) {
+
+	uint8_t reads = 0;
+	unsigned long now = millis();
+
+	bool wait = _sensors->getWaitForConversion();
+	bool autoSave = _sensors->getAutoSaveScratchPad();
+	_sensors->setWaitForConversion(false);
+	_sensors->setAutoSaveScratchPad(false);
+
+	for (uint8_t i = 0; i < _count; i++) {
+		Probe& p = _probes[i];
+		if (p.converting && now - p.started > DallasTemperature::millisToWaitForConversion(p.resolution)) {
+			if (_sensors->isParasitePowerMode())
+				_sensors->deactivateExternalPullup();
+			readProbe(i);
+			reads++;
+		}
+	}
+
+	if (_count) {
+		if (!_sensors->isParasitePowerMode())
+			startGroups();
+		else if (!converting())
+			startNext();
+	}
+
+	_sensors->setAutoSaveScratchPad(autoSave);
+	_sensors->setWaitForConversion(wait);
+	return reads;
+}
+
+bool DallasResolutionScheduler::refresh(uint8_t index) {
+
+	if (index >= _count)
+		return false;
+	// on a parasite bus the running conversion would lose its power
+	if (_sensors->isParasitePowerMode() && converting())
+		return false;
+
+	bool wait = _sensors->getWaitForConversion();
+	bool autoSave = _sensors->getAutoSaveScratchPad();
+	_sensors->setWaitForConversion(true);
+	_sensors->setAutoSaveScratchPad(false);
+
+	bool ok = startProbe(index);
+	if (ok)
+		readProbe(index);
+
+	_sensors->setAutoSaveScratchPad(autoSave);
+	_sensors->setWaitForConversion(wait);
+	return ok && _probes[index].valid;
+}
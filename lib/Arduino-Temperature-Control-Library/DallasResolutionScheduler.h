@@ -0,0 +1,120 @@
+#ifndef DallasResolutionScheduler_h
+#define DallasResolutionScheduler_h
+
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+
+// Per-probe resolution and conversion scheduling.
+//
+// Every probe gets the lowest resolution that keeps its expected error
+// within an error budget.  The error of a reading is taken as half the
+// resolution step plus how far the temperature moves during one
+// conversion at the probe's recent rate of change:
+//
+//   9 bit: 0.5C step,    94ms     11 bit: 0.125C step,  375ms
+//  10 bit: 0.25C step,  188ms     12 bit: 0.0625C step, 750ms
+//
+// so a stable probe with a loose budget runs at 9 bit and is sampled
+// eight times as often as one that needs 12 bit.  If no resolution fits
+// the budget the one with the smallest expected error is used.
+//
+// Probes with the same resolution form a group that is converted together
+// with requestTemperaturesByAddress() and read out when that resolution's
+// conversion time is up, while the other groups keep converting on their
+// own.  run() never blocks, call it from loop().
+//
+// Parasite powered buses cannot carry any traffic while a conversion is
+// running, so there probes are converted one at a time, with the strong
+// pullup (and the external pullup pin, if set) held until the read-out.
+//
+// Conversions are started at the resolution the scheduler last programmed,
+// without reading it back from the probe first.
+//
+// Resolutions are written to the scratchpad only, never to EEPROM.
+
+#include "DallasTemperature.h"
+
+#ifndef DALLAS_SCHEDULER_MAX
+#define DALLAS_SCHEDULER_MAX 64
+#endif
+
+class DallasResolutionScheduler {
+public:
+
+	// called for every probe read out
+	typedef void SampleHandler(uint8_t index, const uint8_t* deviceAddress, int32_t raw);
+
+	DallasResolutionScheduler(DallasTemperature*, float errorBudget = 0.5);
+
+	bool addProbe(const uint8_t*);
+	void removeProbe(const uint8_t*);
+
+	uint8_t getProbeCount(void);
+	const uint8_t* getAddress(uint8_t);
+
+	// allowed error in degrees C, for all probes or a single one
+	void setErrorBudget(float);
+	void setErrorBudget(uint8_t, float);
+
+	void setSampleHandler(SampleHandler*);
+
+	// reads out groups whose conversion is done and starts idle groups;
+	// returns the number of probes read
+	uint8_t run(void);
+
+	// blocking out of band conversion and read of a single probe
+	bool refresh(uint8_t);
+
+	// last value read from a probe in 1/128 degrees C
+	int32_t getTemp(uint8_t);
+	float getTempC(uint8_t);
+
+	// resolution currently used for a probe
+	uint8_t getResolution(uint8_t);
+
+	// smoothed rate of change of a probe in degrees C per second
+	float getRate(uint8_t);
+
+	// total number of readings taken
+	uint32_t getSampleCount(void);
+
+	// lowest resolution whose expected error fits the budget, both in
+	// 1/128 degrees C, the rate in 1/128 degrees C per second
+	static uint8_t chooseResolution(int32_t rate, int32_t budget);
+
+private:
+
+	struct Probe {
+		DeviceAddress address;
+		int32_t raw;
+		int32_t rate;
+		int32_t budget;
+		unsigned long lastRead;
+		unsigned long started;
+		uint8_t resolution;
+		uint8_t programmed;
+		bool converting;
+		bool valid;
+	};
+
+	int16_t indexOf(const uint8_t*);
+	bool converting(void);
+	bool startProbe(uint8_t);
+	void readProbe(uint8_t);
+	void startGroups(void);
+	void startNext(void);
+
+	DallasTemperature* _sensors;
+	int32_t _budget;
+	SampleHandler* _handler;
+	uint32_t _samples;
+	uint8_t _cursor;
+
+	Probe _probes[DALLAS_SCHEDULER_MAX];
+	uint8_t _count;
+
+};
+
+#endif
@@ -105,6 +105,11 @@ void DallasTemperature::setOneWire(OneWire* _oneWire) {
 	waitForConversion = true;
 	checkForConversion = true;
 	autoSaveScratchPad = true;
+#if REQUIRESCONFIGCACHE
+	configCacheCount = 0;
+	configCacheNext = 0;
+	configBatch = false;
+#endif
 
 }
 
@@ -116,6 +121,9 @@ void DallasTemperature::begin(void) {
 	_wire->reset_search();
 	devices = 0; // Reset the number of devices when we enumerate wire devices
 	ds18Count = 0; // Reset number of DS18xxx Family devices
+#if REQUIRESCONFIGCACHE
+	invalidateConfigCache();
+#endif
 
 	while (_wire->search(deviceAddress)) {
 
@@ -144,6 +152,41 @@ uint8_t DallasTemperature::getDS18Count(void) {
 	return ds18Count;
 }
 
+// account for a device that appeared on the bus after begin()
+// only the new device is queried for its power mode and resolution
+void DallasTemperature::deviceAdded(const uint8_t* deviceAddress) {
+
+	if (!validAddress(deviceAddress))
+		return;
+	devices++;
+
+	if (validFamily(deviceAddress)) {
+		ds18Count++;
+
+		if (!parasite && readPowerSupply(deviceAddress))
+			parasite = true;
+
+		uint8_t b = getResolution(deviceAddress);
+		if (b > bitResolution) bitResolution = b;
+	}
+}
+
+// account for a device that left the bus after begin()
+// parasite mode and the global resolution are kept, they only ever
+// err on the safe side
+void DallasTemperature::deviceRemoved(const uint8_t* deviceAddress) {
+
+	if (!validAddress(deviceAddress) || devices == 0)
+		return;
+	devices--;
+
+	if (validFamily(deviceAddress) && ds18Count > 0)
+		ds18Count--;
+#if REQUIRESCONFIGCACHE
+	forgetConfig(deviceAddress);
+#endif
+}
+
 // returns true if address is valid
 bool DallasTemperature::validAddress(const uint8_t* deviceAddress) {
 	return (_wire->crc8((uint8_t*)deviceAddress, 7) == deviceAddress[DSROM_CRC]);
@@ -180,7 +223,19 @@ bool DallasTemperature::isConnected(const uint8_t* deviceAddress) {
 bool DallasTemperature::isConnected(const uint8_t* deviceAddress,
                                     uint8_t* scratchPad) {
 	bool b = readScratchPad(deviceAddress, scratchPad);
-	return b && !isAllZeros(scratchPad) && (_wire->crc8(scratchPad, 8) == scratchPad[SCRATCHPAD_CRC]);
+	b = b && !isAllZeros(scratchPad) && (_wire->crc8(scratchPad, 8) == scratchPad[SCRATCHPAD_CRC]);
+#if REQUIRESCONFIGCACHE
+	// every good read refreshes the shadow for free; a device that does
+	// not answer may come back from a power cycle with its EEPROM settings
+	if (b) {
+		cacheConfig(deviceAddress, scratchPad);
+	} else {
+		ConfigShadow* shadow = findConfig(deviceAddress);
+		if (shadow && !shadow->unsaved)
+			forgetConfig(deviceAddress);
+	}
+#endif
+	return b;
 }
 
 bool DallasTemperature::readScratchPad(const uint8_t* deviceAddress,
@@ -228,12 +283,43 @@ void DallasTemperature::writeScratchPad(const uint8_t* deviceAddress,
 	if (deviceAddress[DSROM_FAMILY] != DS18S20MODEL)
 		_wire->write(scratchPad[CONFIGURATION]);
 
+#if REQUIRESCONFIGCACHE
+	// with every shadow waiting for its copy this one is saved right away
+	ConfigShadow* shadow = cacheConfig(deviceAddress, scratchPad);
+	if (autoSaveScratchPad && configBatch && shadow) {
+		// copied to EEPROM by commitConfigBatch()
+		shadow->unsaved = true;
+		_wire->reset();
+		return;
+	}
+#endif
+
 	if (autoSaveScratchPad)
 		saveScratchPad(deviceAddress);
 	else
 		_wire->reset();
 }
 
+bool DallasTemperature::readConfig(const uint8_t* deviceAddress,
+                                   uint8_t* scratchPad) {
+
+#if REQUIRESCONFIGCACHE
+	ConfigShadow* shadow = findConfig(deviceAddress);
+	if (shadow) {
+		// the shadow only saves the scratchpad read, not the presence
+		// check; a device missing from a live bus fails its next read,
+		// which drops the shadow
+		if (_wire->reset() == 0)
+			return false;
+		scratchPad[HIGH_ALARM_TEMP] = shadow->highAlarm;
+		scratchPad[LOW_ALARM_TEMP] = shadow->lowAlarm;
+		scratchPad[CONFIGURATION] = shadow->configuration;
+		return true;
+	}
+#endif
+	return isConnected(deviceAddress, scratchPad);
+}
+
 // returns true if parasite mode is used (2 wire)
 // returns false if normal mode is used (3 wire)
 // if no address is given (or nullptr) it checks if any device on the bus
@@ -289,7 +375,7 @@ bool DallasTemperature::setResolution(const uint8_t* deviceAddress,
 		ScratchPad scratchPad;
 
 		// we can only update the sensor if it is connected
-		if (isConnected(deviceAddress, scratchPad)) {
+		if (readConfig(deviceAddress, scratchPad)) {
 			// MAX31850 has no resolution configuration register
 			// this is also a hack as the MAX31850 Coversion time is 100ms max.
 			// use a low res (~10 by spec, but 9 might work) for faster blocking read times.
@@ -441,7 +527,20 @@ DallasTemperature::request_t DallasTemperature::requestTemperaturesByAddress(con
 		return req; //Device disconnected
 	}
 
-	_wire->reset();
+	return requestTemperaturesByAddress(deviceAddress, bitResolution);
+
+}
+
+// sends command for one device to perform a temperature conversion at a
+// known resolution; fails only if nothing answers the reset
+DallasTemperature::request_t DallasTemperature::requestTemperaturesByAddress(const uint8_t* deviceAddress,
+                                                                             uint8_t bitResolution) {
+	DallasTemperature::request_t req = {};
+	if (_wire->reset() == 0) {
+		req.result = false;
+		return req;
+	}
+
 	_wire->select(deviceAddress);
 	_wire->write(STARTCONVO, parasite);
 
@@ -540,6 +639,13 @@ bool DallasTemperature::saveScratchPad(const uint8_t* deviceAddress) {
 		deactivateExternalPullup();
 	}
 
+#if REQUIRESCONFIGCACHE
+	for (uint8_t i = 0; i < configCacheCount; i++) {
+		if (deviceAddress == nullptr || memcmp(configCache[i].address, deviceAddress, sizeof(DeviceAddress)) == 0)
+			configCache[i].unsaved = false;
+	}
+#endif
+
 	return _wire->reset() == 1;
 
 }
@@ -570,6 +676,11 @@ bool DallasTemperature::recallScratchPad(const uint8_t* deviceAddress) {
 
 	_wire->write(RECALLSCRATCH, parasite);
 
+#if REQUIRESCONFIGCACHE
+	// the scratchpad now holds whatever the EEPROM had
+	forgetConfig(deviceAddress);
+#endif
+
 	// Specification: Strong pullup only needed when writing to EEPROM (and temp conversion)
 	unsigned long start = millis();
 	while (_wire->read_bit() == 0) {
@@ -592,6 +703,90 @@ bool DallasTemperature::getAutoSaveScratchPad() {
 	return autoSaveScratchPad;
 }
 
+#if REQUIRESCONFIGCACHE
+
+void DallasTemperature::beginConfigBatch() {
+	configBatch = true;
+}
+
+uint8_t DallasTemperature::commitConfigBatch() {
+
+	uint8_t saved = 0;
+
+	configBatch = false;
+	for (uint8_t i = 0; i < configCacheCount; i++) {
+		if (configCache[i].unsaved && saveScratchPad(configCache[i].address))
+			saved++;
+	}
+	return saved;
+
+}
+
+void DallasTemperature::invalidateConfigCache() {
+	configCacheCount = 0;
+	configCacheNext = 0;
+}
+
+DallasTemperature::ConfigShadow* DallasTemperature::findConfig(const uint8_t* deviceAddress) {
+	for (uint8_t i = 0; i < configCacheCount; i++) {
+		if (memcmp(configCache[i].address, deviceAddress, sizeof(DeviceAddress)) == 0)
+			return &configCache[i];
+	}
+	return nullptr;
+}
+
+// records the alarm and configuration bytes of a device, replacing the
+// oldest entry without a pending EEPROM copy when the cache is full.
+// Never touches the bus, as it is called from reads like isConnected():
+// if every entry waits for commitConfigBatch(), nothing is recorded and
+// nullptr returned.
+DallasTemperature::ConfigShadow* DallasTemperature::cacheConfig(const uint8_t* deviceAddress,
+                                                                const uint8_t* scratchPad) {
+
+	ConfigShadow* shadow = findConfig(deviceAddress);
+
+	if (!shadow) {
+		if (configCacheCount < CONFIGCACHESIZE) {
+			shadow = &configCache[configCacheCount++];
+		} else {
+			for (uint8_t n = 0; n < CONFIGCACHESIZE && !shadow; n++) {
+				if (!configCache[configCacheNext].unsaved)
+					shadow = &configCache[configCacheNext];
+				configCacheNext = (configCacheNext + 1) % CONFIGCACHESIZE;
+			}
+			if (!shadow)
+				return nullptr;
+		}
+		memcpy(shadow->address, deviceAddress, sizeof(DeviceAddress));
+		shadow->unsaved = false;
+	}
+
+	shadow->highAlarm = scratchPad[HIGH_ALARM_TEMP];
+	shadow->lowAlarm = scratchPad[LOW_ALARM_TEMP];
+	shadow->configuration = scratchPad[CONFIGURATION];
+	return shadow;
+
+}
+
+// forgets one device, or all of them for nullptr
+void DallasTemperature::forgetConfig(const uint8_t* deviceAddress) {
+
+	if (deviceAddress == nullptr) {
+		invalidateConfigCache();
+		return;
+	}
+
+	ConfigShadow* shadow = findConfig(deviceAddress);
+	if (!shadow)
+		return;
+	*shadow = configCache[--configCacheCount];
+	if (configCacheNext >= configCacheCount)
+		configCacheNext = 0;
+
+}
+
+#endif
+
 void DallasTemperature::activateExternalPullup() {
 	if (useExternalPullup)
 		digitalWrite(pullupPin, LOW);
@@ -762,12 +957,12 @@ bool DallasTemperature::isParasitePowerMode(void) {
 // note if device is not connected it will fail writing the data.
 void DallasTemperature::setUserData(const uint8_t* deviceAddress,
                                     int16_t data) {
-	// return when stored value == new value
-	if (getUserData(deviceAddress) == data)
-		return;
-
 	ScratchPad scratchPad;
-	if (isConnected(deviceAddress, scratchPad)) {
+	if (readConfig(deviceAddress, scratchPad)) {
+		// return when stored value == new value
+		if (scratchPad[HIGH_ALARM_TEMP] == (uint8_t)(data >> 8) &&
+		    scratchPad[LOW_ALARM_TEMP] == (uint8_t)(data & 255))
+			return;
 		scratchPad[HIGH_ALARM_TEMP] = data >> 8;
 		scratchPad[LOW_ALARM_TEMP] = data & 255;
 		writeScratchPad(deviceAddress, scratchPad);
@@ -841,6 +1036,45 @@ float DallasTemperature::rawToFahrenheit(int32_t raw) {
 
 }
 
+// formats raw / 128 in fixed point, rounding ties to even like printf
+// does for the exact binary value rawToCelsius() returns
+uint8_t DallasTemperature::formatCelsius(int32_t raw, char* buf, uint8_t decimals) {
+
+	static const uint16_t scale[] = { 1, 10, 100, 1000, 10000 };
+	char digits[12];
+	uint8_t n = 0;
+	uint8_t len = 0;
+
+	if (raw <= DEVICE_DISCONNECTED_RAW)
+		raw = DEVICE_DISCONNECTED_C * 128;
+	if (decimals > 4)
+		decimals = 4;
+
+	if (raw < 0)
+		buf[len++] = '-';
+
+	uint32_t value = (raw < 0 ? -raw : raw) * (uint32_t) scale[decimals];
+	uint32_t q = value >> 7;
+	uint32_t rem = value & 127;
+	if (rem > 64 || (rem == 64 && (q & 1)))
+		q++;
+
+	// digits in reverse, at least one before the point
+	do {
+		digits[n++] = '0' + q % 10;
+		q /= 10;
+	} while (q || n <= decimals);
+
+	while (n) {
+		if (n == decimals)
+			buf[len++] = '.';
+		buf[len++] = digits[--n];
+	}
+	buf[len] = 0;
+	return len;
+
+}
+
 // Returns true if all bytes of scratchPad are '\0'
 bool DallasTemperature::isAllZeros(const uint8_t * const scratchPad, const size_t length) {
 	for (size_t i = 0; i < length; i++) {
@@ -880,10 +1114,6 @@ bool DallasTemperature::isAllZeros(const uint8_t * const scratchPad, const size_
 void DallasTemperature::setHighAlarmTemp(const uint8_t* deviceAddress,
                                          int8_t celsius) {
 
-	// return when stored value == new value
-	if (getHighAlarmTemp(deviceAddress) == celsius)
-		return;
-
 	// make sure the alarm temperature is within the device's range
 	if (celsius > 125)
 		celsius = 125;
@@ -891,7 +1121,10 @@ void DallasTemperature::setHighAlarmTemp(const uint8_t* deviceAddress,
 		celsius = -55;
 
 	ScratchPad scratchPad;
-	if (isConnected(deviceAddress, scratchPad)) {
+	if (readConfig(deviceAddress, scratchPad)) {
+		// return when stored value == new value
+		if ((int8_t) scratchPad[HIGH_ALARM_TEMP] == celsius)
+			return;
 		scratchPad[HIGH_ALARM_TEMP] = (uint8_t) celsius;
 		writeScratchPad(deviceAddress, scratchPad);
 	}
@@ -904,10 +1137,6 @@ void DallasTemperature::setHighAlarmTemp(const uint8_t* deviceAddress,
 void DallasTemperature::setLowAlarmTemp(const uint8_t* deviceAddress,
                                         int8_t celsius) {
 
-	// return when stored value == new value
-	if (getLowAlarmTemp(deviceAddress) == celsius)
-		return;
-
 	// make sure the alarm temperature is within the device's range
 	if (celsius > 125)
 		celsius = 125;
@@ -915,13 +1144,43 @@ void DallasTemperature::setLowAlarmTemp(const uint8_t* deviceAddress,
 		celsius = -55;
 
 	ScratchPad scratchPad;
-	if (isConnected(deviceAddress, scratchPad)) {
+	if (readConfig(deviceAddress, scratchPad)) {
+		// return when stored value == new value
+		if ((int8_t) scratchPad[LOW_ALARM_TEMP] == celsius)
+			return;
 		scratchPad[LOW_ALARM_TEMP] = (uint8_t) celsius;
 		writeScratchPad(deviceAddress, scratchPad);
 	}
 
 }
 
+// sets the low and high alarm temperatures for a device in degrees Celsius
+// with at most one scratchpad read and one write, instead of one of each
+// for setLowAlarmTemp() and setHighAlarmTemp() separately.
+// returns false if the device is not connected
+bool DallasTemperature::setAlarmTemps(const uint8_t* deviceAddress,
+                                      int8_t lowCelsius, int8_t highCelsius) {
+
+	// make sure the alarm temperatures are within the device's range
+	lowCelsius = constrain(lowCelsius, -55, 125);
+	highCelsius = constrain(highCelsius, -55, 125);
+
+	ScratchPad scratchPad;
+	if (!readConfig(deviceAddress, scratchPad))
+		return false;
+
+	// return when stored values == new values
+	if ((int8_t) scratchPad[LOW_ALARM_TEMP] == lowCelsius &&
+	    (int8_t) scratchPad[HIGH_ALARM_TEMP] == highCelsius)
+		return true;
+
+	scratchPad[LOW_ALARM_TEMP] = (uint8_t) lowCelsius;
+	scratchPad[HIGH_ALARM_TEMP] = (uint8_t) highCelsius;
+	writeScratchPad(deviceAddress, scratchPad);
+	return true;
+
+}
+
 // returns a int8_t with the current high alarm temperature or
 // DEVICE_DISCONNECTED for an address
 int8_t DallasTemperature::getHighAlarmTemp(const uint8_t* deviceAddress) {
@@ -18,6 +18,27 @@
 #define REQUIRESALARMS true
 #endif
 
+// set to true to keep a shadow of each device's alarm and configuration
+// bytes, so unchanged settings cost no bus traffic and changed ones no
+// scratchpad read
+#ifndef REQUIRESCONFIGCACHE
+#define REQUIRESCONFIGCACHE true
+#endif
+
+// number of devices whose configuration bytes are shadowed, 13 bytes
+// each; a whole bus of up to 64 probes by default, so that the shadow
+// does not thrash on a long bus, 16 on AVRs.  It is also the number of
+// devices a config batch defers copies for: past that, further devices
+// are copied to EEPROM as they are written, never evicted with a copy
+// pending.
+#ifndef CONFIGCACHESIZE
+#ifdef __AVR__
+#define CONFIGCACHESIZE 16
+#else
+#define CONFIGCACHESIZE 64
+#endif
+#endif
+
 #include <inttypes.h>
 #ifdef __STM32F1__
 #include <OneWireSTM.h>
@@ -94,6 +115,11 @@ public:
 	// returns the number of DS18xxx Family devices on bus
 	uint8_t getDS18Count(void);
 
+	// update the device counts for a hot-plugged or removed device
+	// without enumerating the bus again (see OneWireTopology)
+	void deviceAdded(const uint8_t*);
+	void deviceRemoved(const uint8_t*);
+
 	// returns true if address is valid
 	bool validAddress(const uint8_t*);
 
@@ -155,6 +181,10 @@ public:
 	// sends command for one device to perform a temperature conversion by address
 	request_t requestTemperaturesByAddress(const uint8_t*);
 
+	// same, for a device whose resolution the caller already knows: no
+	// scratchpad read before the conversion, only the presence check
+	request_t requestTemperaturesByAddress(const uint8_t*, uint8_t);
+
 	// sends command for one device to perform a temperature conversion by index
 	request_t requestTemperaturesByIndex(uint8_t);
 
@@ -205,6 +235,22 @@ public:
 	// Gets the autoSaveScratchPad flag
 	bool getAutoSaveScratchPad(void);
 
+#if REQUIRESCONFIGCACHE
+
+	// defers the EEPROM copy done by autoSaveScratchPad until
+	// commitConfigBatch(), so several settings cost one copy per device
+	void beginConfigBatch(void);
+
+	// copies every scratchpad written since beginConfigBatch() to EEPROM
+	// once; returns the number of devices saved
+	uint8_t commitConfigBatch(void);
+
+	// forgets the shadowed configuration bytes, e.g. after the bus lost
+	// power and the devices reloaded their scratchpads from EEPROM
+	void invalidateConfigCache(void);
+
+#endif
+
 #if REQUIRESALARMS
 
 	typedef void AlarmHandler(const uint8_t*);
@@ -217,6 +263,10 @@ public:
 	// accepts a int8_t.  valid range is -55C - 125C
 	void setLowAlarmTemp(const uint8_t*, int8_t);
 
+	// sets both alarm temperatures for a device with a single scratchpad write
+	// accepts the low then the high alarm as int8_t.  valid range is -55C - 125C
+	bool setAlarmTemps(const uint8_t*, int8_t, int8_t);
+
 	// returns a int8_t with the current high alarm temperature for a device
 	// in the range -55C - 125C
 	int8_t getHighAlarmTemp(const uint8_t*);
@@ -273,6 +323,11 @@ public:
 	// convert from raw to Fahrenheit
 	static float rawToFahrenheit(int32_t);
 
+	// writes raw as degrees Celsius with 0-4 decimals into a buffer of at
+	// least 12 chars, without going through float; the text is the same
+	// as printing rawToCelsius() with that many decimals.  returns the length
+	static uint8_t formatCelsius(int32_t, char*, uint8_t = 2);
+
 #if REQUIRESNEW
 
 	// initialize memory area
@@ -287,6 +342,12 @@ public:
 	void blockTillConversionComplete(uint8_t, unsigned long);
 	void blockTillConversionComplete(uint8_t, request_t);
 
+	// External pullup control, for callers that do not wait for a
+	// conversion (waitForConversion off) on a parasite powered bus: hold
+	// the pullup from the request until just before the next bus traffic
+	void activateExternalPullup(void);
+	void deactivateExternalPullup(void);
+
 private:
 	typedef uint8_t ScratchPad[9];
 
@@ -326,9 +387,32 @@ private:
 	// Returns true if all bytes of scratchPad are '\0'
 	bool isAllZeros(const uint8_t* const scratchPad, const size_t length = 9);
 
-	// External pullup control
-	void activateExternalPullup(void);
-	void deactivateExternalPullup(void);
+	// fills the alarm and configuration bytes of scratchPad, from the
+	// shadow if available; returns false if the device is not connected,
+	// or with a shadow, if no device answers the reset
+	bool readConfig(const uint8_t*, uint8_t*);
+
+#if REQUIRESCONFIGCACHE
+
+	struct ConfigShadow {
+		DeviceAddress address;
+		uint8_t highAlarm;
+		uint8_t lowAlarm;
+		uint8_t configuration;
+		// written to the scratchpad but not yet copied to EEPROM
+		bool unsaved;
+	};
+
+	ConfigShadow configCache[CONFIGCACHESIZE];
+	uint8_t configCacheCount;
+	uint8_t configCacheNext;
+	bool configBatch;
+
+	ConfigShadow* findConfig(const uint8_t*);
+	ConfigShadow* cacheConfig(const uint8_t*, const uint8_t*);
+	void forgetConfig(const uint8_t*);
+
+#endif
 
 #if REQUIRESALARMS
 
@@ -0,0 +1,32 @@
+// Host Arduino shim, see Arduino.h.
+
+#include "Arduino.h"
+
+uint64_t HostClock::current = 0;
+
+void delayMicroseconds(unsigned int us)
+{
+	HostClock::advance(us);
+}
+
+void delay(unsigned long ms)
+{
+	HostClock::advance((uint64_t)ms * 1000);
+}
+
+unsigned long micros(void)
+{
+	return (unsigned long)HostClock::now();
+}
+
+unsigned long millis(void)
+{
+	return (unsigned long)(HostClock::now() / 1000);
+}
+
+// Polling loops (isConversionComplete, recallScratchPad) yield while they
+// wait; let virtual time pass so they terminate.
+void yield(void)
+{
+	HostClock::advance(1);
+}
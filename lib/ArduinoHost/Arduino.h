@@ -0,0 +1,83 @@
+#ifndef ArduinoHost_Arduino_h
+#define ArduinoHost_Arduino_h
+
+// Minimal Arduino API for building the libraries on the host (the native
+// environment in platformio.ini).  Time is virtual: delay() and
+// delayMicroseconds() advance HostClock and return immediately.  The pin
+// functions are left to whatever simulates the pins, e.g. OneWireSim.
+//
+// Besides the pins and the clock there is the part of the ESP32 core the
+// web server and the sample log build on: String, Print, Stream,
+// IPAddress, FS (HostFS.h) and the PROGMEM accessors, which on the host
+// are plain RAM accesses.  Libraries test for ARDUINO_HOST where they
+// would otherwise test for ESP32.
+
+#define ARDUINO_HOST 1
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include "WString.h"
+#include "Print.h"
+#include "Stream.h"
+#include "IPAddress.h"
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT  0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t *)(addr))
+#define pgm_read_ptr(addr) (*(void * const *)(addr))
+#define strlen_P strlen
+#define strcpy_P strcpy
+#define strncpy_P strncpy
+#define strcmp_P strcmp
+#define memcpy_P memcpy
+#define snprintf_P snprintf
+#define vsnprintf_P vsnprintf
+#define printf_P printf
+
+#define ets_printf printf
+#define os_printf printf
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+#define noInterrupts()
+#define interrupts()
+
+// Virtual microsecond clock behind delay(), micros() and millis().
+class HostClock
+{
+  public:
+    static uint64_t now() { return current; }
+    static void advance(uint64_t us) { current += us; }
+    static void reset() { current = 0; }
+
+  private:
+    static uint64_t current;
+};
+
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+unsigned long millis(void);
+unsigned long micros(void);
+void yield(void);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+#endif
@@ -0,0 +1,166 @@
+// The ESP32 core's file system API for host builds, see FS.h.
+
+#include "FS.h"
+
+using namespace fs;
+
+size_t File::write(uint8_t c)
+{
+	return _p ? _p->write(&c, 1) : 0;
+}
+
+size_t File::write(const uint8_t *buf, size_t size)
+{
+	return _p ? _p->write(buf, size) : 0;
+}
+
+int File::available()
+{
+	return _p ? _p->size() - _p->position() : 0;
+}
+
+int File::read()
+{
+	uint8_t c;
+
+	if (!_p || _p->read(&c, 1) != 1) return -1;
+	return c;
+}
+
+int File::peek()
+{
+	if (!_p) return -1;
+	size_t pos = _p->position();
+	int c = read();
+	_p->seek(pos, SeekSet);
+	return c;
+}
+
+void File::flush()
+{
+	if (_p) _p->flush();
+}
+
+size_t File::read(uint8_t *buf, size_t size)
+{
+	return _p ? _p->read(buf, size) : 0;
+}
+
+bool File::seek(uint32_t pos, SeekMode mode)
+{
+	return _p && _p->seek(pos, mode);
+}
+
+size_t File::position() const
+{
+	return _p ? _p->position() : 0;
+}
+
+size_t File::size() const
+{
+	return _p ? _p->size() : 0;
+}
+
+void File::close()
+{
+	if (_p) {
+		_p->close();
+		_p = nullptr;
+	}
+}
+
+File::operator bool() const
+{
+	return _p && *_p;
+}
+
+time_t File::getLastWrite()
+{
+	return _p ? _p->getLastWrite() : 0;
+}
+
+const char *File::path() const
+{
+	return _p ? _p->path() : 0;
+}
+
+const char *File::name() const
+{
+	return _p ? _p->name() : 0;
+}
+
+bool File::isDirectory(void)
+{
+	return _p && _p->isDirectory();
+}
+
+File File::openNextFile(const char *mode)
+{
+	return _p ? File(_p->openNextFile(mode)) : File();
+}
+
+void File::rewindDirectory(void)
+{
+	if (_p) _p->rewindDirectory();
+}
+
+File FS::open(const char *path, const char *mode, const bool create)
+{
+	if (!_impl || !path) return File();
+	return File(_impl->open(path, mode, create));
+}
+
+File FS::open(const String &path, const char *mode, const bool create)
+{
+	return open(path.c_str(), mode, create);
+}
+
+bool FS::exists(const char *path)
+{
+	return _impl && path && _impl->exists(path);
+}
+
+bool FS::exists(const String &path)
+{
+	return exists(path.c_str());
+}
+
+bool FS::remove(const char *path)
+{
+	return _impl && path && _impl->remove(path);
+}
+
+bool FS::remove(const String &path)
+{
+	return remove(path.c_str());
+}
+
+bool FS::rename(const char *pathFrom, const char *pathTo)
+{
+	return _impl && pathFrom && pathTo && _impl->rename(pathFrom, pathTo);
+}
+
+bool FS::rename(const String &pathFrom, const String &pathTo)
+{
+	return rename(pathFrom.c_str(), pathTo.c_str());
+}
+
+bool FS::mkdir(const char *path)
+{
+	return _impl && path && _impl->mkdir(path);
+}
+
+bool FS::mkdir(const String &path)
+{
+	return mkdir(path.c_str());
+}
+
+bool FS::rmdir(const char *path)
+{
+	return _impl && path && _impl->rmdir(path);
+}
+
+bool FS::rmdir(const String &path)
+{
+	return rmdir(path.c_str());
+}
@@ -0,0 +1,130 @@
+#ifndef ArduinoHost_FS_h
+#define ArduinoHost_FS_h
+
+// The ESP32 core's file system API for host builds: fs::FS and fs::File
+// over an FSImpl/FileImpl pair.  HostFS.h has the implementation backed by
+// a directory on the host.
+
+#include <memory>
+#include <time.h>
+#include "Stream.h"
+
+namespace fs
+{
+
+#define FILE_READ   "r"
+#define FILE_WRITE  "w"
+#define FILE_APPEND "a"
+
+class File;
+
+class FileImpl;
+typedef std::shared_ptr<FileImpl> FileImplPtr;
+class FSImpl;
+typedef std::shared_ptr<FSImpl> FSImplPtr;
+
+enum SeekMode {
+    SeekSet = 0,
+    SeekCur = 1,
+    SeekEnd = 2
+};
+
+class File : public Stream
+{
+  public:
+    File(FileImplPtr p = FileImplPtr()) : _p(p) { _timeout = 0; }
+
+    size_t write(uint8_t) override;
+    size_t write(const uint8_t *buf, size_t size) override;
+    int available() override;
+    int read() override;
+    int peek() override;
+    void flush() override;
+    size_t read(uint8_t *buf, size_t size);
+    size_t readBytes(char *buffer, size_t length) override { return read((uint8_t *)buffer, length); }
+
+    bool seek(uint32_t pos, SeekMode mode);
+    bool seek(uint32_t pos) { return seek(pos, SeekSet); }
+    size_t position() const;
+    size_t size() const;
+    void close();
+    operator bool() const;
+    time_t getLastWrite();
+    const char *path() const;
+    const char *name() const;
+
+    bool isDirectory(void);
+    File openNextFile(const char *mode = FILE_READ);
+    void rewindDirectory(void);
+
+    using Print::write;
+
+  protected:
+    FileImplPtr _p;
+};
+
+class FS
+{
+  public:
+    FS(FSImplPtr impl) : _impl(impl) { }
+
+    File open(const char *path, const char *mode = FILE_READ, const bool create = false);
+    File open(const String &path, const char *mode = FILE_READ, const bool create = false);
+
+    bool exists(const char *path);
+    bool exists(const String &path);
+    bool remove(const char *path);
+    bool remove(const String &path);
+    bool rename(const char *pathFrom, const char *pathTo);
+    bool rename(const String &pathFrom, const String &pathTo);
+    bool mkdir(const char *path);
+    bool mkdir(const String &path);
+    bool rmdir(const char *path);
+    bool rmdir(const String &path);
+
+  protected:
+    FSImplPtr _impl;
+};
+
+class FileImpl
+{
+  public:
+    virtual ~FileImpl() { }
+    virtual size_t write(const uint8_t *buf, size_t size) = 0;
+    virtual size_t read(uint8_t *buf, size_t size) = 0;
+    virtual void flush() = 0;
+    virtual bool seek(uint32_t pos, SeekMode mode) = 0;
+    virtual size_t position() const = 0;
+    virtual size_t size() const = 0;
+    virtual void close() = 0;
+    virtual time_t getLastWrite() = 0;
+    virtual const char *path() const = 0;
+    virtual const char *name() const = 0;
+    virtual bool isDirectory(void) = 0;
+    virtual FileImplPtr openNextFile(const char *mode) = 0;
+    virtual void rewindDirectory(void) = 0;
+    virtual operator bool() = 0;
+};
+
+class FSImpl
+{
+  public:
+    virtual ~FSImpl() { }
+    virtual FileImplPtr open(const char *path, const char *mode, const bool create) = 0;
+    virtual bool exists(const char *path) = 0;
+    virtual bool rename(const char *pathFrom, const char *pathTo) = 0;
+    virtual bool remove(const char *path) = 0;
+    virtual bool mkdir(const char *path) = 0;
+    virtual bool rmdir(const char *path) = 0;
+};
+
+} // namespace fs
+
+using fs::FS;
+using fs::File;
+using fs::SeekMode;
+using fs::SeekSet;
+using fs::SeekCur;
+using fs::SeekEnd;
+
+#endif
@@ -0,0 +1,326 @@
+// fs::FS on a directory of the host, see HostFS.h.
+
+#include "HostFS.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+using namespace fs;
+
+struct HostFSCounters
+{
+	uint32_t opens = 0;
+	uint64_t bytesRead = 0;
+	uint64_t sectorReads = 0;
+	uint64_t bytesWritten = 0;
+	bool armed[3] = { false, false, false };
+	uint32_t after[3] = { 0, 0, 0 };
+
+	// true if this operation is to fail
+	bool fault(HostFSFault f)
+	{
+		if (!armed[f]) return false;
+		if (after[f]) {
+			after[f]--;
+			return false;
+		}
+		return true;
+	}
+};
+
+class HostFileImpl : public FileImpl
+{
+  public:
+    HostFileImpl(HostFSCounters *counters, const std::string &host, const std::string &path, FILE *f)
+      : _counters(counters), _host(host), _path(path), _f(f), _dir(0)
+    {
+        _name = _path.substr(_path.rfind('/') + 1);
+    }
+
+    HostFileImpl(HostFSCounters *counters, const std::string &host, const std::string &path, DIR *d)
+      : _counters(counters), _host(host), _path(path), _f(0), _dir(d)
+    {
+        _name = _path.substr(_path.rfind('/') + 1);
+    }
+
+    ~HostFileImpl() { close(); }
+
+    size_t write(const uint8_t *buf, size_t size) override
+    {
+        if (!_f) return 0;
+        if (_counters->fault(HOST_FS_FAULT_WRITE)) size = size / 2;
+        size_t n = fwrite(buf, 1, size, _f);
+        _counters->bytesWritten += n;
+        return n;
+    }
+
+    size_t read(uint8_t *buf, size_t size) override
+    {
+        if (!_f) return 0;
+        if (_counters->fault(HOST_FS_FAULT_READ)) size = size / 2;
+        long pos = ftell(_f);
+        size_t n = fread(buf, 1, size, _f);
+        _counters->bytesRead += n;
+        if (n && pos >= 0)
+            _counters->sectorReads += (pos + n - 1) / HOST_FS_SECTOR_SIZE - pos / HOST_FS_SECTOR_SIZE + 1;
+        return n;
+    }
+
+    void flush() override
+    {
+        if (_f) fflush(_f);
+    }
+
+    bool seek(uint32_t pos, SeekMode mode) override
+    {
+        if (!_f || _counters->fault(HOST_FS_FAULT_SEEK)) return false;
+        int whence = mode == SeekSet ? SEEK_SET : mode == SeekCur ? SEEK_CUR : SEEK_END;
+        return fseek(_f, pos, whence) == 0;
+    }
+
+    size_t position() const override
+    {
+        return _f ? ftell(_f) : 0;
+    }
+
+    size_t size() const override
+    {
+        if (!_f) return 0;
+        fflush(_f);
+        struct stat st;
+        return fstat(fileno(_f), &st) == 0 ? st.st_size : 0;
+    }
+
+    void close() override
+    {
+        if (_f) fclose(_f);
+        if (_dir) closedir(_dir);
+        _f = 0;
+        _dir = 0;
+    }
+
+    time_t getLastWrite() override
+    {
+        struct stat st;
+        return stat(_host.c_str(), &st) == 0 ? st.st_mtime : 0;
+    }
+
+    const char *path() const override { return _path.c_str(); }
+    const char *name() const override { return _name.c_str(); }
+    bool isDirectory(void) override { return _dir != 0; }
+
+    FileImplPtr openNextFile(const char *mode) override;
+
+    void rewindDirectory(void) override
+    {
+        if (_dir) rewinddir(_dir);
+    }
+
+    operator bool() override { return _f || _dir; }
+
+  private:
+    HostFSCounters *_counters;
+    std::string _host;
+    std::string _path;
+    std::string _name;
+    FILE *_f;
+    DIR *_dir;
+};
+
+static FileImplPtr openHost(HostFSCounters *counters, const std::string &host, const std::string &path, const char *mode)
+{
+	struct stat st;
+
+	if (stat(host.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+		DIR *d = opendir(host.c_str());
+		if (!d) return FileImplPtr();
+		counters->opens++;
+		return std::make_shared<HostFileImpl>(counters, host, path, d);
+	}
+
+	// "w" truncates, "a" appends, both create; the ESP32 VFS is binary
+	std::string m = mode[0] == 'w' ? "wb" : mode[0] == 'a' ? "ab" : "rb";
+	if (mode[1] == '+') m = mode[0] == 'w' ? "w+b" : mode[0] == 'a' ? "a+b" : "r+b";
+	FILE *f = fopen(host.c_str(), m.c_str());
+	if (!f) return FileImplPtr();
+	counters->opens++;
+	return std::make_shared<HostFileImpl>(counters, host, path, f);
+}
+
+FileImplPtr HostFileImpl::openNextFile(const char *mode)
+{
+	if (!_dir) return FileImplPtr();
+
+	struct dirent *e;
+	while ((e = readdir(_dir))) {
+		if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+		std::string path = _path == "/" ? "/" + std::string(e->d_name) : _path + "/" + e->d_name;
+		return openHost(_counters, _host + "/" + e->d_name, path, mode);
+	}
+	return FileImplPtr();
+}
+
+class HostFSImpl : public FSImpl
+{
+  public:
+    HostFSImpl(const char *root) : root(root)
+    {
+        while (this->root.size() > 1 && this->root.back() == '/') this->root.pop_back();
+        mkdirs(this->root);
+    }
+
+    std::string host(const char *path) const
+    {
+        std::string p(path);
+        if (p.empty() || p[0] != '/') p = "/" + p;
+        if (p.size() > 1 && p.back() == '/') p.pop_back();
+        return p == "/" ? root : root + p;
+    }
+
+    FileImplPtr open(const char *path, const char *mode, const bool create) override
+    {
+        std::string p(path);
+        if (create && mode[0] != 'r') {
+            size_t slash = p.rfind('/');
+            if (slash && slash != std::string::npos) mkdirs(host(p.substr(0, slash).c_str()));
+        }
+        if (p.empty() || p[0] != '/') p = "/" + p;
+        return openHost(&counters, host(path), p, mode);
+    }
+
+    bool exists(const char *path) override
+    {
+        struct stat st;
+        return stat(host(path).c_str(), &st) == 0;
+    }
+
+    bool rename(const char *pathFrom, const char *pathTo) override
+    {
+        return ::rename(host(pathFrom).c_str(), host(pathTo).c_str()) == 0;
+    }
+
+    bool remove(const char *path) override
+    {
+        return unlink(host(path).c_str()) == 0;
+    }
+
+    bool mkdir(const char *path) override
+    {
+        return ::mkdir(host(path).c_str(), 0755) == 0 || errno == EEXIST;
+    }
+
+    bool rmdir(const char *path) override
+    {
+        return ::rmdir(host(path).c_str()) == 0;
+    }
+
+    static void mkdirs(const std::string &dir)
+    {
+        for (size_t i = 1; i <= dir.size(); i++) {
+            if (i == dir.size() || dir[i] == '/') ::mkdir(dir.substr(0, i).c_str(), 0755);
+        }
+    }
+
+    static void removeTree(const std::string &dir)
+    {
+        DIR *d = opendir(dir.c_str());
+        if (!d) return;
+
+        struct dirent *e;
+        while ((e = readdir(d))) {
+            if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+            std::string p = dir + "/" + e->d_name;
+            struct stat st;
+            if (lstat(p.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+                removeTree(p);
+                ::rmdir(p.c_str());
+            } else {
+                unlink(p.c_str());
+            }
+        }
+        closedir(d);
+    }
+
+    std::string root;
+    HostFSCounters counters;
+};
+
+// The FS keeps the implementation alive, HostFS only holds on to it.
+static FSImplPtr makeHost(const char *root, HostFSImpl **host)
+{
+	auto impl = std::make_shared<HostFSImpl>(root);
+	*host = impl.get();
+	return impl;
+}
+
+HostFS::HostFS(const char *root) : FS(FSImplPtr()), _host(0)
+{
+	_impl = makeHost(root, &_host);
+}
+
+void HostFS::clear(void)
+{
+	HostFSImpl::removeTree(_host->root);
+}
+
+std::string HostFS::hostPath(const char *path) const
+{
+	return _host->host(path);
+}
+
+bool HostFS::truncate(const char *path, size_t size)
+{
+	return ::truncate(hostPath(path).c_str(), size) == 0;
+}
+
+size_t HostFS::fileSize(const char *path)
+{
+	struct stat st;
+	return stat(hostPath(path).c_str(), &st) == 0 ? st.st_size : 0;
+}
+
+void HostFS::injectFault(HostFSFault fault, uint32_t after)
+{
+	_host->counters.armed[fault] = true;
+	_host->counters.after[fault] = after;
+}
+
+void HostFS::clearFaults(void)
+{
+	for (uint8_t i = 0; i < 3; i++) _host->counters.armed[i] = false;
+}
+
+uint32_t HostFS::opens(void) const
+{
+	return _host->counters.opens;
+}
+
+uint64_t HostFS::bytesRead(void) const
+{
+	return _host->counters.bytesRead;
+}
+
+uint64_t HostFS::sectorReads(void) const
+{
+	return _host->counters.sectorReads;
+}
+
+uint64_t HostFS::bytesWritten(void) const
+{
+	return _host->counters.bytesWritten;
+}
+
+void HostFS::resetStats(void)
+{
+	_host->counters.opens = 0;
+	_host->counters.bytesRead = 0;
+	_host->counters.sectorReads = 0;
+	_host->counters.bytesWritten = 0;
+}
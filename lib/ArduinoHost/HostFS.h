@@ -0,0 +1,64 @@
+#ifndef ArduinoHost_HostFS_h
+#define ArduinoHost_HostFS_h
+
+// fs::FS on a directory of the host, for testing what runs on SPIFFS,
+// LittleFS or SD on the device.
+//
+//   HostFS fs("/tmp/test_fs");   // created, and emptied by clear()
+//   fs.open("/log/0001.seg", FILE_APPEND);
+//
+// Files open the way the ESP32 core's VFS opens them: "r", "w" (truncate)
+// and "a".  Directories list through openNextFile() as on ESP32, which
+// opens every entry it returns.
+//
+// Tests can count what the code under test does (opens(), bytesRead(),
+// sectorReads()) and make it fail: injectFault() fails the Nth read or seek from now on,
+// or every one of them, the way a card that drops out or a torn sector
+// would.
+
+#include "FS.h"
+
+#include <stdint.h>
+#include <string>
+
+#define HOST_FS_SECTOR_SIZE 512   // FAT's, for sectorReads()
+
+enum HostFSFault {
+    HOST_FS_FAULT_READ,   // read() returns short
+    HOST_FS_FAULT_SEEK,   // seek() fails
+    HOST_FS_FAULT_WRITE   // write() returns short
+};
+
+class HostFSImpl;
+
+class HostFS : public fs::FS
+{
+  public:
+    HostFS(const char *root);
+
+    // remove everything under the root
+    void clear(void);
+    // the host path of a path on this FS
+    std::string hostPath(const char *path) const;
+    // cut a file short, as a power loss in the middle of a write would
+    bool truncate(const char *path, size_t size);
+    size_t fileSize(const char *path);
+
+    // after `after` more successful operations of that kind, fail every
+    // one of them until clearFaults()
+    void injectFault(HostFSFault fault, uint32_t after = 0);
+    void clearFaults(void);
+
+    uint32_t opens(void) const;
+    uint64_t bytesRead(void) const;
+    // the sectors a FAT driver would have read: every read() counts each
+    // sector it touches, so reads that end mid-sector read it twice
+    uint64_t sectorReads(void) const;
+    uint64_t bytesWritten(void) const;
+    void resetStats(void);
+
+  private:
+    HostFSImpl *_host;
+};
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef ArduinoHost_IPAddress_h
+#define ArduinoHost_IPAddress_h
+
+// IPv4 address as the ESP32 core has it, for host builds.
+
+#include <stdint.h>
+#include <stdio.h>
+#include "WString.h"
+
+class IPAddress
+{
+  public:
+    IPAddress() : _address(0) { }
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+      : _address(a | (uint32_t)b << 8 | (uint32_t)c << 16 | (uint32_t)d << 24) { }
+    IPAddress(uint32_t address) : _address(address) { }
+
+    operator uint32_t() const { return _address; }
+    bool operator==(const IPAddress &other) const { return _address == other._address; }
+    bool operator!=(const IPAddress &other) const { return _address != other._address; }
+    uint8_t operator[](int index) const { return _address >> (8 * index); }
+
+    String toString() const
+    {
+        char buf[16];
+
+        snprintf(buf, sizeof buf, "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+        return String(buf);
+    }
+
+  private:
+    uint32_t _address;    // network order, first octet in the low byte
+};
+
+#endif
@@ -0,0 +1,33 @@
+// Arduino Stream for host builds, see Stream.h.
+
+#include "Stream.h"
+
+size_t Stream::readBytes(char *buffer, size_t length)
+{
+	size_t n = 0;
+
+	while (n < length) {
+		int c = read();
+		if (c < 0) break;
+		buffer[n++] = (char)c;
+	}
+	return n;
+}
+
+String Stream::readString()
+{
+	String s;
+	int c;
+
+	while ((c = read()) >= 0) s.concat((char)c);
+	return s;
+}
+
+String Stream::readStringUntil(char terminator)
+{
+	String s;
+	int c;
+
+	while ((c = read()) >= 0 && c != terminator) s.concat((char)c);
+	return s;
+}
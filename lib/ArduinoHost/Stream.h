@@ -0,0 +1,28 @@
+#ifndef ArduinoHost_Stream_h
+#define ArduinoHost_Stream_h
+
+// Arduino Stream for host builds.  There is nothing to wait for on the
+// host, so the read helpers never time out, they stop at the end.
+
+#include "Print.h"
+
+class Stream : public Print
+{
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    void setTimeout(unsigned long timeout) { _timeout = timeout; }
+    unsigned long getTimeout(void) const { return _timeout; }
+
+    virtual size_t readBytes(char *buffer, size_t length);
+    size_t readBytes(uint8_t *buffer, size_t length) { return readBytes((char *)buffer, length); }
+    String readString();
+    String readStringUntil(char terminator);
+
+  protected:
+    unsigned long _timeout = 1000;
+};
+
+#endif
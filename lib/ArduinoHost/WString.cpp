@@ -0,0 +1,510 @@
+// Arduino String for host builds, see WString.h.
+
+#include "WString.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+String::String(const char *cstr) : buffer(0), capacity(0), len(0)
+{
+	if (cstr) copy(cstr, strlen(cstr));
+}
+
+String::String(const char *cstr, unsigned int length) : buffer(0), capacity(0), len(0)
+{
+	if (cstr) copy(cstr, length);
+}
+
+String::String(const String &str) : buffer(0), capacity(0), len(0)
+{
+	*this = str;
+}
+
+String::String(String &&rval) : buffer(0), capacity(0), len(0)
+{
+	move(rval);
+}
+
+String::String(const __FlashStringHelper *str) : String(reinterpret_cast<const char *>(str))
+{
+}
+
+String::String(char c) : buffer(0), capacity(0), len(0)
+{
+	copy(&c, 1);
+}
+
+static void formatNumber(char *buf, size_t size, unsigned long long value, bool negative, unsigned char base)
+{
+	char digits[66];
+	int n = 0;
+
+	if (base < 2 || base > 36) base = 10;
+	do {
+		unsigned d = value % base;
+		digits[n++] = d < 10 ? '0' + d : 'a' + d - 10;
+		value /= base;
+	} while (value);
+	if (negative) digits[n++] = '-';
+
+	size_t i = 0;
+	while (n && i + 1 < size) buf[i++] = digits[--n];
+	buf[i] = 0;
+}
+
+String::String(unsigned char value, unsigned char base) : String((unsigned long long)value, base)
+{
+}
+
+String::String(int value, unsigned char base) : String((long long)value, base)
+{
+}
+
+String::String(unsigned int value, unsigned char base) : String((unsigned long long)value, base)
+{
+}
+
+String::String(long value, unsigned char base) : String((long long)value, base)
+{
+}
+
+String::String(unsigned long value, unsigned char base) : String((unsigned long long)value, base)
+{
+}
+
+String::String(long long value, unsigned char base) : buffer(0), capacity(0), len(0)
+{
+	char buf[68];
+
+	// only base 10 is signed, like the core's ltoa()
+	if (base == 10 && value < 0)
+		formatNumber(buf, sizeof buf, 0ULL - (unsigned long long)value, true, base);
+	else
+		formatNumber(buf, sizeof buf, (unsigned long long)value, false, base);
+	copy(buf, strlen(buf));
+}
+
+String::String(unsigned long long value, unsigned char base) : buffer(0), capacity(0), len(0)
+{
+	char buf[68];
+
+	formatNumber(buf, sizeof buf, value, false, base);
+	copy(buf, strlen(buf));
+}
+
+String::String(float value, unsigned int decimalPlaces) : String((double)value, decimalPlaces)
+{
+}
+
+String::String(double value, unsigned int decimalPlaces) : buffer(0), capacity(0), len(0)
+{
+	char buf[64];
+
+	snprintf(buf, sizeof buf, "%.*f", (int)decimalPlaces, value);
+	copy(buf, strlen(buf));
+}
+
+String::~String()
+{
+	free(buffer);
+}
+
+void String::invalidate(void)
+{
+	free(buffer);
+	buffer = 0;
+	capacity = len = 0;
+}
+
+bool String::reserve(unsigned int size)
+{
+	if (buffer && capacity >= size) return true;
+
+	char *p = (char *)realloc(buffer, size + 1);
+	if (!p) return false;
+	if (!buffer) p[0] = 0;
+	buffer = p;
+	capacity = size;
+	return true;
+}
+
+bool String::copy(const char *cstr, unsigned int length)
+{
+	if (!reserve(length)) {
+		invalidate();
+		return false;
+	}
+	memmove(buffer, cstr, length);
+	len = length;
+	buffer[len] = 0;
+	return true;
+}
+
+void String::move(String &rhs)
+{
+	if (this == &rhs) return;
+	free(buffer);
+	buffer = rhs.buffer;
+	capacity = rhs.capacity;
+	len = rhs.len;
+	rhs.buffer = 0;
+	rhs.capacity = rhs.len = 0;
+}
+
+String &String::operator=(const String &rhs)
+{
+	if (this == &rhs) return *this;
+	if (rhs.buffer) copy(rhs.buffer, rhs.len);
+	else invalidate();
+	return *this;
+}
+
+String &String::operator=(String &&rval)
+{
+	move(rval);
+	return *this;
+}
+
+String &String::operator=(const char *cstr)
+{
+	if (cstr) copy(cstr, strlen(cstr));
+	else invalidate();
+	return *this;
+}
+
+String &String::operator=(const __FlashStringHelper *str)
+{
+	return *this = reinterpret_cast<const char *>(str);
+}
+
+bool String::concat(const char *cstr, unsigned int length)
+{
+	if (!cstr) return false;
+	if (!length) return true;
+
+	unsigned int newlen = len + length;
+	// cstr may point into this String
+	if (buffer && cstr >= buffer && cstr < buffer + capacity + 1) {
+		size_t offset = cstr - buffer;
+		if (!reserve(newlen)) return false;
+		cstr = buffer + offset;
+	} else if (!reserve(newlen)) {
+		return false;
+	}
+	memmove(buffer + len, cstr, length);
+	len = newlen;
+	buffer[len] = 0;
+	return true;
+}
+
+bool String::concat(const String &str)
+{
+	return concat(str.c_str(), str.len);
+}
+
+bool String::concat(const char *cstr)
+{
+	return cstr && concat(cstr, strlen(cstr));
+}
+
+bool String::concat(const __FlashStringHelper *str)
+{
+	return concat(reinterpret_cast<const char *>(str));
+}
+
+bool String::concat(char c)
+{
+	return concat(&c, 1);
+}
+
+bool String::concat(unsigned char num) { return concat(String(num)); }
+bool String::concat(int num) { return concat(String(num)); }
+bool String::concat(unsigned int num) { return concat(String(num)); }
+bool String::concat(long num) { return concat(String(num)); }
+bool String::concat(unsigned long num) { return concat(String(num)); }
+bool String::concat(long long num) { return concat(String(num)); }
+bool String::concat(unsigned long long num) { return concat(String(num)); }
+bool String::concat(float num) { return concat(String(num)); }
+bool String::concat(double num) { return concat(String(num)); }
+
+int String::compareTo(const String &s) const
+{
+	return strcmp(c_str(), s.c_str());
+}
+
+bool String::equals(const String &s) const
+{
+	return len == s.len && memcmp(c_str(), s.c_str(), len) == 0;
+}
+
+bool String::equals(const char *cstr) const
+{
+	return strcmp(c_str(), cstr ? cstr : "") == 0;
+}
+
+bool String::equalsIgnoreCase(const String &s) const
+{
+	if (len != s.len) return false;
+	for (unsigned int i = 0; i < len; i++) {
+		if (tolower((unsigned char)buffer[i]) != tolower((unsigned char)s.buffer[i])) return false;
+	}
+	return true;
+}
+
+bool String::equalsConstantTime(const String &s) const
+{
+	unsigned char d = len != s.len;
+
+	for (unsigned int i = 0; i < len && i < s.len; i++) d |= buffer[i] ^ s.buffer[i];
+	return d == 0;
+}
+
+bool String::startsWith(const String &prefix) const
+{
+	return startsWith(prefix, 0);
+}
+
+bool String::startsWith(const String &prefix, unsigned int offset) const
+{
+	if (offset > len || prefix.len > len - offset) return false;
+	return memcmp(c_str() + offset, prefix.c_str(), prefix.len) == 0;
+}
+
+bool String::endsWith(const String &suffix) const
+{
+	if (suffix.len > len) return false;
+	return memcmp(c_str() + len - suffix.len, suffix.c_str(), suffix.len) == 0;
+}
+
+char String::charAt(unsigned int index) const
+{
+	return (*this)[index];
+}
+
+void String::setCharAt(unsigned int index, char c)
+{
+	if (index < len) buffer[index] = c;
+}
+
+char String::operator[](unsigned int index) const
+{
+	return index < len ? buffer[index] : 0;
+}
+
+char &String::operator[](unsigned int index)
+{
+	static char dummy;
+
+	if (index >= len) {
+		dummy = 0;
+		return dummy;
+	}
+	return buffer[index];
+}
+
+void String::getBytes(unsigned char *buf, unsigned int bufsize, unsigned int index) const
+{
+	if (!bufsize || !buf) return;
+	if (index >= len) {
+		buf[0] = 0;
+		return;
+	}
+	unsigned int n = bufsize - 1;
+	if (n > len - index) n = len - index;
+	memcpy(buf, buffer + index, n);
+	buf[n] = 0;
+}
+
+int String::indexOf(char ch, unsigned int fromIndex) const
+{
+	if (fromIndex >= len) return -1;
+	const char *p = (const char *)memchr(buffer + fromIndex, ch, len - fromIndex);
+	return p ? p - buffer : -1;
+}
+
+int String::indexOf(const String &str, unsigned int fromIndex) const
+{
+	if (fromIndex >= len) return -1;
+	const char *p = strstr(buffer + fromIndex, str.c_str());
+	return p ? p - buffer : -1;
+}
+
+int String::lastIndexOf(char ch) const
+{
+	return len ? lastIndexOf(ch, len - 1) : -1;
+}
+
+int String::lastIndexOf(char ch, unsigned int fromIndex) const
+{
+	if (fromIndex >= len) return -1;
+	for (int i = fromIndex; i >= 0; i--) {
+		if (buffer[i] == ch) return i;
+	}
+	return -1;
+}
+
+int String::lastIndexOf(const String &str) const
+{
+	return str.len > len ? -1 : lastIndexOf(str, len - str.len);
+}
+
+int String::lastIndexOf(const String &str, unsigned int fromIndex) const
+{
+	if (str.len == 0 || str.len > len) return -1;
+	if (fromIndex > len - str.len) fromIndex = len - str.len;
+	for (int i = fromIndex; i >= 0; i--) {
+		if (memcmp(buffer + i, str.c_str(), str.len) == 0) return i;
+	}
+	return -1;
+}
+
+String String::substring(unsigned int left, unsigned int right) const
+{
+	if (left > right) {
+		unsigned int t = left;
+		left = right;
+		right = t;
+	}
+	if (left >= len) return String();
+	if (right > len) right = len;
+	return String(buffer + left, right - left);
+}
+
+void String::replace(char find, char replace)
+{
+	for (unsigned int i = 0; i < len; i++) {
+		if (buffer[i] == find) buffer[i] = replace;
+	}
+}
+
+void String::replace(const String &find, const String &replace)
+{
+	if (!len || !find.len) return;
+
+	String out;
+	unsigned int i = 0;
+	int at;
+	while ((at = indexOf(find, i)) >= 0) {
+		out.concat(buffer + i, at - i);
+		out.concat(replace);
+		i = at + find.len;
+	}
+	out.concat(buffer + i, len - i);
+	*this = out;
+}
+
+void String::remove(unsigned int index)
+{
+	remove(index, (unsigned int)-1);
+}
+
+void String::remove(unsigned int index, unsigned int count)
+{
+	if (index >= len || !count) return;
+	if (count > len - index) count = len - index;
+	memmove(buffer + index, buffer + index + count, len - index - count);
+	len -= count;
+	buffer[len] = 0;
+}
+
+void String::toLowerCase(void)
+{
+	for (unsigned int i = 0; i < len; i++) buffer[i] = tolower((unsigned char)buffer[i]);
+}
+
+void String::toUpperCase(void)
+{
+	for (unsigned int i = 0; i < len; i++) buffer[i] = toupper((unsigned char)buffer[i]);
+}
+
+void String::trim(void)
+{
+	if (!len) return;
+
+	unsigned int b = 0, e = len;
+	while (b < e && isspace((unsigned char)buffer[b])) b++;
+	while (e > b && isspace((unsigned char)buffer[e - 1])) e--;
+	memmove(buffer, buffer + b, e - b);
+	len = e - b;
+	buffer[len] = 0;
+}
+
+long String::toInt(void) const
+{
+	return atol(c_str());
+}
+
+float String::toFloat(void) const
+{
+	return atof(c_str());
+}
+
+double String::toDouble(void) const
+{
+	return atof(c_str());
+}
+
+String operator+(const String &lhs, const String &rhs)
+{
+	String s(lhs);
+	s.concat(rhs);
+	return s;
+}
+
+String operator+(const String &lhs, const char *rhs)
+{
+	String s(lhs);
+	s.concat(rhs);
+	return s;
+}
+
+String operator+(const char *lhs, const String &rhs)
+{
+	String s(lhs);
+	s.concat(rhs);
+	return s;
+}
+
+String operator+(const String &lhs, char rhs)
+{
+	String s(lhs);
+	s.concat(rhs);
+	return s;
+}
+
+String operator+(const String &lhs, int rhs)
+{
+	String s(lhs);
+	s.concat(rhs);
+	return s;
+}
+
+String operator+(const String &lhs, unsigned int rhs)
+{
+	String s(lhs);
+	s.concat(rhs);
+	return s;
+}
+
+String operator+(const String &lhs, long rhs)
+{
+	String s(lhs);
+	s.concat(rhs);
+	return s;
+}
+
+String operator+(const String &lhs, unsigned long rhs)
+{
+	String s(lhs);
+	s.concat(rhs);
+	return s;
+}
+
+String operator+(const String &lhs, const __FlashStringHelper *rhs)
+{
+	String s(lhs);
+	s.concat(rhs);
+	return s;
+}
@@ -0,0 +1,5 @@
+// Host WiFi, see WiFi.h.
+
+#include "WiFi.h"
+
+HostWiFi WiFi;
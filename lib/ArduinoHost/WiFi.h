@@ -0,0 +1,21 @@
+#ifndef ArduinoHost_WiFi_h
+#define ArduinoHost_WiFi_h
+
+// The little of WiFi the libraries look at on the host: the station's
+// own address, which tests may set.
+
+#include "IPAddress.h"
+
+class HostWiFi
+{
+  public:
+    IPAddress localIP() const { return _localIP; }
+    void setLocalIP(IPAddress ip) { _localIP = ip; }
+
+  private:
+    IPAddress _localIP = IPAddress(127, 0, 0, 1);
+};
+
+extern HostWiFi WiFi;
+
+#endif
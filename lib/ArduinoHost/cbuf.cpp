@@ -0,0 +1,104 @@
+// Ring buffer of the Arduino cores, for host builds.  One byte of the
+// buffer is kept free to tell full from empty.
+
+#include "cbuf.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+cbuf::cbuf(size_t size) : next(0), _size(size), _buf((char *)malloc(size + 1)),
+  _bufend(_buf + size + 1), _begin(_buf), _end(_buf)
+{
+}
+
+cbuf::~cbuf()
+{
+	free(_buf);
+}
+
+size_t cbuf::resize(size_t newSize)
+{
+	size_t used = available();
+
+	if (newSize < used) return _size;
+	char *buf = (char *)malloc(newSize + 1);
+	if (!buf) return _size;
+	peek(buf, used);
+	free(_buf);
+	_buf = buf;
+	_size = newSize;
+	_bufend = _buf + newSize + 1;
+	_begin = _buf;
+	_end = _buf + used;
+	return _size;
+}
+
+size_t cbuf::available() const
+{
+	if (_end >= _begin) return _end - _begin;
+	return (_bufend - _begin) + (_end - _buf);
+}
+
+size_t cbuf::room() const
+{
+	return _size - available();
+}
+
+int cbuf::peek()
+{
+	return empty() ? -1 : (unsigned char)*_begin;
+}
+
+size_t cbuf::peek(char *dst, size_t size)
+{
+	size_t n = available() < size ? available() : size;
+	const char *p = _begin;
+
+	for (size_t i = 0; i < n; i++) {
+		dst[i] = *p++;
+		if (p == _bufend) p = _buf;
+	}
+	return n;
+}
+
+int cbuf::read()
+{
+	if (empty()) return -1;
+	char c = *_begin;
+	_begin = wrap(_begin + 1);
+	return (unsigned char)c;
+}
+
+size_t cbuf::read(char *dst, size_t size)
+{
+	size_t n = peek(dst, size);
+	remove(n);
+	return n;
+}
+
+size_t cbuf::write(char c)
+{
+	if (full()) return 0;
+	*_end = c;
+	_end = wrap(_end + 1);
+	return 1;
+}
+
+size_t cbuf::write(const char *src, size_t size)
+{
+	size_t n = room() < size ? room() : size;
+
+	for (size_t i = 0; i < n; i++) {
+		*_end = src[i];
+		_end = wrap(_end + 1);
+	}
+	return n;
+}
+
+size_t cbuf::remove(size_t size)
+{
+	size_t n = available() < size ? available() : size;
+
+	for (size_t i = 0; i < n; i++) _begin = wrap(_begin + 1);
+	return available();
+}
@@ -0,0 +1,43 @@
+#ifndef ArduinoHost_cbuf_h
+#define ArduinoHost_cbuf_h
+
+// Ring buffer of the Arduino cores, for host builds.
+
+#include <stddef.h>
+
+class cbuf
+{
+  public:
+    cbuf(size_t size);
+    ~cbuf();
+
+    size_t resize(size_t newSize);
+    size_t resizeAdd(size_t addSize) { return resize(_size + addSize); }
+    size_t available() const;
+    size_t size() { return _size; }
+    size_t room() const;
+    bool empty() const { return _begin == _end; }
+    bool full() const { return room() == 0; }
+
+    int peek();
+    size_t peek(char *dst, size_t size);
+    int read();
+    size_t read(char *dst, size_t size);
+    size_t write(char c);
+    size_t write(const char *src, size_t size);
+    void flush() { _begin = _end = _buf; }
+    size_t remove(size_t size);
+
+    cbuf *next;
+
+  private:
+    char *wrap(char *p) const { return p == _bufend ? _buf : p; }
+
+    size_t _size;
+    char *_buf;
+    const char *_bufend;
+    char *_begin;
+    char *_end;
+};
+
+#endif
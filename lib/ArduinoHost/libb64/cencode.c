@@ -0,0 +1,101 @@
+// The libb64 encoder of the ESP32 core (no line breaks), for host builds.
+
+#include "cencode.h"
+
+void base64_init_encodestate(base64_encodestate *state_in)
+{
+	state_in->step = step_A;
+	state_in->result = 0;
+	state_in->stepcount = 0;
+}
+
+char base64_encode_value(char value_in)
+{
+	static const char *encoding = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+	if ((unsigned char)value_in > 63) return '=';
+	return encoding[(int)value_in];
+}
+
+int base64_encode_block(const char *plaintext_in, int length_in, char *code_out, base64_encodestate *state_in)
+{
+	const unsigned char *in = (const unsigned char *)plaintext_in;
+	const unsigned char *const end = in + length_in;
+	char *out = code_out;
+	char result = state_in->result;
+	unsigned char fragment;
+
+	switch (state_in->step) {
+		for (;;) {
+	case step_A:
+			if (in == end) {
+				state_in->result = result;
+				state_in->step = step_A;
+				return out - code_out;
+			}
+			fragment = *in++;
+			result = (fragment & 0xfc) >> 2;
+			*out++ = base64_encode_value(result);
+			result = (fragment & 0x03) << 4;
+	case step_B:
+			if (in == end) {
+				state_in->result = result;
+				state_in->step = step_B;
+				return out - code_out;
+			}
+			fragment = *in++;
+			result |= (fragment & 0xf0) >> 4;
+			*out++ = base64_encode_value(result);
+			result = (fragment & 0x0f) << 2;
+	case step_C:
+			if (in == end) {
+				state_in->result = result;
+				state_in->step = step_C;
+				return out - code_out;
+			}
+			fragment = *in++;
+			result |= (fragment & 0xc0) >> 6;
+			*out++ = base64_encode_value(result);
+			result = (fragment & 0x3f) >> 0;
+			*out++ = base64_encode_value(result);
+			state_in->stepcount++;
+		}
+	}
+	return out - code_out;
+}
+
+int base64_encode_blockend(char *code_out, base64_encodestate *state_in)
+{
+	char *out = code_out;
+
+	switch (state_in->step) {
+	case step_B:
+		*out++ = base64_encode_value(state_in->result);
+		*out++ = '=';
+		*out++ = '=';
+		break;
+	case step_C:
+		*out++ = base64_encode_value(state_in->result);
+		*out++ = '=';
+		break;
+	case step_A:
+		break;
+	}
+	*out = 0;
+	return out - code_out;
+}
+
+int base64_encode_expected_len(int plaintext_len)
+{
+	return ((plaintext_len + 2) / 3) * 4;
+}
+
+int base64_encode_chars(const char *plaintext_in, int length_in, char *code_out)
+{
+	base64_encodestate state;
+	int len;
+
+	base64_init_encodestate(&state);
+	len = base64_encode_block(plaintext_in, length_in, code_out, &state);
+	return len + base64_encode_blockend(code_out + len, &state);
+}
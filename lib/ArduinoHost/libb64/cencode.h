@@ -0,0 +1,34 @@
+#ifndef ArduinoHost_cencode_h
+#define ArduinoHost_cencode_h
+
+// The libb64 encoder of the ESP32 core (no line breaks), for host builds.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    step_A, step_B, step_C
+} base64_encodestep;
+
+typedef struct {
+    base64_encodestep step;
+    char result;
+    int stepcount;
+} base64_encodestate;
+
+void base64_init_encodestate(base64_encodestate *state_in);
+char base64_encode_value(char value_in);
+int base64_encode_block(const char *plaintext_in, int length_in, char *code_out, base64_encodestate *state_in);
+// writes the padding and a terminating NUL, returns the length without it
+int base64_encode_blockend(char *code_out, base64_encodestate *state_in);
+// encoded length of plaintext_len bytes, without the NUL
+int base64_encode_expected_len(int plaintext_len);
+// whole input at once, NUL terminated; returns the length without the NUL
+int base64_encode_chars(const char *plaintext_in, int length_in, char *code_out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef ArduinoHost_mbedtls_md5_h
+#define ArduinoHost_mbedtls_md5_h
+
+// The mbedtls MD5 calls the libraries use on the ESP32, for host builds.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint32_t total[2];
+    uint32_t state[4];
+    unsigned char buffer[64];
+} mbedtls_md5_context;
+
+void mbedtls_md5_init(mbedtls_md5_context *ctx);
+void mbedtls_md5_free(mbedtls_md5_context *ctx);
+int mbedtls_md5_starts_ret(mbedtls_md5_context *ctx);
+int mbedtls_md5_update_ret(mbedtls_md5_context *ctx, const unsigned char *input, size_t ilen);
+int mbedtls_md5_finish_ret(mbedtls_md5_context *ctx, unsigned char output[16]);
+int mbedtls_md5_ret(const unsigned char *input, size_t ilen, unsigned char output[16]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
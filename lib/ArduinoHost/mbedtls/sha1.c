@@ -0,0 +1,120 @@
+// SHA-1 (RFC 3174) behind the mbedtls calls, for host builds.
+
+#include "sha1.h"
+
+#include <string.h>
+
+#define ROTL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+static void sha1Block(mbedtls_sha1_context *ctx, const unsigned char *p)
+{
+	uint32_t w[80], a, b, c, d, e;
+	int i;
+
+	for (i = 0; i < 16; i++)
+		w[i] = (uint32_t)p[i * 4] << 24 | (uint32_t)p[i * 4 + 1] << 16 | (uint32_t)p[i * 4 + 2] << 8 | p[i * 4 + 3];
+	for (i = 16; i < 80; i++) w[i] = ROTL(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+	a = ctx->state[0];
+	b = ctx->state[1];
+	c = ctx->state[2];
+	d = ctx->state[3];
+	e = ctx->state[4];
+	for (i = 0; i < 80; i++) {
+		uint32_t f, k;
+
+		if (i < 20) {
+			f = (b & c) | (~b & d);
+			k = 0x5a827999;
+		} else if (i < 40) {
+			f = b ^ c ^ d;
+			k = 0x6ed9eba1;
+		} else if (i < 60) {
+			f = (b & c) | (b & d) | (c & d);
+			k = 0x8f1bbcdc;
+		} else {
+			f = b ^ c ^ d;
+			k = 0xca62c1d6;
+		}
+		f += ROTL(a, 5) + e + k + w[i];
+		e = d;
+		d = c;
+		c = ROTL(b, 30);
+		b = a;
+		a = f;
+	}
+	ctx->state[0] += a;
+	ctx->state[1] += b;
+	ctx->state[2] += c;
+	ctx->state[3] += d;
+	ctx->state[4] += e;
+}
+
+void mbedtls_sha1_init(mbedtls_sha1_context *ctx)
+{
+	memset(ctx, 0, sizeof *ctx);
+}
+
+void mbedtls_sha1_free(mbedtls_sha1_context *ctx)
+{
+	if (ctx) memset(ctx, 0, sizeof *ctx);
+}
+
+int mbedtls_sha1_starts_ret(mbedtls_sha1_context *ctx)
+{
+	ctx->total[0] = ctx->total[1] = 0;
+	ctx->state[0] = 0x67452301;
+	ctx->state[1] = 0xefcdab89;
+	ctx->state[2] = 0x98badcfe;
+	ctx->state[3] = 0x10325476;
+	ctx->state[4] = 0xc3d2e1f0;
+	return 0;
+}
+
+int mbedtls_sha1_update_ret(mbedtls_sha1_context *ctx, const unsigned char *input, size_t ilen)
+{
+	size_t fill = ctx->total[0] & 63;
+
+	ctx->total[0] += (uint32_t)ilen;
+	if (ctx->total[0] < (uint32_t)ilen) ctx->total[1]++;
+	if (fill && ilen >= 64 - fill) {
+		memcpy(ctx->buffer + fill, input, 64 - fill);
+		sha1Block(ctx, ctx->buffer);
+		input += 64 - fill;
+		ilen -= 64 - fill;
+		fill = 0;
+	}
+	while (ilen >= 64) {
+		sha1Block(ctx, input);
+		input += 64;
+		ilen -= 64;
+	}
+	if (ilen) memcpy(ctx->buffer + fill, input, ilen);
+	return 0;
+}
+
+int mbedtls_sha1_finish_ret(mbedtls_sha1_context *ctx, unsigned char output[20])
+{
+	static const unsigned char pad[64] = { 0x80 };
+	uint64_t bits = ((uint64_t)ctx->total[1] << 32 | ctx->total[0]) << 3;
+	unsigned char length[8];
+	size_t used = ctx->total[0] & 63;
+	int i;
+
+	for (i = 0; i < 8; i++) length[i] = bits >> (56 - 8 * i);
+	mbedtls_sha1_update_ret(ctx, pad, used < 56 ? 56 - used : 120 - used);
+	mbedtls_sha1_update_ret(ctx, length, 8);
+	for (i = 0; i < 20; i++) output[i] = ctx->state[i / 4] >> (24 - 8 * (i % 4));
+	return 0;
+}
+
+int mbedtls_sha1_ret(const unsigned char *input, size_t ilen, unsigned char output[20])
+{
+	mbedtls_sha1_context ctx;
+
+	mbedtls_sha1_init(&ctx);
+	mbedtls_sha1_starts_ret(&ctx);
+	mbedtls_sha1_update_ret(&ctx, input, ilen);
+	mbedtls_sha1_finish_ret(&ctx, output);
+	mbedtls_sha1_free(&ctx);
+	return 0;
+}
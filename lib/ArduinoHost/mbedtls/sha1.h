@@ -0,0 +1,30 @@
+#ifndef ArduinoHost_mbedtls_sha1_h
+#define ArduinoHost_mbedtls_sha1_h
+
+// The mbedtls SHA-1 calls the libraries use on the ESP32, for host builds.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint32_t total[2];
+    uint32_t state[5];
+    unsigned char buffer[64];
+} mbedtls_sha1_context;
+
+void mbedtls_sha1_init(mbedtls_sha1_context *ctx);
+void mbedtls_sha1_free(mbedtls_sha1_context *ctx);
+int mbedtls_sha1_starts_ret(mbedtls_sha1_context *ctx);
+int mbedtls_sha1_update_ret(mbedtls_sha1_context *ctx, const unsigned char *input, size_t ilen);
+int mbedtls_sha1_finish_ret(mbedtls_sha1_context *ctx, unsigned char output[20]);
+int mbedtls_sha1_ret(const unsigned char *input, size_t ilen, unsigned char output[20]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,254 @@
+// Host-side stand-in for AsyncTCP, see AsyncTCP.h.
+
+#include "AsyncTCP.h"
+
+#include <Arduino.h>
+#include <string.h>
+#include <map>
+#include <vector>
+
+#define ERR_OK    0
+#define ERR_ABRT  -13
+
+AsyncClient::AsyncClient(AsyncTCPSimPeer *peer)
+  : _peer(peer), _remoteIP(0), _remotePort(0),
+    _connect_cb(0), _connect_cb_arg(0), _discard_cb(0), _discard_cb_arg(0),
+    _sent_cb(0), _sent_cb_arg(0), _error_cb(0), _error_cb_arg(0),
+    _recv_cb(0), _recv_cb_arg(0), _timeout_cb(0), _timeout_cb_arg(0),
+    _poll_cb(0), _poll_cb_arg(0),
+    _pcb_busy(false), _pcb_sent_at(0), _ack_pcb(true), _rx_ack_len(0),
+    _rx_last_packet(millis()), _rx_since_timeout(0), _ack_timeout(ASYNC_MAX_ACK_TIME),
+    _nodelay(false), _aborted(false)
+{
+	if (_peer) {
+		_peer->client = this;
+		_remoteIP = _peer->remoteIP;
+		_remotePort = _peer->remotePort;
+	}
+}
+
+AsyncClient::~AsyncClient()
+{
+	if (_peer && !_aborted) _close();
+	// _close() may have run the disconnect handler, which must not delete
+	// the client it is called from a destructor for
+	if (_peer) _peer->client = nullptr;
+}
+
+void AsyncClient::close(bool now)
+{
+	(void)now;
+	_close();
+}
+
+// The error and disconnect handlers run with the next event, see
+// _deliverAbort().
+int8_t AsyncClient::abort()
+{
+	if (_peer && !_aborted) {
+		_aborted = true;
+		_peer->closed = true;
+		_peer->reset = true;
+		_pending.clear();
+	}
+	return ERR_ABRT;
+}
+
+size_t AsyncClient::space()
+{
+	if (!_peer || _aborted) return 0;
+	size_t used = _peer->unacked + _pending.size();
+	return used < _peer->window ? _peer->window - used : 0;
+}
+
+size_t AsyncClient::add(const char *data, size_t size, uint8_t apiflags)
+{
+	(void)apiflags;
+	if (!_peer || !size || !data) return 0;
+
+	size_t room = space();
+	if (!room) return 0;
+	size_t will_send = room < size ? room : size;
+	_pending.append(data, will_send);
+	return will_send;
+}
+
+bool AsyncClient::send()
+{
+	if (!_peer || _aborted) return false;
+	if (_pending.size()) {
+		_peer->received += _pending;
+		_peer->unacked += _pending.size();
+		_peer->segments++;
+		_pending.clear();
+	}
+	_pcb_busy = true;
+	_pcb_sent_at = millis();
+	return true;
+}
+
+size_t AsyncClient::write(const char *data)
+{
+	return data ? write(data, strlen(data)) : 0;
+}
+
+size_t AsyncClient::write(const char *data, size_t size, uint8_t apiflags)
+{
+	size_t will_send = add(data, size, apiflags);
+	if (!will_send || !send()) return 0;
+	return will_send;
+}
+
+size_t AsyncClient::ack(size_t len)
+{
+	if (len > _rx_ack_len) len = _rx_ack_len;
+	_rx_ack_len -= len;
+	if (_peer) _peer->held = _rx_ack_len;
+	return len;
+}
+
+const char *AsyncClient::errorToString(int8_t error)
+{
+	switch (error) {
+		case ERR_OK: return "OK";
+		case ERR_ABRT: return "Connection aborted";
+		default: return "UNKNOWN";
+	}
+}
+
+// The discard handler may delete this client, nothing is touched after it.
+void AsyncClient::_close()
+{
+	if (!_peer || _aborted) return;
+	_peer->closed = true;
+	_peer->client = nullptr;
+	_peer = nullptr;
+	_pending.clear();
+	if (_discard_cb) _discard_cb(_discard_cb_arg, this);
+}
+
+void AsyncClient::_error(int8_t err)
+{
+	_peer->client = nullptr;
+	_peer = nullptr;
+	if (_error_cb) _error_cb(_error_cb_arg, this, err);
+	if (_discard_cb) _discard_cb(_discard_cb_arg, this);
+}
+
+// an aborted connection only reports its error, with whatever event comes
+// next; true if that happened and the event is not to be delivered
+bool AsyncClient::_deliverAbort()
+{
+	if (!_aborted) return false;
+	_error(ERR_ABRT);
+	return true;
+}
+
+void AsyncClient::_recv(const char *data, size_t len)
+{
+	AsyncTCPSimPeer *peer = _peer;
+
+	_rx_last_packet = millis();
+	_ack_pcb = true;
+	if (_recv_cb) {
+		// lwIP hands out the pbuf's payload, which handlers may write to
+		std::vector<char> payload(data, data + len);
+		_recv_cb(_recv_cb_arg, this, payload.data(), len);
+	}
+	// the handler may have closed and deleted the client
+	if (peer->client != this) return;
+	if (!_ack_pcb) {
+		_rx_ack_len += len;
+		peer->held = _rx_ack_len;
+	}
+}
+
+void AsyncClient::_sent(size_t len)
+{
+	_rx_last_packet = millis();
+	_pcb_busy = false;
+	if (_sent_cb) _sent_cb(_sent_cb_arg, this, len, millis() - _pcb_sent_at);
+}
+
+void AsyncClient::_fin()
+{
+	_close();
+}
+
+void AsyncClient::_poll()
+{
+	uint32_t now = millis();
+
+	if (_pcb_busy && _ack_timeout && now - _pcb_sent_at >= _ack_timeout) {
+		_pcb_busy = false;
+		if (_timeout_cb) _timeout_cb(_timeout_cb_arg, this, now - _pcb_sent_at);
+		return;
+	}
+	if (_rx_since_timeout && now - _rx_last_packet >= _rx_since_timeout * 1000) {
+		_close();
+		return;
+	}
+	if (_poll_cb) _poll_cb(_poll_cb_arg, this);
+}
+
+void AsyncTCPSimPeer::send(const char *data, size_t len)
+{
+	if (client && !client->_deliverAbort() && len) client->_recv(data, len);
+}
+
+void AsyncTCPSimPeer::send(const char *data)
+{
+	send(data, strlen(data));
+}
+
+void AsyncTCPSimPeer::ack(size_t len)
+{
+	if (len > unacked) len = unacked;
+	unacked -= len;
+	if (client && !client->_deliverAbort() && len) client->_sent(len);
+}
+
+void AsyncTCPSimPeer::close(void)
+{
+	if (client && !client->_deliverAbort()) client->_fin();
+}
+
+void AsyncTCPSimPeer::poll(void)
+{
+	if (client && !client->_deliverAbort()) client->_poll();
+}
+
+// listening servers by port
+static std::map<uint16_t, AsyncServer *> &listening(void)
+{
+	static std::map<uint16_t, AsyncServer *> servers;
+	return servers;
+}
+
+void AsyncServer::begin()
+{
+	listening()[_port] = this;
+}
+
+void AsyncServer::end()
+{
+	auto it = listening().find(_port);
+	if (it != listening().end() && it->second == this) listening().erase(it);
+}
+
+uint8_t AsyncServer::status()
+{
+	auto it = listening().find(_port);
+	return it != listening().end() && it->second == this;
+}
+
+bool AsyncTCPSim::connect(uint16_t port, AsyncTCPSimPeer *peer)
+{
+	auto it = listening().find(port);
+	if (it == listening().end() || !it->second->_connect_cb) return false;
+
+	AsyncServer *server = it->second;
+	AsyncClient *c = new AsyncClient(peer);
+	server->_connect_cb(server->_connect_cb_arg, c);
+	return true;
+}
@@ -0,0 +1,210 @@
+#ifndef ASYNCTCP_H_
+#define ASYNCTCP_H_
+
+// Host-side stand-in for AsyncTCP.
+//
+// AsyncClient and AsyncServer have AsyncTCP's public API, but there is no
+// network and no AsyncTCP task behind them: the test plays the remote end
+// of every connection through an AsyncTCPSimPeer, and every callback runs
+// synchronously on the test's thread, which thereby is the AsyncTCP task.
+//
+//   AsyncTCPSimPeer peer;
+//   AsyncTCPSim::connect(80, &peer);      // onClient() handler runs
+//   peer.send("GET / HTTP/1.1\r\n\r\n");  // onData() handler runs
+//   peer.ack();                           // onAck() handler runs
+//   peer.received                         // what the server sent
+//
+// The send window is peer.window bytes, less what is sent and not acked,
+// so responses come out in the pieces a real TCP window would allow.
+// A connection the server deletes (a request does, on disconnect) sets
+// peer.client to null.  As with lwIP, abort() resets the connection at
+// once but its error and disconnect handlers only run with the next event
+// on it, never from within abort().
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+#include <string>
+#include "IPAddress.h"
+
+#define CONFIG_ASYNC_TCP_RUNNING_CORE -1
+
+class AsyncClient;
+
+#define ASYNC_MAX_ACK_TIME 5000
+#define ASYNC_WRITE_FLAG_COPY 0x01
+#define ASYNC_WRITE_FLAG_MORE 0x02
+
+#define ASYNC_TCP_SIM_WINDOW 5744   // four segments of 1436 bytes, lwIP's default
+
+typedef std::function<void(void*, AsyncClient*)> AcConnectHandler;
+typedef std::function<void(void*, AsyncClient*, size_t len, uint32_t time)> AcAckHandler;
+typedef std::function<void(void*, AsyncClient*, int8_t error)> AcErrorHandler;
+typedef std::function<void(void*, AsyncClient*, void *data, size_t len)> AcDataHandler;
+typedef std::function<void(void*, AsyncClient*, uint32_t time)> AcTimeoutHandler;
+
+// The remote end of a simulated connection.
+struct AsyncTCPSimPeer
+{
+    AsyncClient *client = nullptr;  // null once the server deleted it
+    std::string received;           // everything the server sent
+    size_t unacked = 0;             // sent and not yet acked
+    size_t window = ASYNC_TCP_SIM_WINDOW;
+    size_t held = 0;                // received by the server, not acked (ackLater)
+    uint32_t segments = 0;          // send() calls that carried data
+    bool closed = false;            // the server closed the connection
+    bool reset = false;             // ... by aborting it
+    IPAddress remoteIP = IPAddress(192, 168, 4, 2);
+    uint16_t remotePort = 50000;
+
+    // deliver data to the server, as one segment
+    void send(const char *data, size_t len);
+    void send(const char *data);
+    // ack len bytes of what was sent, or everything
+    void ack(size_t len);
+    void ack(void) { ack(unacked); }
+    // the remote end closes the connection
+    void close(void);
+    // one AsyncTCP poll tick (nominally every 125ms): the ack and rx
+    // timeouts and the onPoll() handler
+    void poll(void);
+    // forget what was received
+    void clear(void) { received.clear(); }
+};
+
+class AsyncClient
+{
+  public:
+    AsyncClient(AsyncTCPSimPeer *peer = nullptr);
+    ~AsyncClient();
+
+    bool connect(IPAddress ip, uint16_t port) { (void)ip; (void)port; return false; }
+    bool connect(const char *host, uint16_t port) { (void)host; (void)port; return false; }
+    void close(bool now = false);
+    void stop() { close(false); }
+    int8_t abort();
+    bool free() { return !connected(); }
+
+    bool canSend() { return space() > 0; }
+    size_t space();
+    size_t add(const char *data, size_t size, uint8_t apiflags = ASYNC_WRITE_FLAG_COPY);
+    bool send();
+
+    size_t write(const char *data);
+    size_t write(const char *data, size_t size, uint8_t apiflags = ASYNC_WRITE_FLAG_COPY);
+
+    uint8_t state() { return _peer && !_aborted ? 4 : 0; }
+    bool connecting() { return false; }
+    bool connected() { return _peer && !_aborted; }
+    bool disconnecting() { return false; }
+    bool disconnected() { return !connected(); }
+    bool freeable() { return !connected(); }
+
+    uint16_t getMss() { return 1436; }
+
+    uint32_t getRxTimeout() { return _rx_since_timeout; }
+    void setRxTimeout(uint32_t timeout) { _rx_since_timeout = timeout; }
+    uint32_t getAckTimeout() { return _ack_timeout; }
+    void setAckTimeout(uint32_t timeout) { _ack_timeout = timeout; }
+
+    void setNoDelay(bool nodelay) { _nodelay = nodelay; }
+    bool getNoDelay() { return _nodelay; }
+
+    uint32_t getRemoteAddress() { return _remoteIP; }
+    uint16_t getRemotePort() { return _remotePort; }
+    uint32_t getLocalAddress() { return IPAddress(192, 168, 4, 1); }
+    uint16_t getLocalPort() { return 80; }
+
+    IPAddress remoteIP() { return IPAddress(_remoteIP); }
+    uint16_t remotePort() { return _remotePort; }
+    IPAddress localIP() { return IPAddress(getLocalAddress()); }
+    uint16_t localPort() { return getLocalPort(); }
+
+    void onConnect(AcConnectHandler cb, void *arg = 0) { _connect_cb = cb; _connect_cb_arg = arg; }
+    void onDisconnect(AcConnectHandler cb, void *arg = 0) { _discard_cb = cb; _discard_cb_arg = arg; }
+    void onAck(AcAckHandler cb, void *arg = 0) { _sent_cb = cb; _sent_cb_arg = arg; }
+    void onError(AcErrorHandler cb, void *arg = 0) { _error_cb = cb; _error_cb_arg = arg; }
+    void onData(AcDataHandler cb, void *arg = 0) { _recv_cb = cb; _recv_cb_arg = arg; }
+    void onTimeout(AcTimeoutHandler cb, void *arg = 0) { _timeout_cb = cb; _timeout_cb_arg = arg; }
+    void onPoll(AcConnectHandler cb, void *arg = 0) { _poll_cb = cb; _poll_cb_arg = arg; }
+
+    size_t ack(size_t len);
+    void ackLater() { _ack_pcb = false; }
+
+    const char *errorToString(int8_t error);
+    const char *stateToString() { return _peer ? "Established" : "Closed"; }
+
+  private:
+    friend struct AsyncTCPSimPeer;
+
+    AsyncTCPSimPeer *_peer;
+    std::string _pending;
+    uint32_t _remoteIP;
+    uint16_t _remotePort;
+
+    AcConnectHandler _connect_cb;
+    void *_connect_cb_arg;
+    AcConnectHandler _discard_cb;
+    void *_discard_cb_arg;
+    AcAckHandler _sent_cb;
+    void *_sent_cb_arg;
+    AcErrorHandler _error_cb;
+    void *_error_cb_arg;
+    AcDataHandler _recv_cb;
+    void *_recv_cb_arg;
+    AcTimeoutHandler _timeout_cb;
+    void *_timeout_cb_arg;
+    AcConnectHandler _poll_cb;
+    void *_poll_cb_arg;
+
+    bool _pcb_busy;
+    uint32_t _pcb_sent_at;
+    bool _ack_pcb;
+    uint32_t _rx_ack_len;
+    uint32_t _rx_last_packet;
+    uint32_t _rx_since_timeout;
+    uint32_t _ack_timeout;
+    bool _nodelay;
+    bool _aborted;
+
+    void _close();
+    void _error(int8_t err);
+    bool _deliverAbort();
+    void _recv(const char *data, size_t len);
+    void _sent(size_t len);
+    void _fin();
+    void _poll();
+};
+
+class AsyncServer
+{
+  public:
+    AsyncServer(IPAddress addr, uint16_t port) : _port(port), _addr(addr), _noDelay(false), _connect_cb_arg(0) { }
+    AsyncServer(uint16_t port) : AsyncServer(IPAddress(), port) { }
+    ~AsyncServer() { end(); }
+    void onClient(AcConnectHandler cb, void *arg) { _connect_cb = cb; _connect_cb_arg = arg; }
+    void begin();
+    void end();
+    void setNoDelay(bool nodelay) { _noDelay = nodelay; }
+    bool getNoDelay() { return _noDelay; }
+    uint8_t status();
+
+  private:
+    friend class AsyncTCPSim;
+
+    uint16_t _port;
+    IPAddress _addr;
+    bool _noDelay;
+    AcConnectHandler _connect_cb;
+    void *_connect_cb_arg;
+};
+
+class AsyncTCPSim
+{
+  public:
+    // a new connection from peer to the server listening on port, handed
+    // to its onClient() handler; false if nothing listens there
+    static bool connect(uint16_t port, AsyncTCPSimPeer *peer);
+};
+
+#endif /* ASYNCTCP_H_ */
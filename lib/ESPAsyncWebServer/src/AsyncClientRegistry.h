@@ -0,0 +1,266 @@
+/*
+  Asynchronous WebServer library for Espressif MCUs
+
+  Copyright (c) 2016 Hristo Gochkov. All rights reserved.
+  This file is part of the esp8266 core for Arduino environment.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#ifndef ASYNCCLIENTREGISTRY_H_
+#define ASYNCCLIENTREGISTRY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <functional>
+
+//low bits of a client id: the slot, so at most 2^bits clients at once;
+//the high bits count how often the slot was reused
+#ifndef ASYNC_CLIENT_REGISTRY_SLOT_BITS
+#define ASYNC_CLIENT_REGISTRY_SLOT_BITS 10
+#endif
+#if ASYNC_CLIENT_REGISTRY_SLOT_BITS > 15
+#error "ASYNC_CLIENT_REGISTRY_SLOT_BITS must be 15 or less"
+#endif
+
+// Clients of one AsyncWebSocket or AsyncEventSource, by id.
+//
+// Every client sits in a slot of one array that doubles as needed.  Its id
+// is the slot and the slot's generation, so get() and remove() are an
+// index and a compare, and an id of a client that is gone never matches
+// the one that reuses its slot.  The live clients are also linked in the
+// order they were added, which is the order iteration and front() see.
+//
+// As in LinkedList, a client removed while an iterator is alive is only
+// marked; iteration skips it and the slot is freed once the last iterator
+// is gone.
+//
+// Nothing here is locked.  Clients are added and removed from AsyncTCP
+// callbacks, and adding may move the slots, so a registry must only be
+// touched from the AsyncTCP task, or under a lock its owner also takes
+// there (AsyncWebSocket does): otherwise a send, lookup or count() from
+// loop() or another task races with a client connecting or going.
+template <typename T>
+class AsyncClientRegistry {
+  public:
+    typedef std::function<void(T *)> OnRemove;
+  private:
+    static const uint32_t SLOT_MASK = (1UL << ASYNC_CLIENT_REGISTRY_SLOT_BITS) - 1;
+    static const uint32_t GENERATION_MASK = 0xFFFFFFFFUL >> ASYNC_CLIENT_REGISTRY_SLOT_BITS;
+    static const uint16_t NONE = 0xFFFF;
+
+    struct Slot {
+      T *client;              // NULL if free or removed
+      uint32_t generation;
+      uint16_t prev;          // order of addition, or the free list in next
+      uint16_t next;
+      bool connected;
+    };
+
+    Slot *_slots;
+    uint16_t _capacity;
+    uint16_t _head;
+    uint16_t _tail;
+    uint16_t _free;
+    size_t _count;
+    size_t _connected;
+    mutable size_t _iterating;
+    bool _dirty;
+    OnRemove _onRemove;
+
+    class Iterator {
+      const AsyncClientRegistry *_registry;
+      uint16_t _index;
+      void _skip(){
+        while(_index != NONE && !_registry->_slots[_index].client)
+          _index = _registry->_slots[_index].next;
+      }
+    public:
+      Iterator(const AsyncClientRegistry *registry = nullptr, uint16_t index = NONE) : _registry(registry), _index(index) {
+        if(_registry){
+          _registry->_iterating++;
+          _skip();
+        }
+      }
+      Iterator(const Iterator& i) : _registry(i._registry), _index(i._index) {
+        if(_registry)
+          _registry->_iterating++;
+      }
+      ~Iterator(){
+        if(_registry)
+          _registry->_release();
+      }
+      Iterator& operator = (const Iterator& i){
+        if(i._registry)
+          i._registry->_iterating++;
+        if(_registry)
+          _registry->_release();
+        _registry = i._registry;
+        _index = i._index;
+        return *this;
+      }
+      Iterator& operator ++() { _index = _registry->_slots[_index].next; _skip(); return *this; }
+      bool operator != (const Iterator& i) const { return _index != i._index; }
+      T *operator * () const { return _registry->_slots[_index].client; }
+    };
+
+    void _release() const {
+      if(!--_iterating && _dirty)
+        const_cast<AsyncClientRegistry*>(this)->_sweep();
+    }
+
+    void _unlink(uint16_t i){
+      Slot &s = _slots[i];
+      if(s.prev != NONE) _slots[s.prev].next = s.next; else _head = s.next;
+      if(s.next != NONE) _slots[s.next].prev = s.prev; else _tail = s.prev;
+      s.next = _free;
+      _free = i;
+    }
+
+    // frees the slots of clients removed during iteration
+    void _sweep(){
+      uint16_t i = _head;
+      while(i != NONE){
+        uint16_t next = _slots[i].next;
+        if(!_slots[i].client)
+          _unlink(i);
+        i = next;
+      }
+      _dirty = false;
+    }
+
+    bool _grow(){
+      uint32_t capacity = _capacity ? 2UL * _capacity : 4;
+      if(capacity > SLOT_MASK + 1UL)
+        capacity = SLOT_MASK + 1UL;
+      if(capacity <= _capacity)
+        return false;
+      Slot *slots = (Slot *)malloc(capacity * sizeof(Slot));
+      if(!slots)
+        return false;
+      for(uint16_t i = 0; i < _capacity; i++)
+        slots[i] = _slots[i];
+      // new slots go on the free list lowest first
+      for(uint32_t i = capacity; i-- > _capacity;){
+        slots[i].client = NULL;
+        slots[i].generation = 1;
+        slots[i].prev = NONE;
+        slots[i].next = _free;
+        slots[i].connected = false;
+        _free = i;
+      }
+      free(_slots);
+      _slots = slots;
+      _capacity = capacity;
+      return true;
+    }
+
+    Slot *_find(uint32_t id) const {
+      uint32_t i = id & SLOT_MASK;
+      if(i >= _capacity)
+        return NULL;
+      Slot *s = &_slots[i];
+      if(!s->client || s->generation != (id >> ASYNC_CLIENT_REGISTRY_SLOT_BITS))
+        return NULL;
+      return s;
+    }
+
+    AsyncClientRegistry(const AsyncClientRegistry&);
+    AsyncClientRegistry& operator = (const AsyncClientRegistry&);
+
+  public:
+    typedef const Iterator ConstIterator;
+    ConstIterator begin() const { return ConstIterator(this, _head); }
+    ConstIterator end() const { return ConstIterator(); }
+
+    AsyncClientRegistry(OnRemove onRemove)
+      : _slots(NULL), _capacity(0), _head(NONE), _tail(NONE), _free(NONE)
+      , _count(0), _connected(0), _iterating(0), _dirty(false), _onRemove(onRemove) {}
+    ~AsyncClientRegistry(){
+      free(_slots);
+    }
+
+    // id of the added client, 0 if all 2^ASYNC_CLIENT_REGISTRY_SLOT_BITS
+    // slots are taken; a client starts out connected
+    uint32_t add(T *client){
+      if(_free == NONE && !_grow())
+        return 0;
+      uint16_t i = _free;
+      Slot &s = _slots[i];
+      _free = s.next;
+      s.client = client;
+      s.connected = true;
+      s.prev = _tail;
+      s.next = NONE;
+      if(_tail != NONE) _slots[_tail].next = i; else _head = i;
+      _tail = i;
+      _count++;
+      _connected++;
+      return (s.generation << ASYNC_CLIENT_REGISTRY_SLOT_BITS) | i;
+    }
+
+    T *get(uint32_t id) const {
+      Slot *s = _find(id);
+      return s ? s->client : NULL;
+    }
+
+    // the client is handed to the remove callback; its id never matches
+    // again, even once the slot holds another client
+    bool remove(uint32_t id){
+      Slot *s = _find(id);
+      if(!s)
+        return false;
+      T *client = s->client;
+      s->client = NULL;
+      s->generation = (s->generation + 1) & GENERATION_MASK;
+      if(!s->generation)
+        s->generation = 1;
+      if(s->connected)
+        _connected--;
+      s->connected = false;
+      _count--;
+      if(_iterating)
+        _dirty = true;
+      else
+        _unlink(s - _slots);
+      // the callback may come back here
+      _iterating++;
+      if(_onRemove)
+        _onRemove(client);
+      _release();
+      return true;
+    }
+
+    void setConnected(uint32_t id, bool connected){
+      Slot *s = _find(id);
+      if(!s || s->connected == connected)
+        return;
+      s->connected = connected;
+      if(connected) _connected++; else _connected--;
+    }
+
+    // the client added first of those still here
+    T *front() const {
+      for(auto c: *this)
+        return c;
+      return NULL;
+    }
+    bool isEmpty() const { return _count == 0; }
+    bool full() const { return _free == NONE && _capacity == SLOT_MASK + 1UL; }
+    size_t length() const { return _count; }
+    size_t connected() const { return _connected; }
+};
+
+#endif /* ASYNCCLIENTREGISTRY_H_ */
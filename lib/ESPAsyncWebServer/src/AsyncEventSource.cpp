@@ -156,6 +156,7 @@ AsyncEventSourceClient::AsyncEventSourceClient(AsyncWebServerRequest *request, A
 {
   _client = request->client();
   _server = server;
+  _clientId = 0;
   _lastId = 0;
   if(request->hasHeader("Last-Event-ID"))
     _lastId = atoi(request->getHeader("Last-Event-ID")->value().c_str());
@@ -251,7 +252,7 @@ void AsyncEventSourceClient::_runQueue(){
 
 AsyncEventSource::AsyncEventSource(const String& url)
   : _url(url)
-  , _clients(LinkedList<AsyncEventSourceClient *>([](AsyncEventSourceClient *c){ delete c; }))
+  , _clients(AsyncClientRegistry<AsyncEventSourceClient>([](AsyncEventSourceClient *c){ delete c; }))
   , _connectcb(NULL)
 {}
 
@@ -277,13 +278,14 @@ void AsyncEventSource::_addClient(AsyncEventSourceClient * client){
     free(temp);
   }*/
   
-  _clients.add(client);
+  client->_clientId = _clients.add(client);
   if(_connectcb)
     _connectcb(client);
 }
 
 void AsyncEventSource::_handleDisconnect(AsyncEventSourceClient * client){
-  _clients.remove(client);
+  if(!_clients.remove(client->_clientId) && !client->_clientId)
+    delete client;
 }
 
 void AsyncEventSource::close(){
@@ -322,10 +324,10 @@ void AsyncEventSource::send(const char *message, const char *event, uint32_t id,
   }
 }
 
+// clients whose disconnect has not come in yet; one that is closing but
+// still here counts
 size_t AsyncEventSource::count() const {
-  return _clients.count_if([](AsyncEventSourceClient *c){
-    return c->connected();
-  });
+  return _clients.length();
 }
 
 bool AsyncEventSource::canHandle(AsyncWebServerRequest *request){
@@ -339,6 +341,8 @@ bool AsyncEventSource::canHandle(AsyncWebServerRequest *request){
 void AsyncEventSource::handleRequest(AsyncWebServerRequest *request){
   if((_username != "" && _password != "") && !request->authenticate(_username.c_str(), _password.c_str()))
     return request->requestAuthentication();
+  if(_clients.full())
+    return request->send(503);
   request->send(new AsyncEventSourceResponse(this));
 }
 
@@ -21,7 +21,7 @@
 #define ASYNCEVENTSOURCE_H_
 
 #include <Arduino.h>
-#ifdef ESP32
+#if defined(ESP32) || defined(ARDUINO_HOST)
 #include <AsyncTCP.h>
 #define SSE_MAX_QUEUED_MESSAGES 32
 #else
@@ -31,6 +31,7 @@
 #include <ESPAsyncWebServer.h>
 
 #include "AsyncWebSynchronization.h"
+#include "AsyncClientRegistry.h"
 
 #ifdef ESP8266
 #include <Hash.h>
@@ -39,7 +40,7 @@
 #endif
 #endif
 
-#ifdef ESP32
+#if defined(ESP32) || defined(ARDUINO_HOST)
 #define DEFAULT_MAX_SSE_CLIENTS 8
 #else
 #define DEFAULT_MAX_SSE_CLIENTS 4
@@ -67,9 +68,11 @@ class AsyncEventSourceMessage {
 };
 
 class AsyncEventSourceClient {
+  friend class AsyncEventSource;
   private:
     AsyncClient *_client;
     AsyncEventSource *_server;
+    uint32_t _clientId;
     uint32_t _lastId;
     LinkedList<AsyncEventSourceMessage *> _messageQueue;
     void _queueMessage(AsyncEventSourceMessage *dataMessage);
@@ -81,6 +84,7 @@ class AsyncEventSourceClient {
     ~AsyncEventSourceClient();
 
     AsyncClient* client(){ return _client; }
+    uint32_t id() const { return _clientId; }
     void close();
     void write(const char * message, size_t len);
     void send(const char *message, const char *event=NULL, uint32_t id=0, uint32_t reconnect=0);
@@ -98,7 +102,7 @@ class AsyncEventSourceClient {
 class AsyncEventSource: public AsyncWebHandler {
   private:
     String _url;
-    LinkedList<AsyncEventSourceClient *> _clients;
+    AsyncClientRegistry<AsyncEventSourceClient> _clients;   //AsyncTCP task only
     ArEventHandlerFunction _connectcb;
   public:
     AsyncEventSource(const String& url);
@@ -0,0 +1,636 @@
+// AsyncGzip.cpp
+/*
+  Streaming gzip encoder for responses, see AsyncGzip.h
+*/
+#include "AsyncGzip.h"
+#include <string.h>
+
+#define MIN_MATCH     3
+#define MAX_MATCH     258
+// input kept ahead of the match position, so that a match never runs
+// into bytes that are not there yet
+#define MIN_LOOKAHEAD (MAX_MATCH + MIN_MATCH + 1)
+#define MAX_DIST      (ASYNC_GZIP_WINDOW - MIN_LOOKAHEAD)
+#define WINDOW_MASK   (ASYNC_GZIP_WINDOW - 1)
+// a three byte match further back than this costs more than its literals
+#define TOO_FAR       4096
+
+#define END_OF_BLOCK  256
+
+// length - 3 to its length code (0 for 257)
+static const uint8_t LENGTH_CODE[256] = {
+  0, 1, 2, 3, 4, 5, 6, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 12, 12, 13, 13, 13, 13, 14, 14, 14, 14, 15, 15, 15, 15,
+  16, 16, 16, 16, 16, 16, 16, 16, 17, 17, 17, 17, 17, 17, 17, 17, 18, 18, 18, 18, 18, 18, 18, 18, 19, 19, 19, 19, 19, 19, 19, 19,
+  20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21,
+  22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23,
+  24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24,
+  25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25,
+  26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
+  27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 28
+};
+
+// distance - 1 to its distance code: below 256 directly, above as
+// 256 + ((distance - 1) >> 7)
+static const uint8_t DIST_CODE[512] = {
+  0, 1, 2, 3, 4, 4, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7, 8, 8, 8, 8, 8, 8, 8, 8, 9, 9, 9, 9, 9, 9, 9, 9,
+  10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11,
+  12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,
+  13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13,
+  14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
+  14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
+  15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+  15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+  0, 0, 16, 17, 18, 18, 19, 19, 20, 20, 20, 20, 21, 21, 21, 21, 22, 22, 22, 22, 22, 22, 22, 22, 23, 23, 23, 23, 23, 23, 23, 23,
+  24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25,
+  26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
+  27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27,
+  28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+  28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+  29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29,
+  29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29
+};
+
+// first length - 3 and distance - 1 of each code and their extra bits
+static const uint8_t LENGTH_BASE[29] = {
+  0, 1, 2, 3, 4, 5, 6, 7, 8, 10, 12, 14, 16, 20, 24, 28, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 255
+};
+static const uint8_t LENGTH_EXTRA[29] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t DIST_BASE[30] = {
+  0, 1, 2, 3, 4, 6, 8, 12, 16, 24, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768,
+  1024, 1536, 2048, 3072, 4096, 6144, 8192, 12288, 16384, 24576
+};
+static const uint8_t DIST_EXTRA[30] = {
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+// order the code length code lengths are sent in
+static const uint8_t CODE_LENGTH_ORDER[19] = {
+  16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+#define MAX_BITS         15
+#define MAX_LENGTH_BITS  7
+
+static uint32_t crc32(uint32_t crc, const uint8_t *data, size_t len){
+  static const uint32_t table[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+  };
+  crc = ~crc;
+  while(len--){
+    crc ^= *data++;
+    crc = (crc >> 4) ^ table[crc & 15];
+    crc = (crc >> 4) ^ table[crc & 15];
+  }
+  return ~crc;
+}
+
+// Huffman code lengths for 'count' symbols, none longer than 'limit'.
+// Lengths of a minimum redundancy code are found in place over the
+// frequencies sorted ascending (Moffat and Katajainen), then codes over
+// the limit are shortened and as many made longer again as needed to keep
+// the code complete.  With fewer than two symbols in use there are two
+// codes of length 1 anyway, as zlib does: not every inflater takes less.
+static void huffmanLengths(const uint16_t *freq, uint16_t count, uint8_t limit, uint8_t *lengths){
+  uint16_t symbols[286];
+  uint32_t keys[286];
+  uint16_t used = 0;
+
+  memset(lengths, 0, count);
+  for(uint16_t i = 0; i < count; i++){
+    if(!freq[i])
+      continue;
+    // insertion sort, ascending by frequency
+    uint16_t j = used++;
+    while(j && keys[j - 1] > freq[i]){
+      keys[j] = keys[j - 1];
+      symbols[j] = symbols[j - 1];
+      j--;
+    }
+    keys[j] = freq[i];
+    symbols[j] = i;
+  }
+  if(used < 2){
+    lengths[(used && symbols[0] == 0) ? 1 : 0] = 1;
+    if(used)
+      lengths[symbols[0]] = 1;
+    else
+      lengths[1] = 1;
+    return;
+  }
+
+  keys[0] += keys[1];
+  uint16_t root = 0, leaf = 2;
+  for(uint16_t next = 1; next < used - 1; next++){
+    if(leaf >= used || keys[root] < keys[leaf]){
+      keys[next] = keys[root];
+      keys[root++] = next;
+    } else {
+      keys[next] = keys[leaf++];
+    }
+    if(leaf >= used || (root < next && keys[root] < keys[leaf])){
+      keys[next] += keys[root];
+      keys[root++] = next;
+    } else {
+      keys[next] += keys[leaf++];
+    }
+  }
+  keys[used - 2] = 0;
+  for(int next = used - 3; next >= 0; next--)
+    keys[next] = keys[keys[next]] + 1;
+
+  uint16_t depths[32] = {0};
+  int available = 1, taken = 0, depth = 0, node = used - 2;
+  while(available > 0){
+    while(node >= 0 && (int)keys[node] == depth){
+      taken++;
+      node--;
+    }
+    while(available > taken){
+      depths[depth < 31 ? depth : 31]++;
+      available--;
+    }
+    available = 2 * taken;
+    depth++;
+    taken = 0;
+  }
+
+  for(uint8_t i = limit + 1; i < 32; i++){
+    depths[limit] += depths[i];
+    depths[i] = 0;
+  }
+  uint32_t total = 0;
+  for(uint8_t i = 1; i <= limit; i++)
+    total += (uint32_t)depths[i] << (limit - i);
+  while(total > (1UL << limit)){
+    depths[limit]--;
+    for(uint8_t i = limit - 1; i > 0; i--){
+      if(depths[i]){
+        depths[i]--;
+        depths[i + 1] += 2;
+        break;
+      }
+    }
+    total--;
+  }
+
+  // the most frequent symbols get the shortest codes
+  int j = used - 1;
+  for(uint8_t i = 1; i <= limit; i++)
+    for(uint16_t n = depths[i]; n; n--)
+      lengths[symbols[j--]] = i;
+}
+
+// canonical codes for the lengths, bit reversed as deflate sends them
+static void huffmanCodes(const uint8_t *lengths, uint16_t count, uint16_t *codes){
+  uint16_t perLength[MAX_BITS + 1] = {0};
+  uint16_t next[MAX_BITS + 1];
+  for(uint16_t i = 0; i < count; i++)
+    perLength[lengths[i]]++;
+  perLength[0] = 0;
+  uint16_t code = 0;
+  for(uint8_t bits = 1; bits <= MAX_BITS; bits++){
+    code = (code + perLength[bits - 1]) << 1;
+    next[bits] = code;
+  }
+  for(uint16_t i = 0; i < count; i++){
+    uint8_t len = lengths[i];
+    if(!len)
+      continue;
+    uint16_t c = next[len]++, reversed = 0;
+    for(uint8_t b = 0; b < len; b++){
+      reversed = (reversed << 1) | (c & 1);
+      c >>= 1;
+    }
+    codes[i] = reversed;
+  }
+}
+
+static void fixedLengths(uint8_t *lengths){
+  memset(lengths, 8, 144);
+  memset(lengths + 144, 9, 112);
+  memset(lengths + 256, 7, 24);
+  memset(lengths + 280, 8, 8);
+  memset(lengths + 288, 5, 30);
+}
+
+// Run lengths of the code lengths: 16 repeats the one before 3 to 6
+// times, 17 and 18 are 3 to 10 and 11 to 138 zeros.  Counts the code
+// length codes into 'freq', or sends them if 'codes' is set; returns the
+// bits of the extras.
+struct RunLengths {
+  const uint8_t *lengths;
+  uint16_t count;
+
+  template<typename F> uint32_t each(F f) const {
+    uint32_t extra = 0;
+    uint16_t i = 0;
+    while(i < count){
+      uint8_t len = lengths[i];
+      uint16_t run = 1;
+      while(i + run < count && lengths[i + run] == len)
+        run++;
+      i += run;
+      if(!len){
+        while(run >= 11){
+          uint16_t n = run > 138 ? 138 : run;
+          f(18, n - 11, 7);
+          extra += 7;
+          run -= n;
+        }
+        if(run >= 3){
+          f(17, run - 3, 3);
+          extra += 3;
+          run = 0;
+        }
+      } else {
+        f(len, 0, 0);
+        run--;
+        while(run >= 3){
+          uint16_t n = run > 6 ? 6 : run;
+          f(16, n - 3, 2);
+          extra += 2;
+          run -= n;
+        }
+      }
+      while(run--)
+        f(len, 0, 0);
+    }
+    return extra;
+  }
+};
+
+AsyncGzipEncoder::AsyncGzipEncoder()
+  : _state(STATE_MATCH)
+  , _finishing(false)
+  , _last(false)
+  , _crc(0)
+  , _totalIn(0)
+  , _strstart(0)
+  , _lookahead(0)
+  , _matchLength(MIN_MATCH - 1)
+  , _matchStart(0)
+  , _matchAvailable(false)
+  , _blockStart(0)
+  , _stored(false)
+  , _symbols(0)
+  , _emitted(0)
+  , _bits(0)
+  , _bitCount(0)
+  , _outLen(0)
+  , _outPos(0)
+{
+  memset(_freq, 0, sizeof(_freq));
+  memset(_head, 0, sizeof(_head));
+  // gzip member header: deflate, no flags, no time, unknown OS
+  static const uint8_t header[10] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff };
+  memcpy(_out, header, sizeof(header));
+  _outLen = sizeof(header);
+}
+
+uint8_t *AsyncGzipEncoder::input(size_t *len){
+  if(_finishing){
+    *len = 0;
+    return _window;
+  }
+  // not while a stored block is written out of the window
+  if(_strstart >= ASYNC_GZIP_WINDOW + MAX_DIST && _state == STATE_MATCH){
+    // drop the older half of the window; positions below it in the hash
+    // chains become 0, the end of a chain
+    memcpy(_window, _window + ASYNC_GZIP_WINDOW, ASYNC_GZIP_WINDOW);
+    _strstart -= ASYNC_GZIP_WINDOW;
+    _matchStart -= ASYNC_GZIP_WINDOW;
+    _blockStart = _blockStart >= ASYNC_GZIP_WINDOW ? _blockStart - ASYNC_GZIP_WINDOW : -1;
+    for(size_t i = 0; i < (1 << ASYNC_GZIP_HASH_BITS); i++)
+      _head[i] = _head[i] >= ASYNC_GZIP_WINDOW ? _head[i] - ASYNC_GZIP_WINDOW : 0;
+    for(size_t i = 0; i < ASYNC_GZIP_WINDOW; i++)
+      _prev[i] = _prev[i] >= ASYNC_GZIP_WINDOW ? _prev[i] - ASYNC_GZIP_WINDOW : 0;
+  }
+  uint32_t end = _strstart + _lookahead;
+  *len = 2 * ASYNC_GZIP_WINDOW - end;
+  return _window + end;
+}
+
+void AsyncGzipEncoder::commit(size_t len){
+  _crc = crc32(_crc, _window + _strstart + _lookahead, len);
+  _totalIn += len;
+  _lookahead += len;
+}
+
+void AsyncGzipEncoder::finish(){
+  _finishing = true;
+}
+
+size_t AsyncGzipEncoder::read(uint8_t *buf, size_t len){
+  size_t n = 0;
+  while(n < len){
+    if(_outPos < _outLen){
+      size_t chunk = _outLen - _outPos;
+      if(chunk > len - n)
+        chunk = len - n;
+      memcpy(buf + n, _out + _outPos, chunk);
+      _outPos += chunk;
+      n += chunk;
+      continue;
+    }
+    _outPos = _outLen = 0;
+    if(_state == STATE_DONE)
+      break;
+    if(_state == STATE_BLOCK){
+      _emit();
+      continue;
+    }
+    _deflate();
+    if(_state == STATE_MATCH)
+      break;    // needs input
+  }
+  return n;
+}
+
+uint16_t AsyncGzipEncoder::_insert(uint16_t pos){
+  uint32_t h = ((uint32_t)_window[pos] | ((uint32_t)_window[pos + 1] << 8) | ((uint32_t)_window[pos + 2] << 16)) * 2654435761UL;
+  h >>= 32 - ASYNC_GZIP_HASH_BITS;
+  uint16_t head = _head[h];
+  _prev[pos & WINDOW_MASK] = head;
+  _head[h] = pos;
+  return head;
+}
+
+// longest match at _strstart along the chain starting at 'cur'; less than
+// MIN_MATCH if there is none
+uint16_t AsyncGzipEncoder::_longestMatch(uint16_t cur, uint16_t *start){
+  uint32_t best = MIN_MATCH - 1;
+  uint32_t chain = ASYNC_GZIP_CHAIN;
+  uint32_t limit = _strstart > MAX_DIST ? _strstart - MAX_DIST : 0;
+  uint32_t most = _lookahead < MAX_MATCH ? _lookahead : MAX_MATCH;
+  const uint8_t *scan = _window + _strstart;
+  do {
+    const uint8_t *match = _window + cur;
+    if(match[best] != scan[best] || match[0] != scan[0] || match[1] != scan[1])
+      continue;
+    uint32_t len = 2;
+    while(len < most && match[len] == scan[len])
+      len++;
+    if(len > best){
+      best = len;
+      *start = cur;
+      if(len >= most)
+        break;
+    }
+  } while((cur = _prev[cur & WINDOW_MASK]) > limit && --chain);
+  return best;
+}
+
+// true once the block is full
+bool AsyncGzipEncoder::_tally(uint16_t dist, uint16_t len){
+  if(!dist){
+    _lbuf[_symbols] = len;
+    _freq[len]++;
+  } else {
+    _lbuf[_symbols] = len - MIN_MATCH;
+    _freq[257 + LENGTH_CODE[len - MIN_MATCH]]++;
+    uint16_t d = dist - 1;
+    _freq[LITERALS + (d < 256 ? DIST_CODE[d] : DIST_CODE[256 + (d >> 7)])]++;
+  }
+  _dbuf[_symbols++] = dist;
+  return _symbols == ASYNC_GZIP_SYMBOLS;
+}
+
+void AsyncGzipEncoder::_deflate(){
+  while(_state == STATE_MATCH){
+    if(_lookahead < MIN_LOOKAHEAD && !_finishing)
+      return;
+    if(!_lookahead){
+      if(_matchAvailable){
+        _matchAvailable = false;
+        if(_tally(0, _window[_strstart - 1])){
+          _startBlock(false);
+          return;
+        }
+      }
+      _startBlock(true);
+      return;
+    }
+    // The window is about to slide past the start of the block.  If few
+    // matches were found the input may be better stored, so the block
+    // ends while it still can be; with matches the Huffman codes win
+    // anyway and the block goes on.
+    if(_strstart >= ASYNC_GZIP_WINDOW + MAX_DIST && _blockStart >= 0 && _blockStart < ASYNC_GZIP_WINDOW
+        && _symbols && _blockEnd() - _blockStart < 2UL * _symbols){
+      _startBlock(false);
+      return;
+    }
+
+    uint16_t head = 0;
+    if(_lookahead >= MIN_MATCH)
+      head = _insert(_strstart);
+    uint16_t prevLength = _matchLength;
+    uint16_t prevMatch = _matchStart;
+    _matchLength = MIN_MATCH - 1;
+    if(head && prevLength < ASYNC_GZIP_LAZY && _strstart - head <= MAX_DIST){
+      _matchLength = _longestMatch(head, &_matchStart);
+      if(_matchLength == MIN_MATCH && _strstart - _matchStart > TOO_FAR)
+        _matchLength = MIN_MATCH - 1;
+    }
+
+    if(prevLength >= MIN_MATCH && _matchLength <= prevLength){
+      // the match before is at least as good: take it
+      uint32_t lastInsert = _strstart + _lookahead - MIN_MATCH;
+      bool full = _tally(_strstart - 1 - prevMatch, prevLength);
+      _lookahead -= prevLength - 1;
+      prevLength -= 2;
+      do {
+        if(++_strstart <= lastInsert)
+          _insert(_strstart);
+      } while(--prevLength);
+      _matchAvailable = false;
+      _matchLength = MIN_MATCH - 1;
+      _strstart++;
+      if(full)
+        _startBlock(false);
+    } else if(_matchAvailable){
+      bool full = _tally(0, _window[_strstart - 1]);
+      _strstart++;
+      _lookahead--;
+      if(full)
+        _startBlock(false);
+    } else {
+      _matchAvailable = true;
+      _strstart++;
+      _lookahead--;
+    }
+  }
+}
+
+// Picks fixed or dynamic codes, or storing the input, for the symbols so
+// far and writes the block header; the symbols or the input follow from
+// _emit()
+void AsyncGzipEncoder::_startBlock(bool last){
+  _freq[END_OF_BLOCK] = 1;
+
+  uint8_t dynamic[CODES];
+  huffmanLengths(_freq, 286, MAX_BITS, dynamic);
+  dynamic[286] = dynamic[287] = 0;
+  huffmanLengths(_freq + LITERALS, DISTANCES, MAX_BITS, dynamic + LITERALS);
+  uint16_t literals = 286, distances = DISTANCES;
+  while(literals > 257 && !dynamic[literals - 1])
+    literals--;
+  while(distances > 1 && !dynamic[LITERALS + distances - 1])
+    distances--;
+
+  // literal/length and distance lengths run together
+  uint8_t sequence[CODES];
+  memcpy(sequence, dynamic, literals);
+  memcpy(sequence + literals, dynamic + LITERALS, distances);
+  RunLengths runs = { sequence, (uint16_t)(literals + distances) };
+
+  uint16_t lengthFreq[19] = {0};
+  uint32_t runExtra = runs.each([&](uint8_t code, uint8_t, uint8_t){ lengthFreq[code]++; });
+  uint8_t lengthLengths[19];
+  uint16_t lengthCodes[19];
+  huffmanLengths(lengthFreq, 19, MAX_LENGTH_BITS, lengthLengths);
+  huffmanCodes(lengthLengths, 19, lengthCodes);
+  uint8_t orderCount = 19;
+  while(orderCount > 4 && !lengthLengths[CODE_LENGTH_ORDER[orderCount - 1]])
+    orderCount--;
+
+  uint8_t fixed[CODES];
+  fixedLengths(fixed);
+  uint32_t dynamicBits = 5 + 5 + 4 + 3 * orderCount + runExtra;
+  uint32_t fixedBits = 0;
+  for(uint8_t i = 0; i < 19; i++)
+    dynamicBits += (uint32_t)lengthFreq[i] * lengthLengths[i];
+  for(uint16_t i = 0; i < CODES; i++){
+    dynamicBits += (uint32_t)_freq[i] * dynamic[i];
+    fixedBits += (uint32_t)_freq[i] * fixed[i];
+  }
+
+  // a stored block: the header padded to a byte, its length twice and
+  // the input
+  uint32_t blockEnd = _blockEnd();
+  uint32_t storedBits = 0xFFFFFFFF;
+  if(_blockStart >= 0 && blockEnd - _blockStart <= 0xFFFF)
+    storedBits = 7 + 32 + 8 * (blockEnd - _blockStart);
+
+  _last = last;
+  _emitted = 0;
+  _state = STATE_BLOCK;
+  _put(last ? 1 : 0, 1);
+  _stored = storedBits < fixedBits && storedBits < dynamicBits;
+  if(_stored){
+    uint16_t len = blockEnd - _blockStart;
+    _put(0, 2);
+    _alignBits();
+    _put(len, 16);
+    _put((uint16_t)~len, 16);
+    return;
+  }
+  if(fixedBits <= dynamicBits){
+    memcpy(_lengths, fixed, CODES);
+    _put(1, 2);
+  } else {
+    memcpy(_lengths, dynamic, CODES);
+    _put(2, 2);
+    _put(literals - 257, 5);
+    _put(distances - 1, 5);
+    _put(orderCount - 4, 4);
+    for(uint8_t i = 0; i < orderCount; i++)
+      _put(lengthLengths[CODE_LENGTH_ORDER[i]], 3);
+    runs.each([&](uint8_t code, uint8_t extra, uint8_t extraBits){
+      _put(lengthCodes[code], lengthLengths[code]);
+      if(extraBits)
+        _put(extra, extraBits);
+    });
+  }
+  huffmanCodes(_lengths, LITERALS, _codes);
+  huffmanCodes(_lengths + LITERALS, DISTANCES, _codes + LITERALS);
+}
+
+// Writes the symbols of the block while there is room, then its end and
+// after the last block the gzip trailer
+void AsyncGzipEncoder::_emit(){
+  if(_stored)
+    return _emitStored();
+  while(_emitted < _symbols){
+    // a literal/length, a distance and their extra bits: 48 bits at most
+    if(_outLen + 8 > ASYNC_GZIP_OUT)
+      return;
+    uint16_t dist = _dbuf[_emitted];
+    uint8_t value = _lbuf[_emitted++];
+    if(!dist){
+      _put(_codes[value], _lengths[value]);
+      continue;
+    }
+    uint8_t code = LENGTH_CODE[value];
+    _put(_codes[257 + code], _lengths[257 + code]);
+    if(LENGTH_EXTRA[code])
+      _put(value - LENGTH_BASE[code], LENGTH_EXTRA[code]);
+    dist--;
+    code = dist < 256 ? DIST_CODE[dist] : DIST_CODE[256 + (dist >> 7)];
+    _put(_codes[LITERALS + code], _lengths[LITERALS + code]);
+    if(DIST_EXTRA[code])
+      _put(dist - DIST_BASE[code], DIST_EXTRA[code]);
+  }
+  // end of block, padding and trailer
+  if(_outLen + 12 > ASYNC_GZIP_OUT)
+    return;
+  _put(_codes[END_OF_BLOCK], _lengths[END_OF_BLOCK]);
+  _endBlock();
+}
+
+// Copies the input of a stored block while there is room
+void AsyncGzipEncoder::_emitStored(){
+  uint16_t len = _blockEnd() - _blockStart;
+  if(_emitted < len){
+    uint16_t chunk = len - _emitted;
+    if(chunk > ASYNC_GZIP_OUT - _outLen)
+      chunk = ASYNC_GZIP_OUT - _outLen;
+    memcpy(_out + _outLen, _window + _blockStart + _emitted, chunk);
+    _outLen += chunk;
+    _emitted += chunk;
+    return;
+  }
+  if(_outLen + 8 > ASYNC_GZIP_OUT)
+    return;
+  _endBlock();
+}
+
+// The next block starts where this one ended; after the last comes the
+// trailer
+void AsyncGzipEncoder::_endBlock(){
+  memset(_freq, 0, sizeof(_freq));
+  _symbols = 0;
+  _blockStart = _blockEnd();
+  if(!_last){
+    _state = STATE_MATCH;
+    return;
+  }
+  _alignBits();
+  for(uint8_t i = 0; i < 32; i += 8)
+    _putByte(_crc >> i);
+  for(uint8_t i = 0; i < 32; i += 8)
+    _putByte(_totalIn >> i);
+  _state = STATE_DONE;
+}
+
+// deflate packs bits from the least significant end of each byte
+void AsyncGzipEncoder::_put(uint32_t bits, uint8_t count){
+  _bits |= bits << _bitCount;
+  _bitCount += count;
+  while(_bitCount >= 8){
+    _out[_outLen++] = _bits;
+    _bits >>= 8;
+    _bitCount -= 8;
+  }
+}
+
+void AsyncGzipEncoder::_putByte(uint8_t b){
+  _out[_outLen++] = b;
+}
+
+void AsyncGzipEncoder::_alignBits(){
+  if(_bitCount)
+    _put(0, 8 - _bitCount);
+}
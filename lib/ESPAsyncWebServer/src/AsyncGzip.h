@@ -0,0 +1,146 @@
+// AsyncGzip.h
+/*
+  Streaming gzip (deflate, RFC 1951/1952) encoder for responses
+
+  Input goes straight into the sliding window, compressed output comes out
+  in pieces of whatever size the caller has room for, so a response is
+  compressed as it is sent and never held whole.  Everything lives in the
+  object itself, its size is fixed by the settings below (about 18KB with
+  the defaults) and nothing is allocated while it runs.
+
+  Matches are searched over the last ASYNC_GZIP_WINDOW_BITS of input along
+  hash chains cut after ASYNC_GZIP_CHAIN candidates, with zlib's lazy
+  evaluation.  Every ASYNC_GZIP_SYMBOLS literals and matches end a block,
+  coded with fixed or its own Huffman codes, whichever is shorter, or
+  stored as it came when that is shorter still: input that does not
+  compress grows by 5 bytes a block instead of some 2%.  A
+  smaller window costs ratio on repetitive text long before it costs
+  speed; CSV and JSON repeat themselves within a few hundred bytes.
+
+  Example
+
+  AsyncGzipEncoder *gz = new AsyncGzipEncoder();
+  size_t space;
+  uint8_t *in = gz->input(&space);   // room for up to 'space' bytes
+  gz->commit(source.read(in, space));
+  ...                                // or gz->finish() at the end
+  size_t n = gz->read(out, outLen);  // less than outLen: needs input
+  if(gz->done()) ...
+*/
+#ifndef ASYNC_GZIP_H_
+#define ASYNC_GZIP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+//window of 2^bits bytes searched for matches, 9 to 15
+#ifndef ASYNC_GZIP_WINDOW_BITS
+#define ASYNC_GZIP_WINDOW_BITS 11
+#endif
+
+#ifndef ASYNC_GZIP_HASH_BITS
+#define ASYNC_GZIP_HASH_BITS 10
+#endif
+
+//match candidates tried at each position
+#ifndef ASYNC_GZIP_CHAIN
+#define ASYNC_GZIP_CHAIN 32
+#endif
+
+//a match at least this long is taken without looking one byte further
+#ifndef ASYNC_GZIP_LAZY
+#define ASYNC_GZIP_LAZY 16
+#endif
+
+//literals and matches per block
+#ifndef ASYNC_GZIP_SYMBOLS
+#define ASYNC_GZIP_SYMBOLS 2048
+#endif
+
+#define ASYNC_GZIP_WINDOW (1 << ASYNC_GZIP_WINDOW_BITS)
+
+//output staged at once; the longest dynamic block header is 286 bytes
+#define ASYNC_GZIP_OUT 320
+
+class AsyncGzipEncoder {
+  public:
+    AsyncGzipEncoder();
+
+    // Where the next input goes and how much fits; 0 until read() took
+    // the output of what is already in, or after finish()
+    uint8_t *input(size_t *len);
+    // 'len' bytes were written to input()
+    void commit(size_t len);
+    // no more input
+    void finish();
+
+    // Up to 'len' bytes of output.  Less than 'len' once everything in
+    // is compressed and the encoder waits for input() or finish().
+    size_t read(uint8_t *buf, size_t len);
+
+    bool done() const { return _state == STATE_DONE && _outPos == _outLen; }
+    uint32_t totalIn() const { return _totalIn; }
+
+  private:
+    enum {
+      STATE_MATCH,     // looking for matches, until the block is full
+      STATE_BLOCK,     // writing out the block
+      STATE_DONE
+    };
+
+    // codes of a block: 288 literal/length (the last two only make the
+    // fixed code complete), 30 distance
+    enum { LITERALS = 288, DISTANCES = 30, CODES = LITERALS + DISTANCES };
+
+    uint16_t _insert(uint16_t pos);
+    uint16_t _longestMatch(uint16_t cur, uint16_t *start);
+    bool _tally(uint16_t dist, uint16_t len);
+    void _deflate();
+    uint32_t _blockEnd() const { return _strstart - (_matchAvailable ? 1 : 0); }
+    void _startBlock(bool last);
+    void _emit();
+    void _emitStored();
+    void _endBlock();
+    void _put(uint32_t bits, uint8_t count);
+    void _putByte(uint8_t b);
+    void _alignBits();
+
+    uint8_t _state;
+    bool _finishing;
+    bool _last;
+    uint32_t _crc;
+    uint32_t _totalIn;
+
+    // matching, as zlib's deflate_slow(): a match found at _strstart - 1
+    // is only taken if the one at _strstart is not longer
+    uint32_t _strstart;
+    uint32_t _lookahead;
+    uint16_t _matchLength;
+    uint16_t _matchStart;
+    bool _matchAvailable;
+
+    // the block: literal or length - 3 and distance (0 for a literal).
+    // Its input starts at _blockStart in the window, below 0 once the
+    // window slid past it and it can no longer be stored.
+    int32_t _blockStart;
+    bool _stored;
+    uint16_t _symbols;
+    uint16_t _emitted;     // symbols, or bytes of a stored block
+    uint8_t _lbuf[ASYNC_GZIP_SYMBOLS];
+    uint16_t _dbuf[ASYNC_GZIP_SYMBOLS];
+    uint16_t _freq[CODES];
+    uint8_t _lengths[CODES];
+    uint16_t _codes[CODES];
+
+    uint32_t _bits;
+    uint8_t _bitCount;
+    uint8_t _out[ASYNC_GZIP_OUT];
+    uint16_t _outLen;
+    uint16_t _outPos;
+
+    uint8_t _window[2 * ASYNC_GZIP_WINDOW];
+    uint16_t _prev[ASYNC_GZIP_WINDOW];
+    uint16_t _head[1 << ASYNC_GZIP_HASH_BITS];
+};
+
+#endif
@@ -30,6 +30,11 @@
     // ...
   });
   server.addHandler(handler);
+
+  With ArduinoJson 6 the body is parsed as it arrives (see
+  AsyncJsonTokenizer.h), straight into a document of maxJsonBufferSize,
+  so the raw body is never held in memory and setMaxContentLength() only
+  limits how long a client may keep sending.
   
 */
 #ifndef ASYNC_JSON_H_
@@ -37,6 +42,7 @@
 #include <ArduinoJson.h>
 #include <ESPAsyncWebServer.h>
 #include <Print.h>
+#include "AsyncJsonTokenizer.h"
 
 #if ARDUINOJSON_VERSION_MAJOR == 5
   #define ARDUINOJSON_5_COMPATIBILITY
@@ -79,6 +85,220 @@ class ChunkPrint : public Print {
     }
 };
 
+#ifndef ARDUINOJSON_5_COMPATIBILITY
+/*
+ * Resumable serializer: keeps its place in the document between reads,
+ * so every byte is produced once however small the send windows are.
+ * The output is the same as serializeJson().
+ * */
+
+class AsyncJsonSerializer {
+  private:
+    enum { STEP_VALUE, STEP_NEXT, STEP_KEY, STEP_COLON, STEP_DONE };
+
+    struct Frame {
+      bool object;
+      bool first;
+      JsonObjectIterator member, members;
+      JsonArrayIterator element, elements;
+    };
+
+    JsonVariant _value;
+    Frame _frames[ASYNC_JSON_MAX_DEPTH];
+    uint8_t _depth;
+    uint8_t _step;
+    // progress inside the token being written
+    size_t _offset;
+    bool _escaped;
+    bool _failed;
+
+    uint8_t *_buf;
+    size_t _len;
+    size_t _used;
+
+    static char _escapeChar(char c){
+      switch(c){
+        case '"': return '"';
+        case '\\': return '\\';
+        case '\b': return 'b';
+        case '\f': return 'f';
+        case '\n': return 'n';
+        case '\r': return 'r';
+        case '\t': return 't';
+        default: return 0;
+      }
+    }
+
+    // each _write*() returns false when the buffer filled up before the
+    // token was complete; it is called again for the same token next time
+    bool _write(const char *s, size_t n){
+      size_t copy = std::min(n - _offset, _len - _used);
+      memcpy(_buf + _used, s + _offset, copy);
+      _used += copy;
+      _offset += copy;
+      if(_offset < n)
+        return false;
+      _offset = 0;
+      return true;
+    }
+
+    bool _writeScalar(JsonVariant v){
+      size_t n = measureJson(v);
+      size_t copy = std::min(n - _offset, _len - _used);
+      ChunkPrint dest(_buf + _used, _offset, copy);
+      serializeJson(v, dest);
+      _used += copy;
+      _offset += copy;
+      if(_offset < n)
+        return false;
+      _offset = 0;
+      return true;
+    }
+
+    // _offset is 0 before the opening quote, then 1 + index into s
+    bool _writeString(const char *s){
+      if(_offset == 0){
+        if(_used == _len) return false;
+        _buf[_used++] = '"';
+        _offset = 1;
+      }
+      for(;;){
+        const char *p = s + _offset - 1;
+        const char *run = p;
+        while(*run && !_escapeChar(*run)) run++;
+        size_t copy = std::min((size_t)(run - p), _len - _used);
+        memcpy(_buf + _used, p, copy);
+        _used += copy;
+        _offset += copy;
+        if(p + copy != run)
+          return false;
+        if(!*run)
+          break;
+        if(!_escaped){
+          if(_used == _len) return false;
+          _buf[_used++] = '\\';
+          _escaped = true;
+        }
+        if(_used == _len) return false;
+        _buf[_used++] = _escapeChar(*run);
+        _escaped = false;
+        _offset++;
+      }
+      if(_used == _len) return false;
+      _buf[_used++] = '"';
+      _offset = 0;
+      return true;
+    }
+
+    bool _afterValue(){
+      _step = _depth ? STEP_NEXT : STEP_DONE;
+      return true;
+    }
+
+    bool _writeValue(){
+      if(_value.is<JsonObject>() || _value.is<JsonArray>()){
+        bool object = _value.is<JsonObject>();
+        if(_depth == ASYNC_JSON_MAX_DEPTH){
+          _failed = true;
+          return false;
+        }
+        if(!_write(object ? "{" : "[", 1))
+          return false;
+        Frame &f = _frames[_depth++];
+        f.object = object;
+        f.first = true;
+        if(object){
+          JsonObject o = _value.as<JsonObject>();
+          f.member = o.begin();
+          f.members = o.end();
+        } else {
+          JsonArray a = _value.as<JsonArray>();
+          f.element = a.begin();
+          f.elements = a.end();
+        }
+        _step = STEP_NEXT;
+        return true;
+      }
+      if(_value.is<const char*>()){
+        if(!_writeString(_value.as<const char*>()))
+          return false;
+      } else if(!_writeScalar(_value)){
+        return false;
+      }
+      return _afterValue();
+    }
+
+    bool _writeNext(){
+      Frame &f = _frames[_depth - 1];
+      if(f.object ? f.member == f.members : f.element == f.elements){
+        if(!_write(f.object ? "}" : "]", 1))
+          return false;
+        _depth--;
+        return _afterValue();
+      }
+      if(!f.first && !_write(",", 1))
+        return false;
+      f.first = false;
+      if(f.object){
+        _step = STEP_KEY;
+      } else {
+        _value = *f.element;
+        ++f.element;
+        _step = STEP_VALUE;
+      }
+      return true;
+    }
+
+  public:
+    AsyncJsonSerializer(JsonVariant root)
+      : _value(root), _depth(0), _step(STEP_VALUE), _offset(0), _escaped(false), _failed(false), _buf(NULL), _len(0), _used(0) {}
+
+    bool done() const { return _step == STEP_DONE; }
+    // nested deeper than ASYNC_JSON_MAX_DEPTH, the rest cannot be written
+    bool failed() const { return _failed; }
+
+    // fills buf with the next part of the document; 0 once it is all out,
+    // or when failed(), which a caller must tell apart from the end
+    size_t read(uint8_t *buf, size_t len){
+      if(_failed)
+        return 0;
+      _buf = buf;
+      _len = len;
+      _used = 0;
+      while(_used < _len){
+        bool complete;
+        switch(_step){
+          case STEP_VALUE:
+            complete = _writeValue();
+            break;
+          case STEP_NEXT:
+            complete = _writeNext();
+            break;
+          case STEP_KEY:
+            complete = _writeString((*_frames[_depth - 1].member).key().c_str());
+            if(complete) _step = STEP_COLON;
+            break;
+          case STEP_COLON:
+            complete = _write(":", 1);
+            if(complete){
+              JsonObjectIterator &member = _frames[_depth - 1].member;
+              _value = (*member).value();
+              ++member;
+              _step = STEP_VALUE;
+            }
+            break;
+          default:
+            return _used;
+        }
+        // too deep to follow, or nothing more fits
+        if(!complete && (_failed || _used < _len))
+          break;
+      }
+      return _used;
+    }
+};
+#endif
+
 class AsyncJsonResponse: public AsyncAbstractResponse {
   protected:
 
@@ -90,6 +310,9 @@ class AsyncJsonResponse: public AsyncAbstractResponse {
 
     JsonVariant _root;
     bool _isValid;
+#ifndef ARDUINOJSON_5_COMPATIBILITY
+    AsyncJsonSerializer *_serializer;
+#endif
 
   public:    
 
@@ -103,7 +326,7 @@ class AsyncJsonResponse: public AsyncAbstractResponse {
         _root = _jsonBuffer.createObject();
     }
 #else
-    AsyncJsonResponse(bool isArray=false, size_t maxJsonBufferSize = DYNAMIC_JSON_DOCUMENT_SIZE) : _jsonBuffer(maxJsonBufferSize), _isValid{false} {
+    AsyncJsonResponse(bool isArray=false, size_t maxJsonBufferSize = DYNAMIC_JSON_DOCUMENT_SIZE) : _jsonBuffer(maxJsonBufferSize), _isValid{false}, _serializer{NULL} {
       _code = 200;
       _contentType = JSON_MIMETYPE;
       if(isArray)
@@ -113,9 +336,34 @@ class AsyncJsonResponse: public AsyncAbstractResponse {
     }
 #endif
 
+#ifdef ARDUINOJSON_5_COMPATIBILITY
     ~AsyncJsonResponse() {}
-    JsonVariant & getRoot() { return _root; }
     bool _sourceValid() const { return _isValid; }
+#else
+    ~AsyncJsonResponse() { delete _serializer; }
+    // Without setLength() the document goes out chunked (or, to HTTP/1.0
+    // clients, until the connection closes) instead of being measured first
+    bool _sourceValid() const { return true; }
+    void _respond(AsyncWebServerRequest *request){
+      if(!_isValid){
+        _sendContentLength = false;
+        _chunked = request->version() != 0;
+      }
+      AsyncAbstractResponse::_respond(request);
+    }
+    // A document the serializer gave up on is reset, not ended: a final
+    // chunk, or closing a response sent until close, would pass the
+    // truncated text for all of it
+    size_t _ack(AsyncWebServerRequest *request, size_t len, uint32_t time){
+      size_t sent = AsyncAbstractResponse::_ack(request, len, time);
+      if(_serializer && _serializer->failed() && _state != RESPONSE_FAILED){
+        _state = RESPONSE_FAILED;
+        request->client()->abort();
+      }
+      return sent;
+    }
+#endif
+    JsonVariant & getRoot() { return _root; }
     size_t setLength() {
 
 #ifdef ARDUINOJSON_5_COMPATIBILITY      
@@ -131,14 +379,16 @@ class AsyncJsonResponse: public AsyncAbstractResponse {
    size_t getSize() { return _jsonBuffer.size(); }
 
     size_t _fillBuffer(uint8_t *data, size_t len){
-      ChunkPrint dest(data, _sentLength, len);
-
 #ifdef ARDUINOJSON_5_COMPATIBILITY      
+      ChunkPrint dest(data, _sentLength, len);
       _root.printTo( dest ) ;
+      return len;
 #else
-      serializeJson(_root, dest);
+      if(!_serializer)
+        _serializer = new AsyncJsonSerializer(_root);
+      size_t n = _serializer->read(data, len);
+      return n || !_serializer->failed() ? n : RESPONSE_TRY_AGAIN;
 #endif
-      return len;
     }
 };
 
@@ -158,6 +408,9 @@ public:
 		if (_contentLength) {_isValid = true;}
 		return _contentLength;
 	}
+#ifndef ARDUINOJSON_5_COMPATIBILITY
+	bool _sourceValid () const { return _isValid; }
+#endif
 	size_t _fillBuffer (uint8_t *data, size_t len) {
 		ChunkPrint dest (data, _sentLength, len);
 #ifdef ARDUINOJSON_5_COMPATIBILITY
@@ -169,6 +422,78 @@ public:
 	}
 };
 
+#ifndef ARDUINOJSON_5_COMPATIBILITY
+/*
+ * Json Request body, built into the document token by token
+ * */
+
+class AsyncJsonBodyParser: public AsyncJsonListener {
+  private:
+    DynamicJsonDocument _document;
+    JsonVariant _containers[ASYNC_JSON_MAX_DEPTH];
+    uint8_t _depth;
+    AsyncJsonTokenizer _tokenizer;
+    bool _complete;
+
+    // the document copies char* keys and strings, the tokenizer reuses its buffer
+    JsonVariant _slot(const char *key){
+      if(!_depth)
+        return _document.to<JsonVariant>();
+      JsonVariant parent = _containers[_depth - 1];
+      return key ? parent.getOrAddMember((char*)key) : parent.addElement();
+    }
+
+    bool _begin(JsonVariant container){
+      if(_document.overflowed())
+        return false;
+      _containers[_depth++] = container;
+      return true;
+    }
+
+  public:
+    AsyncJsonBodyParser(size_t maxJsonBufferSize)
+      : _document(maxJsonBufferSize), _depth(0), _tokenizer(this), _complete(false) {}
+
+    bool feed(const uint8_t *data, size_t len){ return _tokenizer.feed(data, len); }
+    bool finish(){ _complete = _tokenizer.finish(); return _complete; }
+    bool complete() const { return _complete; }
+    JsonVariant root(){ return _document.as<JsonVariant>(); }
+
+    bool beginObject(const char *key) override { return _begin(_slot(key).to<JsonObject>()); }
+    bool beginArray(const char *key) override { return _begin(_slot(key).to<JsonArray>()); }
+    bool end() override { _depth--; return true; }
+
+    bool value(const char *key, AsyncJsonToken type, const char *text, size_t len) override {
+      (void)len;
+      JsonVariant slot = _slot(key);
+      switch(type){
+        case AJSON_STRING:
+          slot.set((char*)text);
+          break;
+        case AJSON_NUMBER: {
+          // as deserializeJson() stores them: integers as integers unless
+          // they overflow JsonInteger/JsonUInt, everything else as double
+          AsyncJsonNumber n = asyncJsonNumber(text);
+          if(n.type == AJSON_INTEGER && (int64_t)(JsonInteger)n.i == n.i)
+            slot.set((JsonInteger)n.i);
+          else if(n.type == AJSON_UNSIGNED && (uint64_t)(JsonUInt)n.u == n.u)
+            slot.set((JsonUInt)n.u);
+          else
+            slot.set(n.type == AJSON_DOUBLE ? n.d : strtod(text, NULL));
+          break;
+        }
+        case AJSON_TRUE:
+        case AJSON_FALSE:
+          slot.set(type == AJSON_TRUE);
+          break;
+        case AJSON_NULL:
+          break;
+      }
+      return !_document.overflowed();
+    }
+};
+#endif
+
 typedef std::function<void(AsyncWebServerRequest *request, JsonVariant &json)> ArJsonRequestHandlerFunction;
 
 class AsyncCallbackJsonWebHandler: public AsyncWebHandler {
@@ -220,16 +545,21 @@ public:
         DynamicJsonBuffer jsonBuffer;
         JsonVariant json = jsonBuffer.parse((uint8_t*)(request->_tempObject));
         if (json.success()) {
+          _onRequest(request, json);
+          return;
+        }
 #else
-        DynamicJsonDocument jsonBuffer(this->maxJsonBufferSize);
-        DeserializationError error = deserializeJson(jsonBuffer, (uint8_t*)(request->_tempObject));
-        if(!error) {
-          JsonVariant json = jsonBuffer.as<JsonVariant>();
-#endif
-
+        // the request frees _tempObject with free(), so take it back first
+        AsyncJsonBodyParser *parser = (AsyncJsonBodyParser*)(request->_tempObject);
+        request->_tempObject = NULL;
+        if(parser->complete()) {
+          JsonVariant json = parser->root();
           _onRequest(request, json);
+          delete parser;
           return;
         }
+        delete parser;
+#endif
       }
       request->send(_contentLength > _maxContentLength ? 413 : 400);
     } else {
@@ -241,12 +571,30 @@ public:
   virtual void handleBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) override final {
     if (_onRequest) {
       _contentLength = total;
+#ifdef ARDUINOJSON_5_COMPATIBILITY
       if (total > 0 && request->_tempObject == NULL && total < _maxContentLength) {
         request->_tempObject = malloc(total);
       }
       if (request->_tempObject != NULL) {
         memcpy((uint8_t*)(request->_tempObject) + index, data, len);
       }
+#else
+      if (index == 0 && total > 0 && request->_tempObject == NULL && total < _maxContentLength
+          && request->_charge(sizeof(AsyncJsonBodyParser) + this->maxJsonBufferSize)) {
+        request->_tempObject = new AsyncJsonBodyParser(this->maxJsonBufferSize);
+        // a client going away mid-body never reaches handleRequest()
+        request->onDisconnect([request](){
+          delete (AsyncJsonBodyParser*)(request->_tempObject);
+          request->_tempObject = NULL;
+        });
+      }
+      AsyncJsonBodyParser *parser = (AsyncJsonBodyParser*)(request->_tempObject);
+      if (parser != NULL) {
+        parser->feed(data, len);
+        if (index + len == total)
+          parser->finish();
+      }
+#endif
     }
   }
   virtual bool isRequestHandlerTrivial() override final {return _onRequest ? false : true;}
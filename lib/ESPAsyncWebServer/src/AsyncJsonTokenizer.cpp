@@ -0,0 +1,352 @@
+// AsyncJsonTokenizer.cpp
+/*
+  Incremental JSON tokenizer for request bodies, see AsyncJsonTokenizer.h
+*/
+#include "AsyncJsonTokenizer.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+static bool isDigit(uint8_t c){
+  return c >= '0' && c <= '9';
+}
+
+static bool isSpace(uint8_t c){
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+static bool isNumber(const char *s, size_t len){
+  size_t i = 0;
+  if(i < len && s[i] == '-') i++;
+  if(i == len || !isDigit(s[i])) return false;
+  if(s[i++] != '0')
+    while(i < len && isDigit(s[i])) i++;
+  if(i < len && s[i] == '.'){
+    i++;
+    if(i == len || !isDigit(s[i])) return false;
+    while(i < len && isDigit(s[i])) i++;
+  }
+  if(i < len && (s[i] == 'e' || s[i] == 'E')){
+    i++;
+    if(i < len && (s[i] == '+' || s[i] == '-')) i++;
+    if(i == len || !isDigit(s[i])) return false;
+    while(i < len && isDigit(s[i])) i++;
+  }
+  return i == len;
+}
+
+AsyncJsonNumber asyncJsonNumber(const char *text){
+  AsyncJsonNumber n;
+  char *end;
+
+  if(!strpbrk(text, ".eE")){
+    errno = 0;
+    if(text[0] == '-'){
+      n.type = AJSON_INTEGER;
+      n.i = strtoll(text, &end, 10);
+    } else {
+      n.type = AJSON_UNSIGNED;
+      n.u = strtoull(text, &end, 10);
+    }
+    if(errno != ERANGE && !*end)
+      return n;
+  }
+  n.type = AJSON_DOUBLE;
+  n.d = strtod(text, NULL);
+  return n;
+}
+
+AsyncJsonTokenizer::AsyncJsonTokenizer(AsyncJsonListener *listener)
+  : _listener(listener)
+{
+  reset();
+}
+
+void AsyncJsonTokenizer::reset(){
+  _state = STATE_VALUE;
+  _readingKey = false;
+  _depth = 0;
+  _hexDigits = 0;
+  _codeUnit = 0;
+  _highSurrogate = 0;
+  _keyLength = 0;
+  _length = 0;
+}
+
+bool AsyncJsonTokenizer::_fail(){
+  _state = STATE_ERROR;
+  return false;
+}
+
+bool AsyncJsonTokenizer::_put(char c){
+  // keep room for the terminator
+  if(_length + 1 >= ASYNC_JSON_TOKEN_SIZE)
+    return false;
+  _token[_length++] = c;
+  return true;
+}
+
+bool AsyncJsonTokenizer::_afterValue(){
+  _state = _depth ? STATE_NEXT : STATE_DONE;
+  return true;
+}
+
+bool AsyncJsonTokenizer::_endToken(AsyncJsonToken type){
+  size_t start = _inObject() ? _keyLength + 1 : 0;
+  _token[_length] = 0;
+  if(!_listener->value(_key(), type, _token + start, _length - start))
+    return _fail();
+  return _afterValue();
+}
+
+bool AsyncJsonTokenizer::_endText(){
+  size_t start = _inObject() ? _keyLength + 1 : 0;
+  const char *text = _token + start;
+  size_t len = _length - start;
+
+  if(_state == STATE_NUMBER)
+    return isNumber(text, len) ? _endToken(AJSON_NUMBER) : _fail();
+  if(len == 4 && !memcmp(text, "true", 4))
+    return _endToken(AJSON_TRUE);
+  if(len == 5 && !memcmp(text, "false", 5))
+    return _endToken(AJSON_FALSE);
+  if(len == 4 && !memcmp(text, "null", 4))
+    return _endToken(AJSON_NULL);
+  return _fail();
+}
+
+bool AsyncJsonTokenizer::_beginValue(uint8_t c){
+  _length = _inObject() ? _keyLength + 1 : 0;
+  if(c == '{' || c == '['){
+    if(_depth == ASYNC_JSON_MAX_DEPTH)
+      return _fail();
+    bool ok = (c == '{') ? _listener->beginObject(_key()) : _listener->beginArray(_key());
+    if(!ok)
+      return _fail();
+    _objects[_depth++] = (c == '{');
+    _state = (c == '{') ? STATE_FIRST_KEY : STATE_FIRST_VALUE;
+  } else if(c == '"'){
+    _readingKey = false;
+    _state = STATE_STRING;
+  } else if(c == '-' || isDigit(c)){
+    if(!_put(c))
+      return _fail();
+    _state = STATE_NUMBER;
+  } else if(c == 't' || c == 'f' || c == 'n'){
+    if(!_put(c))
+      return _fail();
+    _state = STATE_LITERAL;
+  } else {
+    return _fail();
+  }
+  return true;
+}
+
+// A high surrogate not followed by a low one becomes U+FFFD
+static const char REPLACEMENT[] = "\xEF\xBF\xBD";
+
+size_t AsyncJsonTokenizer::_string(const uint8_t *data, size_t len){
+  size_t i = 0;
+  if(_highSurrogate && data[0] != '\\'){
+    _highSurrogate = 0;
+    if(!_put(REPLACEMENT[0]) || !_put(REPLACEMENT[1]) || !_put(REPLACEMENT[2])){
+      _fail();
+      return len;
+    }
+  }
+  while(i < len){
+    uint8_t c = data[i];
+    if(c == '"'){
+      if(_readingKey){
+        _token[_length] = 0;
+        _keyLength = _length;
+        _readingKey = false;
+        _state = STATE_COLON;
+      } else {
+        _endToken(AJSON_STRING);
+      }
+      return i + 1;
+    }
+    if(c == '\\'){
+      _state = STATE_ESCAPE;
+      return i + 1;
+    }
+    if(c < 0x20){
+      _fail();
+      return len;
+    }
+    size_t end = i + 1;
+    while(end < len && data[end] != '"' && data[end] != '\\' && data[end] >= 0x20)
+      end++;
+    if(_length + (end - i) >= ASYNC_JSON_TOKEN_SIZE){
+      _fail();
+      return len;
+    }
+    memcpy(_token + _length, data + i, end - i);
+    _length += end - i;
+    i = end;
+  }
+  return i;
+}
+
+bool AsyncJsonTokenizer::_escape(uint8_t c){
+  char r;
+  switch(c){
+    case '"': case '\\': case '/': r = c; break;
+    case 'b': r = '\b'; break;
+    case 'f': r = '\f'; break;
+    case 'n': r = '\n'; break;
+    case 'r': r = '\r'; break;
+    case 't': r = '\t'; break;
+    case 'u':
+      _hexDigits = 0;
+      _codeUnit = 0;
+      _state = STATE_UNICODE;
+      return true;
+    default:
+      return false;
+  }
+  if(_highSurrogate){
+    _highSurrogate = 0;
+    if(!_put(REPLACEMENT[0]) || !_put(REPLACEMENT[1]) || !_put(REPLACEMENT[2]))
+      return false;
+  }
+  _state = STATE_STRING;
+  return _put(r);
+}
+
+bool AsyncJsonTokenizer::_unicode(uint8_t c){
+  uint8_t v;
+  if(isDigit(c)) v = c - '0';
+  else if(c >= 'a' && c <= 'f') v = c - 'a' + 10;
+  else if(c >= 'A' && c <= 'F') v = c - 'A' + 10;
+  else return false;
+  _codeUnit = (_codeUnit << 4) | v;
+  if(++_hexDigits < 4)
+    return true;
+
+  _state = STATE_STRING;
+  uint32_t cp = _codeUnit;
+  if(cp >= 0xD800 && cp <= 0xDBFF){
+    bool lone = _highSurrogate != 0;
+    _highSurrogate = _codeUnit;
+    if(!lone)
+      return true;
+    cp = 0xFFFD;
+  } else if(cp >= 0xDC00 && cp <= 0xDFFF){
+    if(_highSurrogate)
+      cp = 0x10000 + ((uint32_t)(_highSurrogate - 0xD800) << 10) + (cp - 0xDC00);
+    else
+      cp = 0xFFFD;
+    _highSurrogate = 0;
+  } else if(_highSurrogate){
+    _highSurrogate = 0;
+    if(!_put(REPLACEMENT[0]) || !_put(REPLACEMENT[1]) || !_put(REPLACEMENT[2]))
+      return false;
+  }
+
+  if(cp < 0x80)
+    return _put(cp);
+  if(cp < 0x800)
+    return _put(0xC0 | (cp >> 6)) && _put(0x80 | (cp & 0x3F));
+  if(cp < 0x10000)
+    return _put(0xE0 | (cp >> 12)) && _put(0x80 | ((cp >> 6) & 0x3F)) && _put(0x80 | (cp & 0x3F));
+  return _put(0xF0 | (cp >> 18)) && _put(0x80 | ((cp >> 12) & 0x3F))
+      && _put(0x80 | ((cp >> 6) & 0x3F)) && _put(0x80 | (cp & 0x3F));
+}
+
+bool AsyncJsonTokenizer::feed(const uint8_t *data, size_t len){
+  size_t i = 0;
+  while(i < len){
+    if(_state == STATE_ERROR)
+      return false;
+    uint8_t c = data[i];
+
+    switch(_state){
+      case STATE_STRING:
+        i += _string(data + i, len - i);
+        continue;
+      case STATE_ESCAPE:
+        if(!_escape(c)) return _fail();
+        i++;
+        continue;
+      case STATE_UNICODE:
+        if(!_unicode(c)) return _fail();
+        i++;
+        continue;
+      case STATE_NUMBER:
+      case STATE_LITERAL:
+        if((c >= 'a' && c <= 'z') || isDigit(c) || c == '+' || c == '-' || c == '.' || c == 'E'){
+          if(!_put(c)) return _fail();
+          i++;
+          continue;
+        }
+        // the delimiter is looked at again below
+        if(!_endText()) return false;
+        break;
+      default:
+        break;
+    }
+
+    if(isSpace(c)){
+      i++;
+      continue;
+    }
+
+    switch(_state){
+      case STATE_VALUE:
+        _beginValue(c);
+        break;
+      case STATE_FIRST_VALUE:
+        if(c == ']'){
+          _depth--;
+          if(!_listener->end()) return _fail();
+          _afterValue();
+        } else {
+          _beginValue(c);
+        }
+        break;
+      case STATE_FIRST_KEY:
+        if(c == '}'){
+          _depth--;
+          if(!_listener->end()) return _fail();
+          _afterValue();
+          break;
+        }
+        // fall through
+      case STATE_KEY:
+        if(c != '"') return _fail();
+        _readingKey = true;
+        _length = 0;
+        _state = STATE_STRING;
+        break;
+      case STATE_COLON:
+        if(c != ':') return _fail();
+        _state = STATE_VALUE;
+        break;
+      case STATE_NEXT:
+        if(c == ','){
+          _state = _inObject() ? STATE_KEY : STATE_VALUE;
+        } else if(c == (_inObject() ? '}' : ']')){
+          _depth--;
+          if(!_listener->end()) return _fail();
+          _afterValue();
+        } else {
+          return _fail();
+        }
+        break;
+      default:
+        // anything but whitespace after the value
+        return _fail();
+    }
+    i++;
+  }
+  return _state != STATE_ERROR;
+}
+
+bool AsyncJsonTokenizer::finish(){
+  if((_state == STATE_NUMBER || _state == STATE_LITERAL) && !_depth)
+    _endText();
+  return _state == STATE_DONE;
+}
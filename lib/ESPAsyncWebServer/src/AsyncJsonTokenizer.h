@@ -0,0 +1,139 @@
+// AsyncJsonTokenizer.h
+/*
+  Incremental JSON tokenizer for request bodies
+
+  Bytes are fed as they arrive from handleBody(); events go to an
+  AsyncJsonListener as soon as each token is complete, so nothing but the
+  token in progress is ever buffered.  Keys and string values are handed
+  over unescaped and null terminated, numbers as their source text.
+
+  Example
+
+  class Counter : public AsyncJsonListener {
+    ...
+    bool value(const char *key, AsyncJsonToken type, const char *text, size_t len){
+      if(key && !strcmp(key, "interval") && type == AJSON_NUMBER)
+        interval = atoi(text);
+      return true;
+    }
+  };
+
+  Counter counter;
+  AsyncJsonTokenizer tokenizer(&counter);
+  tokenizer.feed(data, len);   // as often as needed
+  if(tokenizer.finish()) ...   // true if exactly one complete value was seen
+*/
+#ifndef ASYNC_JSON_TOKENIZER_H_
+#define ASYNC_JSON_TOKENIZER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+//longest key plus string, number or literal held at once
+#ifndef ASYNC_JSON_TOKEN_SIZE
+#define ASYNC_JSON_TOKEN_SIZE 512
+#endif
+
+#ifndef ASYNC_JSON_MAX_DEPTH
+#define ASYNC_JSON_MAX_DEPTH 16
+#endif
+
+typedef enum {
+  AJSON_STRING,
+  AJSON_NUMBER,
+  AJSON_TRUE,
+  AJSON_FALSE,
+  AJSON_NULL
+} AsyncJsonToken;
+
+// A number's text as the value it is best stored as: integers as 64 bit
+// integers, unsigned unless negative, and anything with a fraction or an
+// exponent, or out of range, as a double.
+typedef enum {
+  AJSON_INTEGER,
+  AJSON_UNSIGNED,
+  AJSON_DOUBLE
+} AsyncJsonNumberType;
+
+struct AsyncJsonNumber {
+  AsyncJsonNumberType type;
+  union {
+    int64_t i;
+    uint64_t u;
+    double d;
+  };
+};
+
+AsyncJsonNumber asyncJsonNumber(const char *text);
+
+// key is the member name inside objects and NULL inside arrays or for the
+// top level value.  Returning false stops the tokenizer.
+class AsyncJsonListener {
+  public:
+    virtual ~AsyncJsonListener(){}
+    virtual bool beginObject(const char *key) = 0;
+    virtual bool beginArray(const char *key) = 0;
+    virtual bool end() = 0;
+    virtual bool value(const char *key, AsyncJsonToken type, const char *text, size_t len) = 0;
+};
+
+class AsyncJsonTokenizer {
+  public:
+    AsyncJsonTokenizer(AsyncJsonListener *listener);
+
+    void reset();
+    // false once the input is malformed, too deep, has a token longer than
+    // ASYNC_JSON_TOKEN_SIZE or the listener refused an event
+    bool feed(const uint8_t *data, size_t len);
+    // end of input; true if one complete value was parsed
+    bool finish();
+
+    bool failed() const { return _state == STATE_ERROR; }
+    size_t depth() const { return _depth; }
+
+  private:
+    enum {
+      STATE_VALUE,          // a value is expected
+      STATE_FIRST_VALUE,    // after '[': a value or ']'
+      STATE_FIRST_KEY,      // after '{': a key or '}'
+      STATE_KEY,            // after ',' in an object
+      STATE_COLON,
+      STATE_NEXT,           // after a value: ',' or the closing bracket
+      STATE_STRING,
+      STATE_ESCAPE,
+      STATE_UNICODE,
+      STATE_NUMBER,
+      STATE_LITERAL,
+      STATE_DONE,
+      STATE_ERROR
+    };
+
+    size_t _string(const uint8_t *data, size_t len);
+    bool _escape(uint8_t c);
+    bool _unicode(uint8_t c);
+    bool _put(char c);
+    bool _beginValue(uint8_t c);
+    bool _endToken(AsyncJsonToken type);
+    bool _endText();
+    bool _afterValue();
+    bool _fail();
+
+    const char *_key() const { return _inObject() ? _token : NULL; }
+    bool _inObject() const { return _depth && _objects[_depth - 1]; }
+
+    AsyncJsonListener *_listener;
+    uint8_t _state;
+    bool _readingKey;
+    uint8_t _depth;
+    bool _objects[ASYNC_JSON_MAX_DEPTH];
+    uint8_t _hexDigits;
+    uint16_t _codeUnit;
+    uint16_t _highSurrogate;
+    // [key \0][value \0]: the key of the member being parsed stays in
+    // front of its value
+    size_t _keyLength;
+    size_t _length;
+    char _token[ASYNC_JSON_TOKEN_SIZE];
+};
+
+#endif
@@ -470,7 +470,7 @@ AsyncWebSocketClient::AsyncWebSocketClient(AsyncWebServerRequest *request, Async
 {
   _client = request->client();
   _server = server;
-  _clientId = _server->_getNextId();
+  _clientId = 0;
   _status = WS_CONNECTED;
   _pstate = 0;
   _lastMessageTime = millis();
@@ -482,7 +482,7 @@ AsyncWebSocketClient::AsyncWebSocketClient(AsyncWebServerRequest *request, Async
   _client->onTimeout([](void *r, AsyncClient* c, uint32_t time){ (void)c; ((AsyncWebSocketClient*)(r))->_onTimeout(time); }, this);
   _client->onData([](void *r, AsyncClient* c, void *buf, size_t len){ (void)c; ((AsyncWebSocketClient*)(r))->_onData(buf, len); }, this);
   _client->onPoll([](void *r, AsyncClient* c){ (void)c; ((AsyncWebSocketClient*)(r))->_onPoll(); }, this);
-  _server->_addClient(this);
+  _clientId = _server->_addClient(this);
   _server->_handleEvent(this, WS_EVT_CONNECT, request, NULL, 0);
   delete request;
 }
@@ -494,6 +494,7 @@ AsyncWebSocketClient::~AsyncWebSocketClient(){
 }
 
 void AsyncWebSocketClient::_onAck(size_t len, uint32_t time){
+  AsyncWebLockGuard l(_server->_lock);
   _lastMessageTime = millis();
   if(!_controlQueue.isEmpty()){
     auto head = _controlQueue.front();
@@ -501,7 +502,7 @@ void AsyncWebSocketClient::_onAck(size_t len, uint32_t time){
       len -= head->len();
       if(_status == WS_DISCONNECTING && head->opcode() == WS_DISCONNECT){
         _controlQueue.remove(head);
-        _status = WS_DISCONNECTED;
+        _setStatus(WS_DISCONNECTED);
         _client->close(true);
         return;
       }
@@ -516,6 +517,7 @@ void AsyncWebSocketClient::_onAck(size_t len, uint32_t time){
 }
 
 void AsyncWebSocketClient::_onPoll(){
+  AsyncWebLockGuard l(_server->_lock);
   if(_client->canSend() && (!_controlQueue.isEmpty() || !_messageQueue.isEmpty())){
     _runQueue();
   } else if(_keepAlivePeriod > 0 && _controlQueue.isEmpty() && _messageQueue.isEmpty() && (millis() - _lastMessageTime) >= _keepAlivePeriod){
@@ -595,19 +597,28 @@ void AsyncWebSocketClient::ping(uint8_t *data, size_t len){
     _queueControl(new AsyncWebSocketControl(WS_PING, data, len));
 }
 
+void AsyncWebSocketClient::_setStatus(AwsClientStatus status){
+  if((_status == WS_CONNECTED) != (status == WS_CONNECTED))
+    _server->_handleStatus(this, status == WS_CONNECTED);
+  _status = status;
+}
+
 void AsyncWebSocketClient::_onError(int8_t){}
 
 void AsyncWebSocketClient::_onTimeout(uint32_t time){
+  AsyncWebLockGuard l(_server->_lock);
   (void)time;
   _client->close(true);
 }
 
 void AsyncWebSocketClient::_onDisconnect(){
+  AsyncWebLockGuard l(_server->_lock);
   _client = NULL;
   _server->_handleDisconnect(this);
 }
 
 void AsyncWebSocketClient::_onData(void *pbuf, size_t plen){
+  AsyncWebLockGuard l(_server->_lock);
   _lastMessageTime = millis();
   uint8_t *data = (uint8_t*)pbuf;
   while(plen > 0){
@@ -668,10 +679,10 @@ void AsyncWebSocketClient::_onData(void *pbuf, size_t plen){
           }
         }
         if(_status == WS_DISCONNECTING){
-          _status = WS_DISCONNECTED;
+          _setStatus(WS_DISCONNECTED);
           _client->close(true);
         } else {
-          _status = WS_DISCONNECTING;
+          _setStatus(WS_DISCONNECTING);
           _client->ackLater();
           _queueControl(new AsyncWebSocketControl(WS_DISCONNECT, data, datalen));
         }
@@ -728,7 +739,7 @@ size_t AsyncWebSocketClient::printf(const char *format, ...) {
   return len;
 }
 
-#ifndef ESP32
+#if !defined(ESP32) && !defined(ARDUINO_HOST)
 size_t AsyncWebSocketClient::printf_P(PGM_P formatP, ...) {
   va_list arg;
   va_start(arg, formatP);
@@ -849,12 +860,13 @@ uint16_t AsyncWebSocketClient::remotePort() {
 
 AsyncWebSocket::AsyncWebSocket(const String& url)
   :_url(url)
-  ,_clients(LinkedList<AsyncWebSocketClient *>([](AsyncWebSocketClient *c){ delete c; }))
-  ,_cNextId(1)
+  ,_clients(AsyncClientRegistry<AsyncWebSocketClient>([](AsyncWebSocketClient *c){ delete c; }))
   ,_enabled(true)
   ,_buffers(LinkedList<AsyncWebSocketMessageBuffer *>([](AsyncWebSocketMessageBuffer *b){ delete b; }))
 {
   _eventHandler = NULL;
+  // live telemetry goes ahead of page loads and downloads
+  _priority = true;
 }
 
 AsyncWebSocket::~AsyncWebSocket(){}
@@ -865,18 +877,25 @@ void AsyncWebSocket::_handleEvent(AsyncWebSocketClient * client, AwsEventType ty
   }
 }
 
-void AsyncWebSocket::_addClient(AsyncWebSocketClient * client){
-  _clients.add(client);
+uint32_t AsyncWebSocket::_addClient(AsyncWebSocketClient * client){
+  AsyncWebLockGuard l(_lock);
+  return _clients.add(client);
 }
 
 void AsyncWebSocket::_handleDisconnect(AsyncWebSocketClient * client){
-  
-  _clients.remove_first([=](AsyncWebSocketClient * c){
-    return c->id() == client->id();
-  });
+  AsyncWebLockGuard l(_lock);
+  // id 0: the registry filled up after the handshake was answered
+  if(!_clients.remove(client->id()) && !client->id())
+    delete client;
+}
+
+void AsyncWebSocket::_handleStatus(AsyncWebSocketClient * client, bool connected){
+  AsyncWebLockGuard l(_lock);
+  _clients.setConnected(client->id(), connected);
 }
 
 bool AsyncWebSocket::availableForWriteAll(){
+  AsyncWebLockGuard l(_lock);
   for(const auto& c: _clients){
     if(c->queueIsFull()) return false;
   }
@@ -884,35 +903,32 @@ bool AsyncWebSocket::availableForWriteAll(){
 }
 
 bool AsyncWebSocket::availableForWrite(uint32_t id){
-  for(const auto& c: _clients){
-    if(c->queueIsFull() && (c->id() == id )) return false;
-  }
-  return true;
+  AsyncWebLockGuard l(_lock);
+  AsyncWebSocketClient * c = _clients.get(id);
+  return !(c && c->queueIsFull());
 }
 
 size_t AsyncWebSocket::count() const {
-  return _clients.count_if([](AsyncWebSocketClient * c){
-    return c->status() == WS_CONNECTED;
-  });
+  return _clients.connected();
 }
 
 AsyncWebSocketClient * AsyncWebSocket::client(uint32_t id){
-  for(const auto &c: _clients){
-    if(c->id() == id && c->status() == WS_CONNECTED){
-      return c;
-    }
-  }
+  AsyncWebSocketClient * c = _clients.get(id);
+  if(c && c->status() == WS_CONNECTED)
+    return c;
   return nullptr;
 }
 
 
 void AsyncWebSocket::close(uint32_t id, uint16_t code, const char * message){
+  AsyncWebLockGuard l(_lock);
   AsyncWebSocketClient * c = client(id);
   if(c)
     c->close(code, message);
 }
 
 void AsyncWebSocket::closeAll(uint16_t code, const char * message){
+  AsyncWebLockGuard l(_lock);
   for(const auto& c: _clients){
     if(c->status() == WS_CONNECTED)
       c->close(code, message);
@@ -921,18 +937,21 @@ void AsyncWebSocket::closeAll(uint16_t code, const char * message){
 
 void AsyncWebSocket::cleanupClients(uint16_t maxClients)
 {
+  AsyncWebLockGuard l(_lock);
   if (count() > maxClients){
     _clients.front()->close();
   }
 }
 
 void AsyncWebSocket::ping(uint32_t id, uint8_t *data, size_t len){
+  AsyncWebLockGuard l(_lock);
   AsyncWebSocketClient * c = client(id);
   if(c)
     c->ping(data, len);
 }
 
 void AsyncWebSocket::pingAll(uint8_t *data, size_t len){
+  AsyncWebLockGuard l(_lock);
   for(const auto& c: _clients){
     if(c->status() == WS_CONNECTED)
       c->ping(data, len);
@@ -940,12 +959,14 @@ void AsyncWebSocket::pingAll(uint8_t *data, size_t len){
 }
 
 void AsyncWebSocket::text(uint32_t id, const char * message, size_t len){
+  AsyncWebLockGuard l(_lock);
   AsyncWebSocketClient * c = client(id);
   if(c)
     c->text(message, len);
 }
 
 void AsyncWebSocket::textAll(AsyncWebSocketMessageBuffer * buffer){
+  AsyncWebLockGuard l(_lock);
   if (!buffer) return;
   buffer->lock(); 
   for(const auto& c: _clients){
@@ -964,6 +985,7 @@ void AsyncWebSocket::textAll(const char * message, size_t len){
 }
 
 void AsyncWebSocket::binary(uint32_t id, const char * message, size_t len){
+  AsyncWebLockGuard l(_lock);
   AsyncWebSocketClient * c = client(id);
   if(c)
     c->binary(message, len);
@@ -976,6 +998,7 @@ void AsyncWebSocket::binaryAll(const char * message, size_t len){
 
 void AsyncWebSocket::binaryAll(AsyncWebSocketMessageBuffer * buffer)
 {
+  AsyncWebLockGuard l(_lock);
   if (!buffer) return;
   buffer->lock(); 
     for(const auto& c: _clients){
@@ -987,12 +1010,14 @@ void AsyncWebSocket::binaryAll(AsyncWebSocketMessageBuffer * buffer)
 }
 
 void AsyncWebSocket::message(uint32_t id, AsyncWebSocketMessage *message){
+  AsyncWebLockGuard l(_lock);
   AsyncWebSocketClient * c = client(id);
   if(c)
     c->message(message);
 }
 
 void AsyncWebSocket::messageAll(AsyncWebSocketMultiMessage *message){
+  AsyncWebLockGuard l(_lock);
   for(const auto& c: _clients){
     if(c->status() == WS_CONNECTED)
       c->message(message);
@@ -1001,6 +1026,7 @@ void AsyncWebSocket::messageAll(AsyncWebSocketMultiMessage *message){
 }
 
 size_t AsyncWebSocket::printf(uint32_t id, const char *format, ...){
+  AsyncWebLockGuard l(_lock);
   AsyncWebSocketClient * c = client(id);
   if(c){
     va_list arg;
@@ -1036,8 +1062,9 @@ size_t AsyncWebSocket::printfAll(const char *format, ...) {
   return len;
 }
 
-#ifndef ESP32
+#if !defined(ESP32) && !defined(ARDUINO_HOST)
 size_t AsyncWebSocket::printf_P(uint32_t id, PGM_P formatP, ...){
+  AsyncWebLockGuard l(_lock);
   AsyncWebSocketClient * c = client(id);
   if(c != NULL){
     va_list arg;
@@ -1185,6 +1212,10 @@ void AsyncWebSocket::handleRequest(AsyncWebServerRequest *request){
     request->send(response);
     return;
   }
+  if(_clients.full()){
+    request->send(503);
+    return;
+  }
   AsyncWebHeader* key = request->getHeader(WS_STR_KEY);
   AsyncWebServerResponse *response = new AsyncWebSocketResponse(key->value(), this);
   if(request->hasHeader(WS_STR_PROTOCOL)){
@@ -1229,7 +1260,11 @@ void AsyncWebSocket::_cleanBuffers()
 }
 
 AsyncWebSocket::AsyncWebSocketClientLinkedList AsyncWebSocket::getClients() const {
-  return _clients;
+  AsyncWebLockGuard l(_lock);
+  AsyncWebSocketClientLinkedList clients(nullptr);
+  for(const auto& c: _clients)
+    clients.add(c);
+  return clients;
 }
 
 /*
@@ -22,7 +22,7 @@
 #define ASYNCWEBSOCKET_H_
 
 #include <Arduino.h>
-#ifdef ESP32
+#if defined(ESP32) || defined(ARDUINO_HOST)
 #include <AsyncTCP.h>
 #define WS_MAX_QUEUED_MESSAGES 32
 #else
@@ -32,6 +32,7 @@
 #include <ESPAsyncWebServer.h>
 
 #include "AsyncWebSynchronization.h"
+#include "AsyncClientRegistry.h"
 
 #ifdef ESP8266
 #include <Hash.h>
@@ -40,7 +41,7 @@
 #endif
 #endif
 
-#ifdef ESP32
+#if defined(ESP32) || defined(ARDUINO_HOST)
 #define DEFAULT_MAX_WS_CLIENTS 8
 #else
 #define DEFAULT_MAX_WS_CLIENTS 4
@@ -173,6 +174,7 @@ class AsyncWebSocketClient {
     void _queueMessage(AsyncWebSocketMessage *dataMessage);
     void _queueControl(AsyncWebSocketControl *controlMessage);
     void _runQueue();
+    void _setStatus(AwsClientStatus status);
 
   public:
     void *_tempObject;
@@ -180,7 +182,8 @@ class AsyncWebSocketClient {
     AsyncWebSocketClient(AsyncWebServerRequest *request, AsyncWebSocket *server);
     ~AsyncWebSocketClient();
 
-    //client id increments for the given server
+    //client id, unique for the given server while the client is connected
+    //and not given to another one until its slot wraps its generation count
     uint32_t id(){ return _clientId; }
     AwsClientStatus status(){ return _status; }
     AsyncClient* client(){ return _client; }
@@ -207,7 +210,7 @@ class AsyncWebSocketClient {
     bool queueIsFull();
 
     size_t printf(const char *format, ...)  __attribute__ ((format (printf, 2, 3)));
-#ifndef ESP32
+#if !defined(ESP32) && !defined(ARDUINO_HOST)
     size_t printf_P(PGM_P formatP, ...)  __attribute__ ((format (printf, 2, 3)));
 #endif
     void text(const char * message, size_t len);
@@ -245,12 +248,16 @@ class AsyncWebSocket: public AsyncWebHandler {
     typedef LinkedList<AsyncWebSocketClient *> AsyncWebSocketClientLinkedList;
   private:
     String _url;
-    AsyncWebSocketClientLinkedList _clients;
-    uint32_t _cNextId;
+    AsyncClientRegistry<AsyncWebSocketClient> _clients;   //under _lock
     AwsEventHandler _eventHandler;
     bool _enabled;
+    //held by the clients' AsyncTCP callbacks and by the calls below that
+    //reach clients, so those may come from any task; calls made on an
+    //AsyncWebSocketClient directly belong in the AsyncTCP task
     AsyncWebLock _lock;
 
+    friend class AsyncWebSocketClient;
+
   public:
     AsyncWebSocket(const String& url);
     ~AsyncWebSocket();
@@ -306,7 +313,7 @@ class AsyncWebSocket: public AsyncWebHandler {
 
     size_t printf(uint32_t id, const char *format, ...)  __attribute__ ((format (printf, 3, 4)));
     size_t printfAll(const char *format, ...)  __attribute__ ((format (printf, 2, 3)));
-#ifndef ESP32
+#if !defined(ESP32) && !defined(ARDUINO_HOST)
     size_t printf_P(uint32_t id, PGM_P formatP, ...)  __attribute__ ((format (printf, 3, 4)));
 #endif
     size_t printfAll_P(PGM_P formatP, ...)  __attribute__ ((format (printf, 2, 3)));
@@ -317,9 +324,9 @@ class AsyncWebSocket: public AsyncWebHandler {
     }
 
     //system callbacks (do not call)
-    uint32_t _getNextId(){ return _cNextId++; }
-    void _addClient(AsyncWebSocketClient * client);
+    uint32_t _addClient(AsyncWebSocketClient * client);
     void _handleDisconnect(AsyncWebSocketClient * client);
+    void _handleStatus(AsyncWebSocketClient * client, bool connected);
     void _handleEvent(AsyncWebSocketClient * client, AwsEventType type, void * arg, uint8_t *data, size_t len);
     virtual bool canHandle(AsyncWebServerRequest *request) override final;
     virtual void handleRequest(AsyncWebServerRequest *request) override final;
@@ -34,6 +34,9 @@
 #elif defined(ESP8266)
 #include <ESP8266WiFi.h>
 #include <ESPAsyncTCP.h>
+#elif defined(ARDUINO_HOST)
+#include <WiFi.h>
+#include <AsyncTCP.h>
 #else
 #error Platform not supported
 #endif
@@ -56,6 +59,7 @@ class AsyncWebHandler;
 class AsyncStaticWebHandler;
 class AsyncCallbackWebHandler;
 class AsyncResponseStream;
+class AsyncAbstractResponse;
 
 #ifndef WEBSERVER_H
 typedef enum {
@@ -73,6 +77,31 @@ typedef enum {
 //if this value is returned when asked for data, packet will not be sent and you will be asked for data again
 #define RESPONSE_TRY_AGAIN 0xFFFFFFFF
 
+//bytes available for one multipart part header line or non-file field value
+#ifndef MULTIPART_ARENA_SIZE
+#define MULTIPART_ARENA_SIZE 1024
+#endif
+
+//charged to the memory budget for every connection on top of the request
+//object itself: url, host, content type and the line being parsed
+#ifndef WEB_SERVER_REQUEST_OVERHEAD
+#define WEB_SERVER_REQUEST_OVERHEAD 512
+#endif
+
+//seconds a kept-alive connection may sit idle, and the number of requests
+//served over one connection before it is closed
+#ifndef WEB_SERVER_KEEPALIVE_TIMEOUT
+#define WEB_SERVER_KEEPALIVE_TIMEOUT 5
+#endif
+#ifndef WEB_SERVER_KEEPALIVE_MAX
+#define WEB_SERVER_KEEPALIVE_MAX 100
+#endif
+
+//bytes of pipelined requests held while the one before them is answered
+#ifndef WEB_SERVER_PIPELINE_SIZE
+#define WEB_SERVER_PIPELINE_SIZE 1460
+#endif
+
 typedef uint8_t WebRequestMethodComposite;
 typedef std::function<void(void)> ArDisconnectHandler;
 
@@ -147,6 +176,17 @@ class AsyncWebServerRequest {
     String _temp;
     uint8_t _parseState;
 
+    size_t _charged;
+    bool _probation;
+    bool _priority;
+    bool _overBudget;
+
+    bool _keepAlive;
+    bool _persistent;
+    uint16_t _served;
+    uint8_t *_pipelined;
+    size_t _pipelinedLength;
+
     uint8_t _version;
     WebRequestMethodComposite _method;
     String _url;
@@ -154,6 +194,10 @@ class AsyncWebServerRequest {
     String _contentType;
     String _boundary;
     String _authorization;
+    String _session;
+    String _setSession;
+    bool _staleNonce;
+    bool _acceptsGzip;
     RequestedConnectionType _reqconntype;
     void _removeNotInterestingHeaders();
     bool _isDigest;
@@ -174,7 +218,6 @@ class AsyncWebServerRequest {
     String _itemName;
     String _itemFilename;
     String _itemType;
-    String _itemValue;
     uint8_t *_itemBuffer;
     size_t _itemBufferIndex;
     bool _itemIsFile;
@@ -185,6 +228,8 @@ class AsyncWebServerRequest {
     void _onTimeout(uint32_t time);
     void _onDisconnect();
     void _onData(void *buf, size_t len);
+    void _pipeline(uint8_t *data, size_t len);
+    void _next();
 
     void _addParam(AsyncWebParameter*);
     void _addPathParam(const char *param);
@@ -193,17 +238,29 @@ class AsyncWebServerRequest {
     bool _parseReqHeader();
     void _parseLine();
     void _parsePlainPostChar(uint8_t data);
-    void _parseMultipartPostByte(uint8_t data, bool last);
+    void _parseMultipartPostBlock(uint8_t *data, size_t len);
+    size_t _parseMultipartHeaders(uint8_t *data, size_t len);
+    size_t _parseMultipartData(uint8_t *data, size_t len);
+    size_t _parseMultipartSuffix(uint8_t *data, size_t len);
+    void _parseMultipartHeader();
+    bool _multipartBegin();
+    void _multipartItemData(uint8_t *data, size_t len, bool final);
+    void _multipartItemEnd(uint8_t *data, size_t len);
     void _addGetParams(const String& params);
 
-    void _handleUploadStart();
-    void _handleUploadByte(uint8_t data, bool last);
-    void _handleUploadEnd();
-
   public:
     File _tempFile;
     void *_tempObject;
 
+    // Counts len bytes against the server's memory budget until the
+    // request ends; false if the budget cannot cover them.
+    bool _charge(size_t len);
+    // Called by responses that end on their own as they assemble the head;
+    // true if the connection is kept open for the next request
+    bool _persist(bool delimited);
+    // what _persist() decided for the response going out
+    bool _persisting() const { return _persistent; }
+
     AsyncWebServerRequest(AsyncWebServer*, AsyncClient*);
     ~AsyncWebServerRequest();
 
@@ -215,6 +272,7 @@ class AsyncWebServerRequest {
     const String& contentType() const { return _contentType; }
     size_t contentLength() const { return _contentLength; }
     bool multipart() const { return _isMultipart; }
+    bool acceptsGzip() const { return _acceptsGzip; }
     const char * methodToString() const;
     const char * requestedConnTypeToString() const;
     RequestedConnectionType requestedConnType() const { return _reqconntype; }
@@ -240,6 +298,8 @@ class AsyncWebServerRequest {
     void send(Stream &stream, const String& contentType, size_t len, AwsTemplateProcessor callback=nullptr);
     void send(const String& contentType, size_t len, AwsResponseFiller callback, AwsTemplateProcessor templateCallback=nullptr);
     void sendChunked(const String& contentType, AwsResponseFiller callback, AwsTemplateProcessor templateCallback=nullptr);
+    // as sendChunked(), gzip compressed on the fly if the client takes it
+    void sendChunkedGzip(const String& contentType, AwsResponseFiller callback, AwsTemplateProcessor templateCallback=nullptr);
     void send_P(int code, const String& contentType, const uint8_t * content, size_t len, AwsTemplateProcessor callback=nullptr);
     void send_P(int code, const String& contentType, PGM_P content, AwsTemplateProcessor callback=nullptr);
 
@@ -249,6 +309,9 @@ class AsyncWebServerRequest {
     AsyncWebServerResponse *beginResponse(Stream &stream, const String& contentType, size_t len, AwsTemplateProcessor callback=nullptr);
     AsyncWebServerResponse *beginResponse(const String& contentType, size_t len, AwsResponseFiller callback, AwsTemplateProcessor templateCallback=nullptr);
     AsyncWebServerResponse *beginChunkedResponse(const String& contentType, AwsResponseFiller callback, AwsTemplateProcessor templateCallback=nullptr);
+    // 'source' wrapped in an AsyncGzipResponse if the client takes gzip,
+    // otherwise 'source' itself
+    AsyncWebServerResponse *beginGzipResponse(AsyncAbstractResponse *source);
     AsyncResponseStream *beginResponseStream(const String& contentType, size_t bufferSize=1460);
     AsyncWebServerResponse *beginResponse_P(int code, const String& contentType, const uint8_t * content, size_t len, AwsTemplateProcessor callback=nullptr);
     AsyncWebServerResponse *beginResponse_P(int code, const String& contentType, PGM_P content, AwsTemplateProcessor callback=nullptr);
@@ -332,9 +395,13 @@ class AsyncWebHandler {
     ArRequestFilterFunction _filter;
     String _username;
     String _password;
+    bool _priority;
   public:
-    AsyncWebHandler():_username(""), _password(""){}
+    AsyncWebHandler():_username(""), _password(""), _priority(false){}
     AsyncWebHandler& setFilter(ArRequestFilterFunction fn) { _filter = fn; return *this; }
+    // priority requests may use the reserved part of the memory budget
+    AsyncWebHandler& setPriority(bool priority) { _priority = priority; return *this; }
+    bool isPriority() const { return _priority; }
     AsyncWebHandler& setAuthentication(const char *username, const char *password){  _username = String(username);_password = String(password); return *this; };
     bool filter(AsyncWebServerRequest *request){ return _filter == NULL || _filter(request); }
     virtual ~AsyncWebHandler(){}
@@ -394,6 +461,17 @@ typedef std::function<void(AsyncWebServerRequest *request)> ArRequestHandlerFunc
 typedef std::function<void(AsyncWebServerRequest *request, const String& filename, size_t index, uint8_t *data, size_t len, bool final)> ArUploadHandlerFunction;
 typedef std::function<void(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)> ArBodyHandlerFunction;
 
+typedef struct {
+  size_t budget;            // 0 if unlimited
+  size_t used;              // charged by the requests alive now
+  size_t peak;
+  uint32_t admitted;
+  uint32_t rejected;        // turned away with 503
+  uint32_t freeHeap;
+  uint32_t minFreeHeap;     // lowest free heap since boot
+  uint32_t largestFreeBlock;
+} AsyncWebServerStats;
+
 class AsyncWebServer {
   protected:
     AsyncServer _server;
@@ -401,6 +479,14 @@ class AsyncWebServer {
     LinkedList<AsyncWebHandler*> _handlers;
     AsyncCallbackWebHandler* _catchAllHandler;
 
+    size_t _memoryBudget;
+    size_t _memoryReserve;
+    size_t _memoryUsed;
+    size_t _memoryPeak;
+    size_t _heapFloor;
+    uint32_t _admitted;
+    uint32_t _rejected;
+
   public:
     AsyncWebServer(uint16_t port);
     ~AsyncWebServer();
@@ -432,6 +518,17 @@ class AsyncWebServer {
     void onRequestBody(ArBodyHandlerFunction fn); //handle posts with plain body content (JSON often transmitted this way as a request)
 
     void reset(); //remove all writers and handlers, with onNotFound/onFileUpload/onRequestBody 
+
+    // Bytes all requests together may hold; the last 'reserve' of them only
+    // for requests to priority handlers.  0 disables accounting.
+    void setMemoryBudget(size_t budget, size_t reserve = 0);
+    // Turn connections away while the largest free heap block is smaller
+    void setHeapFloor(size_t largestFreeBlock){ _heapFloor = largestFreeBlock; }
+    AsyncWebServerStats stats() const;
+
+    bool _charge(size_t len, bool priority);
+    void _release(size_t len);
+    void _reject(AsyncClient *client);
   
     void _handleDisconnect(AsyncWebServerRequest *request);
     void _attachHandler(AsyncWebServerRequest *request);
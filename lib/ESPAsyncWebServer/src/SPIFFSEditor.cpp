@@ -1,5 +1,6 @@
 #include "SPIFFSEditor.h"
 #include <FS.h>
+#include <memory>
 
 //File: edit.htm.gz, Size: 4151
 #define edit_htm_gz_len 4151
@@ -318,6 +319,15 @@ static bool addExclude(const char *item){
     return true;
 }
 
+static void freeExcludeList(){
+    while(excludes){
+        ExcludeList *e = excludes;
+        excludes = e->next;
+        free(e->item);
+        free(e);
+    }
+}
+
 static void loadExcludeList(fs::FS &_fs, const char *filename){
     static char linebuf[SPIFFS_MAXLENGTH_FILEPATH];
     fs::File excludeFile=_fs.open(filename, "r");
@@ -325,7 +335,7 @@ static void loadExcludeList(fs::FS &_fs, const char *filename){
         //addExclude("/*.js.gz");
         return;
     }
-#ifdef ESP32
+#if defined(ESP32) || defined(ARDUINO_HOST)
     if(excludeFile.isDirectory()){
       excludeFile.close();
       return;
@@ -360,10 +370,7 @@ static void loadExcludeList(fs::FS &_fs, const char *filename){
     excludeFile.close();
 }
 
-static bool isExcluded(fs::FS &_fs, const char *filename) {
-  if(excludes == NULL){
-      loadExcludeList(_fs, excludeListFile);
-  }
+static bool isExcluded(const char *filename) {
   ExcludeList *e = excludes;
   while(e){
     if (matchWild(e->item, filename)){
@@ -374,9 +381,109 @@ static bool isExcluded(fs::FS &_fs, const char *filename) {
   return false;
 }
 
+// DIRECTORY LISTING
+
+// One ?list= response.  Entries are read from the directory as the chunk
+// callback asks for them, so the listing takes the same memory however many
+// files there are; an entry that does not fit into one chunk waits in
+// 'pending' for the next one.
+#define LIST_ENTRY_SIZE (SPIFFS_MAXLENGTH_FILEPATH + 64)
+
+struct ListState {
+#if defined(ESP32) || defined(ARDUINO_HOST)
+  fs::File dir;
+#else
+  Dir dir;
+#endif
+  size_t skip;      // entries still to skip for 'offset'
+  size_t left;      // entries still to send for 'limit'
+  bool started;
+  bool first;
+  bool done;
+  char pending[LIST_ENTRY_SIZE];
+  size_t pendingLen;
+  size_t pendingPos;
+};
+
+// formats the next entry into pending, false at the end of the listing
+static bool listNext(ListState *state){
+  while(state->left){
+#if defined(ESP32) || defined(ARDUINO_HOST)
+    // the ESP32 core opens every entry it returns, so this is one open per
+    // file; only ESP8266's Dir gives names and sizes without opening them
+    fs::File entry = state->dir.openNextFile();
+    if(!entry)
+      return false;
+    const char *name = entry.name();
+    size_t size = entry.size();
+#else
+    if(!state->dir.next())
+      return false;
+    String fileName = state->dir.fileName();
+    const char *name = fileName.c_str();
+    size_t size = state->dir.fileSize();
+#endif
+    if(isExcluded(name))
+      continue;
+    if(state->skip){
+      state->skip--;
+      continue;
+    }
+    int len = snprintf(state->pending, LIST_ENTRY_SIZE, "%s{\"type\":\"file\",\"name\":\"%s\",\"size\":%u}",
+                       state->first ? "" : ",", name, (unsigned)size);
+    if(len < 0 || len >= LIST_ENTRY_SIZE)
+      continue; // a name longer than the file system allows
+    state->first = false;
+    state->left--;
+    state->pendingLen = len;
+    state->pendingPos = 0;
+    return true;
+  }
+  return false;
+}
+
+// a missing or negative parameter gives 'otherwise'
+static size_t listParam(AsyncWebServerRequest *request, const char *name, size_t otherwise){
+  if(!request->hasParam(name))
+    return otherwise;
+  long value = request->getParam(name)->value().toInt();
+  return value < 0 ? otherwise : (size_t)value;
+}
+
+static size_t listFill(ListState *state, uint8_t *buf, size_t maxLen){
+  size_t len = 0;
+  while(len < maxLen){
+    if(state->pendingPos < state->pendingLen){
+      size_t n = state->pendingLen - state->pendingPos;
+      if(n > maxLen - len)
+        n = maxLen - len;
+      memcpy(buf + len, state->pending + state->pendingPos, n);
+      state->pendingPos += n;
+      len += n;
+      continue;
+    }
+    if(state->done)
+      break;
+    state->pendingPos = 0;
+    if(!state->started){
+      state->started = true;
+      state->pending[0] = '[';
+      state->pendingLen = 1;
+    } else if(!listNext(state)){
+      state->done = true;
+      state->pending[0] = ']';
+      state->pendingLen = 1;
+#if defined(ESP32) || defined(ARDUINO_HOST)
+      state->dir.close();
+#endif
+    }
+  }
+  return len;
+}
+
 // WEB HANDLER IMPLEMENTATION
 
-#ifdef ESP32
+#if defined(ESP32) || defined(ARDUINO_HOST)
 SPIFFSEditor::SPIFFSEditor(const fs::FS& fs, const String& username, const String& password)
 #else
 SPIFFSEditor::SPIFFSEditor(const String& username, const String& password, const fs::FS& fs)
@@ -398,7 +505,7 @@ bool SPIFFSEditor::canHandle(AsyncWebServerRequest *request){
         if(!request->_tempFile){
           return false;
         }
-#ifdef ESP32
+#if defined(ESP32) || defined(ARDUINO_HOST)
         if(request->_tempFile.isDirectory()){
           request->_tempFile.close();
           return false;
@@ -410,7 +517,7 @@ bool SPIFFSEditor::canHandle(AsyncWebServerRequest *request){
         if(!request->_tempFile){
           return false;
         }
-#ifdef ESP32
+#if defined(ESP32) || defined(ARDUINO_HOST)
         if(request->_tempFile.isDirectory()){
           request->_tempFile.close();
           return false;
@@ -438,47 +545,28 @@ void SPIFFSEditor::handleRequest(AsyncWebServerRequest *request){
 
   if(request->method() == HTTP_GET){
     if(request->hasParam("list")){
-      String path = request->getParam("list")->value();
-#ifdef ESP32
-      File dir = _fs.open(path);
-#else
-      Dir dir = _fs.openDir(path);
-#endif
-      path = String();
-      String output = "[";
-#ifdef ESP32
-      File entry = dir.openNextFile();
-      while(entry){
-#else
-      while(dir.next()){
-        fs::File entry = dir.openFile("r");
-#endif
-        if (isExcluded(_fs, entry.name())) {
-#ifdef ESP32
-            entry = dir.openNextFile();
-#endif
-            continue;
-        }
-        if (output != "[") output += ',';
-        output += "{\"type\":\"";
-        output += "file";
-        output += "\",\"name\":\"";
-        output += String(entry.name());
-        output += "\",\"size\":";
-        output += String(entry.size());
-        output += "}";
-#ifdef ESP32
-        entry = dir.openNextFile();
+      // ?list=/dir&offset=N&limit=M, both optional
+      // read for every listing, so an exclude file written since the last
+      // one counts; that is one open per listing, not per entry
+      freeExcludeList();
+      loadExcludeList(_fs, excludeListFile);
+      std::shared_ptr<ListState> state(new ListState());
+#if defined(ESP32) || defined(ARDUINO_HOST)
+      state->dir = _fs.open(request->getParam("list")->value());
 #else
-        entry.close();
-#endif
-      }
-#ifdef ESP32
-      dir.close();
+      state->dir = _fs.openDir(request->getParam("list")->value());
 #endif
-      output += "]";
-      request->send(200, "application/json", output);
-      output = String();
+      state->skip = listParam(request, "offset", 0);
+      state->left = listParam(request, "limit", SIZE_MAX);
+      state->started = false;
+      state->first = true;
+      state->done = false;
+      state->pendingLen = 0;
+      state->pendingPos = 0;
+      request->sendChunked("application/json", [state](uint8_t *buf, size_t maxLen, size_t index) -> size_t {
+        (void)index;
+        return listFill(state.get(), buf, maxLen);
+      });
     }
     else if(request->hasParam("edit") || request->hasParam("download")){
       request->send(request->_tempFile, request->_tempFile.name(), String(), request->hasParam("download"));
@@ -24,150 +24,259 @@
 #include "stddef.h"
 #include "WString.h"
 
-template <typename T>
-class LinkedListNode {
-    T _value;
-  public:
-    LinkedListNode<T>* next;
-    LinkedListNode(const T val): _value(val), next(nullptr) {}
-    ~LinkedListNode(){}
-    const T& value() const { return _value; };
-    T& value(){ return _value; }
-};
+#include <functional>
+#include <utility>
 
-template <typename T, template<typename> class Item = LinkedListNode>
+// An ordered list of values kept in slots: the first N inside the list
+// itself, more in one heap array that doubles as needed.  length() is a
+// counter, and removing from the front of a queue only moves its start.
+// remove() and remove_first() search from the front, so taking the front
+// of a queue finds it at once; any other value costs a scan of the slots
+// before it, as with the node list this replaced.
+//
+// While an iterator is alive, remove() only marks the slot dead and
+// iteration skips it; the list closes the gaps when the last iterator is
+// gone.  add() during iteration appends past the end and is reached by
+// the loop, but may move the slots, so hold no reference across it.
+// Assignment during iteration removes every value and adds the new ones,
+// so the loop goes on with those.
+template <typename T, size_t N = 4>
 class LinkedList {
   public:
-    typedef Item<T> ItemType;
     typedef std::function<void(const T&)> OnRemove;
     typedef std::function<bool(const T&)> Predicate;
   private:
-    ItemType* _root;
+    struct Slot {
+      T value;
+      bool live;
+      Slot(): value(), live(false) {}
+    };
+
+    Slot _inline[N];
+    Slot* _slots;
+    size_t _capacity;
+    size_t _begin;
+    size_t _end;
+    size_t _length;
+    mutable size_t _iterating;
     OnRemove _onRemove;
 
     class Iterator {
-      ItemType* _node;
+      const LinkedList* _list;
+      size_t _index;
+      void _skip(){
+        while(_index < _list->_end && !_list->_slots[_index].live)
+          _index++;
+      }
+      bool _atEnd() const { return !_list || _index >= _list->_end; }
     public:
-      Iterator(ItemType* current = nullptr) : _node(current) {}
-      Iterator(const Iterator& i) : _node(i._node) {}
-      Iterator& operator ++() { _node = _node->next; return *this; }
-      bool operator != (const Iterator& i) const { return _node != i._node; }
-      const T& operator * () const { return _node->value(); }
-      const T* operator -> () const { return &_node->value(); }
+      Iterator(const LinkedList* list = nullptr, size_t index = 0) : _list(list), _index(index) {
+        if(_list){
+          _list->_iterating++;
+          _skip();
+        }
+      }
+      Iterator(const Iterator& i) : _list(i._list), _index(i._index) {
+        if(_list)
+          _list->_iterating++;
+      }
+      ~Iterator(){
+        if(_list)
+          _list->_release();
+      }
+      Iterator& operator = (const Iterator& i){
+        if(i._list)
+          i._list->_iterating++;
+        if(_list)
+          _list->_release();
+        _list = i._list;
+        _index = i._index;
+        return *this;
+      }
+      Iterator& operator ++() { _index++; _skip(); return *this; }
+      bool operator != (const Iterator& i) const {
+        if(_atEnd() || i._atEnd())
+          return _atEnd() != i._atEnd();
+        return _index != i._index;
+      }
+      const T& operator * () const { return _list->_slots[_index].value; }
+      const T* operator -> () const { return &_list->_slots[_index].value; }
     };
-    
+
+    void _release() const {
+      if(!--_iterating && _length != _end - _begin)
+        const_cast<LinkedList*>(this)->_compact();
+    }
+
+    // drops leading and trailing dead slots and closes the gaps between
+    // the live ones; only when no iterator is alive and there are some
+    void _compact(){
+      while(_begin < _end && !_slots[_begin].live)
+        _begin++;
+      while(_end > _begin && !_slots[_end - 1].live)
+        _end--;
+      if(_length != _end - _begin){
+        size_t to = _begin;
+        for(size_t from = _begin; from < _end; from++){
+          if(!_slots[from].live)
+            continue;
+          if(to != from){
+            _slots[to].value = std::move(_slots[from].value);
+            _slots[to].live = true;
+            _slots[from].value = T();
+            _slots[from].live = false;
+          }
+          to++;
+        }
+        _end = to;
+      }
+      if(!_length)
+        _begin = _end = 0;
+    }
+
+    // slots keep their index, iterators stay valid
+    void _grow(){
+      size_t capacity = _capacity * 2;
+      Slot* slots = new Slot[capacity];
+      for(size_t i = _begin; i < _end; i++){
+        slots[i].value = std::move(_slots[i].value);
+        slots[i].live = _slots[i].live;
+      }
+      if(_slots != _inline)
+        delete[] _slots;
+      _slots = slots;
+      _capacity = capacity;
+    }
+
+    void _removeAt(size_t i){
+      _slots[i].live = false;
+      _length--;
+      // the callback may come back to this list; keep the slots in place
+      _iterating++;
+      if(_onRemove)
+        _onRemove(_slots[i].value);
+      _slots[i].value = T();
+      _release();
+    }
+
   public:
     typedef const Iterator ConstIterator;
-    ConstIterator begin() const { return ConstIterator(_root); }
-    ConstIterator end() const { return ConstIterator(nullptr); }
+    ConstIterator begin() const { return ConstIterator(this, _begin); }
+    ConstIterator end() const { return ConstIterator(); }
+
+    LinkedList(OnRemove onRemove) : _slots(_inline), _capacity(N), _begin(0), _end(0), _length(0), _iterating(0), _onRemove(onRemove) {}
+    LinkedList(const LinkedList& l) : _slots(_inline), _capacity(N), _begin(0), _end(0), _length(0), _iterating(0), _onRemove(l._onRemove) {
+      for(const auto& t: l)
+        add(t);
+    }
+    ~LinkedList(){
+      if(_slots != _inline)
+        delete[] _slots;
+    }
+    LinkedList& operator = (const LinkedList& l){
+      if(this == &l)
+        return *this;
+      for(size_t i = _begin; i < _end; i++){
+        _slots[i].value = T();
+        _slots[i].live = false;
+      }
+      _length = 0;
+      // live iterators stand in these slots; the last one compacts them
+      if(!_iterating)
+        _begin = _end = 0;
+      _onRemove = l._onRemove;
+      for(const auto& t: l)
+        add(t);
+      return *this;
+    }
 
-    LinkedList(OnRemove onRemove) : _root(nullptr), _onRemove(onRemove) {}
-    ~LinkedList(){}
     void add(const T& t){
-      auto it = new ItemType(t);
-      if(!_root){
-        _root = it;
-      } else {
-        auto i = _root;
-        while(i->next) i = i->next;
-        i->next = it;
+      if(_end == _capacity){
+        if(_begin && !_iterating){
+          // room freed at the front of a queue
+          for(size_t i = _begin; i < _end; i++){
+            _slots[i - _begin].value = std::move(_slots[i].value);
+            _slots[i - _begin].live = _slots[i].live;
+            _slots[i].value = T();
+            _slots[i].live = false;
+          }
+          _end -= _begin;
+          _begin = 0;
+        } else {
+          _grow();
+        }
       }
+      _slots[_end].value = t;
+      _slots[_end].live = true;
+      _end++;
+      _length++;
     }
     T& front() const {
-      return _root->value();
+      size_t i = _begin;
+      while(!_slots[i].live)
+        i++;
+      return _slots[i].value;
     }
-    
+
     bool isEmpty() const {
-      return _root == nullptr;
+      return _length == 0;
     }
     size_t length() const {
-      size_t i = 0;
-      auto it = _root;
-      while(it){
-        i++;
-        it = it->next;
-      }
-      return i;
+      return _length;
     }
     size_t count_if(Predicate predicate) const {
+      if(!predicate)
+        return _length;
       size_t i = 0;
-      auto it = _root;
-      while(it){
-        if (!predicate){
-          i++;
-        }
-        else if (predicate(it->value())) {
+      for(const auto& t: *this){
+        if(predicate(t))
           i++;
-        }
-        it = it->next;
       }
       return i;
     }
-    const T* nth(size_t N) const {
-      size_t i = 0;
-      auto it = _root;
-      while(it){
-        if(i++ == N)
-          return &(it->value());
-        it = it->next;
+    const T* nth(size_t index) const {
+      if(index >= _length)
+        return nullptr;
+      if(_length == _end - _begin)
+        return &_slots[_begin + index].value;
+      for(size_t i = _begin; i < _end; i++){
+        if(_slots[i].live && !index--)
+          return &_slots[i].value;
       }
       return nullptr;
     }
     bool remove(const T& t){
-      auto it = _root;
-      auto pit = _root;
-      while(it){
-        if(it->value() == t){
-          if(it == _root){
-            _root = _root->next;
-          } else {
-            pit->next = it->next;
-          }
-          
-          if (_onRemove) {
-            _onRemove(it->value());
-          }
-          
-          delete it;
+      for(size_t i = _begin; i < _end; i++){
+        if(_slots[i].live && _slots[i].value == t){
+          _removeAt(i);
           return true;
         }
-        pit = it;
-        it = it->next;
       }
       return false;
     }
     bool remove_first(Predicate predicate){
-      auto it = _root;
-      auto pit = _root;
-      while(it){
-        if(predicate(it->value())){
-          if(it == _root){
-            _root = _root->next;
-          } else {
-            pit->next = it->next;
-          }
-          if (_onRemove) {
-            _onRemove(it->value());
-          }
-          delete it;
+      for(size_t i = _begin; i < _end; i++){
+        if(_slots[i].live && predicate(_slots[i].value)){
+          _removeAt(i);
           return true;
         }
-        pit = it;
-        it = it->next;
       }
       return false;
     }
-    
+
+    // removes every value; the heap array is kept for the next ones
     void free(){
-      while(_root != nullptr){
-        auto it = _root;
-        _root = _root->next;
-        if (_onRemove) {
-          _onRemove(it->value());
-        }
-        delete it;
+      _iterating++;
+      for(size_t i = _begin; i < _end; i++){
+        if(!_slots[i].live)
+          continue;
+        _slots[i].live = false;
+        _length--;
+        if(_onRemove)
+          _onRemove(_slots[i].value);
+        _slots[i].value = T();
       }
-      _root = nullptr;
+      _release();
     }
 };
 
@@ -20,93 +20,164 @@
 */
 #include "WebAuthentication.h"
 #include <libb64/cencode.h>
-#ifdef ESP32
+#if defined(ESP32) || defined(ARDUINO_HOST)
 #include "mbedtls/md5.h"
 #else
 #include "md5.h"
 #endif
 
+// Credentials are looked up in a small cache that holds everything derived
+// from them (HA1, the Basic token), so a request costs string compares and
+// the MD5s that depend on the request itself.  Digest nonces are issued from
+// and checked against a bounded table, which also tracks the nonce count of
+// each one.  A successful login is remembered with a session cookie tagged
+// with HMAC-MD5 under a key drawn at boot.
 
-// Basic Auth hash = base64("username:password")
-
-bool checkBasicAuthentication(const char * hash, const char * username, const char * password){
-  if(username == NULL || password == NULL || hash == NULL)
-    return false;
+#if defined(ESP32) || defined(ARDUINO_HOST)
+typedef mbedtls_md5_context md5_ctx;
+static void md5Begin(md5_ctx *ctx){ mbedtls_md5_init(ctx); mbedtls_md5_starts_ret(ctx); }
+static void md5Add(md5_ctx *ctx, const void *data, size_t len){ mbedtls_md5_update_ret(ctx, (const uint8_t*)data, len); }
+static void md5End(md5_ctx *ctx, uint8_t *out){ mbedtls_md5_finish_ret(ctx, out); mbedtls_md5_free(ctx); }
+#else
+typedef md5_context_t md5_ctx;
+static void md5Begin(md5_ctx *ctx){ MD5Init(ctx); }
+static void md5Add(md5_ctx *ctx, const void *data, size_t len){ MD5Update(ctx, (const uint8_t*)data, len); }
+static void md5End(md5_ctx *ctx, uint8_t *out){ MD5Final(out, ctx); }
+#endif
 
-  size_t toencodeLen = strlen(username)+strlen(password)+1;
-  size_t encodedLen = base64_encode_expected_len(toencodeLen);
-  if(strlen(hash) != encodedLen)
-    return false;
+static const char HEX_DIGITS[] = "0123456789abcdef";
 
-  char *toencode = new char[toencodeLen+1];
-  if(toencode == NULL){
-    return false;
-  }
-  char *encoded = new char[base64_encode_expected_len(toencodeLen)+1];
-  if(encoded == NULL){
-    delete[] toencode;
-    return false;
+static void toHex(const uint8_t *data, size_t len, char *out){//2*len+1 bytes
+  for(size_t i = 0; i < len; i++){
+    out[i * 2] = HEX_DIGITS[data[i] >> 4];
+    out[i * 2 + 1] = HEX_DIGITS[data[i] & 15];
   }
-  sprintf(toencode, "%s:%s", username, password);
-  if(base64_encode_chars(toencode, toencodeLen, encoded) > 0 && memcmp(hash, encoded, encodedLen) == 0){
-    delete[] toencode;
-    delete[] encoded;
-    return true;
+  out[len * 2] = 0;
+}
+
+static int hexValue(char c){
+  if(c >= '0' && c <= '9') return c - '0';
+  if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+static bool fromHex(const char *hex, size_t len, uint8_t *out){
+  for(size_t i = 0; i < len; i += 2){
+    int h = hexValue(hex[i]), l = hexValue(hex[i + 1]);
+    if(h < 0 || l < 0)
+      return false;
+    out[i / 2] = (h << 4) | l;
   }
-  delete[] toencode;
-  delete[] encoded;
-  return false;
+  return true;
 }
 
-static bool getMD5(uint8_t * data, uint16_t len, char * output){//33 bytes or more
-#ifdef ESP32
-    mbedtls_md5_context _ctx;
-#else
-    md5_context_t _ctx;
-#endif
-  uint8_t i;
-  uint8_t * _buf = (uint8_t*)malloc(16);
-  if(_buf == NULL)
-    return false;
-  memset(_buf, 0x00, 16);
+// does not stop at the first difference
+static bool sameBytes(const void *a, const void *b, size_t len){
+  const uint8_t *x = (const uint8_t*)a, *y = (const uint8_t*)b;
+  uint8_t d = 0;
+  for(size_t i = 0; i < len; i++)
+    d |= x[i] ^ y[i];
+  return d == 0;
+}
+
+static void randomBytes(uint8_t *out, size_t len){
+  for(size_t i = 0; i < len; i += 4){
 #ifdef ESP32
-  mbedtls_md5_init(&_ctx);
-  mbedtls_md5_starts_ret(&_ctx);
-  mbedtls_md5_update_ret(&_ctx, data, len);
-  mbedtls_md5_finish_ret(&_ctx, _buf);
+    uint32_t r = esp_random();
+#elif defined(ESP8266)
+    uint32_t r = RANDOM_REG32;
 #else
-  MD5Init(&_ctx);
-  MD5Update(&_ctx, data, len);
-  MD5Final(_buf, &_ctx);
+    uint32_t r = rand();
 #endif
-  for(i = 0; i < 16; i++) {
-    sprintf(output + (i * 2), "%02x", _buf[i]);
+    memcpy(out + i, &r, (len - i < 4) ? len - i : 4);
   }
-  free(_buf);
+}
+
+static bool getMD5(uint8_t * data, uint16_t len, char * output){//33 bytes or more
+  md5_ctx ctx;
+  uint8_t digest[16];
+  md5Begin(&ctx);
+  md5Add(&ctx, data, len);
+  md5End(&ctx, digest);
+  toHex(digest, 16, output);
   return true;
 }
 
-static String genRandomMD5(){
-#ifdef ESP8266
-  uint32_t r = RANDOM_REG32;
-#else
-  uint32_t r = rand();
-#endif
-  char * out = (char*)malloc(33);
-  if(out == NULL || !getMD5((uint8_t*)(&r), 4, out))
-    return "";
-  String res = String(out);
-  free(out);
-  return res;
+/*
+ * Credential cache
+ * */
+
+struct AuthCredential {
+  String username;
+  String password;
+  String realm;
+  bool isHash;
+  char ha1[33];       // hex MD5(username:realm:password)
+  String basic;       // base64(username:password), built on first use
+};
+
+static AuthCredential credentials[WEB_AUTH_CREDENTIALS];
+static uint8_t credentialsNext = 0;
+
+static AuthCredential *findCredential(const char *username, const char *password, const char *realm, bool isHash){
+  for(uint8_t i = 0; i < WEB_AUTH_CREDENTIALS; i++){
+    AuthCredential *c = &credentials[i];
+    if(c->isHash == isHash && c->username.equals(username) && c->password.equals(password) && c->realm.equals(realm))
+      return c;
+  }
+  AuthCredential *c = &credentials[credentialsNext];
+  credentialsNext = (credentialsNext + 1) % WEB_AUTH_CREDENTIALS;
+  c->username = username;
+  c->password = password;
+  c->realm = realm;
+  c->isHash = isHash;
+  c->basic = String();
+  if(isHash){
+    // the password is the HA1 already
+    strncpy(c->ha1, password, 32);
+    c->ha1[32] = 0;
+  } else {
+    md5_ctx ctx;
+    uint8_t digest[16];
+    md5Begin(&ctx);
+    md5Add(&ctx, username, strlen(username));
+    md5Add(&ctx, ":", 1);
+    md5Add(&ctx, realm, strlen(realm));
+    md5Add(&ctx, ":", 1);
+    md5Add(&ctx, password, strlen(password));
+    md5End(&ctx, digest);
+    toHex(digest, 16, c->ha1);
+  }
+  return c;
 }
 
-static String stringMD5(const String& in){
-  char * out = (char*)malloc(33);
-  if(out == NULL || !getMD5((uint8_t*)(in.c_str()), in.length(), out))
-    return "";
-  String res = String(out);
-  free(out);
-  return res;
+// Basic Auth hash = base64("username:password")
+
+bool checkBasicAuthentication(const char * hash, const char * username, const char * password){
+  if(username == NULL || password == NULL || hash == NULL)
+    return false;
+
+  AuthCredential *c = findCredential(username, password, "", false);
+  if(!c->basic.length()){
+    size_t toencodeLen = strlen(username)+strlen(password)+1;
+    char *toencode = new char[toencodeLen+1];
+    if(toencode == NULL){
+      return false;
+    }
+    char *encoded = new char[base64_encode_expected_len(toencodeLen)+1];
+    if(encoded == NULL){
+      delete[] toencode;
+      return false;
+    }
+    sprintf(toencode, "%s:%s", username, password);
+    if(base64_encode_chars(toencode, toencodeLen, encoded) > 0)
+      c->basic = String(encoded);
+    delete[] toencode;
+    delete[] encoded;
+  }
+  size_t len = c->basic.length();
+  return len && strlen(hash) == len && sameBytes(hash, c->basic.c_str(), len);
 }
 
 String generateDigestHash(const char * username, const char * password, const char * realm){
@@ -127,109 +198,305 @@ String generateDigestHash(const char * username, const char * password, const ch
   return res;
 }
 
-String requestDigestAuthentication(const char * realm){
-  String header = "realm=\"";
+/*
+ * Nonce table
+ * */
+
+struct AuthNonce {
+  uint8_t nonce[16];
+  uint32_t realm;     // FNV-1a of the realm it was issued for
+  uint32_t issued;    // millis()
+  uint32_t count;     // highest nonce count accepted so far
+  bool used;
+};
+
+static AuthNonce nonces[WEB_AUTH_NONCES];
+static char digestOpaque[33];
+
+static uint32_t realmHash(const char *s, size_t len){
+  uint32_t h = 2166136261UL;
+  for(size_t i = 0; i < len; i++){
+    h ^= (uint8_t)s[i];
+    h *= 16777619UL;
+  }
+  return h;
+}
+
+String requestDigestAuthentication(const char * realm, bool stale){
   if(realm == NULL)
-    header.concat("asyncesp");
-  else
-    header.concat(realm);
-  header.concat( "\", qop=\"auth\", nonce=\"");
-  header.concat(genRandomMD5());
+    realm = "asyncesp";
+  if(!digestOpaque[0]){
+    uint8_t r[16];
+    randomBytes(r, 16);
+    toHex(r, 16, digestOpaque);
+  }
+
+  // reuse a free slot, else the oldest one
+  AuthNonce *n = &nonces[0];
+  uint32_t now = millis();
+  for(uint8_t i = 0; i < WEB_AUTH_NONCES; i++){
+    if(!nonces[i].used){
+      n = &nonces[i];
+      break;
+    }
+    if(now - nonces[i].issued > now - n->issued)
+      n = &nonces[i];
+  }
+  randomBytes(n->nonce, 16);
+  n->realm = realmHash(realm, strlen(realm));
+  n->issued = now;
+  n->count = 0;
+  n->used = true;
+
+  char nonce[33];
+  toHex(n->nonce, 16, nonce);
+  String header = "realm=\"";
+  header.concat(realm);
+  header.concat("\", qop=\"auth\", nonce=\"");
+  header.concat(nonce);
   header.concat("\", opaque=\"");
-  header.concat(genRandomMD5());
+  header.concat(digestOpaque);
   header.concat("\"");
+  if(stale)
+    header.concat(", stale=true");
   return header;
 }
 
-bool checkDigestAuthentication(const char * header, const char * method, const char * username, const char * password, const char * realm, bool passwordIsHash, const char * nonce, const char * opaque, const char * uri){
+/*
+ * Digest verification
+ * */
+
+struct DigestField {
+  const char *value;
+  size_t len;
+};
+
+static bool fieldIs(const DigestField &f, const char *s){
+  return s == NULL || (f.value && strlen(s) == f.len && !memcmp(f.value, s, f.len));
+}
+
+// Splits 'name="value", name=value, ...' in place of the header
+static bool parseDigest(const char *p, DigestField *fields, const char * const *names, uint8_t count){
+  while(*p){
+    while(*p == ' ' || *p == ',')
+      p++;
+    if(!*p)
+      break;
+    const char *name = p;
+    while(*p && *p != '=')
+      p++;
+    if(*p != '=')
+      return false;
+    size_t nameLen = p - name;
+    const char *value = ++p;
+    size_t len;
+    if(*p == '"'){
+      value = ++p;
+      while(*p && *p != '"')
+        p++;
+      if(*p != '"')
+        return false;
+      len = p++ - value;
+    } else {
+      while(*p && *p != ',' && *p != ' ')
+        p++;
+      len = p - value;
+    }
+    for(uint8_t i = 0; i < count; i++){
+      if(strlen(names[i]) == nameLen && !memcmp(name, names[i], nameLen)){
+        fields[i].value = value;
+        fields[i].len = len;
+      }
+    }
+  }
+  return true;
+}
+
+enum { F_USERNAME, F_REALM, F_NONCE, F_OPAQUE, F_URI, F_RESPONSE, F_QOP, F_NC, F_CNONCE, F_COUNT };
+static const char * const DIGEST_FIELDS[F_COUNT] = { "username", "realm", "nonce", "opaque", "uri", "response", "qop", "nc", "cnonce" };
+
+// response = MD5(HA1:nonce:nc:cnonce:qop:HA2), or MD5(HA1:nonce:HA2) without qop
+static void digestResponse(const char *ha1, const DigestField *f, const char *method, char *out){
+  md5_ctx ctx;
+  uint8_t digest[16];
+  char ha2[33];
+
+  md5Begin(&ctx);
+  md5Add(&ctx, method, strlen(method));
+  md5Add(&ctx, ":", 1);
+  md5Add(&ctx, f[F_URI].value, f[F_URI].len);
+  md5End(&ctx, digest);
+  toHex(digest, 16, ha2);
+
+  md5Begin(&ctx);
+  md5Add(&ctx, ha1, 32);
+  md5Add(&ctx, ":", 1);
+  md5Add(&ctx, f[F_NONCE].value, f[F_NONCE].len);
+  md5Add(&ctx, ":", 1);
+  if(f[F_QOP].len){
+    md5Add(&ctx, f[F_NC].value, f[F_NC].len);
+    md5Add(&ctx, ":", 1);
+    md5Add(&ctx, f[F_CNONCE].value, f[F_CNONCE].len);
+    md5Add(&ctx, ":", 1);
+    md5Add(&ctx, f[F_QOP].value, f[F_QOP].len);
+    md5Add(&ctx, ":", 1);
+  }
+  md5Add(&ctx, ha2, 32);
+  md5End(&ctx, digest);
+  toHex(digest, 16, out);
+}
+
+bool checkDigestAuthentication(const char * header, const char * method, const char * username, const char * password, const char * realm, bool passwordIsHash, const char * nonce, const char * opaque, const char * uri, bool * stale){
+  if(stale != NULL)
+    *stale = false;
   if(username == NULL || password == NULL || header == NULL || method == NULL){
     //os_printf("AUTH FAIL: missing requred fields\n");
     return false;
   }
 
-  String myHeader = String(header);
-  int nextBreak = myHeader.indexOf(",");
-  if(nextBreak < 0){
-    //os_printf("AUTH FAIL: no variables\n");
+  DigestField f[F_COUNT];
+  memset(f, 0, sizeof(f));
+  if(!parseDigest(header, f, DIGEST_FIELDS, F_COUNT)){
+    //os_printf("AUTH FAIL: malformed header\n");
+    return false;
+  }
+  if(!f[F_USERNAME].value || !f[F_REALM].value || !f[F_NONCE].value || !f[F_URI].value || f[F_RESPONSE].len != 32){
+    //os_printf("AUTH FAIL: missing fields\n");
+    return false;
+  }
+  if(f[F_QOP].len && (!f[F_NC].value || !f[F_CNONCE].value)){
+    return false;
+  }
+  if(!fieldIs(f[F_USERNAME], username) || !fieldIs(f[F_REALM], realm) || !fieldIs(f[F_URI], uri)
+     || (f[F_OPAQUE].value && !fieldIs(f[F_OPAQUE], opaque))){
+    //os_printf("AUTH FAIL: username, realm, uri or opaque\n");
     return false;
   }
 
-  String myUsername = String();
-  String myRealm = String();
-  String myNonce = String();
-  String myUri = String();
-  String myResponse = String();
-  String myQop = String();
-  String myNc = String();
-  String myCnonce = String();
-
-  myHeader += ", ";
-  do {
-    String avLine = myHeader.substring(0, nextBreak);
-    avLine.trim();
-    myHeader = myHeader.substring(nextBreak+1);
-    nextBreak = myHeader.indexOf(",");
-
-    int eqSign = avLine.indexOf("=");
-    if(eqSign < 0){
-      //os_printf("AUTH FAIL: no = sign\n");
+  // a nonce handed in by the caller is trusted as it is, any other one
+  // must be ours, fresh and used with a growing nonce count
+  AuthNonce *n = NULL;
+  uint32_t count = 0;
+  if(nonce != NULL){
+    if(!fieldIs(f[F_NONCE], nonce))
       return false;
+  } else {
+    uint8_t raw[16];
+    if(f[F_NONCE].len != 32 || !fromHex(f[F_NONCE].value, 32, raw))
+      return false;
+    for(uint8_t i = 0; i < WEB_AUTH_NONCES && n == NULL; i++){
+      if(nonces[i].used && !memcmp(nonces[i].nonce, raw, 16))
+        n = &nonces[i];
     }
-    String varName = avLine.substring(0, eqSign);
-    avLine = avLine.substring(eqSign + 1);
-    if(avLine.startsWith("\"")){
-      avLine = avLine.substring(1, avLine.length() - 1);
+    if(n != NULL && n->realm != realmHash(f[F_REALM].value, f[F_REALM].len)){
+      //os_printf("AUTH FAIL: realm of the nonce\n");
+      return false;
     }
-
-    if(varName.equals("username")){
-      if(!avLine.equals(username)){
-        //os_printf("AUTH FAIL: username\n");
-        return false;
-      }
-      myUsername = avLine;
-    } else if(varName.equals("realm")){
-      if(realm != NULL && !avLine.equals(realm)){
-        //os_printf("AUTH FAIL: realm\n");
-        return false;
-      }
-      myRealm = avLine;
-    } else if(varName.equals("nonce")){
-      if(nonce != NULL && !avLine.equals(nonce)){
-        //os_printf("AUTH FAIL: nonce\n");
-        return false;
-      }
-      myNonce = avLine;
-    } else if(varName.equals("opaque")){
-      if(opaque != NULL && !avLine.equals(opaque)){
-        //os_printf("AUTH FAIL: opaque\n");
+    if(n != NULL && f[F_QOP].len){
+      char nc[9];
+      if(f[F_NC].len != 8)
         return false;
-      }
-    } else if(varName.equals("uri")){
-      if(uri != NULL && !avLine.equals(uri)){
-        //os_printf("AUTH FAIL: uri\n");
+      memcpy(nc, f[F_NC].value, 8);
+      nc[8] = 0;
+      count = strtoul(nc, NULL, 16);
+      if(count <= n->count){
+        //os_printf("AUTH FAIL: replayed nonce count\n");
         return false;
       }
-      myUri = avLine;
-    } else if(varName.equals("response")){
-      myResponse = avLine;
-    } else if(varName.equals("qop")){
-      myQop = avLine;
-    } else if(varName.equals("nc")){
-      myNc = avLine;
-    } else if(varName.equals("cnonce")){
-      myCnonce = avLine;
     }
-  } while(nextBreak > 0);
+  }
+
+  char realmBuf[65];
+  if(f[F_REALM].len >= sizeof(realmBuf))
+    return false;
+  memcpy(realmBuf, f[F_REALM].value, f[F_REALM].len);
+  realmBuf[f[F_REALM].len] = 0;
+  AuthCredential *c = findCredential(username, password, realmBuf, passwordIsHash);
+
+  char response[33];
+  digestResponse(c->ha1, f, method, response);
+  if(!sameBytes(response, f[F_RESPONSE].value, 32)){
+    //os_printf("AUTH FAIL: password\n");
+    return false;
+  }
+
+  // right password with an old or forgotten nonce (reboot, table full):
+  // stale=true in the next challenge lets the client retry without asking
+  if(nonce == NULL && (n == NULL || millis() - n->issued > WEB_AUTH_NONCE_LIFETIME * 1000UL)){
+    //os_printf("AUTH FAIL: stale nonce\n");
+    if(n != NULL)
+      n->used = false;
+    if(stale != NULL)
+      *stale = true;
+    return false;
+  }
+  if(n != NULL)
+    n->count = count;
+  //os_printf("AUTH SUCCESS\n");
+  return true;
+}
+
+/*
+ * Session cookie: expiry (8 hex) followed by
+ * HMAC-MD5(key, expiry | MD5(username:realm:password)) (32 hex)
+ * */
 
-  String ha1 = (passwordIsHash) ? String(password) : stringMD5(myUsername + ":" + myRealm + ":" + String(password));
-  String ha2 = String(method) + ":" + myUri;
-  String response = ha1 + ":" + myNonce + ":" + myNc + ":" + myCnonce + ":" + myQop + ":" + stringMD5(ha2);
+static md5_ctx sessionInner;
+static md5_ctx sessionOuter;
+static bool sessionReady = false;
 
-  if(myResponse.equals(stringMD5(response))){
-    //os_printf("AUTH SUCCESS\n");
-    return true;
+static void sessionTag(uint32_t expiry, AuthCredential *c, char *out){
+  if(!sessionReady){
+    uint8_t key[64], pad[64];
+    randomBytes(key, 16);
+    memset(key + 16, 0, 48);
+    for(uint8_t i = 0; i < 64; i++) pad[i] = key[i] ^ 0x36;
+    md5Begin(&sessionInner);
+    md5Add(&sessionInner, pad, 64);
+    for(uint8_t i = 0; i < 64; i++) pad[i] = key[i] ^ 0x5c;
+    md5Begin(&sessionOuter);
+    md5Add(&sessionOuter, pad, 64);
+    sessionReady = true;
   }
+  uint8_t digest[16];
+  md5_ctx ctx = sessionInner;
+  md5Add(&ctx, &expiry, 4);
+  md5Add(&ctx, c->ha1, 32);
+  md5End(&ctx, digest);
+  ctx = sessionOuter;
+  md5Add(&ctx, digest, 16);
+  md5End(&ctx, digest);
+  toHex(digest, 16, out);
+}
+
+String authSessionCookie(const char * username, const char * password, const char * realm, bool passwordIsHash){
+  if(username == NULL || password == NULL)
+    return String();
+  AuthCredential *c = findCredential(username, password, realm ? realm : "", passwordIsHash);
+  uint32_t expiry = millis() / 1000 + WEB_AUTH_SESSION_LIFETIME;
+  char value[41];
+  uint8_t be[4] = { (uint8_t)(expiry >> 24), (uint8_t)(expiry >> 16), (uint8_t)(expiry >> 8), (uint8_t)expiry };
+  toHex(be, 4, value);
+  sessionTag(expiry, c, value + 8);
+
+  String cookie = WEB_AUTH_COOKIE "=";
+  cookie.concat(value);
+  cookie.concat("; Path=/; HttpOnly; Max-Age=");
+  cookie.concat(String(WEB_AUTH_SESSION_LIFETIME));
+  return cookie;
+}
 
-  //os_printf("AUTH FAIL: password\n");
-  return false;
+bool checkAuthSessionCookie(const char * session, const char * username, const char * password, const char * realm, bool passwordIsHash){
+  if(session == NULL || username == NULL || password == NULL || strlen(session) != 40)
+    return false;
+  uint8_t be[4];
+  if(!fromHex(session, 8, be))
+    return false;
+  uint32_t expiry = ((uint32_t)be[0] << 24) | ((uint32_t)be[1] << 16) | ((uint32_t)be[2] << 8) | be[3];
+  if((int32_t)(expiry - millis() / 1000) <= 0)
+    return false;
+  AuthCredential *c = findCredential(username, password, realm ? realm : "", passwordIsHash);
+  char tag[33];
+  sessionTag(expiry, c, tag);
+  return sameBytes(tag, session + 8, 32);
 }
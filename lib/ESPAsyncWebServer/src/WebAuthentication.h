@@ -24,9 +24,37 @@
 
 #include "Arduino.h"
 
+//credentials whose HA1 and Basic token are kept
+#ifndef WEB_AUTH_CREDENTIALS
+#define WEB_AUTH_CREDENTIALS 4
+#endif
+
+//digest nonces tracked at once, and how long (in seconds) one is accepted
+#ifndef WEB_AUTH_NONCES
+#define WEB_AUTH_NONCES 8
+#endif
+#ifndef WEB_AUTH_NONCE_LIFETIME
+#define WEB_AUTH_NONCE_LIFETIME 300
+#endif
+
+//name and lifetime (in seconds) of the session cookie set after a login,
+//0 to not set one
+#ifndef WEB_AUTH_COOKIE
+#define WEB_AUTH_COOKIE "ESPSESSION"
+#endif
+#ifndef WEB_AUTH_SESSION_LIFETIME
+#define WEB_AUTH_SESSION_LIFETIME 3600
+#endif
+
 bool checkBasicAuthentication(const char * header, const char * username, const char * password);
-String requestDigestAuthentication(const char * realm);
-bool checkDigestAuthentication(const char * header, const char * method, const char * username, const char * password, const char * realm, bool passwordIsHash, const char * nonce, const char * opaque, const char * uri);
+String requestDigestAuthentication(const char * realm, bool stale = false);
+//with nonce NULL the nonce must come from requestDigestAuthentication();
+//stale is set if only the nonce was wrong
+bool checkDigestAuthentication(const char * header, const char * method, const char * username, const char * password, const char * realm, bool passwordIsHash, const char * nonce, const char * opaque, const char * uri, bool * stale = NULL);
+
+//Set-Cookie value remembering a login, and its check
+String authSessionCookie(const char * username, const char * password, const char * realm, bool passwordIsHash);
+bool checkAuthSessionCookie(const char * session, const char * username, const char * password, const char * realm, bool passwordIsHash);
 
 //for storing hashed versions on the device that can be authenticated against
 String generateDigestHash(const char * username, const char * password, const char * realm);
@@ -128,7 +128,7 @@ bool AsyncStaticWebHandler::_getFile(AsyncWebServerRequest *request)
   return _fileExists(request, path);
 }
 
-#ifdef ESP32
+#if defined(ESP32) || defined(ARDUINO_HOST)
 #define FILE_IS_REAL(f) (f == true && !f.isDirectory())
 #else
 #define FILE_IS_REAL(f) (f == true)
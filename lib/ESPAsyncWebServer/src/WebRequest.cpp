@@ -39,6 +39,15 @@ AsyncWebServerRequest::AsyncWebServerRequest(AsyncWebServer* s, AsyncClient* c)
   , _response(NULL)
   , _temp()
   , _parseState(0)
+  , _charged(0)
+  , _probation(false)
+  , _priority(false)
+  , _overBudget(false)
+  , _keepAlive(false)
+  , _persistent(false)
+  , _served(0)
+  , _pipelined(NULL)
+  , _pipelinedLength(0)
   , _version(0)
   , _method(HTTP_ANY)
   , _url()
@@ -46,6 +55,10 @@ AsyncWebServerRequest::AsyncWebServerRequest(AsyncWebServer* s, AsyncClient* c)
   , _contentType()
   , _boundary()
   , _authorization()
+  , _session()
+  , _setSession()
+  , _staleNonce(false)
+  , _acceptsGzip(false)
   , _reqconntype(RCT_HTTP)
   , _isDigest(false)
   , _isMultipart(false)
@@ -63,7 +76,6 @@ AsyncWebServerRequest::AsyncWebServerRequest(AsyncWebServer* s, AsyncClient* c)
   , _itemName()
   , _itemFilename()
   , _itemType()
-  , _itemValue()
   , _itemBuffer(0)
   , _itemBufferIndex(0)
   , _itemIsFile(false)
@@ -96,13 +108,147 @@ AsyncWebServerRequest::~AsyncWebServerRequest(){
   if(_tempFile){
     _tempFile.close();
   }
+
+  if(_itemBuffer){
+    free(_itemBuffer);
+  }
+
+  if(_pipelined){
+    free(_pipelined);
+  }
+
+  _server->_release(_charged);
+}
+
+bool AsyncWebServerRequest::_charge(size_t len){
+  // a request on probation only survives its headers if it is a priority one
+  if(!_server->_charge(len, _priority || _probation))
+    return false;
+  _charged += len;
+  return true;
+}
+
+bool AsyncWebServerRequest::_persist(bool delimited){
+  // a response sent before the body is in leaves the rest of the body
+  // unread on the connection, so that one closes too
+  _persistent = _keepAlive && delimited && _parseState == PARSE_REQ_END;
+  return _persistent;
+}
+
+void AsyncWebServerRequest::_pipeline(uint8_t *data, size_t len){
+  if(!_keepAlive)
+    return;
+  if(!_pipelined){
+    if(!_charge(WEB_SERVER_PIPELINE_SIZE)){
+      _keepAlive = false;
+      return;
+    }
+    _pipelined = (uint8_t*)malloc(WEB_SERVER_PIPELINE_SIZE);
+    if(!_pipelined){
+      _keepAlive = false;
+      return;
+    }
+  }
+  if(_pipelinedLength + len > WEB_SERVER_PIPELINE_SIZE){
+    // more than we can hold: answer this request, then close
+    _keepAlive = false;
+    return;
+  }
+  // while replaying, data is the unparsed tail of _pipelined itself
+  memmove(_pipelined + _pipelinedLength, data, len);
+  _pipelinedLength += len;
+}
+
+// The response is out: the same client and request object take the next
+// request, starting with whatever was pipelined behind this one.
+void AsyncWebServerRequest::_next(){
+  AsyncWebServerResponse* r = _response;
+  _response = NULL;
+  delete r;
+
+  if(!_keepAlive || ++_served >= WEB_SERVER_KEEPALIVE_MAX){
+    _client->close();
+    return;
+  }
+
+  _headers.free();
+  _params.free();
+  _pathParams.free();
+  _interestingHeaders.free();
+  _onDisconnectfn = nullptr;
+  if(_tempObject != NULL){
+    free(_tempObject);
+    _tempObject = NULL;
+  }
+  if(_tempFile){
+    _tempFile.close();
+  }
+  if(_itemBuffer){
+    free(_itemBuffer);
+    _itemBuffer = NULL;
+  }
+
+  // everything but the connection itself goes back to the budget
+  size_t kept = sizeof(AsyncWebServerRequest) + WEB_SERVER_REQUEST_OVERHEAD;
+  if(_pipelined)
+    kept += WEB_SERVER_PIPELINE_SIZE;
+  if(_charged > kept){
+    _server->_release(_charged - kept);
+    _charged = kept;
+  }
+
+  _handler = NULL;
+  _temp = String();
+  _parseState = PARSE_REQ_START;
+  _priority = false;
+  _overBudget = false;
+  _keepAlive = false;
+  _persistent = false;
+  _version = 0;
+  _method = HTTP_ANY;
+  _url = String();
+  _host = String();
+  _contentType = String();
+  _boundary = String();
+  _authorization = String();
+  _session = String();
+  _setSession = String();
+  _staleNonce = false;
+  _acceptsGzip = false;
+  _reqconntype = RCT_HTTP;
+  _isDigest = false;
+  _isMultipart = false;
+  _isPlainPost = false;
+  _expectingContinue = false;
+  _contentLength = 0;
+  _parsedLength = 0;
+  _multiParseState = 0;
+  _boundaryPosition = 0;
+  _itemStartIndex = 0;
+  _itemSize = 0;
+  _itemName = String();
+  _itemFilename = String();
+  _itemType = String();
+  _itemBufferIndex = 0;
+  _itemIsFile = false;
+
+  // the ack that completed the response restarted the rx timer
+  _client->setRxTimeout(WEB_SERVER_KEEPALIVE_TIMEOUT);
+  if(_pipelinedLength){
+    size_t len = _pipelinedLength;
+    _pipelinedLength = 0;
+    _onData(_pipelined, len);
+  }
 }
 
 void AsyncWebServerRequest::_onData(void *buf, size_t len){
   size_t i = 0;
   while (true) {
 
-  if(_parseState < PARSE_REQ_BODY){
+  if(_parseState == PARSE_REQ_END){
+    // the next request, sent before this one is answered
+    _pipeline((uint8_t*)buf, len);
+  } else if(_parseState < PARSE_REQ_BODY){
     // Find new line in buf
     char *str = (char*)buf;
     for (i = 0; i < len; i++) {
@@ -129,16 +275,18 @@ void AsyncWebServerRequest::_onData(void *buf, size_t len){
       }
     }
   } else if(_parseState == PARSE_REQ_BODY){
+    // bytes past the body belong to the next request
+    size_t rest = 0;
+    if(len > _contentLength - _parsedLength){
+      rest = len - (_contentLength - _parsedLength);
+      len -= rest;
+    }
     // A handler should be already attached at this point in _parseLine function.
     // If handler does nothing (_onRequest is NULL), we don't need to really parse the body.
     const bool needParse = _handler && !_handler->isRequestHandlerTrivial();
     if(_isMultipart){
       if(needParse){
-        size_t i;
-        for(i=0; i<len; i++){
-          _parseMultipartPostByte(((uint8_t*)buf)[i], i == len - 1);
-          _parsedLength++;
-        }
+        _parseMultipartPostBlock((uint8_t*)buf, len);
       } else
           _parsedLength += len;
     } else {
@@ -173,6 +321,11 @@ void AsyncWebServerRequest::_onData(void *buf, size_t len){
       if(_handler) _handler->handleRequest(this);
       else send(501);
     }
+    if(rest){
+      buf = (uint8_t*)buf + len;
+      len = rest;
+      continue;
+    }
   }
   break;
   }
@@ -190,7 +343,10 @@ void AsyncWebServerRequest::_removeNotInterestingHeaders(){
 void AsyncWebServerRequest::_onPoll(){
   //os_printf("p\n");
   if(_response != NULL && _client != NULL && _client->canSend() && !_response->_finished()){
+    bool persistent = _persistent;
     _response->_ack(this, 0, 0);
+    if(persistent && _response->_finished() && !_response->_failed())
+      _next();
   }
 }
 
@@ -198,7 +354,12 @@ void AsyncWebServerRequest::_onAck(size_t len, uint32_t time){
   //os_printf("a:%u:%u\n", len, time);
   if(_response != NULL){
     if(!_response->_finished()){
+      // only check back on persistent responses: upgrades hand the client
+      // over and delete this request from within _ack()
+      bool persistent = _persistent;
       _response->_ack(this, len, time);
+      if(persistent && _response->_finished() && !_response->_failed())
+        _next();
     } else {
       AsyncWebServerResponse* r = _response;
       _response = NULL;
@@ -286,6 +447,8 @@ bool AsyncWebServerRequest::_parseReqHead(){
 
   if(!_temp.startsWith("HTTP/1.0"))
     _version = 1;
+  // HTTP/1.1 connections persist unless the client says otherwise
+  _keepAlive = _version == 1;
 
   _temp = String();
   return true;
@@ -309,6 +472,28 @@ bool strContains(String src, String find, bool mindcase = true) {
   return false;
 }
 
+// true if 'coding' is listed in an Accept-Encoding value and not with q=0
+static bool acceptsCoding(const String& value, const char *coding){
+  int start = 0;
+  while(start < (int)value.length()){
+    int end = value.indexOf(',', start);
+    if(end < 0)
+      end = value.length();
+    String item = value.substring(start, end);
+    start = end + 1;
+    int params = item.indexOf(';');
+    String name = params < 0 ? item : item.substring(0, params);
+    name.trim();
+    if(!name.equalsIgnoreCase(coding))
+      continue;
+    if(params < 0)
+      return true;
+    int q = item.indexOf("q=", params);
+    return q < 0 || atof(item.c_str() + q + 2) > 0;
+  }
+  return false;
+}
+
 bool AsyncWebServerRequest::_parseReqHeader(){
   int index = _temp.indexOf(':');
   if(index){
@@ -325,6 +510,13 @@ bool AsyncWebServerRequest::_parseReqHeader(){
       }
     } else if(name.equalsIgnoreCase("Content-Length")){
       _contentLength = atoi(value.c_str());
+    } else if(name.equalsIgnoreCase("Connection")){
+      if(strContains(value, "close", false))
+        _keepAlive = false;
+      else if(strContains(value, "keep-alive", false))
+        _keepAlive = true;
+    } else if(name.equalsIgnoreCase("Accept-Encoding")){
+      _acceptsGzip = acceptsCoding(value, "gzip");
     } else if(name.equalsIgnoreCase("Expect") && value == "100-continue"){
       _expectingContinue = true;
     } else if(name.equalsIgnoreCase("Authorization")){
@@ -334,6 +526,13 @@ bool AsyncWebServerRequest::_parseReqHeader(){
         _isDigest = true;
         _authorization = value.substring(7);
       }
+    } else if(name.equalsIgnoreCase("Cookie")){
+      int start = value.indexOf(WEB_AUTH_COOKIE "=");
+      if(start == 0 || (start > 0 && (value[start - 1] == ' ' || value[start - 1] == ';'))){
+        start += sizeof(WEB_AUTH_COOKIE);
+        int end = value.indexOf(';', start);
+        _session = (end < 0) ? value.substring(start) : value.substring(start, end);
+      }
     } else {
       if(name.equalsIgnoreCase("Upgrade") && value.equalsIgnoreCase("websocket")){
         // WebSocket request can be uniquely identified by header: [Upgrade: websocket]
@@ -345,7 +544,12 @@ bool AsyncWebServerRequest::_parseReqHeader(){
         }
       }
     }
-    _headers.add(new AsyncWebHeader(name, value));
+    // over budget: keep parsing, the request is answered with 503 once
+    // the headers are complete
+    if(_charge(sizeof(AsyncWebHeader) + name.length() + value.length()))
+      _headers.add(new AsyncWebHeader(name, value));
+    else
+      _overBudget = true;
   }
   _temp = String();
   return true;
@@ -366,189 +570,280 @@ void AsyncWebServerRequest::_parsePlainPostChar(uint8_t data){
   }
 }
 
-void AsyncWebServerRequest::_handleUploadByte(uint8_t data, bool last){
-  _itemBuffer[_itemBufferIndex++] = data;
+// Multipart bodies are scanned a whole received block at a time.  The
+// delimiter "\r\n--boundary" is searched with Boyer-Moore-Horspool; the
+// first one in the body comes without the CRLF, so the scan starts as if
+// that had already been seen.  A delimiter split over two blocks is
+// carried in _boundaryPosition (how many of its bytes ended the previous
+// block).  File data goes to handleUpload() straight out of the received
+// buffer, part headers and field values into a bounded arena.
+//
+// _itemBuffer layout: [skip table 256][delimiter][arena]
 
-  if(last || _itemBufferIndex == 1460){
-    //check if authenticated before calling the upload
-    if(_handler)
-      _handler->handleUpload(this, _itemFilename, _itemSize - _itemBufferIndex, _itemBuffer, _itemBufferIndex, false);
-    _itemBufferIndex = 0;
-  }
-}
+#define MULTIPART_SKIP_SIZE 256
+#define MULTIPART_BOUNDARY_MAX 70 // RFC 2046
+#define MULTIPART_DELIMITER_MAX 76 // "\r\n--" and the boundary, rounded up
 
 enum {
   EXPECT_BOUNDARY,
   PARSE_HEADERS,
-  WAIT_FOR_RETURN1,
-  EXPECT_FEED1,
-  EXPECT_DASH1,
-  EXPECT_DASH2,
-  BOUNDARY_OR_DATA,
-  DASH3_OR_RETURN2,
-  EXPECT_FEED2,
+  PARSE_DATA,
+  BOUNDARY_SUFFIX,
   PARSING_FINISHED,
   PARSE_ERROR
 };
 
-void AsyncWebServerRequest::_parseMultipartPostByte(uint8_t data, bool last){
-#define itemWriteByte(b) do { _itemSize++; if(_itemIsFile) _handleUploadByte(b, last); else _itemValue+=(char)(b); } while(0)
+static const uint8_t * _findDelimiter(const uint8_t *data, size_t len, const uint8_t *delim, size_t dlen, const uint8_t *skip){
+  if(len < dlen)
+    return NULL;
+  const uint8_t last = delim[dlen - 1];
+  size_t i = 0;
+  while(i <= len - dlen){
+    uint8_t c = data[i + dlen - 1];
+    if(c == last && memcmp(data + i, delim, dlen - 1) == 0)
+      return data + i;
+    i += skip[c];
+  }
+  return NULL;
+}
 
-  if(!_parsedLength){
-    _multiParseState = EXPECT_BOUNDARY;
-    _temp = String();
-    _itemName = String();
-    _itemFilename = String();
-    _itemType = String();
+bool AsyncWebServerRequest::_multipartBegin(){
+  size_t dlen = _boundary.length() + 4;
+  if(!_boundary.length() || _boundary.length() > MULTIPART_BOUNDARY_MAX)
+    return false;
+  if(!_itemBuffer){
+    if(!_charge(MULTIPART_SKIP_SIZE + MULTIPART_DELIMITER_MAX + MULTIPART_ARENA_SIZE))
+      return false;
+    _itemBuffer = (uint8_t*)malloc(MULTIPART_SKIP_SIZE + MULTIPART_DELIMITER_MAX + MULTIPART_ARENA_SIZE);
   }
+  if(!_itemBuffer)
+    return false;
 
-  if(_multiParseState == WAIT_FOR_RETURN1){
-    if(data != '\r'){
-      itemWriteByte(data);
-    } else {
-      _multiParseState = EXPECT_FEED1;
+  uint8_t *skip = _itemBuffer;
+  uint8_t *delim = _itemBuffer + MULTIPART_SKIP_SIZE;
+  memcpy(delim, "\r\n--", 4);
+  memcpy(delim + 4, _boundary.c_str(), _boundary.length());
+  memset(skip, dlen, MULTIPART_SKIP_SIZE);
+  for(size_t i = 0; i < dlen - 1; i++)
+    skip[delim[i]] = dlen - 1 - i;
+
+  _multiParseState = EXPECT_BOUNDARY;
+  _boundaryPosition = 2;
+  _itemBufferIndex = 0;
+  _itemIsFile = false;
+  _temp = String();
+  _itemName = String();
+  _itemFilename = String();
+  _itemType = String();
+  return true;
+}
+
+void AsyncWebServerRequest::_multipartItemData(uint8_t *data, size_t len, bool final){
+  if(_multiParseState != PARSE_DATA)
+    return; // preamble
+  if(_itemIsFile){
+    if(len || (final && _itemSize)){
+      //check if authenticated before calling the upload
+      if(_handler) _handler->handleUpload(this, _itemFilename, _itemSize, data, len, final);
     }
-  } else if(_multiParseState == EXPECT_BOUNDARY){
-    if(_parsedLength < 2 && data != '-'){
-      _multiParseState = PARSE_ERROR;
-      return;
-    } else if(_parsedLength - 2 < _boundary.length() && _boundary.c_str()[_parsedLength - 2] != data){
-      _multiParseState = PARSE_ERROR;
-      return;
-    } else if(_parsedLength - 2 == _boundary.length() && data != '\r'){
+    _itemSize += len;
+  } else {
+    // keep room for the terminator
+    if(_itemBufferIndex + len >= MULTIPART_ARENA_SIZE){
       _multiParseState = PARSE_ERROR;
       return;
-    } else if(_parsedLength - 3 == _boundary.length()){
-      if(data != '\n'){
-        _multiParseState = PARSE_ERROR;
-        return;
-      }
-      _multiParseState = PARSE_HEADERS;
-      _itemIsFile = false;
-    }
-  } else if(_multiParseState == PARSE_HEADERS){
-    if((char)data != '\r' && (char)data != '\n')
-       _temp += (char)data;
-    if((char)data == '\n'){
-      if(_temp.length()){
-        if(_temp.length() > 12 && _temp.substring(0, 12).equalsIgnoreCase("Content-Type")){
-          _itemType = _temp.substring(14);
-          _itemIsFile = true;
-        } else if(_temp.length() > 19 && _temp.substring(0, 19).equalsIgnoreCase("Content-Disposition")){
-          _temp = _temp.substring(_temp.indexOf(';') + 2);
-          while(_temp.indexOf(';') > 0){
-            String name = _temp.substring(0, _temp.indexOf('='));
-            String nameVal = _temp.substring(_temp.indexOf('=') + 2, _temp.indexOf(';') - 1);
-            if(name == "name"){
-              _itemName = nameVal;
-            } else if(name == "filename"){
-              _itemFilename = nameVal;
-              _itemIsFile = true;
-            }
-            _temp = _temp.substring(_temp.indexOf(';') + 2);
-          }
-          String name = _temp.substring(0, _temp.indexOf('='));
-          String nameVal = _temp.substring(_temp.indexOf('=') + 2, _temp.length() - 1);
-          if(name == "name"){
-            _itemName = nameVal;
-          } else if(name == "filename"){
-            _itemFilename = nameVal;
-            _itemIsFile = true;
-          }
-        }
-        _temp = String();
-      } else {
-        _multiParseState = WAIT_FOR_RETURN1;
-        //value starts from here
-        _itemSize = 0;
-        _itemStartIndex = _parsedLength;
-        _itemValue = String();
-        if(_itemIsFile){
-          if(_itemBuffer)
-            free(_itemBuffer);
-          _itemBuffer = (uint8_t*)malloc(1460);
-          if(_itemBuffer == NULL){
-            _multiParseState = PARSE_ERROR;
-            return;
-          }
-          _itemBufferIndex = 0;
-        }
-      }
     }
-  } else if(_multiParseState == EXPECT_FEED1){
-    if(data != '\n'){
-      _multiParseState = WAIT_FOR_RETURN1;
-      itemWriteByte('\r'); _parseMultipartPostByte(data, last);
-    } else {
-      _multiParseState = EXPECT_DASH1;
+    memcpy(_itemBuffer + MULTIPART_SKIP_SIZE + MULTIPART_DELIMITER_MAX + _itemBufferIndex, data, len);
+    _itemBufferIndex += len;
+    _itemSize += len;
+  }
+}
+
+void AsyncWebServerRequest::_multipartItemEnd(uint8_t *data, size_t len){
+  _multipartItemData(data, len, true);
+  if(_multiParseState == PARSE_DATA){
+    if(!_itemIsFile){
+      char *arena = (char*)_itemBuffer + MULTIPART_SKIP_SIZE + MULTIPART_DELIMITER_MAX;
+      arena[_itemBufferIndex] = 0;
+      _addParam(new AsyncWebParameter(_itemName, String(arena), true));
+    } else if(_itemSize){
+      _addParam(new AsyncWebParameter(_itemName, _itemFilename, true, true, _itemSize));
     }
-  } else if(_multiParseState == EXPECT_DASH1){
-    if(data != '-'){
-      _multiParseState = WAIT_FOR_RETURN1;
-      itemWriteByte('\r'); itemWriteByte('\n');  _parseMultipartPostByte(data, last);
-    } else {
-      _multiParseState = EXPECT_DASH2;
+  }
+  if(_multiParseState != PARSE_ERROR){
+    _multiParseState = BOUNDARY_SUFFIX;
+    _boundaryPosition = 0;
+  }
+}
+
+void AsyncWebServerRequest::_parseMultipartHeader(){
+  if(_temp.length() > 12 && _temp.substring(0, 12).equalsIgnoreCase("Content-Type")){
+    _itemType = _temp.substring(14);
+    _itemIsFile = true;
+  } else if(_temp.length() > 19 && _temp.substring(0, 19).equalsIgnoreCase("Content-Disposition")){
+    _temp = _temp.substring(_temp.indexOf(';') + 2);
+    while(_temp.indexOf(';') > 0){
+      String name = _temp.substring(0, _temp.indexOf('='));
+      String nameVal = _temp.substring(_temp.indexOf('=') + 2, _temp.indexOf(';') - 1);
+      if(name == "name"){
+        _itemName = nameVal;
+      } else if(name == "filename"){
+        _itemFilename = nameVal;
+        _itemIsFile = true;
+      }
+      _temp = _temp.substring(_temp.indexOf(';') + 2);
     }
-  } else if(_multiParseState == EXPECT_DASH2){
-    if(data != '-'){
-      _multiParseState = WAIT_FOR_RETURN1;
-      itemWriteByte('\r'); itemWriteByte('\n'); itemWriteByte('-');  _parseMultipartPostByte(data, last);
-    } else {
-      _multiParseState = BOUNDARY_OR_DATA;
-      _boundaryPosition = 0;
+    String name = _temp.substring(0, _temp.indexOf('='));
+    String nameVal = _temp.substring(_temp.indexOf('=') + 2, _temp.length() - 1);
+    if(name == "name"){
+      _itemName = nameVal;
+    } else if(name == "filename"){
+      _itemFilename = nameVal;
+      _itemIsFile = true;
     }
-  } else if(_multiParseState == BOUNDARY_OR_DATA){
-    if(_boundaryPosition < _boundary.length() && _boundary.c_str()[_boundaryPosition] != data){
-      _multiParseState = WAIT_FOR_RETURN1;
-      itemWriteByte('\r'); itemWriteByte('\n'); itemWriteByte('-');  itemWriteByte('-');
-      uint8_t i;
-      for(i=0; i<_boundaryPosition; i++)
-        itemWriteByte(_boundary.c_str()[i]);
-      _parseMultipartPostByte(data, last);
-    } else if(_boundaryPosition == _boundary.length() - 1){
-      _multiParseState = DASH3_OR_RETURN2;
-      if(!_itemIsFile){
-        _addParam(new AsyncWebParameter(_itemName, _itemValue, true));
-      } else {
-        if(_itemSize){
-          //check if authenticated before calling the upload
-          if(_handler) _handler->handleUpload(this, _itemFilename, _itemSize - _itemBufferIndex, _itemBuffer, _itemBufferIndex, true);
-          _itemBufferIndex = 0;
-          _addParam(new AsyncWebParameter(_itemName, _itemFilename, true, true, _itemSize));
-        }
-        free(_itemBuffer);
-        _itemBuffer = NULL;
-      }
+  }
+  _temp = String();
+}
 
-    } else {
-      _boundaryPosition++;
+// returns the number of bytes used, up to and including the end of a line
+size_t AsyncWebServerRequest::_parseMultipartHeaders(uint8_t *data, size_t len){
+  uint8_t *eol = (uint8_t*)memchr(data, '\n', len);
+  size_t used = eol ? eol - data + 1 : len;
+  size_t n = eol ? eol - data : len;
+  if(n && data[n - 1] == '\r')
+    n--;
+
+  char *arena = (char*)_itemBuffer + MULTIPART_SKIP_SIZE + MULTIPART_DELIMITER_MAX;
+  if(_itemBufferIndex + n >= MULTIPART_ARENA_SIZE){
+    _multiParseState = PARSE_ERROR;
+    return used;
+  }
+  memcpy(arena + _itemBufferIndex, data, n);
+  _itemBufferIndex += n;
+  // a CR split from its LF by the block end
+  if(_itemBufferIndex && arena[_itemBufferIndex - 1] == '\r' && eol && !n)
+    _itemBufferIndex--;
+  if(!eol)
+    return used;
+
+  if(_itemBufferIndex){
+    arena[_itemBufferIndex] = 0;
+    _temp = String(arena);
+    _itemBufferIndex = 0;
+    _parseMultipartHeader();
+  } else {
+    //value starts from here
+    _multiParseState = PARSE_DATA;
+    _itemSize = 0;
+    _itemStartIndex = _parsedLength + used;
+  }
+  return used;
+}
+
+// returns the number of bytes used
+size_t AsyncWebServerRequest::_parseMultipartData(uint8_t *data, size_t len){
+  const uint8_t *skip = _itemBuffer;
+  uint8_t *delim = _itemBuffer + MULTIPART_SKIP_SIZE;
+  size_t dlen = _boundary.length() + 4;
+
+  // finish a delimiter that started at the end of the previous block
+  if(_boundaryPosition){
+    size_t n = dlen - _boundaryPosition;
+    if(n > len)
+      n = len;
+    if(memcmp(data, delim + _boundaryPosition, n) == 0){
+      _boundaryPosition += n;
+      if(_boundaryPosition == dlen)
+        _multipartItemEnd(data, 0);
+      return n;
     }
-  } else if(_multiParseState == DASH3_OR_RETURN2){
-    if(data == '-' && (_contentLength - _parsedLength - 4) != 0){
-      //os_printf("ERROR: The parser got to the end of the POST but is expecting %u bytes more!\nDrop an issue so we can have more info on the matter!\n", _contentLength - _parsedLength - 4);
-      _contentLength = _parsedLength + 4;//lets close the request gracefully
+    // it was data after all; boundaries hold no CR, so no other
+    // delimiter can start inside the carried bytes
+    size_t carried = _boundaryPosition;
+    _boundaryPosition = 0;
+    _multipartItemData(delim, carried, false);
+    if(_multiParseState == PARSE_ERROR)
+      return len;
+  }
+
+  const uint8_t *hit = _findDelimiter(data, len, delim, dlen, skip);
+  if(hit){
+    size_t n = hit - data;
+    _multipartItemEnd(data, n);
+    return n + dlen;
+  }
+
+  // hold back a possible delimiter start at the end of the block
+  size_t keep = 0;
+  for(size_t i = len > dlen - 1 ? len - (dlen - 1) : 0; i < len; i++){
+    if(data[i] == '\r' && memcmp(data + i, delim, len - i) == 0){
+      keep = len - i;
+      break;
     }
-    if(data == '\r'){
-      _multiParseState = EXPECT_FEED2;
-    } else if(data == '-' && _contentLength == (_parsedLength + 4)){
-      _multiParseState = PARSING_FINISHED;
-    } else {
-      _multiParseState = WAIT_FOR_RETURN1;
-      itemWriteByte('\r'); itemWriteByte('\n'); itemWriteByte('-');  itemWriteByte('-');
-      uint8_t i; for(i=0; i<_boundary.length(); i++) itemWriteByte(_boundary.c_str()[i]);
-      _parseMultipartPostByte(data, last);
+  }
+  _multipartItemData(data, len - keep, false);
+  _boundaryPosition = keep;
+  return len;
+}
+
+// after a delimiter: CRLF starts the next part, "--" ends the body
+size_t AsyncWebServerRequest::_parseMultipartSuffix(uint8_t *data, size_t len){
+  (void)len;
+  uint8_t c = data[0];
+  if(_boundaryPosition == 0){
+    if(c == '\r'){
+      _boundaryPosition = 1;
+    } else if(c == '-'){
+      _boundaryPosition = 2;
+    } else if(c != ' ' && c != '\t'){ // transport padding
+      _multiParseState = PARSE_ERROR;
     }
-  } else if(_multiParseState == EXPECT_FEED2){
-    if(data == '\n'){
+  } else if(_boundaryPosition == 1){
+    if(c == '\n'){
       _multiParseState = PARSE_HEADERS;
+      _boundaryPosition = 0;
       _itemIsFile = false;
+      _itemName = String();
+      _itemFilename = String();
+      _itemType = String();
+      _itemBufferIndex = 0;
+    } else {
+      _multiParseState = PARSE_ERROR;
+    }
+  } else {
+    if(c == '-'){
+      // the CRLF after the close delimiter is optional and anything up to
+      // Content-Length is epilogue, skipped; cutting the body short here
+      // would hand the epilogue to a kept-alive connection as a request
+      _multiParseState = PARSING_FINISHED;
     } else {
-      _multiParseState = WAIT_FOR_RETURN1;
-      itemWriteByte('\r'); itemWriteByte('\n'); itemWriteByte('-');  itemWriteByte('-');
-      uint8_t i; for(i=0; i<_boundary.length(); i++) itemWriteByte(_boundary.c_str()[i]);
-      itemWriteByte('\r'); _parseMultipartPostByte(data, last);
+      _multiParseState = PARSE_ERROR;
     }
   }
+  return 1;
+}
+
+void AsyncWebServerRequest::_parseMultipartPostBlock(uint8_t *data, size_t len){
+  if(!_parsedLength && !_multipartBegin())
+    _multiParseState = PARSE_ERROR;
+
+  while(len && _multiParseState != PARSE_ERROR && _multiParseState != PARSING_FINISHED){
+    size_t used;
+    if(_multiParseState == PARSE_HEADERS)
+      used = _parseMultipartHeaders(data, len);
+    else if(_multiParseState == BOUNDARY_SUFFIX)
+      used = _parseMultipartSuffix(data, len);
+    else
+      used = _parseMultipartData(data, len);
+    data += used;
+    len -= used;
+    _parsedLength += used;
+  }
+
+  // epilogue, or whatever follows an error
+  _parsedLength += len;
+  if(_parsedLength > _contentLength)
+    _parsedLength = _contentLength;
 }
 
 void AsyncWebServerRequest::_parseLine(){
@@ -568,6 +863,12 @@ void AsyncWebServerRequest::_parseLine(){
       //end of headers
       _server->_rewriteRequest(this);
       _server->_attachHandler(this);
+      _priority = _handler && _handler->isPriority();
+      if(_overBudget || (_probation && !_priority)){
+        _parseState = PARSE_REQ_FAIL;
+        send(503);
+        return;
+      }
       _removeNotInterestingHeaders();
       if(_expectingContinue){
         const char * response = "HTTP/1.1 100 Continue\r\n\r\n";
@@ -721,6 +1022,8 @@ void AsyncWebServerRequest::send(AsyncWebServerResponse *response){
     send(500);
   }
   else {
+    if(_setSession.length())
+      _response->addHeader("Set-Cookie", _setSession);
     _client->setRxTimeout(0);
     _response->_respond(this);
   }
@@ -756,6 +1059,12 @@ AsyncWebServerResponse * AsyncWebServerRequest::beginChunkedResponse(const Strin
   return new AsyncCallbackResponse(contentType, 0, callback, templateCallback);
 }
 
+AsyncWebServerResponse * AsyncWebServerRequest::beginGzipResponse(AsyncAbstractResponse *source){
+  if(_acceptsGzip)
+    return new AsyncGzipResponse(source);
+  return source;
+}
+
 AsyncResponseStream * AsyncWebServerRequest::beginResponseStream(const String& contentType, size_t bufferSize){
   return new AsyncResponseStream(contentType, bufferSize);
 }
@@ -796,6 +1105,16 @@ void AsyncWebServerRequest::sendChunked(const String& contentType, AwsResponseFi
   send(beginChunkedResponse(contentType, callback, templateCallback));
 }
 
+void AsyncWebServerRequest::sendChunkedGzip(const String& contentType, AwsResponseFiller callback, AwsTemplateProcessor templateCallback){
+  if(_acceptsGzip){
+    send(new AsyncGzipResponse(new AsyncChunkedResponse(contentType, callback, templateCallback)));
+    return;
+  }
+  AsyncWebServerResponse *response = beginChunkedResponse(contentType, callback, templateCallback);
+  response->addHeader("Vary", "Accept-Encoding");
+  send(response);
+}
+
 void AsyncWebServerRequest::send_P(int code, const String& contentType, const uint8_t * content, size_t len, AwsTemplateProcessor callback){
   send(beginResponse_P(code, contentType, content, len, callback));
 }
@@ -811,13 +1130,20 @@ void AsyncWebServerRequest::redirect(const String& url){
 }
 
 bool AsyncWebServerRequest::authenticate(const char * username, const char * password, const char * realm, bool passwordIsHash){
+  if(_session.length() && checkAuthSessionCookie(_session.c_str(), username, password, realm, passwordIsHash))
+    return true;
   if(_authorization.length()){
+    bool valid;
     if(_isDigest)
-      return checkDigestAuthentication(_authorization.c_str(), methodToString(), username, password, realm, passwordIsHash, NULL, NULL, NULL);
+      valid = checkDigestAuthentication(_authorization.c_str(), methodToString(), username, password, realm, passwordIsHash, NULL, NULL, NULL, &_staleNonce);
     else if(!passwordIsHash)
-      return checkBasicAuthentication(_authorization.c_str(), username, password);
+      valid = checkBasicAuthentication(_authorization.c_str(), username, password);
     else
-      return _authorization.equals(password);
+      valid = _authorization.equals(password);
+    // the cookie spares the next requests the Authorization check
+    if(valid && WEB_AUTH_SESSION_LIFETIME)
+      _setSession = authSessionCookie(username, password, realm, passwordIsHash);
+    return valid;
   }
   return false;
 }
@@ -838,7 +1164,7 @@ bool AsyncWebServerRequest::authenticate(const char * hash){
       return false;
     String realm = hStr.substring(0, separator);
     hStr = hStr.substring(separator + 1);
-    return checkDigestAuthentication(_authorization.c_str(), methodToString(), username.c_str(), hStr.c_str(), realm.c_str(), true, NULL, NULL, NULL);
+    return checkDigestAuthentication(_authorization.c_str(), methodToString(), username.c_str(), hStr.c_str(), realm.c_str(), true, NULL, NULL, NULL, &_staleNonce);
   }
 
   return (_authorization.equals(hash));
@@ -855,7 +1181,7 @@ void AsyncWebServerRequest::requestAuthentication(const char * realm, bool isDig
     r->addHeader("WWW-Authenticate", header);
   } else {
     String header = "Digest ";
-    header.concat(requestDigestAuthentication(realm));
+    header.concat(requestDigestAuthentication(realm, _staleNonce));
     r->addHeader("WWW-Authenticate", header);
   }
   send(r);
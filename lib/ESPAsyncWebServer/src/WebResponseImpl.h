@@ -39,9 +39,16 @@ class AsyncBasicResponse: public AsyncWebServerResponse {
     bool _sourceValid() const { return true; }
 };
 
+#ifndef RESPONSE_SEND_BUFFER_MIN
+#define RESPONSE_SEND_BUFFER_MIN 1460
+#endif
+
 class AsyncAbstractResponse: public AsyncWebServerResponse {
+  friend class AsyncGzipResponse;
   private:
     String _head;
+    uint8_t *_sendBuffer;
+    size_t _sendBufferSize;
     // Data is inserted into cache at begin(). 
     // This is inefficient with vector, but if we use some other container, 
     // we won't be able to access it as contiguous array of bytes when reading from it,
@@ -53,6 +60,7 @@ class AsyncAbstractResponse: public AsyncWebServerResponse {
     AwsTemplateProcessor _callback;
   public:
     AsyncAbstractResponse(AwsTemplateProcessor callback=nullptr);
+    virtual ~AsyncAbstractResponse();
     void _respond(AsyncWebServerRequest *request);
     size_t _ack(AsyncWebServerRequest *request, size_t len, uint32_t time);
     bool _sourceValid() const { return false; }
@@ -64,6 +72,11 @@ class AsyncAbstractResponse: public AsyncWebServerResponse {
 #endif
 
 #define TEMPLATE_PARAM_NAME_LENGTH 32
+
+#ifndef FILE_RESPONSE_SECTOR_SIZE
+#define FILE_RESPONSE_SECTOR_SIZE 512
+#endif
+
 class AsyncFileResponse: public AsyncAbstractResponse {
   using File = fs::File;
   using FS = fs::FS;
@@ -118,6 +131,29 @@ class AsyncProgmemResponse: public AsyncAbstractResponse {
     virtual size_t _fillBuffer(uint8_t *buf, size_t maxLen) override;
 };
 
+class AsyncGzipEncoder;
+
+// Sends what another response produces gzip compressed, with chunked
+// transfer encoding (closed at the end for HTTP/1.0).  The code, type and
+// headers are taken over from 'source', which is deleted with this one.
+// Sent as is if 'source' is already encoded or the memory budget cannot
+// cover the encoder.
+class AsyncGzipResponse: public AsyncAbstractResponse {
+  private:
+    AsyncAbstractResponse *_source;
+    AsyncGzipEncoder *_encoder;
+    bool _sourceDone;
+    size_t _sourceLength;
+    size_t _sourceRead;
+    size_t _readSource(uint8_t *buf, size_t maxLen);
+  public:
+    AsyncGzipResponse(AsyncAbstractResponse *source);
+    ~AsyncGzipResponse();
+    void _respond(AsyncWebServerRequest *request);
+    bool _sourceValid() const { return _source && _source->_sourceValid(); }
+    virtual size_t _fillBuffer(uint8_t *buf, size_t maxLen) override;
+};
+
 class cbuf;
 
 class AsyncResponseStream: public AsyncAbstractResponse, public Print {
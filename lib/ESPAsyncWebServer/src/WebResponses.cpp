@@ -21,6 +21,8 @@
 #include "ESPAsyncWebServer.h"
 #include "WebResponseImpl.h"
 #include "cbuf.h"
+#include "AsyncGzip.h"
+#include <new>
 
 // Since ESP8266 does not link memchr by default, here's its implementation.
 void* memchr(void* ptr, int ch, size_t count)
@@ -175,10 +177,10 @@ AsyncBasicResponse::AsyncBasicResponse(int code, const String& contentType, cons
     if(!_contentType.length())
       _contentType = "text/plain";
   }
-  addHeader("Connection","close");
 }
 
 void AsyncBasicResponse::_respond(AsyncWebServerRequest *request){
+  addHeader("Connection", request->_persist(true) ? "keep-alive" : "close");
   _state = RESPONSE_HEADERS;
   String out = _assembleHead(request->version());
   size_t outLen = out.length();
@@ -234,6 +236,9 @@ size_t AsyncBasicResponse::_ack(AsyncWebServerRequest *request, size_t len, uint
   } else if(_state == RESPONSE_WAIT_ACK){
     if(_ackedLength >= _writtenLength){
       _state = RESPONSE_END;
+      // the client was told Connection: close; this deletes the request
+      if(!request->_persisting())
+        request->client()->close(true);
     }
   }
   return 0;
@@ -244,7 +249,7 @@ size_t AsyncBasicResponse::_ack(AsyncWebServerRequest *request, size_t len, uint
  * Abstract Response
  * */
 
-AsyncAbstractResponse::AsyncAbstractResponse(AwsTemplateProcessor callback): _callback(callback)
+AsyncAbstractResponse::AsyncAbstractResponse(AwsTemplateProcessor callback): _sendBuffer(NULL), _sendBufferSize(0), _callback(callback)
 {
   // In case of template processing, we're unable to determine real response size
   if(callback) {
@@ -254,8 +259,13 @@ AsyncAbstractResponse::AsyncAbstractResponse(AwsTemplateProcessor callback): _ca
   }
 }
 
+AsyncAbstractResponse::~AsyncAbstractResponse(){
+  free(_sendBuffer);
+}
+
 void AsyncAbstractResponse::_respond(AsyncWebServerRequest *request){
-  addHeader("Connection","close");
+  // without a length or chunks only closing the connection ends the body
+  addHeader("Connection", request->_persist(_sendContentLength || (_chunked && request->version())) ? "keep-alive" : "close");
   _head = _assembleHead(request->version());
   _state = RESPONSE_HEADERS;
   _ack(request, 0, 0);
@@ -274,6 +284,24 @@ size_t AsyncAbstractResponse::_ack(AsyncWebServerRequest *request, size_t len, u
   size_t headLen = _head.length();
   if(_state == RESPONSE_HEADERS){
     if(space >= headLen){
+      // one buffer for the rest of the response, as large as the send
+      // window, instead of one per window
+      if(!_sendBuffer){
+        size_t size = std::max(space, headLen + RESPONSE_SEND_BUFFER_MIN);
+        // short of budget a smaller buffer will do; with none at all
+        // wait for the next poll, other requests release theirs
+        if(!request->_charge(size)){
+          size = headLen + RESPONSE_SEND_BUFFER_MIN;
+          if(!request->_charge(size))
+            return 0;
+        }
+        _sendBuffer = (uint8_t *)malloc(size);
+        if(!_sendBuffer){
+          // os_printf("_ack malloc %d failed\n", size);
+          return 0;
+        }
+        _sendBufferSize = size;
+      }
       _state = RESPONSE_CONTENT;
       space -= headLen;
     } else {
@@ -285,10 +313,19 @@ size_t AsyncAbstractResponse::_ack(AsyncWebServerRequest *request, size_t len, u
   }
 
   if(_state == RESPONSE_CONTENT){
+    if(headLen + space > _sendBufferSize){
+      space = _sendBufferSize - headLen;
+    }
     size_t outLen;
     if(_chunked){
       if(space <= 8){
-        return 0;
+        // no room for a chunk after the head: the head alone, or a window
+        // smaller than both would never see either go out
+        if(!headLen)
+          return 0;
+        _writtenLength += request->client()->write(_head.c_str(), headLen);
+        _head = String();
+        return headLen;
       }
       outLen = space;
     } else if(!_sendContentLength){
@@ -297,11 +334,7 @@ size_t AsyncAbstractResponse::_ack(AsyncWebServerRequest *request, size_t len, u
       outLen = ((_contentLength - _sentLength) > space)?space:(_contentLength - _sentLength);
     }
 
-    uint8_t *buf = (uint8_t *)malloc(outLen+headLen);
-    if (!buf) {
-      // os_printf("_ack malloc %d failed\n", outLen+headLen);
-      return 0;
-    }
+    uint8_t *buf = _sendBuffer;
 
     if(headLen){
       memcpy(buf, _head.c_str(), _head.length());
@@ -314,7 +347,6 @@ size_t AsyncAbstractResponse::_ack(AsyncWebServerRequest *request, size_t len, u
       // See RFC2616 sections 2, 3.6.1.
       readLen = _fillBufferAndProcessTemplates(buf+headLen+6, outLen - 8);
       if(readLen == RESPONSE_TRY_AGAIN){
-          free(buf);
           return 0;
       }
       outLen = sprintf((char*)buf+headLen, "%x", readLen) + headLen;
@@ -327,7 +359,6 @@ size_t AsyncAbstractResponse::_ack(AsyncWebServerRequest *request, size_t len, u
     } else {
       readLen = _fillBufferAndProcessTemplates(buf+headLen, outLen);
       if(readLen == RESPONSE_TRY_AGAIN){
-          free(buf);
           return 0;
       }
       outLen = readLen + headLen;
@@ -347,8 +378,6 @@ size_t AsyncAbstractResponse::_ack(AsyncWebServerRequest *request, size_t len, u
         _sentLength += outLen - headLen;
     }
 
-    free(buf);
-
     if((_chunked && readLen == 0) || (!_sendContentLength && outLen == 0) || (!_chunked && _sentLength == _contentLength)){
       _state = RESPONSE_WAIT_ACK;
     }
@@ -357,7 +386,9 @@ size_t AsyncAbstractResponse::_ack(AsyncWebServerRequest *request, size_t len, u
   } else if(_state == RESPONSE_WAIT_ACK){
     if(!_sendContentLength || _ackedLength >= _writtenLength){
       _state = RESPONSE_END;
-      if(!_chunked && !_sendContentLength)
+      // sent until close, or the client was told Connection: close; this
+      // deletes the request
+      if(!request->_persisting())
         request->client()->close(true);
     }
   }
@@ -396,7 +427,7 @@ size_t AsyncAbstractResponse::_fillBufferAndProcessTemplates(uint8_t* data, size
     // If closing placeholder is found:
     if(pTemplateEnd) {
       // prepare argument to callback
-      const size_t paramNameLength = std::min(sizeof(buf) - 1, (unsigned int)(pTemplateEnd - pTemplateStart - 1));
+      const size_t paramNameLength = std::min(sizeof(buf) - 1, (size_t)(pTemplateEnd - pTemplateStart - 1));
       if(paramNameLength) {
         memcpy(buf, pTemplateStart + 1, paramNameLength);
         buf[paramNameLength] = 0;
@@ -570,6 +601,14 @@ AsyncFileResponse::AsyncFileResponse(File content, const String& path, const Str
 }
 
 size_t AsyncFileResponse::_fillBuffer(uint8_t *data, size_t len){
+  // End reads on a sector boundary so the next one starts on one and the
+  // filesystem does not have to read a sector twice
+  if(len > FILE_RESPONSE_SECTOR_SIZE){
+    size_t pos = _content.position();
+    size_t end = (pos + len) & ~(size_t)(FILE_RESPONSE_SECTOR_SIZE - 1);
+    if(end > pos)
+      len = end - pos;
+  }
   return _content.read(data, len);
 }
 
@@ -662,6 +701,88 @@ size_t AsyncProgmemResponse::_fillBuffer(uint8_t *data, size_t len){
 }
 
 
+/*
+ * Gzip Response
+ * */
+
+AsyncGzipResponse::AsyncGzipResponse(AsyncAbstractResponse *source)
+  : _source(source)
+  , _encoder(NULL)
+  , _sourceDone(false)
+  , _sourceLength(0)
+  , _sourceRead(0)
+{
+  _contentLength = 0;
+  _sendContentLength = false;
+  _chunked = true;
+  if(!_source)
+    return;
+  _code = _source->_code;
+  _contentType = _source->_contentType;
+  _sourceLength = _source->_sendContentLength ? _source->_contentLength : SIZE_MAX;
+  for(const auto& header: _source->_headers)
+    addHeader(header->name(), header->value());
+  _source->_headers.free();
+}
+
+AsyncGzipResponse::~AsyncGzipResponse(){
+  delete _encoder;
+  delete _source;
+}
+
+void AsyncGzipResponse::_respond(AsyncWebServerRequest *request){
+  _chunked = request->version() != 0;
+  bool encoded = false;
+  for(const auto& header: _headers){
+    if(header->name().equalsIgnoreCase("Content-Encoding"))
+      encoded = true;
+  }
+  // short of memory the body goes out uncompressed
+  if(!encoded && request->_charge(sizeof(AsyncGzipEncoder)))
+    _encoder = new (std::nothrow) AsyncGzipEncoder();
+  if(_encoder)
+    addHeader("Content-Encoding", "gzip");
+  addHeader("Vary", "Accept-Encoding");
+  AsyncAbstractResponse::_respond(request);
+}
+
+size_t AsyncGzipResponse::_readSource(uint8_t *data, size_t len){
+  if(_sourceRead >= _sourceLength)
+    return 0;
+  if(len > _sourceLength - _sourceRead)
+    len = _sourceLength - _sourceRead;
+  size_t ret = _source->_fillBufferAndProcessTemplates(data, len);
+  if(ret != RESPONSE_TRY_AGAIN){
+    _sourceRead += ret;
+  }
+  return ret;
+}
+
+size_t AsyncGzipResponse::_fillBuffer(uint8_t *data, size_t len){
+  if(!_encoder)
+    return _readSource(data, len);
+  // a whole block of input may compress before any output comes out, so
+  // keep feeding the encoder until the window is full; 0 ends the body
+  size_t outLen = 0;
+  while(outLen < len){
+    outLen += _encoder->read(data + outLen, len - outLen);
+    if(outLen == len || _encoder->done())
+      break;
+    size_t space;
+    uint8_t *in = _encoder->input(&space);
+    size_t readLen = _sourceDone ? 0 : _readSource(in, space);
+    if(readLen == RESPONSE_TRY_AGAIN)
+      return outLen ? outLen : RESPONSE_TRY_AGAIN;
+    if(readLen){
+      _encoder->commit(readLen);
+    } else {
+      _sourceDone = true;
+      _encoder->finish();
+    }
+  }
+  return outLen;
+}
+
 /*
  * Response Stream (You can print/write/printf to it, up to the contentLen bytes)
  * */
@@ -34,6 +34,13 @@ AsyncWebServer::AsyncWebServer(uint16_t port)
   : _server(port)
   , _rewrites(LinkedList<AsyncWebRewrite*>([](AsyncWebRewrite* r){ delete r; }))
   , _handlers(LinkedList<AsyncWebHandler*>([](AsyncWebHandler* h){ delete h; }))
+  , _memoryBudget(0)
+  , _memoryReserve(0)
+  , _memoryUsed(0)
+  , _memoryPeak(0)
+  , _heapFloor(0)
+  , _admitted(0)
+  , _rejected(0)
 {
   _catchAllHandler = new AsyncCallbackWebHandler();
   if(_catchAllHandler == NULL)
@@ -41,13 +48,28 @@ AsyncWebServer::AsyncWebServer(uint16_t port)
   _server.onClient([](void *s, AsyncClient* c){
     if(c == NULL)
       return;
+    AsyncWebServer *server = (AsyncWebServer*)s;
+    const size_t cost = sizeof(AsyncWebServerRequest) + WEB_SERVER_REQUEST_OVERHEAD;
+    // Before the request line is in nobody knows whether this will be a
+    // priority request, so a connection that only fits into the reserve
+    // is admitted on probation and dropped once its handler is known.
+    bool probation = !server->_charge(cost, false);
+    if(probation && !server->_charge(cost, true)){
+      server->_reject(c);
+      return;
+    }
     c->setRxTimeout(3);
-    AsyncWebServerRequest *r = new AsyncWebServerRequest((AsyncWebServer*)s, c);
+    AsyncWebServerRequest *r = new AsyncWebServerRequest(server, c);
     if(r == NULL){
+      server->_release(cost);
       c->close(true);
       c->free();
       delete c;
+      return;
     }
+    r->_charged = cost;
+    r->_probation = probation;
+    server->_admitted++;
   }, this);
 }
 
@@ -102,6 +124,67 @@ void AsyncWebServer::_handleDisconnect(AsyncWebServerRequest *request){
   delete request;
 }
 
+void AsyncWebServer::setMemoryBudget(size_t budget, size_t reserve){
+  _memoryBudget = budget;
+  _memoryReserve = (reserve < budget) ? reserve : budget;
+}
+
+bool AsyncWebServer::_charge(size_t len, bool priority){
+  if(_heapFloor){
+#if defined(ESP32)
+    if(ESP.getMaxAllocHeap() < _heapFloor)
+      return false;
+#elif defined(ESP8266)
+    if(ESP.getMaxFreeBlockSize() < _heapFloor)
+      return false;
+#endif
+  }
+  if(_memoryBudget){
+    size_t limit = priority ? _memoryBudget : _memoryBudget - _memoryReserve;
+    if(_memoryUsed + len > limit)
+      return false;
+  }
+  _memoryUsed += len;
+  if(_memoryUsed > _memoryPeak)
+    _memoryPeak = _memoryUsed;
+  return true;
+}
+
+void AsyncWebServer::_release(size_t len){
+  _memoryUsed = (len < _memoryUsed) ? _memoryUsed - len : 0;
+}
+
+// Answered without allocating a request, before the client says anything
+void AsyncWebServer::_reject(AsyncClient *client){
+  static const char response[] = "HTTP/1.1 503 Service Unavailable\r\nRetry-After: 1\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+  _rejected++;
+  client->write(response, sizeof(response) - 1);
+  client->close(true);
+  client->free();
+  delete client;
+}
+
+AsyncWebServerStats AsyncWebServer::stats() const {
+  AsyncWebServerStats s;
+  s.budget = _memoryBudget;
+  s.used = _memoryUsed;
+  s.peak = _memoryPeak;
+  s.admitted = _admitted;
+  s.rejected = _rejected;
+#if defined(ESP32)
+  s.freeHeap = ESP.getFreeHeap();
+  s.minFreeHeap = ESP.getMinFreeHeap();
+  s.largestFreeBlock = ESP.getMaxAllocHeap();
+#elif defined(ESP8266)
+  s.freeHeap = ESP.getFreeHeap();
+  s.minFreeHeap = 0;
+  s.largestFreeBlock = ESP.getMaxFreeBlockSize();
+#else
+  s.freeHeap = s.minFreeHeap = s.largestFreeBlock = 0;
+#endif
+  return s;
+}
+
 void AsyncWebServer::_rewriteRequest(AsyncWebServerRequest *request){
   for(const auto& r: _rewrites){
     if (r->match(request)){
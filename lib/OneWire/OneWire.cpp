@@ -149,11 +149,26 @@ void OneWire::begin(uint8_t pin)
 	pinMode(pin, INPUT);
 	bitmask = PIN_TO_BITMASK(pin);
 	baseReg = PIN_TO_BASEREG(pin);
+#if ONEWIRE_RMT
+	rmt = 0;
+#endif
 #if ONEWIRE_SEARCH
 	reset_search();
 #endif
 }
 
+#if ONEWIRE_RMT
+void OneWire::begin(OneWireRmt *transport)
+{
+	bitmask = 0;
+	baseReg = 0;
+	rmt = transport;
+#if ONEWIRE_SEARCH
+	reset_search();
+#endif
+}
+#endif
+
 
 // Perform the onewire reset function.  We will wait up to 250uS for
 // the bus to come high, if it doesn't then it is broken or shorted
@@ -168,6 +183,10 @@ uint8_t OneWire::reset(void)
 	uint8_t r;
 	uint8_t retries = 125;
 
+#if ONEWIRE_RMT
+	if (rmt) return rmt->reset();
+#endif
+
 	noInterrupts();
 	DIRECT_MODE_INPUT(reg, mask);
 	interrupts();
@@ -200,6 +219,13 @@ void OneWire::write_bit(uint8_t v)
 	IO_REG_TYPE mask IO_REG_MASK_ATTR = bitmask;
 	__attribute__((unused)) volatile IO_REG_TYPE *reg IO_REG_BASE_ATTR = baseReg;
 
+#if ONEWIRE_RMT
+	if (rmt) {
+		rmt->write_bits(v, 1);
+		return;
+	}
+#endif
+
 	if (v & 1) {
 		noInterrupts();
 		DIRECT_WRITE_LOW(reg, mask);
@@ -229,6 +255,10 @@ uint8_t OneWire::read_bit(void)
 	__attribute__((unused)) volatile IO_REG_TYPE *reg IO_REG_BASE_ATTR = baseReg;
 	uint8_t r;
 
+#if ONEWIRE_RMT
+	if (rmt) return rmt->read_bits(1);
+#endif
+
 	noInterrupts();
 	DIRECT_MODE_OUTPUT(reg, mask);
 	DIRECT_WRITE_LOW(reg, mask);
@@ -251,6 +281,15 @@ uint8_t OneWire::read_bit(void)
 void OneWire::write(uint8_t v, uint8_t power /* = 0 */) {
     uint8_t bitMask;
 
+#if ONEWIRE_RMT
+    // The whole byte goes out as one transaction; with 'power' set the
+    // channel drives the bus for it and holds it high afterwards.
+    if (rmt) {
+	rmt->write_bits(v, 8, power);
+	return;
+    }
+#endif
+
     for (bitMask = 0x01; bitMask; bitMask <<= 1) {
 	OneWire::write_bit( (bitMask & v)?1:0);
     }
@@ -263,6 +302,13 @@ void OneWire::write(uint8_t v, uint8_t power /* = 0 */) {
 }
 
 void OneWire::write_bytes(const uint8_t *buf, uint16_t count, bool power /* = 0 */) {
+#if ONEWIRE_RMT
+  if (rmt) {
+    for (uint16_t i = 0 ; i < count ; i++)
+      rmt->write_bits(buf[i], 8, power);
+    return;
+  }
+#endif
   for (uint16_t i = 0 ; i < count ; i++)
     write(buf[i]);
   if (!power) {
@@ -280,6 +326,10 @@ uint8_t OneWire::read() {
     uint8_t bitMask;
     uint8_t r = 0;
 
+#if ONEWIRE_RMT
+    if (rmt) return rmt->read_bits(8);
+#endif
+
     for (bitMask = 0x01; bitMask; bitMask <<= 1) {
 	if ( OneWire::read_bit()) r |= bitMask;
     }
@@ -313,6 +363,12 @@ void OneWire::skip()
 
 void OneWire::depower()
 {
+#if ONEWIRE_RMT
+	if (rmt) {
+		rmt->power(false);
+		return;
+	}
+#endif
 	noInterrupts();
 	DIRECT_MODE_INPUT(baseReg, bitmask);
 	interrupts();
@@ -489,7 +545,42 @@ bool OneWire::search(uint8_t *newAddr, bool search_mode /* = true */)
 // "Understanding and Using Cyclic Redundancy Checks with Maxim iButton Products"
 //
 
-#if ONEWIRE_CRC8_TABLE
+#include "util/OneWire_crc_tables.h"
+
+#if ONEWIRE_CRC8_TABLE >= 3
+// Compute a Dallas Semiconductor 8 bit CRC four bytes at a time.  The
+// CRC is linear, so the state after four bytes is the XOR of each byte's
+// contribution, taken from the table for its distance to the end.
+uint8_t OneWire::crc8(const uint8_t *addr, uint8_t len)
+{
+	uint8_t crc = 0;
+
+	while (len >= 4) {
+		crc = pgm_read_byte(&dscrc_slice4_table[3][crc ^ addr[0]]) ^
+		      pgm_read_byte(&dscrc_slice4_table[2][addr[1]]) ^
+		      pgm_read_byte(&dscrc_slice4_table[1][addr[2]]) ^
+		      pgm_read_byte(&dscrc_slice4_table[0][addr[3]]);
+		addr += 4;
+		len -= 4;
+	}
+	while (len--)
+		crc = pgm_read_byte(&dscrc_slice4_table[0][crc ^ *addr++]);
+
+	return crc;
+}
+#elif ONEWIRE_CRC8_TABLE == 2
+// Compute a Dallas Semiconductor 8 bit CRC with one 256 entry table lookup
+// per byte.
+uint8_t OneWire::crc8(const uint8_t *addr, uint8_t len)
+{
+	uint8_t crc = 0;
+
+	while (len--)
+		crc = pgm_read_byte(dscrc_table + (crc ^ *addr++));
+
+	return crc;
+}
+#elif ONEWIRE_CRC8_TABLE
 // Dow-CRC using polynomial X^8 + X^5 + X^4 + X^0
 // Tiny 2x16 entry CRC table created by Arjen Lentz
 // See http://lentz.com.au/blog/calculating-crc-with-a-tiny-32-entry-lookup-table
@@ -549,7 +640,22 @@ bool OneWire::check_crc16(const uint8_t* input, uint16_t len, const uint8_t* inv
 
 uint16_t OneWire::crc16(const uint8_t* input, uint16_t len, uint16_t crc)
 {
-#if defined(__AVR__)
+#if ONEWIRE_CRC8_TABLE >= 3
+    while (len >= 4) {
+        uint16_t x = crc ^ (input[0] | (input[1] << 8));
+        crc = pgm_read_word(&dscrc16_slice4_table[3][x & 0xff]) ^
+              pgm_read_word(&dscrc16_slice4_table[2][x >> 8]) ^
+              pgm_read_word(&dscrc16_slice4_table[1][input[2]]) ^
+              pgm_read_word(&dscrc16_slice4_table[0][input[3]]);
+        input += 4;
+        len -= 4;
+    }
+    while (len--)
+        crc = (crc >> 8) ^ pgm_read_word(&dscrc16_slice4_table[0][(crc ^ *input++) & 0xff]);
+#elif ONEWIRE_CRC8_TABLE == 2
+    while (len--)
+        crc = (crc >> 8) ^ pgm_read_word(dscrc16_table + ((crc ^ *input++) & 0xff));
+#elif defined(__AVR__)
     for (uint16_t i = 0 ; i < len ; i++) {
         crc = _crc16_update(crc, input[i]);
     }
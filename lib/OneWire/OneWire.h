@@ -41,6 +41,10 @@
 // about 250 bytes.  It does NOT consume RAM (but did in very
 // old versions of OneWire).  If you disable this, a slower
 // but very compact algorithm is used.
+// Larger values select faster kernels for both crc8 and crc16, with
+// their tables in flash (see util/OneWire_crc_tables.h):
+//   2 - one lookup per byte, 256 entry tables (768 bytes)
+//   3 - slice-by-4, four lookups per four bytes (3kB)
 #ifndef ONEWIRE_CRC8_TABLE
 #define ONEWIRE_CRC8_TABLE 1
 #endif
@@ -51,15 +55,36 @@
 #define ONEWIRE_CRC16 1
 #endif
 
+// Allow the bus to be driven by a hardware-timed transport (see
+// OneWireRmt.h) instead of bit-banging with interrupts disabled, by
+// setting this to 1.  It is only used when the OneWire object is
+// constructed with a transport, begin(pin) still bit-bangs.
+#ifndef ONEWIRE_RMT
+#if defined(ARDUINO_ARCH_ESP32) || defined(ONEWIRE_HOST)
+#define ONEWIRE_RMT 1
+#else
+#define ONEWIRE_RMT 0
+#endif
+#endif
+
 // Board-specific macros for direct GPIO
 #include "util/OneWire_direct_regtype.h"
 
+#if ONEWIRE_RMT
+#include "OneWireRmt.h"
+#endif
+
 class OneWire
 {
   private:
     IO_REG_TYPE bitmask;
     volatile IO_REG_TYPE *baseReg;
 
+#if ONEWIRE_RMT
+    // hardware transport, or 0 when bit-banging
+    OneWireRmt *rmt;
+#endif
+
 #if ONEWIRE_SEARCH
     // global search state
     unsigned char ROM_NO[8];
@@ -73,6 +98,11 @@ class OneWire
     OneWire(uint8_t pin) { begin(pin); }
     void begin(uint8_t pin);
 
+#if ONEWIRE_RMT
+    OneWire(OneWireRmt *transport) { begin(transport); }
+    void begin(OneWireRmt *transport);
+#endif
+
     // Perform a 1-Wire reset cycle. Returns 1 if a device responds
     // with a presence pulse.  Returns 0 if there is no device or the
     // bus is shorted or otherwise held low for more than 250uS
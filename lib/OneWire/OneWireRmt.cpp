@@ -0,0 +1,265 @@
+/*
+Hardware-timed 1-Wire transport, see OneWireRmt.h.
+
+Each reset or group of time slots is one transaction: the encoder builds
+the symbol buffer, the channel transmits it while capturing the pin, and
+the decoder classifies the captured low phases.  Because the bus is
+open-drain the capture contains both the master's pulses and whatever
+the slaves added to them:
+
+  reset:  master low 480uS, release, slave presence pulse 60-240uS
+          starting 15-60uS after the release
+  slot:   master low 6uS (write 1), 3uS (read) or 60uS (write 0); a
+          slave answering a read with a 0 stretches the low past 15uS
+*/
+
+#include "OneWireRmt.h"
+
+static inline void setSymbol(OneWireRmtSymbol *s, uint8_t level0, uint16_t duration0,
+                             uint8_t level1, uint16_t duration1)
+{
+	s->level0 = level0;
+	s->duration0 = duration0;
+	s->level1 = level1;
+	s->duration1 = duration1;
+}
+
+size_t OneWireRmt::encodeReset(OneWireRmtSymbol *out)
+{
+	// The recovery time after the presence pulse is covered by the
+	// receiver's idle threshold, so only the pulse itself is sent.
+	setSymbol(&out[0], 0, ONEWIRE_RMT_RESET_LOW, 1, ONEWIRE_RMT_RESET_WAIT);
+	setSymbol(&out[1], 1, 0, 1, 0);	// end marker
+	return 2;
+}
+
+size_t OneWireRmt::encodeSlots(OneWireRmtSymbol *out, uint8_t v, uint8_t count,
+                               uint16_t oneLow)
+{
+	uint8_t i;
+
+	if (count > 8) count = 8;
+	for (i = 0; i < count; i++) {
+		uint16_t low = (v & (1 << i)) ? oneLow : ONEWIRE_RMT_WRITE0_LOW;
+		setSymbol(&out[i], 0, low, 1, ONEWIRE_RMT_SLOT - low);
+	}
+	setSymbol(&out[i], 1, 0, 1, 0);	// end marker
+	return count + 1;
+}
+
+// Walk the captured phases in order.  The first long low is our own reset
+// pulse; any low that follows it is a presence pulse.  A bus that never
+// comes back up after the reset pulse is shorted and reports no presence.
+uint8_t OneWireRmt::decodePresence(const OneWireRmtSymbol *rx, size_t count)
+{
+	bool sawReset = false;
+
+	for (size_t i = 0; i < count; i++) {
+		uint16_t duration[2] = { (uint16_t)rx[i].duration0, (uint16_t)rx[i].duration1 };
+		uint8_t level[2] = { (uint8_t)rx[i].level0, (uint8_t)rx[i].level1 };
+
+		for (uint8_t h = 0; h < 2; h++) {
+			if (duration[h] == 0) return 0;	// end of capture
+			if (level[h] != 0) continue;
+			if (!sawReset) {
+				if (duration[h] >= ONEWIRE_RMT_RESET_LOW - 20) sawReset = true;
+			} else {
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+// Every slot starts with exactly one low phase; it is a 0 if it lasted
+// past the master's sample point.  Slots missing from the capture read
+// as 1, the same as a floating bus does when bit-banged.
+uint8_t OneWireRmt::decodeSlots(const OneWireRmtSymbol *rx, size_t count, uint8_t bits)
+{
+	uint8_t r = 0;
+	uint8_t slot = 0;
+
+	for (size_t i = 0; i < count && slot < bits; i++) {
+		uint16_t duration[2] = { (uint16_t)rx[i].duration0, (uint16_t)rx[i].duration1 };
+		uint8_t level[2] = { (uint8_t)rx[i].level0, (uint8_t)rx[i].level1 };
+
+		for (uint8_t h = 0; h < 2 && slot < bits; h++) {
+			if (duration[h] == 0) {
+				i = count;	// end of capture
+				break;
+			}
+			if (level[h] != 0) continue;
+			if (duration[h] < ONEWIRE_RMT_SAMPLE) r |= (1 << slot);
+			slot++;
+		}
+	}
+	for (; slot < bits; slot++) r |= (1 << slot);
+	return r;
+}
+
+uint8_t OneWireRmt::reset(void)
+{
+	OneWireRmtSymbol tx[2];
+	OneWireRmtSymbol rx[ONEWIRE_RMT_MAX_RX_SYMBOLS];
+	size_t rxCount = ONEWIRE_RMT_MAX_RX_SYMBOLS;
+
+	if (!channel) return 0;
+	if (powered) power(false);
+	size_t txCount = encodeReset(tx);
+	if (!channel->transceive(tx, txCount, rx, &rxCount, ONEWIRE_RMT_IDLE_RESET))
+		return 0;
+	return decodePresence(rx, rxCount);
+}
+
+// Write slots need nothing from the slaves, so a powered write can go out
+// push-pull, the way the bit-banged driver writes.
+void OneWireRmt::write_bits(uint8_t v, uint8_t count, bool power)
+{
+	OneWireRmtSymbol tx[ONEWIRE_RMT_MAX_SYMBOLS];
+	OneWireRmtSymbol rx[ONEWIRE_RMT_MAX_RX_SYMBOLS];
+	size_t rxCount = ONEWIRE_RMT_MAX_RX_SYMBOLS;
+
+	if (!channel) return;
+	if (power != powered) this->power(power);
+	size_t txCount = encodeSlots(tx, v, count);
+	channel->transceive(tx, txCount, rx, &rxCount, ONEWIRE_RMT_IDLE_SLOT);
+}
+
+uint8_t OneWireRmt::read_bits(uint8_t count)
+{
+	OneWireRmtSymbol tx[ONEWIRE_RMT_MAX_SYMBOLS];
+	OneWireRmtSymbol rx[ONEWIRE_RMT_MAX_RX_SYMBOLS];
+	size_t rxCount = ONEWIRE_RMT_MAX_RX_SYMBOLS;
+	uint8_t mask = (count >= 8) ? 0xFF : (uint8_t)((1 << count) - 1);
+
+	if (!channel) return mask;
+	if (powered) power(false);
+	size_t txCount = encodeSlots(tx, 0xFF, count, ONEWIRE_RMT_READ_LOW);
+	if (!channel->transceive(tx, txCount, rx, &rxCount, ONEWIRE_RMT_IDLE_SLOT))
+		return mask;
+	return decodeSlots(rx, rxCount, count) & mask;
+}
+
+bool OneWireRmt::power(bool on)
+{
+	if (!channel) return false;
+	if (!channel->power(on)) {
+		if (!on) powered = false;
+		return false;
+	}
+	powered = on;
+	return true;
+}
+
+#if defined(ARDUINO_ARCH_ESP32)
+#include <driver/gpio.h>
+#include <esp_rom_gpio.h>
+#include <soc/gpio_sig_map.h>
+
+// 80MHz APB clock / 80 = 1uS per tick
+#define ONEWIRE_RMT_CLK_DIV        80
+// Glitch filter, in APB cycles (~0.4uS)
+#define ONEWIRE_RMT_FILTER_TICKS   30
+#define ONEWIRE_RMT_RX_BUFFER      (ONEWIRE_RMT_MAX_RX_SYMBOLS * sizeof(rmt_item32_t) * 4)
+#define ONEWIRE_RMT_TIMEOUT_MS     10
+
+bool OneWireEsp32RmtChannel::begin(void)
+{
+	if (installed) return true;
+
+	rmt_config_t txConfig = RMT_DEFAULT_CONFIG_TX((gpio_num_t)pin, txChannel);
+	txConfig.clk_div = ONEWIRE_RMT_CLK_DIV;
+	txConfig.tx_config.idle_output_en = true;
+	txConfig.tx_config.idle_level = RMT_IDLE_LEVEL_HIGH;
+
+	rmt_config_t rxConfig = RMT_DEFAULT_CONFIG_RX((gpio_num_t)pin, rxChannel);
+	rxConfig.clk_div = ONEWIRE_RMT_CLK_DIV;
+	rxConfig.rx_config.filter_en = true;
+	rxConfig.rx_config.filter_ticks_thresh = ONEWIRE_RMT_FILTER_TICKS;
+	rxConfig.rx_config.idle_threshold = ONEWIRE_RMT_IDLE_RESET;
+
+	if (rmt_config(&txConfig) != ESP_OK) return false;
+	if (rmt_driver_install(txChannel, 0, 0) != ESP_OK) return false;
+	if (rmt_config(&rxConfig) != ESP_OK || rmt_driver_install(rxChannel, ONEWIRE_RMT_RX_BUFFER, 0) != ESP_OK) {
+		rmt_driver_uninstall(txChannel);
+		return false;
+	}
+
+	RingbufHandle_t ring = NULL;
+	rmt_get_ringbuf_handle(rxChannel, &ring);
+	rxRing = ring;
+
+	// rmt_config() routed the pin to whichever channel came last; wire
+	// both up again on an open-drain pad so the receiver sees the loopback.
+	gpio_set_pull_mode((gpio_num_t)pin, GPIO_PULLUP_ONLY);
+	gpio_set_direction((gpio_num_t)pin, GPIO_MODE_INPUT_OUTPUT_OD);
+	esp_rom_gpio_connect_out_signal(pin, RMT_SIG_OUT0_IDX + txChannel, false, false);
+	esp_rom_gpio_connect_in_signal(pin, RMT_SIG_IN0_IDX + rxChannel, false);
+
+	installed = (rxRing != 0);
+	return installed;
+}
+
+OneWireEsp32RmtChannel::~OneWireEsp32RmtChannel()
+{
+	if (installed) {
+		rmt_driver_uninstall(rxChannel);
+		rmt_driver_uninstall(txChannel);
+	}
+}
+
+bool OneWireEsp32RmtChannel::transceive(const OneWireRmtSymbol *tx, size_t txCount,
+                                        OneWireRmtSymbol *rx, size_t *rxCount,
+                                        uint16_t idleUs)
+{
+	RingbufHandle_t ring = (RingbufHandle_t)rxRing;
+	size_t size = 0;
+	void *item;
+
+	if (!installed) {
+		*rxCount = 0;
+		return false;
+	}
+
+	// Drop anything left over from an aborted transaction
+	while ((item = xRingbufferReceive(ring, &size, 0)) != NULL)
+		vRingbufferReturnItem(ring, item);
+
+	rmt_set_rx_idle_thresh(rxChannel, idleUs);
+	rmt_rx_start(rxChannel, true);
+	// Blocks this task, not the CPU, until the last slot has gone out
+	rmt_write_items(txChannel, (const rmt_item32_t *)tx, txCount, true);
+
+	item = xRingbufferReceive(ring, &size, pdMS_TO_TICKS(ONEWIRE_RMT_TIMEOUT_MS));
+	rmt_rx_stop(rxChannel);
+	if (item == NULL) {
+		*rxCount = 0;
+		return false;
+	}
+
+	size_t n = size / sizeof(rmt_item32_t);
+	if (n > *rxCount) n = *rxCount;
+	const rmt_item32_t *items = (const rmt_item32_t *)item;
+	for (size_t i = 0; i < n; i++) {
+		rx[i].duration0 = items[i].duration0;
+		rx[i].level0 = items[i].level0;
+		rx[i].duration1 = items[i].duration1;
+		rx[i].level1 = items[i].level1;
+	}
+	*rxCount = n;
+	vRingbufferReturnItem(ring, item);
+	return true;
+}
+
+bool OneWireEsp32RmtChannel::power(bool on)
+{
+	if (!installed) return false;
+
+	// gpio_set_direction() hands the pad back to the plain GPIO output,
+	// so the TX channel is connected to it again
+	gpio_set_direction((gpio_num_t)pin, on ? GPIO_MODE_INPUT_OUTPUT : GPIO_MODE_INPUT_OUTPUT_OD);
+	esp_rom_gpio_connect_out_signal(pin, RMT_SIG_OUT0_IDX + txChannel, false, false);
+	return true;
+}
+
+#endif
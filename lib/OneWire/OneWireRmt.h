@@ -0,0 +1,147 @@
+#ifndef OneWireRmt_h
+#define OneWireRmt_h
+
+#ifdef __cplusplus
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Hardware-timed 1-Wire transport.
+//
+// Instead of bit-banging the pin with interrupts disabled, reset pulses
+// and time slots are encoded as a buffer of RMT symbols (level/duration
+// pairs, 1 tick = 1uS) and handed to a channel which transmits them and
+// captures the resulting waveform on the same open-drain pin.  A whole
+// byte (8 slots, ~560uS) goes out in one transaction and the calling
+// task blocks on the driver instead of spinning, so the CPU is free for
+// WiFi and the TCP stack while the bits are in flight.
+//
+// A write can leave the bus held high actively, the strong pullup
+// parasite powered devices need while converting or copying to EEPROM
+// (OneWire::write() with 'power' set).  The channel switches the pin to
+// push-pull for the whole write, so the pullup follows the last slot
+// without a gap, and back to open drain before the next transaction.
+//
+// The channel is a small interface so the encoder/decoder can be driven
+// by real hardware (OneWireEsp32RmtChannel) or by a simulated RMT and
+// slave model on the host.
+
+// Slot timings in uS, see the DS18B20 datasheet and Maxim AN126.
+#define ONEWIRE_RMT_RESET_LOW       480
+#define ONEWIRE_RMT_RESET_WAIT      70
+#define ONEWIRE_RMT_RESET_RECOVER   410
+#define ONEWIRE_RMT_SLOT            70
+#define ONEWIRE_RMT_WRITE1_LOW      6
+#define ONEWIRE_RMT_WRITE0_LOW      60
+#define ONEWIRE_RMT_READ_LOW        3
+#define ONEWIRE_RMT_SAMPLE          15
+
+// Receive stops after the bus has been idle for this many uS.
+#define ONEWIRE_RMT_IDLE_SLOT       (ONEWIRE_RMT_SLOT + 2)
+#define ONEWIRE_RMT_IDLE_RESET      (ONEWIRE_RMT_RESET_LOW + 60)
+
+// Largest transaction: reset (2 symbols) or one byte of slots plus the
+// end marker.
+#define ONEWIRE_RMT_MAX_SYMBOLS     10
+// A slot produces one low and one high phase; allow for glitches.
+#define ONEWIRE_RMT_MAX_RX_SYMBOLS  32
+
+// Layout-compatible with the ESP32 rmt_item32_t.
+typedef struct {
+	uint32_t duration0 : 15;
+	uint32_t level0 : 1;
+	uint32_t duration1 : 15;
+	uint32_t level1 : 1;
+} OneWireRmtSymbol;
+
+class OneWireRmtChannel
+{
+  public:
+    virtual ~OneWireRmtChannel() { }
+
+    // Transmit 'txCount' symbols and capture the bus until it has been idle
+    // for 'idleUs'.  Captured symbols are stored in 'rx' (at most *rxCount,
+    // which is updated with the number received).  Returns false if the
+    // driver timed out or the pin could not be sampled.
+    virtual bool transceive(const OneWireRmtSymbol *tx, size_t txCount,
+                            OneWireRmtSymbol *rx, size_t *rxCount,
+                            uint16_t idleUs) = 0;
+
+    // Switch the pin to push-pull (on), so that the idle level drives the
+    // bus high, or back to open drain (off).  Only called between
+    // transactions.  Returns false if the channel cannot drive the bus.
+    virtual bool power(bool on) { (void)on; return false; }
+};
+
+class OneWireRmt
+{
+  private:
+    OneWireRmtChannel *channel;
+    bool powered;
+
+  public:
+    OneWireRmt(OneWireRmtChannel *ch = 0) : channel(ch), powered(false) { }
+    void setChannel(OneWireRmtChannel *ch) { channel = ch; powered = false; }
+
+    // Same contract as OneWire::reset(): 1 if a presence pulse was seen.
+    uint8_t reset(void);
+
+    // Write the 'count' low bits of 'v', LSB first, in one transaction.
+    // With 'power' set the bus is held high afterwards, until the next
+    // transaction or power(false).
+    void write_bits(uint8_t v, uint8_t count, bool power = false);
+
+    // Read 'count' bits, LSB first, in one transaction.
+    uint8_t read_bits(uint8_t count);
+
+    // Switch the strong pullup on or off between transactions.  Returns
+    // false if the channel cannot drive the bus.
+    bool power(bool on);
+
+    // Encoders, return the number of symbols written (end marker included).
+    static size_t encodeReset(OneWireRmtSymbol *out);
+    // Read slots are encoded as write-1 slots with a shorter low pulse,
+    // which leaves the slaves more of the window before the sample point.
+    static size_t encodeSlots(OneWireRmtSymbol *out, uint8_t v, uint8_t count,
+                              uint16_t oneLow = ONEWIRE_RMT_WRITE1_LOW);
+
+    // Decoders for the captured waveform.
+    static uint8_t decodePresence(const OneWireRmtSymbol *rx, size_t count);
+    static uint8_t decodeSlots(const OneWireRmtSymbol *rx, size_t count, uint8_t bits);
+};
+
+#if defined(ARDUINO_ARCH_ESP32)
+#include <driver/rmt.h>
+
+// RMT channel pair bound to one open-drain GPIO.  The TX channel drives
+// the pin low through the GPIO matrix and idles released (high), the RX
+// channel listens on the same pin.  power() switches the pad to
+// push-pull, so the TX idle level drives the bus high.
+class OneWireEsp32RmtChannel : public OneWireRmtChannel
+{
+  private:
+    uint8_t pin;
+    rmt_channel_t txChannel;
+    rmt_channel_t rxChannel;
+    void *rxRing;
+    bool installed;
+
+  public:
+    OneWireEsp32RmtChannel(uint8_t pin, rmt_channel_t tx = RMT_CHANNEL_0,
+                           rmt_channel_t rx = RMT_CHANNEL_1)
+      : pin(pin), txChannel(tx), rxChannel(rx), rxRing(0), installed(false) { }
+    ~OneWireEsp32RmtChannel();
+
+    // Install the RMT drivers and route both channels to the pin.  Call
+    // this from setup(), not from a global constructor.
+    bool begin(void);
+
+    bool transceive(const OneWireRmtSymbol *tx, size_t txCount,
+                    OneWireRmtSymbol *rx, size_t *rxCount,
+                    uint16_t idleUs);
+    bool power(bool on);
+};
+#endif
+
+#endif // __cplusplus
+#endif // OneWireRmt_h
@@ -0,0 +1,262 @@
+// Incremental bus topology tracker, see OneWireTopology.h.
+
+#include <string.h>
+#include "OneWireTopology.h"
+
+#if ONEWIRE_SEARCH
+
+#define SEARCHROM 0xF0
+
+static inline uint8_t romBit(const uint8_t *rom, uint8_t bit)
+{
+	return (rom[bit >> 3] >> (bit & 7)) & 1;
+}
+
+static inline void setRomBit(uint8_t *rom, uint8_t bit, uint8_t value)
+{
+	if (value)
+		rom[bit >> 3] |= (1 << (bit & 7));
+	else
+		rom[bit >> 3] &= ~(1 << (bit & 7));
+}
+
+// true if a and b agree on bits [0, bits)
+static bool samePrefix(const uint8_t *a, const uint8_t *b, uint8_t bits)
+{
+	uint8_t bytes = bits >> 3;
+	if (memcmp(a, b, bytes) != 0) return false;
+	if (bits & 7) {
+		uint8_t mask = (1 << (bits & 7)) - 1;
+		if ((a[bytes] ^ b[bytes]) & mask) return false;
+	}
+	return true;
+}
+
+OneWireTopology::OneWireTopology(OneWire *wire, uint8_t family)
+  : _wire(wire), _family(family), _handler(0), _count(0), _cursor(0)
+{
+}
+
+const uint8_t *OneWireTopology::address(uint8_t index) const
+{
+	return index < _count ? _roms[index] : 0;
+}
+
+bool OneWireTopology::contains(const uint8_t *rom) const
+{
+	for (uint8_t i = 0; i < _count; i++) {
+		if (memcmp(_roms[i], rom, 8) == 0) return true;
+	}
+	return false;
+}
+
+void OneWireTopology::suspect(const uint8_t *rom)
+{
+	for (uint8_t i = 0; i < _count; i++) {
+		if (memcmp(_roms[i], rom, 8) == 0) _suspect[i] = true;
+	}
+}
+
+void OneWireTopology::report(const uint8_t *rom, bool added)
+{
+	if (_handler) _handler(rom, added);
+}
+
+void OneWireTopology::add(const uint8_t *rom)
+{
+	if (_count >= ONEWIRE_TOPOLOGY_MAX || contains(rom)) return;
+	memcpy(_roms[_count], rom, 8);
+	_suspect[_count] = false;
+	_misses[_count] = 0;
+	_count++;
+	report(rom, true);
+}
+
+void OneWireTopology::remove(uint8_t index)
+{
+	uint8_t rom[8];
+
+	memcpy(rom, _roms[index], 8);
+	_count--;
+	if (index != _count) {
+		memcpy(_roms[index], _roms[_count], 8);
+		_suspect[index] = _suspect[_count];
+		_misses[index] = _misses[_count];
+	}
+	report(rom, false);
+}
+
+uint8_t OneWireTopology::begin(void)
+{
+	uint8_t rom[8];
+	uint8_t before = _count;
+
+	_wire->reset_search();
+	if (_family) _wire->target_search(_family);
+	while (_wire->search(rom)) {
+		if (_family && rom[0] != _family) break;
+		if (OneWire::crc8(rom, 7) != rom[7]) continue;
+		add(rom);
+	}
+	_wire->reset_search();
+	return _count - before;
+}
+
+uint8_t OneWireTopology::knownBranches(const uint8_t *rom, uint8_t bit) const
+{
+	uint8_t r = 0;
+
+	for (uint8_t i = 0; i < _count && r != 3; i++) {
+		if (samePrefix(_roms[i], rom, bit))
+			r |= 1 << romBit(_roms[i], bit);
+	}
+	return r;
+}
+
+void OneWireTopology::markSuspects(const uint8_t *rom, uint8_t bit, uint8_t value)
+{
+	for (uint8_t i = 0; i < _count; i++) {
+		if (samePrefix(_roms[i], rom, bit) && romBit(_roms[i], bit) == value)
+			_suspect[i] = true;
+	}
+}
+
+// One search pass steered along 'target' (or, with no target, towards the
+// lowest ROM).  Within the family prefix the pass is forced, elsewhere it
+// follows the target as long as the known set accounts for every device
+// answering.  When an unknown branch shows up the pass leaves the target
+// and takes that branch, always preferring 0 below it, so the new device's
+// ROM comes back in 'found'.
+uint8_t OneWireTopology::guidedPass(const uint8_t *target, uint8_t *found)
+{
+	uint8_t path[8];
+	bool exploring = (target == 0);
+	uint8_t result = PASS_OK;
+
+	memset(path, 0, 8);
+	if (!_wire->reset()) {
+		// no presence pulse, every known device is gone
+		markSuspects(path, 0, 0);
+		markSuspects(path, 0, 1);
+		return _count ? PASS_SUSPECT : PASS_FAILED;
+	}
+	_wire->write(SEARCHROM);
+
+	for (uint8_t bit = 0; bit < 64; bit++) {
+		uint8_t a = _wire->read_bit();
+		uint8_t b = _wire->read_bit();
+		uint8_t dir;
+
+		if (a && b) {
+			// nobody left on this path
+			if (!exploring) {
+				markSuspects(path, bit, 0);
+				markSuspects(path, bit, 1);
+				return PASS_SUSPECT;
+			}
+			return PASS_FAILED;
+		}
+
+		if (bit < 8 && _family) {
+			dir = romBit(&_family, bit);
+			if (a != b && a != dir) {
+				// nothing of this family answers
+				if (exploring) return PASS_FAILED;
+				markSuspects(path, bit, dir);
+				return PASS_SUSPECT;
+			}
+		} else if (exploring) {
+			dir = (a != b) ? a : 0;
+		} else {
+			uint8_t want = romBit(target, bit);
+			uint8_t known = knownBranches(path, bit);
+
+			if (a != b) {
+				// only 'a' answered; known devices on the other side are gone
+				if (known & (1 << !a)) {
+					markSuspects(path, bit, !a);
+					result = PASS_SUSPECT;
+				}
+				if (a != want) return PASS_SUSPECT;
+				dir = a;
+			} else if (!(known & (1 << !want))) {
+				// both answered but only one side is known
+				dir = !want;
+				exploring = true;
+			} else {
+				dir = want;
+			}
+		}
+
+		setRomBit(path, bit, dir);
+		_wire->write_bit(dir);
+	}
+
+	if (exploring) {
+		if (OneWire::crc8(path, 7) != path[7]) return PASS_FAILED;
+		memcpy(found, path, 8);
+		return PASS_ADDED;
+	}
+	return result;
+}
+
+// Directed pass along exactly 'rom'.
+bool OneWireTopology::verify(const uint8_t *rom)
+{
+	if (!_wire->reset()) return false;
+	_wire->write(SEARCHROM);
+
+	for (uint8_t bit = 0; bit < 64; bit++) {
+		uint8_t a = _wire->read_bit();
+		uint8_t b = _wire->read_bit();
+		uint8_t dir = romBit(rom, bit);
+
+		if (a && b) return false;
+		if (a != b && a != dir) return false;
+		_wire->write_bit(dir);
+	}
+	return true;
+}
+
+uint8_t OneWireTopology::poll(void)
+{
+	uint8_t found[8];
+	uint8_t r;
+
+	// confirm suspects first, one per call; a suspect that misses stays
+	// suspect until it has missed ONEWIRE_TOPOLOGY_MISSES times in a row
+	for (uint8_t i = 0; i < _count; i++) {
+		if (!_suspect[i]) continue;
+		if (verify(_roms[i])) {
+			_suspect[i] = false;
+			_misses[i] = 0;
+			return 0;
+		}
+		if (++_misses[i] < ONEWIRE_TOPOLOGY_MISSES) return 0;
+		remove(i);
+		return 1;
+	}
+
+	if (_count == 0) {
+		r = guidedPass(0, found);
+	} else {
+		if (_cursor >= _count) _cursor = 0;
+		r = guidedPass(_roms[_cursor], found);
+	}
+
+	switch (r) {
+	case PASS_ADDED:
+		if (_family && found[0] != _family) return 0;
+		add(found);
+		// revisit the same path next time, there may be more below it
+		return 1;
+	case PASS_OK:
+		_cursor++;
+		return 0;
+	default:
+		// suspects are verified on the following polls
+		return 0;
+	}
+}
+
+#endif // ONEWIRE_SEARCH
@@ -0,0 +1,95 @@
+#ifndef OneWireTopology_h
+#define OneWireTopology_h
+
+#ifdef __cplusplus
+
+#include <stdint.h>
+#include "OneWire.h"
+
+#if ONEWIRE_SEARCH
+
+// Incremental bus topology tracker.
+//
+// begin() enumerates the bus once.  After that every poll() performs a
+// single guided search pass (one reset plus 64 search triplets, ~15ms of
+// bus time) along the path of one known ROM, rotating through the known
+// set.  At each bit the pass compares what the bus answers with the
+// branches the known set predicts:
+//
+//   - both bits present where only one is known: an unknown device sits
+//     on the other branch, so the pass follows it and returns its ROM in
+//     the same pass (added)
+//   - a known branch does not answer: every known ROM below it is
+//     suspect and gets verified with a directed pass, and is removed
+//     once ONEWIRE_TOPOLOGY_MISSES passes in a row miss it, so that one
+//     corrupted slot on a long bus does not drop a device
+//
+// Every unknown device shares its longest known prefix with some known
+// ROM, so one round over the known set is guaranteed to find it, without
+// ever re-enumerating the whole bus.  Passes can be restricted to one
+// family code (e.g. DS18B20MODEL), which turns the first byte into a
+// fixed prefix.
+
+#ifndef ONEWIRE_TOPOLOGY_MAX
+#define ONEWIRE_TOPOLOGY_MAX 64
+#endif
+
+// consecutive failed verifications before a device counts as removed
+#ifndef ONEWIRE_TOPOLOGY_MISSES
+#define ONEWIRE_TOPOLOGY_MISSES 2
+#endif
+
+class OneWireTopology
+{
+  public:
+    // rom is the device that appeared (added = true) or disappeared
+    typedef void TopologyHandler(const uint8_t *rom, bool added);
+
+    OneWireTopology(OneWire *wire, uint8_t family = 0);
+
+    void setHandler(TopologyHandler *handler) { _handler = handler; }
+
+    // Full enumeration.  Reports every device found as added.
+    uint8_t begin(void);
+
+    // One guided pass or one verification.  Returns the number of events
+    // reported.
+    uint8_t poll(void);
+
+    uint8_t count(void) const { return _count; }
+    const uint8_t *address(uint8_t index) const;
+    bool contains(const uint8_t *rom) const;
+
+    // Hint from a failed read (e.g. DEVICE_DISCONNECTED from a probe):
+    // verify this ROM on the next poll.
+    void suspect(const uint8_t *rom);
+
+  private:
+    enum { PASS_OK, PASS_ADDED, PASS_SUSPECT, PASS_FAILED };
+
+    // bit 0 set if a known ROM matching rom[0..bit) has a 0 at 'bit',
+    // bit 1 set if one has a 1
+    uint8_t knownBranches(const uint8_t *rom, uint8_t bit) const;
+    void markSuspects(const uint8_t *rom, uint8_t bit, uint8_t value);
+
+    uint8_t guidedPass(const uint8_t *target, uint8_t *found);
+    bool verify(const uint8_t *rom);
+
+    void add(const uint8_t *rom);
+    void remove(uint8_t index);
+    void report(const uint8_t *rom, bool added);
+
+    OneWire *_wire;
+    uint8_t _family;
+    TopologyHandler *_handler;
+
+    uint8_t _roms[ONEWIRE_TOPOLOGY_MAX][8];
+    bool _suspect[ONEWIRE_TOPOLOGY_MAX];
+    uint8_t _misses[ONEWIRE_TOPOLOGY_MAX];
+    uint8_t _count;
+    uint8_t _cursor;
+};
+
+#endif // ONEWIRE_SEARCH
+#endif // __cplusplus
+#endif // OneWireTopology_h
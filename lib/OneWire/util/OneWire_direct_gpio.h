@@ -9,7 +9,25 @@
 
 // Platform specific I/O definitions
 
-#if defined(__AVR__)
+#if defined(ONEWIRE_HOST)
+// Host build: the pin is a handle into a simulated bus (see OneWireSim),
+// which provides these functions and keeps the virtual clock that
+// delayMicroseconds() advances.
+#define PIN_TO_BASEREG(pin)             (0)
+#define PIN_TO_BITMASK(pin)             (pin)
+#define IO_REG_TYPE uint32_t
+#define IO_REG_BASE_ATTR
+#define IO_REG_MASK_ATTR
+uint8_t onewire_host_read(IO_REG_TYPE pin);
+void onewire_host_write(IO_REG_TYPE pin, uint8_t level);
+void onewire_host_mode(IO_REG_TYPE pin, uint8_t output);
+#define DIRECT_READ(base, pin)          onewire_host_read(pin)
+#define DIRECT_WRITE_LOW(base, pin)     onewire_host_write(pin, 0)
+#define DIRECT_WRITE_HIGH(base, pin)    onewire_host_write(pin, 1)
+#define DIRECT_MODE_INPUT(base, pin)    onewire_host_mode(pin, 0)
+#define DIRECT_MODE_OUTPUT(base, pin)   onewire_host_mode(pin, 1)
+
+#elif defined(__AVR__)
 #define PIN_TO_BASEREG(pin)             (portInputRegister(digitalPinToPort(pin)))
 #define PIN_TO_BITMASK(pin)             (digitalPinToBitMask(pin))
 #define IO_REG_TYPE uint8_t
@@ -5,7 +5,10 @@
 
 // Platform specific I/O register type
 
-#if defined(__AVR__)
+#if defined(ONEWIRE_HOST)
+#define IO_REG_TYPE uint32_t
+
+#elif defined(__AVR__)
 #define IO_REG_TYPE uint8_t
 
 #elif defined(__MK20DX128__) || defined(__MK20DX256__) || defined(__MK66FX1M0__) || defined(__MK64FX512__)
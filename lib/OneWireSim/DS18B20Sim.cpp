@@ -0,0 +1,189 @@
+// DS18B20 model for the simulated bus, see DS18B20Sim.h.
+
+#if defined(ONEWIRE_HOST)
+
+#include "DS18B20Sim.h"
+
+// Function commands
+#define STARTCONVO      0x44
+#define COPYSCRATCH     0x48
+#define READSCRATCH     0xBE
+#define WRITESCRATCH    0x4E
+#define RECALLSCRATCH   0xB8
+#define READPOWERSUPPLY 0xB4
+
+// EEPROM copy time, datasheet max
+#define COPY_MICROS     10000
+
+DS18B20Sim::DS18B20Sim(const uint8_t rom[8], bool parasite)
+  : OneWireSimDevice(rom), current(25 * 16), parasite(parasite), alarm(false),
+    converting(false), convertStart(0), convertDone(0), copyDone(0),
+    status(STATUS_CONVERT), rxIndex(0), crcErrors(0), eepromWriteCount(0),
+    conversionCount(0), readCount(0), writeCount(0)
+{
+	// power-on state: 85C, TH/TL/config recalled from factory EEPROM
+	nv[0] = 0x4B;
+	nv[1] = 0x46;
+	nv[2] = 0x7F;
+	sp[0] = 0x50;
+	sp[1] = 0x05;
+	sp[2] = nv[0];
+	sp[3] = nv[1];
+	sp[4] = nv[2];
+	sp[5] = 0xFF;
+	sp[6] = 0x0C;
+	sp[7] = 0x10;
+	sp[8] = OneWire::crc8(sp, 8);
+}
+
+void DS18B20Sim::setTemperature(float celsius)
+{
+	float r = celsius * 16.0f;
+	current = (int16_t)(r < 0 ? r - 0.5f : r + 0.5f);
+}
+
+uint8_t DS18B20Sim::resolution() const
+{
+	return 9 + ((sp[4] >> 5) & 0x03);
+}
+
+uint32_t DS18B20Sim::conversionMicros(uint8_t resolution)
+{
+	switch (resolution) {
+	case 9:
+		return 93750;
+	case 10:
+		return 187500;
+	case 11:
+		return 375000;
+	default:
+		return 750000;
+	}
+}
+
+// Store the current temperature, truncated to the configured resolution,
+// and update the alarm flag.  Only bits 11..4 are compared against TH/TL.
+void DS18B20Sim::latch()
+{
+	int16_t raw = current & ~((1 << (12 - resolution())) - 1);
+	int8_t whole = (int8_t)(raw >> 4);
+
+	sp[0] = raw & 0xFF;
+	sp[1] = (raw >> 8) & 0xFF;
+	alarm = whole >= (int8_t)sp[2] || whole <= (int8_t)sp[3];
+}
+
+void DS18B20Sim::settle()
+{
+	if (!converting || OneWireSimClock::now() < convertDone) return;
+
+	converting = false;
+	conversionCount++;
+	if (parasite && (!bus || !bus->strongPullupHeld(convertStart, convertDone))) {
+		// brown-out during conversion, the part comes back with 85C
+		sp[0] = 0x50;
+		sp[1] = 0x05;
+		return;
+	}
+	latch();
+}
+
+bool DS18B20Sim::alarmed()
+{
+	settle();
+	return alarm;
+}
+
+uint8_t DS18B20Sim::statusBit()
+{
+	switch (status) {
+	case STATUS_CONVERT:
+		return converting ? 0 : 1;
+	case STATUS_COPY:
+		return OneWireSimClock::now() < copyDone ? 0 : 1;
+	case STATUS_POWER:
+		return parasite ? 0 : 1;
+	default:
+		return 1;
+	}
+}
+
+void DS18B20Sim::functionCommand(uint8_t cmd)
+{
+	uint8_t buf[9];
+
+	switch (cmd) {
+	case STARTCONVO:
+		converting = true;
+		convertStart = OneWireSimClock::now();
+		convertDone = convertStart + conversionMicros(resolution());
+		status = STATUS_CONVERT;
+		transmitStatus();
+		break;
+
+	case READSCRATCH:
+		settle();
+		readCount++;
+		sp[8] = OneWire::crc8(sp, 8);
+		for (uint8_t i = 0; i < 9; i++) buf[i] = sp[i];
+		if (crcErrors) {
+			crcErrors--;
+			buf[0] ^= 0x01;
+		}
+		transmit(buf, 9);
+		break;
+
+	case WRITESCRATCH:
+		rxIndex = 0;
+		receive();
+		break;
+
+	case COPYSCRATCH:
+		nv[0] = sp[2];
+		nv[1] = sp[3];
+		nv[2] = sp[4];
+		eepromWriteCount++;
+		copyDone = OneWireSimClock::now() + COPY_MICROS;
+		status = STATUS_COPY;
+		transmitStatus();
+		break;
+
+	case RECALLSCRATCH:
+		sp[2] = nv[0];
+		sp[3] = nv[1];
+		sp[4] = nv[2];
+		status = STATUS_RECALL;
+		transmitStatus();
+		break;
+
+	case READPOWERSUPPLY:
+		status = STATUS_POWER;
+		transmitStatus();
+		break;
+
+	default:
+		deselect();
+		break;
+	}
+}
+
+// Write Scratchpad: TH, TL, configuration.  Only the resolution bits of
+// the configuration register are writable.
+void DS18B20Sim::dataByte(uint8_t b)
+{
+	switch (rxIndex++) {
+	case 0:
+		sp[2] = b;
+		break;
+	case 1:
+		sp[3] = b;
+		break;
+	case 2:
+		sp[4] = (b & 0x60) | 0x1F;
+		writeCount++;
+		deselect();
+		break;
+	}
+}
+
+#endif // ONEWIRE_HOST
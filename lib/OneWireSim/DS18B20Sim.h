@@ -0,0 +1,71 @@
+#ifndef DS18B20Sim_h
+#define DS18B20Sim_h
+
+#include "OneWireSim.h"
+
+// DS18B20 model for the simulated bus: scratchpad and EEPROM, resolution
+// dependent conversion time, alarm flag for conditional search, parasite
+// power (a conversion without the strong pullup held fails and leaves the
+// 85C power-on value) and injectable scratchpad CRC errors.
+class DS18B20Sim : public OneWireSimDevice
+{
+  public:
+    DS18B20Sim(const uint8_t rom[8], bool parasite = false);
+
+    // Temperature latched by the next conversion.
+    void setTemperature(float celsius);
+    float temperature() const { return current / 16.0f; }
+
+    void setParasite(bool on) { parasite = on; }
+    bool isParasite() const { return parasite; }
+
+    // Corrupt the next 'count' scratchpad reads so their CRC fails.
+    void injectCrcErrors(uint8_t count) { crcErrors = count; }
+
+    const uint8_t *scratchpad() const { return sp; }
+    const uint8_t *eeprom() const { return nv; }
+    uint8_t resolution() const;
+    bool alarmFlag() { settle(); return alarm; }
+
+    uint32_t eepromWrites() const { return eepromWriteCount; }
+    uint32_t conversions() const { return conversionCount; }
+    uint32_t scratchpadReads() const { return readCount; }
+    uint32_t scratchpadWrites() const { return writeCount; }
+
+    // Datasheet maximum conversion time for a resolution, in uS.
+    static uint32_t conversionMicros(uint8_t resolution);
+
+    void settle();
+
+  protected:
+    void functionCommand(uint8_t cmd);
+    void dataByte(uint8_t b);
+    bool alarmed();
+    uint8_t statusBit();
+
+  private:
+    enum Status { STATUS_CONVERT, STATUS_COPY, STATUS_RECALL, STATUS_POWER };
+
+    void latch();
+
+    uint8_t sp[9];
+    uint8_t nv[3];
+    int16_t current;        // 1/16 C
+    bool parasite;
+    bool alarm;
+
+    bool converting;
+    uint64_t convertStart;
+    uint64_t convertDone;
+    uint64_t copyDone;
+    Status status;
+    uint8_t rxIndex;
+    uint8_t crcErrors;
+
+    uint32_t eepromWriteCount;
+    uint32_t conversionCount;
+    uint32_t readCount;
+    uint32_t writeCount;
+};
+
+#endif // DS18B20Sim_h
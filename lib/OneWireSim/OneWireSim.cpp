@@ -0,0 +1,488 @@
+// Host-side 1-Wire bus simulator, see OneWireSim.h.
+
+#if defined(ONEWIRE_HOST)
+
+#include <Arduino.h>
+#include "OneWireSim.h"
+#include <string.h>
+
+static OneWireSimBus *buses[ONEWIRE_SIM_MAX_BUSES];
+
+// ROM commands
+#define READROM         0x33
+#define MATCHROM        0x55
+#define SKIPROM         0xCC
+#define SEARCHROM       0xF0
+#define ALARMSEARCH     0xEC
+
+//
+// Device
+//
+
+OneWireSimDevice::OneWireSimDevice(const uint8_t rom[8])
+  : bus(0), phase(PHASE_IDLE), shift(0), bitCount(0), matchIndex(0),
+    searchBit(0), searchStep(0), txLen(0), txBit(0), romAfterTx(false)
+{
+	memcpy(romCode, rom, 8);
+}
+
+void OneWireSimDevice::makeRom(uint8_t family, uint64_t serial, uint8_t rom[8])
+{
+	rom[0] = family;
+	for (uint8_t i = 1; i < 7; i++) {
+		rom[i] = serial & 0xFF;
+		serial >>= 8;
+	}
+	rom[7] = OneWire::crc8(rom, 7);
+}
+
+void OneWireSimDevice::busReset(OneWireSimBus *b)
+{
+	bus = b;
+	settle();
+	phase = PHASE_ROM_CMD;
+	shift = 0;
+	bitCount = 0;
+	romAfterTx = false;
+}
+
+void OneWireSimDevice::transmit(const uint8_t *buf, uint8_t len)
+{
+	if (len > sizeof(txBuf)) len = sizeof(txBuf);
+	memcpy(txBuf, buf, len);
+	txLen = len;
+	txBit = 0;
+	phase = PHASE_TX_DATA;
+}
+
+// Returns the level this device puts on the bus for the slot that just
+// started: 0 to hold it low, 1 to leave it to the pullup.
+uint8_t OneWireSimDevice::slotBegin()
+{
+	uint8_t romBit;
+
+	settle();
+	switch (phase) {
+	case PHASE_TX_DATA:
+		if (txBit >= txLen * 8) return 1;
+		return (txBuf[txBit / 8] >> (txBit % 8)) & 1;
+
+	case PHASE_SEARCH:
+		romBit = (romCode[searchBit / 8] >> (searchBit % 8)) & 1;
+		if (searchStep == 0) return romBit;
+		if (searchStep == 1) return !romBit;
+		return 1;
+
+	case PHASE_TX_STATUS:
+		return statusBit();
+
+	default:
+		return 1;
+	}
+}
+
+void OneWireSimDevice::slotEnd(uint8_t masterBit)
+{
+	uint8_t romBit;
+
+	switch (phase) {
+	case PHASE_IDLE:
+	case PHASE_TX_STATUS:
+		return;
+
+	case PHASE_TX_DATA:
+		if (txBit < txLen * 8) txBit++;
+		if (romAfterTx && txBit == txLen * 8) {
+			romAfterTx = false;
+			phase = PHASE_FUNC_CMD;
+		}
+		return;
+
+	case PHASE_SEARCH:
+		if (searchStep < 2) {
+			searchStep++;
+			return;
+		}
+		romBit = (romCode[searchBit / 8] >> (searchBit % 8)) & 1;
+		if (masterBit != romBit) {
+			phase = PHASE_IDLE;
+			return;
+		}
+		searchStep = 0;
+		if (++searchBit == 64) phase = PHASE_FUNC_CMD;
+		return;
+
+	default:
+		if (masterBit) shift |= (1 << bitCount);
+		if (++bitCount == 8) {
+			uint8_t b = shift;
+			shift = 0;
+			bitCount = 0;
+			byteReceived(b);
+		}
+		return;
+	}
+}
+
+void OneWireSimDevice::byteReceived(uint8_t b)
+{
+	switch (phase) {
+	case PHASE_ROM_CMD:
+		switch (b) {
+		case READROM:
+			transmit(romCode, 8);
+			romAfterTx = true;
+			break;
+		case MATCHROM:
+			matchIndex = 0;
+			phase = PHASE_MATCH;
+			break;
+		case SKIPROM:
+			phase = PHASE_FUNC_CMD;
+			break;
+		case ALARMSEARCH:
+			if (!alarmed()) {
+				phase = PHASE_IDLE;
+				break;
+			}
+			// fall through
+		case SEARCHROM:
+			searchBit = 0;
+			searchStep = 0;
+			phase = PHASE_SEARCH;
+			break;
+		default:
+			phase = PHASE_IDLE;
+			break;
+		}
+		break;
+
+	case PHASE_MATCH:
+		if (b != romCode[matchIndex]) {
+			phase = PHASE_IDLE;
+		} else if (++matchIndex == 8) {
+			phase = PHASE_FUNC_CMD;
+		}
+		break;
+
+	case PHASE_FUNC_CMD:
+		functionCommand(b);
+		break;
+
+	case PHASE_RX_DATA:
+		dataByte(b);
+		break;
+
+	default:
+		break;
+	}
+}
+
+//
+// Bus
+//
+
+OneWireSimBus::OneWireSimBus(uint8_t pin)
+  : pin(pin), pullupPin(-1), count(0), output(false), latch(1),
+    masterLow(false), lowSince(0), slaveLowUntil(0), presenceFrom(0),
+    presenceUntil(0), strong(false), external(false), strongSince(0),
+    resets(0), slots(0)
+{
+	for (uint8_t i = 0; i < ONEWIRE_SIM_MAX_BUSES; i++) {
+		if (!buses[i]) {
+			buses[i] = this;
+			break;
+		}
+	}
+}
+
+OneWireSimBus::~OneWireSimBus()
+{
+	for (uint8_t i = 0; i < ONEWIRE_SIM_MAX_BUSES; i++) {
+		if (buses[i] == this) buses[i] = 0;
+	}
+}
+
+OneWireSimBus *OneWireSimBus::forPin(uint8_t pin)
+{
+	for (uint8_t i = 0; i < ONEWIRE_SIM_MAX_BUSES; i++) {
+		if (buses[i] && buses[i]->pin == pin) return buses[i];
+	}
+	return 0;
+}
+
+OneWireSimBus *OneWireSimBus::forPullupPin(uint8_t pin)
+{
+	for (uint8_t i = 0; i < ONEWIRE_SIM_MAX_BUSES; i++) {
+		if (buses[i] && buses[i]->pullupPin == pin) return buses[i];
+	}
+	return 0;
+}
+
+bool OneWireSimBus::attach(OneWireSimDevice *device)
+{
+	for (uint8_t i = 0; i < count; i++) {
+		if (devices[i] == device) return true;
+	}
+	if (count >= ONEWIRE_SIM_MAX_DEVICES) return false;
+	device->bus = this;
+	device->phase = OneWireSimDevice::PHASE_IDLE;
+	devices[count++] = device;
+	return true;
+}
+
+void OneWireSimBus::detach(OneWireSimDevice *device)
+{
+	for (uint8_t i = 0; i < count; i++) {
+		if (devices[i] == device) {
+			devices[i] = devices[--count];
+			return;
+		}
+	}
+}
+
+void OneWireSimBus::masterWrite(uint8_t level)
+{
+	latch = level ? 1 : 0;
+	update();
+}
+
+void OneWireSimBus::masterMode(uint8_t out)
+{
+	output = out != 0;
+	update();
+}
+
+void OneWireSimBus::externalPullup(bool on)
+{
+	external = on;
+	update();
+}
+
+uint8_t OneWireSimBus::masterRead()
+{
+	uint64_t now = OneWireSimClock::now();
+
+	if (masterLow) return 0;
+	if (now < slaveLowUntil) return 0;
+	if (now >= presenceFrom && now < presenceUntil) return 0;
+	return 1;
+}
+
+bool OneWireSimBus::strongPullupHeld(uint64_t from, uint64_t to) const
+{
+	(void)to;
+	// update() settles every device before the pullup is dropped, so if
+	// it is still on now it has been on up to the end of any conversion
+	// being settled.
+	return strong && strongSince <= from;
+}
+
+OneWireSimStats OneWireSimBus::stats() const
+{
+	OneWireSimStats s = { OneWireSimClock::now(), resets, slots };
+	return s;
+}
+
+// Apply a change on the master side of the pin.  Slaves act on the edges
+// of the master's low pulses: the falling edge starts a slot (and lets a
+// transmitting slave decide whether to hold the bus), the rising edge
+// ends it, or is a reset if the pulse was long enough.
+void OneWireSimBus::update()
+{
+	uint64_t now = OneWireSimClock::now();
+	bool low = output && latch == 0;
+	bool pulled = (output && latch == 1) || external;
+
+	if (pulled != strong) {
+		// conversions finishing under the old pullup state see it
+		for (uint8_t i = 0; i < count; i++) devices[i]->settle();
+		strong = pulled;
+		if (strong) strongSince = now;
+	}
+
+	if (low && !masterLow) {
+		masterLow = true;
+		lowSince = now;
+		for (uint8_t i = 0; i < count; i++) {
+			if (devices[i]->slotBegin() == 0)
+				slaveLowUntil = now + ONEWIRE_SIM_SLAVE_HOLD;
+		}
+	} else if (!low && masterLow) {
+		masterLow = false;
+		if (now - lowSince >= ONEWIRE_SIM_RESET_MIN) {
+			resets++;
+			slaveLowUntil = 0;
+			presenceFrom = presenceUntil = 0;
+			for (uint8_t i = 0; i < count; i++) devices[i]->busReset(this);
+			if (count) {
+				presenceFrom = now + ONEWIRE_SIM_PRESENCE_WAIT;
+				presenceUntil = presenceFrom + ONEWIRE_SIM_PRESENCE_LOW;
+			}
+		} else {
+			uint8_t bit = (now - lowSince) < ONEWIRE_SIM_SAMPLE;
+			slots++;
+			for (uint8_t i = 0; i < count; i++) devices[i]->slotEnd(bit);
+		}
+	}
+}
+
+//
+// Simulated RMT channel
+//
+
+struct RmtCapture
+{
+	OneWireRmtSymbol *rx;
+	size_t max;
+	size_t n;
+	bool half;          // next phase goes into the second half of rx[n]
+	bool started;       // capture starts on the first falling edge
+	uint8_t level;
+	uint32_t run;
+
+	void push(uint8_t lvl, uint32_t duration) {
+		if (n >= max) return;
+		if (duration > 0x7FFF) duration = 0x7FFF;
+		if (!half) {
+			rx[n].level0 = lvl;
+			rx[n].duration0 = duration;
+			rx[n].level1 = lvl;
+			rx[n].duration1 = 0;
+			half = true;
+		} else {
+			rx[n].level1 = lvl;
+			rx[n].duration1 = duration;
+			half = false;
+			n++;
+		}
+	}
+
+	// Feed one 1uS sample, returns true on an edge
+	bool sample(uint8_t lvl) {
+		if (!started) {
+			if (lvl) return false;
+			started = true;
+			level = 0;
+			run = 1;
+			return true;
+		}
+		if (lvl == level) {
+			run++;
+			return false;
+		}
+		push(level, run);
+		level = lvl;
+		run = 1;
+		return true;
+	}
+
+	size_t finish() {
+		// the final phase ends in idle, which the RMT reports as a zero
+		// duration
+		push(level, 0);
+		if (half) n++;
+		return n < max ? n : max;
+	}
+};
+
+bool OneWireSimRmtChannel::transceive(const OneWireRmtSymbol *tx, size_t txCount,
+                                      OneWireRmtSymbol *rx, size_t *rxCount,
+                                      uint16_t idleUs)
+{
+	RmtCapture cap = { rx, *rxCount, 0, false, false, 1, 0 };
+	uint32_t idle = 0;
+
+	for (size_t i = 0; i < txCount; i++) {
+		uint16_t duration[2] = { (uint16_t)tx[i].duration0, (uint16_t)tx[i].duration1 };
+		uint8_t level[2] = { (uint8_t)tx[i].level0, (uint8_t)tx[i].level1 };
+
+		for (uint8_t h = 0; h < 2; h++) {
+			if (duration[h] == 0) {
+				i = txCount;
+				break;
+			}
+			// open drain: 0 drives the pin low, 1 releases it; push-pull
+			// (powered) drives the 1 as well
+			bus->masterWrite(level[h]);
+			bus->masterMode(level[h] == 0 || pushPull);
+			for (uint16_t t = 0; t < duration[h]; t++) {
+				OneWireSimClock::advance(1);
+				if (cap.sample(bus->masterRead())) idle = 0;
+				else idle++;
+			}
+		}
+	}
+
+	// keep listening until the bus has been quiet long enough, at the
+	// idle level
+	bus->masterWrite(1);
+	bus->masterMode(pushPull);
+	while (idle < idleUs) {
+		OneWireSimClock::advance(1);
+		if (cap.sample(bus->masterRead())) idle = 0;
+		else idle++;
+	}
+
+	*rxCount = cap.started ? cap.finish() : 0;
+	return true;
+}
+
+// Switches the pad between open drain and push-pull, like the ESP32
+// channel; with the TX idling high, push-pull drives the bus high.
+bool OneWireSimRmtChannel::power(bool on)
+{
+	pushPull = on;
+	bus->masterWrite(1);
+	bus->masterMode(on);
+	return true;
+}
+
+//
+// Host pin layer, see util/OneWire_direct_gpio.h
+//
+
+uint8_t onewire_host_read(uint32_t pin)
+{
+	OneWireSimBus *bus = OneWireSimBus::forPin(pin);
+	return bus ? bus->masterRead() : 1;
+}
+
+void onewire_host_write(uint32_t pin, uint8_t level)
+{
+	OneWireSimBus *bus = OneWireSimBus::forPin(pin);
+	if (bus) bus->masterWrite(level);
+}
+
+void onewire_host_mode(uint32_t pin, uint8_t output)
+{
+	OneWireSimBus *bus = OneWireSimBus::forPin(pin);
+	if (bus) bus->masterMode(output);
+}
+
+//
+// Pins of the Arduino shim (lib/ArduinoHost)
+//
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+	OneWireSimBus *bus = OneWireSimBus::forPin(pin);
+	if (bus) bus->masterMode(mode == OUTPUT);
+}
+
+// DallasTemperature drives its external pullup pin low to switch the
+// strong pullup on.
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+	OneWireSimBus *bus = OneWireSimBus::forPullupPin(pin);
+	if (bus) bus->externalPullup(val == LOW);
+	bus = OneWireSimBus::forPin(pin);
+	if (bus) bus->masterWrite(val);
+}
+
+int digitalRead(uint8_t pin)
+{
+	return onewire_host_read(pin);
+}
+
+#endif // ONEWIRE_HOST
@@ -0,0 +1,205 @@
+#ifndef OneWireSim_h
+#define OneWireSim_h
+
+// Host-side 1-Wire bus simulator.
+//
+// OneWire.cpp and DallasTemperature.cpp are built natively against the
+// ONEWIRE_HOST pin layer in util/OneWire_direct_gpio.h and the Arduino
+// shim in lib/ArduinoHost, which is what the native environment in
+// platformio.ini does for the tests under test/ (pio test -e native).
+//
+// Every pin operation the master performs is applied to a simulated
+// open-drain bus running on a virtual microsecond clock, which
+// delay()/delayMicroseconds() advance.  Slaves see the same edges a real
+// device would: a low longer than 400uS is a reset, anything shorter is a
+// time slot that reads as 1 if released before 15uS.  Slaves answering a
+// slot with a 0 hold the bus low for 30uS.
+//
+// Since no real time passes, bus time consumed by an API call is simply
+// the difference of two stats() snapshots, which makes search, sweep and
+// conversion strategies directly comparable and repeatable.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <Arduino.h>
+#include <OneWire.h>
+
+// enough for more devices than DallasTemperature shadows
+#ifndef ONEWIRE_SIM_MAX_DEVICES
+#define ONEWIRE_SIM_MAX_DEVICES 96
+#endif
+
+#ifndef ONEWIRE_SIM_MAX_BUSES
+#define ONEWIRE_SIM_MAX_BUSES   8
+#endif
+
+// Slave timing in uS
+#define ONEWIRE_SIM_RESET_MIN       400   // shortest low seen as a reset
+#define ONEWIRE_SIM_SAMPLE          15    // slaves sample write slots here
+#define ONEWIRE_SIM_SLAVE_HOLD      30    // a transmitted 0 holds the bus this long
+#define ONEWIRE_SIM_PRESENCE_WAIT   30
+#define ONEWIRE_SIM_PRESENCE_LOW    120
+
+class OneWireSimBus;
+
+// Virtual clock shared by all simulated buses, the one delay() advances.
+typedef HostClock OneWireSimClock;
+
+struct OneWireSimStats
+{
+    uint64_t micros;    // virtual time
+    uint32_t resets;    // reset pulses
+    uint32_t slots;     // read and write time slots
+
+    OneWireSimStats operator-(const OneWireSimStats &o) const {
+      OneWireSimStats d = { micros - o.micros, resets - o.resets, slots - o.slots };
+      return d;
+    }
+};
+
+// A slave on the bus.  ROM commands (read, match, skip, search and
+// conditional search) are handled here, subclasses implement the
+// function commands of a particular device.
+class OneWireSimDevice
+{
+  public:
+    OneWireSimDevice(const uint8_t rom[8]);
+    virtual ~OneWireSimDevice() { }
+
+    const uint8_t *rom() const { return romCode; }
+
+    // Build a ROM code with a valid CRC from a family code and serial.
+    static void makeRom(uint8_t family, uint64_t serial, uint8_t rom[8]);
+
+    // Called by the bus
+    void busReset(OneWireSimBus *bus);
+    uint8_t slotBegin();
+    void slotEnd(uint8_t masterBit);
+
+    // Advance internal state (conversions, EEPROM writes) to now.
+    virtual void settle() { }
+
+  protected:
+    enum Phase {
+      PHASE_IDLE,       // deselected, waiting for reset
+      PHASE_ROM_CMD,
+      PHASE_MATCH,
+      PHASE_SEARCH,
+      PHASE_FUNC_CMD,
+      PHASE_RX_DATA,
+      PHASE_TX_DATA,
+      PHASE_TX_STATUS
+    };
+
+    // Function command received after a successful ROM phase.
+    virtual void functionCommand(uint8_t cmd) = 0;
+    // Data byte received after receive() was called.
+    virtual void dataByte(uint8_t b) { (void)b; }
+    // Participation in conditional (0xEC) search.
+    virtual bool alarmed() { return false; }
+    // Bit returned in status slots (conversion, copy, power supply).
+    virtual uint8_t statusBit() { return 1; }
+
+    void transmit(const uint8_t *buf, uint8_t len);
+    void receive() { phase = PHASE_RX_DATA; }
+    void transmitStatus() { phase = PHASE_TX_STATUS; }
+    void deselect() { phase = PHASE_IDLE; }
+
+    OneWireSimBus *bus;
+
+  private:
+    friend class OneWireSimBus;
+
+    void byteReceived(uint8_t b);
+
+    uint8_t romCode[8];
+    Phase phase;
+    uint8_t shift;
+    uint8_t bitCount;
+    uint8_t matchIndex;
+    uint8_t searchBit;
+    uint8_t searchStep;
+    uint8_t txBuf[16];
+    uint8_t txLen;
+    uint8_t txBit;
+    bool romAfterTx;
+};
+
+class OneWireSimBus
+{
+  public:
+    // Registers the bus as the target of the host pin layer for 'pin'.
+    OneWireSimBus(uint8_t pin);
+    ~OneWireSimBus();
+
+    // Devices may be attached and detached at any time.  A device
+    // attached in the middle of a transaction stays silent until the
+    // next reset, like a probe plugged into a live bus.
+    bool attach(OneWireSimDevice *device);
+    void detach(OneWireSimDevice *device);
+    uint8_t deviceCount() const { return count; }
+
+    // Pin driven low by DallasTemperature::setPullupPin() to enable the
+    // external strong pullup.
+    void setPullupPin(int pin) { pullupPin = pin; }
+
+    // Master side of the pin, used by the host pin layer and the
+    // simulated RMT channel.
+    void masterWrite(uint8_t level);
+    void masterMode(uint8_t output);
+    uint8_t masterRead();
+    void externalPullup(bool on);
+    bool externalPullupOn() const { return external; }
+
+    // True if the bus was strongly pulled up over [from, to], which is
+    // what parasite powered devices need while converting.
+    bool strongPullupHeld(uint64_t from, uint64_t to) const;
+
+    OneWireSimStats stats() const;
+
+    static OneWireSimBus *forPin(uint8_t pin);
+    static OneWireSimBus *forPullupPin(uint8_t pin);
+
+  private:
+    void update();
+
+    uint8_t pin;
+    int pullupPin;
+    OneWireSimDevice *devices[ONEWIRE_SIM_MAX_DEVICES];
+    uint8_t count;
+
+    bool output;
+    uint8_t latch;
+    bool masterLow;
+    uint64_t lowSince;
+    uint64_t slaveLowUntil;
+    uint64_t presenceFrom;
+    uint64_t presenceUntil;
+
+    bool strong;
+    bool external;
+    uint64_t strongSince;
+
+    uint32_t resets;
+    uint32_t slots;
+};
+
+// Simulated RMT channel: renders the symbols onto a simulated bus at 1uS
+// resolution and captures the resulting waveform, so OneWireRmt can be
+// exercised against the same slave models as the bit-banged driver.
+class OneWireSimRmtChannel : public OneWireRmtChannel
+{
+  public:
+    OneWireSimRmtChannel(OneWireSimBus *bus) : bus(bus), pushPull(false) { }
+
+    bool transceive(const OneWireRmtSymbol *tx, size_t txCount,
+                    OneWireRmtSymbol *rx, size_t *rxCount,
+                    uint16_t idleUs);
+    bool power(bool on);
+
+  private:
+    OneWireSimBus *bus;
+    bool pushPull;
+};
+
+#endif // OneWireSim_h
@@ -0,0 +1,581 @@
+// Columnar sample archive, see SampleArchive.h.
+
+#include <string.h>
+#include "SampleArchive.h"
+
+#if SAMPLE_BLOCK_SAMPLES < 1 || SAMPLE_BLOCK_SAMPLES > 255
+#error "SAMPLE_BLOCK_SAMPLES must be 1 to 255"
+#endif
+
+// text entries go through the same buffer as blocks
+#if SAMPLE_BLOCK_MAX < SAMPLE_TEXT_HEADER + SAMPLE_TEXT_MAX
+#error "SAMPLE_BLOCK_SAMPLES too small for a text entry"
+#endif
+
+// CRC32 (IEEE, reflected) four bits at a time
+static const uint32_t crcNibble[16] = {
+	0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+	0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+uint32_t sampleCrc32(uint32_t crc, const uint8_t *data, size_t len)
+{
+	crc = ~crc;
+	while (len--) {
+		crc ^= *data++;
+		crc = (crc >> 4) ^ crcNibble[crc & 15];
+		crc = (crc >> 4) ^ crcNibble[crc & 15];
+	}
+	return ~crc;
+}
+
+static void put16(uint8_t *p, uint16_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static uint16_t get16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint32_t zigzag(int32_t v)
+{
+	return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static int32_t unzigzag(uint32_t u)
+{
+	return (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+}
+
+// Days since 1970-01-01 of a date in the proleptic Gregorian calendar
+static int32_t daysFromCivil(int32_t y, uint32_t m, uint32_t d)
+{
+	y -= m <= 2;
+	int32_t era = (y >= 0 ? y : y - 399) / 400;
+	uint32_t yoe = y - era * 400;
+	uint32_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+	uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + (int32_t)doe - 719468;
+}
+
+static void civilFromDays(int32_t z, int32_t *y, uint32_t *m, uint32_t *d)
+{
+	z += 719468;
+	int32_t era = (z >= 0 ? z : z - 146096) / 146097;
+	uint32_t doe = z - era * 146097;
+	uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	uint32_t mp = (5 * doy + 2) / 153;
+	*d = doy - (153 * mp + 2) / 5 + 1;
+	*m = mp < 10 ? mp + 3 : mp - 9;
+	*y = (int32_t)yoe + era * 400 + (*m <= 2);
+}
+
+// 'digits' decimal digits at p, -1 if there are not that many
+static int32_t number(const char *p, const char *end, uint8_t digits)
+{
+	int32_t v = 0;
+
+	if (end - p < digits) return -1;
+	while (digits--) {
+		if (*p < '0' || *p > '9') return -1;
+		v = v * 10 + (*p++ - '0');
+	}
+	return v;
+}
+
+// Hundredths of a degree, rounded half to even like
+// DallasTemperature::formatCelsius() with two decimals
+static uint32_t hundredths(uint32_t raw)
+{
+	uint32_t value = raw * 100;
+	uint32_t q = value >> 7;
+	uint32_t rem = value & 127;
+	if (rem > 64 || (rem == 64 && (q & 1))) q++;
+	return q;
+}
+
+static char *putNumber(char *p, uint32_t v, uint8_t digits)
+{
+	char *end = p + digits;
+	while (digits--) {
+		p[digits] = '0' + v % 10;
+		v /= 10;
+	}
+	return end;
+}
+
+static char *putDecimal(char *p, uint32_t v)
+{
+	char digits[10];
+	uint8_t n = 0;
+
+	do {
+		digits[n++] = '0' + v % 10;
+		v /= 10;
+	} while (v);
+	while (n) *p++ = digits[--n];
+	return p;
+}
+
+size_t formatSample(const Sample &sample, char *buf)
+{
+	char *p = buf;
+	int32_t year;
+	uint32_t month, day;
+	uint32_t seconds = sample.time % 86400;
+
+	p = putDecimal(p, sample.id);
+	*p++ = ',';
+	civilFromDays(sample.time / 86400, &year, &month, &day);
+	p = putNumber(p, year, 4);
+	*p++ = '-';
+	p = putNumber(p, month, 2);
+	*p++ = '-';
+	p = putNumber(p, day, 2);
+	*p++ = ',';
+	p = putNumber(p, seconds / 3600, 2);
+	*p++ = ':';
+	p = putNumber(p, seconds / 60 % 60, 2);
+	*p++ = ':';
+	p = putNumber(p, seconds % 60, 2);
+	*p++ = ',';
+	if (sample.value < 0) *p++ = '-';
+	uint32_t h = hundredths(sample.value < 0 ? -sample.value : sample.value);
+	p = putDecimal(p, h / 100);
+	*p++ = '.';
+	p = putNumber(p, h % 100, 2);
+	*p++ = '\r';
+	*p++ = '\n';
+	*p = 0;
+	return p - buf;
+}
+
+bool parseSample(const char *line, size_t length, Sample *sample)
+{
+	const char *p = line;
+	const char *end = line + length;
+	uint64_t id = 0;
+
+	if (length >= SAMPLE_LINE_MAX) return false;
+
+	while (p < end && *p >= '0' && *p <= '9' && id <= 0xFFFFFFFF) id = id * 10 + (*p++ - '0');
+	if (p == line || id > 0xFFFFFFFF || p == end || *p++ != ',') return false;
+
+	int32_t year = number(p, end, 4);
+	int32_t month = (p + 5 <= end && p[4] == '-') ? number(p + 5, end, 2) : -1;
+	int32_t day = (p + 8 <= end && p[7] == '-') ? number(p + 8, end, 2) : -1;
+	if (year < 1970 || year > 2105 || month < 1 || month > 12 || day < 1 || day > 31) return false;
+	p += 10;
+	if (p == end || *p++ != ',') return false;
+
+	int32_t hour = number(p, end, 2);
+	int32_t minute = (p + 3 <= end && p[2] == ':') ? number(p + 3, end, 2) : -1;
+	int32_t second = (p + 6 <= end && p[5] == ':') ? number(p + 6, end, 2) : -1;
+	if (hour < 0 || hour > 23 || minute < 0 || minute > 59 || second < 0 || second > 59) return false;
+	p += 8;
+	if (p == end || *p++ != ',') return false;
+
+	uint64_t time = (uint64_t)daysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+	if (time > 0xFFFFFFFF) return false;
+
+	bool negative = p < end && *p == '-';
+	if (negative) p++;
+	uint32_t whole = 0;
+	const char *digits = p;
+	while (p < end && *p >= '0' && *p <= '9' && whole < 1000) whole = whole * 10 + (*p++ - '0');
+	if (p == digits || p == end || *p++ != '.') return false;
+	int32_t fraction = number(p, end, 2);
+	if (fraction < 0) return false;
+
+	// Of the one or two raw values that print as these hundredths, the one
+	// with more trailing zero bits is what a probe reads
+	uint32_t h = whole * 100 + fraction;
+	uint32_t guess = h * 128 / 100;
+	int32_t raw = -1;
+	for (uint32_t r = guess ? guess - 1 : 0; r <= guess + 2; r++) {
+		if (hundredths(r) != h) continue;
+		if (raw < 0 || (r & -r) > ((uint32_t)raw & -(uint32_t)raw)) raw = r;
+	}
+	if (raw < 0 || raw > 32767) return false;
+
+	sample->id = id;
+	sample->time = time;
+	sample->value = negative ? -raw : raw;
+
+	char check[SAMPLE_LINE_MAX];
+	return formatSample(*sample, check) == length && !memcmp(check, line, length);
+}
+
+bool readBlockHeader(const uint8_t *header, SampleBlockInfo *info)
+{
+	if (header[0] != SAMPLE_BLOCK_MAGIC || !header[1] || header[2] > 15) return false;
+	info->count = header[1];
+	info->shift = header[2];
+	info->length = SAMPLE_BLOCK_HEADER;
+	for (uint8_t i = 0; i < 3; i++) {
+		info->columns[i] = get16(header + 3 + 2 * i);
+		if (info->columns[i] > SAMPLE_COLUMN_MAX) return false;
+		info->length += info->columns[i];
+	}
+	info->firstId = get32(header + 9);
+	info->firstTime = get32(header + 13);
+	info->lastTime = get32(header + 17);
+	info->min = get16(header + 21);
+	info->max = get16(header + 23);
+	return true;
+}
+
+// Most significant bit first
+class BitWriter
+{
+  public:
+	BitWriter(uint8_t *p) : _start(p), _p(p), _acc(0), _count(0) {}
+
+	void put(uint32_t v, uint8_t n)
+	{
+		_acc = (_acc << n) | v;
+		_count += n;
+		while (_count >= 8) {
+			_count -= 8;
+			*_p++ = _acc >> _count;
+		}
+	}
+
+	void putCode(uint32_t u)
+	{
+		if (u == 0) put(0, 1);
+		else if (u < 8) put(0x2 << 3 | u, 5);
+		else if (u < 128) put(0x6 << 7 | u, 10);
+		else if (u < 4096) put(0xE << 12 | u, 16);
+		else {
+			put(0xF, 4);
+			put(u, 32);
+		}
+	}
+
+	size_t finish(void)
+	{
+		if (_count) put(0, 8 - _count);
+		return _p - _start;
+	}
+
+  private:
+	uint8_t *_start;
+	uint8_t *_p;
+	uint64_t _acc;
+	uint8_t _count;
+};
+
+bool SampleBlockEncoder::add(const Sample &sample)
+{
+	if (_count == SAMPLE_BLOCK_SAMPLES || (_count && sample.time < _samples[_count - 1].time)) return false;
+	_samples[_count++] = sample;
+	return true;
+}
+
+size_t SampleBlockEncoder::finish(uint8_t *buf)
+{
+	uint8_t *columns = buf + SAMPLE_BLOCK_HEADER;
+	const Sample &first = _samples[0];
+	int32_t min = first.value, max = first.value;
+	uint32_t bits = 0;
+
+	for (uint8_t i = 0; i < _count; i++) {
+		int32_t v = _samples[i].value;
+		if (v < min) min = v;
+		if (v > max) max = v;
+		bits |= v;
+	}
+	uint8_t shift = 0;
+	while (bits && !(bits & 1) && shift < 15) {
+		bits >>= 1;
+		shift++;
+	}
+	if (!bits) shift = 0;
+
+	size_t sizes[3];
+	{
+		BitWriter w(columns);
+		uint32_t prev = first.id, delta = 1;
+		for (uint8_t i = 1; i < _count; i++) {
+			uint32_t d = _samples[i].id - prev;
+			w.putCode(zigzag(d - delta));
+			prev = _samples[i].id;
+			delta = d;
+		}
+		sizes[0] = w.finish();
+	}
+	{
+		BitWriter w(columns + sizes[0]);
+		uint32_t prev = first.time, delta = 0;
+		for (uint8_t i = 1; i < _count; i++) {
+			uint32_t d = _samples[i].time - prev;
+			w.putCode(zigzag(d - delta));
+			prev = _samples[i].time;
+			delta = d;
+		}
+		sizes[1] = w.finish();
+	}
+	{
+		BitWriter w(columns + sizes[0] + sizes[1]);
+		int32_t prev = min >> shift;
+		for (uint8_t i = 0; i < _count; i++) {
+			int32_t v = _samples[i].value >> shift;
+			w.putCode(zigzag(v - prev));
+			prev = v;
+		}
+		sizes[2] = w.finish();
+	}
+
+	buf[0] = SAMPLE_BLOCK_MAGIC;
+	buf[1] = _count;
+	buf[2] = shift;
+	for (uint8_t i = 0; i < 3; i++) put16(buf + 3 + 2 * i, sizes[i]);
+	put32(buf + 9, first.id);
+	put32(buf + 13, first.time);
+	put32(buf + 17, _samples[_count - 1].time);
+	put16(buf + 21, min);
+	put16(buf + 23, max);
+	size_t length = SAMPLE_BLOCK_HEADER + sizes[0] + sizes[1] + sizes[2];
+	uint32_t crc = sampleCrc32(0, buf, SAMPLE_BLOCK_HEADER - 4);
+	put32(buf + SAMPLE_BLOCK_HEADER - 4, sampleCrc32(crc, columns, length - SAMPLE_BLOCK_HEADER));
+	_count = 0;
+	return length;
+}
+
+bool SampleBlockDecoder::begin(const uint8_t *block, size_t length)
+{
+	_left = 0;
+	if (length < SAMPLE_BLOCK_HEADER || !readBlockHeader(block, &_info) || _info.length != length) return false;
+	uint32_t crc = sampleCrc32(0, block, SAMPLE_BLOCK_HEADER - 4);
+	crc = sampleCrc32(crc, block + SAMPLE_BLOCK_HEADER, length - SAMPLE_BLOCK_HEADER);
+	if (crc != get32(block + SAMPLE_BLOCK_HEADER - 4)) return false;
+
+	const uint8_t *p = block + SAMPLE_BLOCK_HEADER;
+	for (uint8_t i = 0; i < 3; i++) {
+		_columns[i].p = p;
+		_columns[i].end = p + _info.columns[i];
+		_columns[i].acc = 0;
+		_columns[i].count = 0;
+		p += _info.columns[i];
+	}
+	_left = _info.count;
+	_started = false;
+	_value = _info.min >> _info.shift;
+	return true;
+}
+
+// past the end of the column reads as zeros, the count says where it ends
+uint32_t SampleBlockDecoder::get(Bits &bits, uint8_t n)
+{
+	uint32_t v = 0;
+
+	while (n) {
+		if (!bits.count) {
+			bits.acc = bits.p < bits.end ? *bits.p++ : 0;
+			bits.count = 8;
+		}
+		uint8_t take = n < bits.count ? n : bits.count;
+		bits.count -= take;
+		v = (v << take) | ((bits.acc >> bits.count) & ((1u << take) - 1));
+		n -= take;
+	}
+	return v;
+}
+
+uint32_t SampleBlockDecoder::getCode(Bits &bits)
+{
+	if (!get(bits, 1)) return 0;
+	if (!get(bits, 1)) return get(bits, 3);
+	if (!get(bits, 1)) return get(bits, 7);
+	if (!get(bits, 1)) return get(bits, 12);
+	return get(bits, 32);
+}
+
+bool SampleBlockDecoder::next(Sample *sample)
+{
+	if (!_left) return false;
+	_left--;
+
+	if (!_started) {
+		_started = true;
+		_id = _info.firstId;
+		_idDelta = 1;
+		_time = _info.firstTime;
+		_timeDelta = 0;
+	} else {
+		_idDelta += unzigzag(getCode(_columns[0]));
+		_id += _idDelta;
+		_timeDelta += unzigzag(getCode(_columns[1]));
+		_time += _timeDelta;
+	}
+	_value += unzigzag(getCode(_columns[2]));
+
+	sample->id = _id;
+	sample->time = _time;
+	sample->value = (int32_t)((uint32_t)_value << _info.shift);
+	return true;
+}
+
+bool SampleArchiveInput::skip(size_t len)
+{
+	uint8_t buf[64];
+
+	while (len) {
+		size_t n = read(buf, len < sizeof(buf) ? len : sizeof(buf));
+		if (!n) return false;
+		len -= n;
+	}
+	return true;
+}
+
+void SampleArchiveEncoder::write(size_t length)
+{
+	if (!_failed && !_out->write(_buf, length)) _failed = true;
+	_total += length;
+}
+
+void SampleArchiveEncoder::flushBlock(void)
+{
+	if (_block.count()) write(_block.finish(_buf));
+}
+
+void SampleArchiveEncoder::text(const char *line, size_t length)
+{
+	flushBlock();
+	_buf[0] = SAMPLE_TEXT_MAGIC;
+	put16(_buf + 1, length);
+	memcpy(_buf + SAMPLE_TEXT_HEADER, line, length);
+	uint32_t crc = sampleCrc32(0, _buf, 3);
+	put32(_buf + 3, sampleCrc32(crc, _buf + SAMPLE_TEXT_HEADER, length));
+	write(SAMPLE_TEXT_HEADER + length);
+}
+
+void SampleArchiveEncoder::line(const char *line, size_t length)
+{
+	Sample sample;
+
+	if (!parseSample(line, length, &sample)) {
+		text(line, length);
+		return;
+	}
+	if (!_block.add(sample)) {
+		flushBlock();
+		_block.add(sample);
+	}
+}
+
+void SampleArchiveEncoder::feed(const uint8_t *data, size_t len)
+{
+	while (len--) {
+		char c = *data++;
+		_line[_length++] = c;
+		if (c == '\n') {
+			line(_line, _length);
+			_length = 0;
+		} else if (_length == SAMPLE_TEXT_MAX) {
+			text(_line, _length);
+			_length = 0;
+		}
+	}
+}
+
+bool SampleArchiveEncoder::finish(void)
+{
+	if (_length) {
+		_line[_length++] = '\n';
+		line(_line, _length);
+		_length = 0;
+	}
+	flushBlock();
+	return !_failed;
+}
+
+void SampleArchiveDecoder::begin(SampleArchiveInput *in, uint32_t from, uint32_t to)
+{
+	_in = in;
+	_inBlock = false;
+	_from = from;
+	_to = to;
+	_skipped = 0;
+}
+
+// Reads the next text entry into _buf or starts on the next block that
+// may have samples in the range; false at the end
+bool SampleArchiveDecoder::nextEntry(void)
+{
+	for (;;) {
+		if (_in->read(_buf, 1) != 1) return false;
+
+		if (_buf[0] == SAMPLE_TEXT_MAGIC) {
+			if (_in->read(_buf + 1, SAMPLE_TEXT_HEADER - 1) != SAMPLE_TEXT_HEADER - 1) return false;
+			size_t length = get16(_buf + 1);
+			if (length > SAMPLE_TEXT_MAX) return false;
+			if (_in->read(_buf + SAMPLE_TEXT_HEADER, length) != length) return false;
+			uint32_t crc = sampleCrc32(0, _buf, 3);
+			if (sampleCrc32(crc, _buf + SAMPLE_TEXT_HEADER, length) != get32(_buf + 3)) continue;
+			_inBlock = false;
+			return true;
+		}
+
+		SampleBlockInfo info;
+		if (_buf[0] != SAMPLE_BLOCK_MAGIC) return false;
+		if (_in->read(_buf + 1, SAMPLE_BLOCK_HEADER - 1) != SAMPLE_BLOCK_HEADER - 1) return false;
+		if (!readBlockHeader(_buf, &info)) return false;
+		size_t rest = info.length - SAMPLE_BLOCK_HEADER;
+		if (info.lastTime < _from || info.firstTime > _to) {
+			if (!_in->skip(rest)) return false;
+			_skipped++;
+			continue;
+		}
+		if (_in->read(_buf + SAMPLE_BLOCK_HEADER, rest) != rest) return false;
+		if (_block.begin(_buf, info.length)) {
+			_inBlock = true;
+			return true;
+		}
+	}
+}
+
+bool SampleArchiveDecoder::next(const char **line, size_t *length)
+{
+	Sample sample;
+
+	if (!_in) return false;
+	for (;;) {
+		if (_inBlock) {
+			if (_block.next(&sample)) {
+				if (sample.time < _from || sample.time > _to) continue;
+				*length = formatSample(sample, _line);
+				*line = _line;
+				return true;
+			}
+			_inBlock = false;
+		}
+		if (!nextEntry()) {
+			_in = 0;
+			return false;
+		}
+		if (!_inBlock) {
+			*line = (const char *)_buf + SAMPLE_TEXT_HEADER;
+			*length = get16(_buf + 1);
+			return true;
+		}
+	}
+}
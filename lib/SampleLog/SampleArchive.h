@@ -0,0 +1,237 @@
+#ifndef SampleArchive_h
+#define SampleArchive_h
+
+// Columnar archive of sample lines.
+//
+// A sample line is what main.cpp logs, the reading ID, date, hour and
+// temperature:
+//
+//   123,2023-10-16,12:00:30,21.50\r\n
+//
+// As text that is about 30 bytes a sample.  The archive keeps up to
+// SAMPLE_BLOCK_SAMPLES of them in a block, column by column, each value
+// coded against the one of the sample before it:
+//
+//   id           delta of delta, the delta before the first one being 1
+//   date, hour   as seconds since 1970, delta of delta
+//   temperature  as the 1/128 degree value it was printed from, delta
+//
+// The temperatures of a block are first shifted right by the trailing
+// zero bits they all have (a 12 bit probe reads in steps of 8/128
+// degrees).  Every number is zigzagged and written as a bit code:
+//
+//   0                0
+//   10   + 3 bits    up to 7
+//   110  + 7 bits    up to 127
+//   1110 + 12 bits   up to 4095
+//   1111 + 32 bits   anything else
+//
+// so the next reading ID, at the usual interval, one step away from the
+// temperature before, takes 7 bits.
+//
+// A block, little endian:
+//
+//   0xC5, count (1), shift (1), id, time and value column sizes (2 each),
+//   first id (4), first and last time (4 each), lowest and highest
+//   temperature (2 each), CRC32 (4), the three columns
+//
+// the CRC over the header before it and the columns.  The header alone
+// tells whether a block can have samples of a time range, so blocks
+// outside of it are skipped without being read.
+//
+// A line that does not come back the same from a sample (the CSV header,
+// anything edited by hand) is kept as a text entry:
+//
+//   0xC4, length (2), CRC32 (4), line
+//
+// Lines longer than SAMPLE_TEXT_MAX are split over several of them.
+//
+// Nothing here needs Arduino, archives copied off the card are turned
+// back into CSV on the host with the same decoder:
+//
+//   g++ -Ilib/SampleLog tool.cpp lib/SampleLog/SampleArchive.cpp
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef SAMPLE_BLOCK_SAMPLES
+#define SAMPLE_BLOCK_SAMPLES 128
+#endif
+
+#define SAMPLE_BLOCK_MAGIC  0xC5
+#define SAMPLE_TEXT_MAGIC   0xC4
+
+#define SAMPLE_BLOCK_HEADER 29
+#define SAMPLE_TEXT_HEADER  7
+
+// longest code is 36 bits
+#define SAMPLE_COLUMN_MAX   ((SAMPLE_BLOCK_SAMPLES * 36 + 7) / 8)
+#define SAMPLE_BLOCK_MAX    (SAMPLE_BLOCK_HEADER + 3 * SAMPLE_COLUMN_MAX)
+
+// longest text entry
+#define SAMPLE_TEXT_MAX     256
+
+// a formatted sample line with its line end and a terminator
+#define SAMPLE_LINE_MAX     48
+
+struct Sample
+{
+    uint32_t id;
+    uint32_t time;    // date and hour in seconds since 1970
+    int32_t value;    // 1/128 degrees C
+};
+
+// False unless formatSample() gives back exactly 'line'
+bool parseSample(const char *line, size_t length, Sample *sample);
+
+// Returns the length of the line, 'buf' has room for SAMPLE_LINE_MAX
+size_t formatSample(const Sample &sample, char *buf);
+
+// CRC32 (IEEE), 0 to start with
+uint32_t sampleCrc32(uint32_t crc, const uint8_t *data, size_t len);
+
+struct SampleBlockInfo
+{
+    uint8_t count;
+    uint8_t shift;
+    uint16_t columns[3];
+    uint32_t firstId;
+    uint32_t firstTime;
+    uint32_t lastTime;
+    int16_t min;
+    int16_t max;
+    size_t length;    // of the whole block
+};
+
+// Reads the SAMPLE_BLOCK_HEADER bytes at 'header'; false if they are not
+// a block header
+bool readBlockHeader(const uint8_t *header, SampleBlockInfo *info);
+
+class SampleBlockEncoder
+{
+  public:
+    SampleBlockEncoder() : _count(0) {}
+
+    // False if the block is full, or the sample is older than the one
+    // before (times only go forward within a block, so that the first and
+    // last are its range)
+    bool add(const Sample &sample);
+    uint8_t count(void) const { return _count; }
+
+    // Writes the block to 'buf' (SAMPLE_BLOCK_MAX bytes) and starts a new
+    // one; returns its size
+    size_t finish(uint8_t *buf);
+
+  private:
+    Sample _samples[SAMPLE_BLOCK_SAMPLES];
+    uint8_t _count;
+};
+
+class SampleBlockDecoder
+{
+  public:
+    SampleBlockDecoder() : _left(0) {}
+
+    // 'block' stays where it is until the last sample is out; false if
+    // the block is damaged
+    bool begin(const uint8_t *block, size_t length);
+    bool next(Sample *sample);
+    const SampleBlockInfo &info(void) const { return _info; }
+
+  private:
+    struct Bits {
+      const uint8_t *p;
+      const uint8_t *end;
+      uint32_t acc;
+      uint8_t count;
+    };
+
+    static uint32_t get(Bits &bits, uint8_t n);
+    static uint32_t getCode(Bits &bits);
+
+    SampleBlockInfo _info;
+    Bits _columns[3];
+    uint8_t _left;
+    bool _started;
+    uint32_t _id;
+    uint32_t _idDelta;
+    uint32_t _time;
+    uint32_t _timeDelta;
+    int32_t _value;
+};
+
+class SampleArchiveOutput
+{
+  public:
+    virtual ~SampleArchiveOutput() {}
+    virtual bool write(const uint8_t *data, size_t len) = 0;
+};
+
+class SampleArchiveInput
+{
+  public:
+    virtual ~SampleArchiveInput() {}
+    virtual size_t read(uint8_t *buf, size_t len) = 0;
+    // reads and drops by default
+    virtual bool skip(size_t len);
+};
+
+// Turns text into an archive, fed as it comes
+class SampleArchiveEncoder
+{
+  public:
+    SampleArchiveEncoder(SampleArchiveOutput *out) : _out(out), _length(0), _total(0), _failed(false) {}
+
+    void feed(const uint8_t *data, size_t len);
+
+    // a torn last line gets its line end back
+    bool finish(void);
+
+    size_t total(void) const { return _total; }
+
+  private:
+    void line(const char *line, size_t length);
+    void text(const char *line, size_t length);
+    void flushBlock(void);
+    void write(size_t length);
+
+    SampleArchiveOutput *_out;
+    SampleBlockEncoder _block;
+    uint8_t _buf[SAMPLE_BLOCK_MAX];
+    char _line[SAMPLE_TEXT_MAX];
+    size_t _length;
+    size_t _total;
+    bool _failed;
+};
+
+// Turns an archive back into text.  With a time range, blocks outside of
+// it are skipped and only the samples in it are given out; text entries
+// always are.
+class SampleArchiveDecoder
+{
+  public:
+    SampleArchiveDecoder() : _in(0) {}
+
+    void begin(SampleArchiveInput *in, uint32_t from = 0, uint32_t to = 0xFFFFFFFF);
+
+    // The next line, or piece of a line that was split; false at the end
+    // of the archive or where it stops making sense.  A damaged entry is
+    // left out.
+    bool next(const char **line, size_t *length);
+
+    uint32_t skipped(void) const { return _skipped; }
+
+  private:
+    bool nextEntry(void);
+
+    SampleArchiveInput *_in;
+    SampleBlockDecoder _block;
+    bool _inBlock;
+    uint32_t _from;
+    uint32_t _to;
+    uint32_t _skipped;
+    uint8_t _buf[SAMPLE_BLOCK_MAX];
+    char _line[SAMPLE_LINE_MAX];
+};
+
+#endif
@@ -0,0 +1,885 @@
+// Segmented sample log, see SegmentedLog.h.
+
+#include <stdlib.h>
+#include <string.h>
+#include "SegmentedLog.h"
+
+#define RECORD_MAGIC    0xA5
+#define RECORD_HEAD     7
+#define RECORD_TAIL     6
+#define RECORD_OVERHEAD (RECORD_HEAD + RECORD_TAIL)
+
+// text entries of archives are handed out through the record buffer
+#if SAMPLE_TEXT_MAX > SEGMENTED_LOG_RECORD_MAX
+#error "SAMPLE_TEXT_MAX larger than SEGMENTED_LOG_RECORD_MAX"
+#endif
+
+static void put16(uint8_t *p, uint16_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static uint16_t get16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// true if the record of 'len' bytes of line at r is intact
+static bool intact(const uint8_t *r, size_t len, uint32_t *sequence)
+{
+	const uint8_t *tail = r + RECORD_HEAD + len;
+
+	if (r[0] != RECORD_MAGIC || get16(r + 1) != len || get16(tail + 4) != len) return false;
+	if (get32(tail) != sampleCrc32(0, r, RECORD_HEAD + len)) return false;
+	*sequence = get32(r + 3);
+	return true;
+}
+
+enum { RECORD_OK, RECORD_DAMAGED, RECORD_END };
+
+// Reads the next record into 'line'.  A record whose CRC does not match
+// but whose two lengths do is skipped (RECORD_DAMAGED), anything else
+// that is not a whole record ends the segment.
+static uint8_t nextRecord(SegmentInput &in, char *line, size_t *length, uint32_t *sequence)
+{
+	uint8_t head[RECORD_HEAD];
+	uint8_t tail[RECORD_TAIL];
+
+	if (in.read(head, RECORD_HEAD) != RECORD_HEAD || head[0] != RECORD_MAGIC) return RECORD_END;
+	size_t len = get16(head + 1);
+	if (len > SEGMENTED_LOG_RECORD_MAX) return RECORD_END;
+	if (in.read((uint8_t *)line, len) != len || in.read(tail, RECORD_TAIL) != RECORD_TAIL) return RECORD_END;
+	if (get16(tail + 4) != len) return RECORD_END;
+	if (get32(tail) != sampleCrc32(sampleCrc32(0, head, RECORD_HEAD), (const uint8_t *)line, len)) return RECORD_DAMAGED;
+	*length = len;
+	*sequence = get32(head + 3);
+	return RECORD_OK;
+}
+
+// End of the last intact record in the first 'size' bytes of a segment
+// in *last, 0 if there is none; false if the segment could not be read.
+// Record ends are tried from the back, a block at a time; the blocks
+// overlap by one record so that every record is seen whole in one of them.
+static bool lastRecord(fs::File &file, size_t size, size_t *last, uint32_t *sequence)
+{
+	uint8_t block[SEGMENTED_LOG_RECOVERY_BLOCK];
+	const size_t longest = SEGMENTED_LOG_RECORD_MAX + RECORD_OVERHEAD;
+	size_t end = size;
+
+	*last = 0;
+	while (end >= RECORD_OVERHEAD) {
+		size_t start = end > sizeof(block) ? end - sizeof(block) : 0;
+		if (!file.seek(start) || file.read(block, end - start) != end - start) return false;
+
+		// ends closer to the start may belong to records starting before it
+		size_t lowest = start ? start + longest : RECORD_OVERHEAD;
+		for (size_t e = end; e >= lowest; e--) {
+			const uint8_t *p = block + (e - start);
+			size_t len = get16(p - 2);
+			if (len > SEGMENTED_LOG_RECORD_MAX || len + RECORD_OVERHEAD > e - start) continue;
+			if (intact(p - RECORD_OVERHEAD - len, len, sequence)) {
+				*last = e;
+				return true;
+			}
+		}
+		if (!start) break;
+		end = lowest - 1;
+	}
+	return true;
+}
+
+// Sequence number after the last line of a plain text segment, taken
+// from the number its last line starts with
+static uint32_t lastTextSequence(fs::File &file, size_t size)
+{
+	char tail[64];
+	size_t start = size > sizeof(tail) - 1 ? size - (sizeof(tail) - 1) : 0;
+
+	if (!file.seek(start)) return 0;
+	size_t n = file.read((uint8_t *)tail, size - start);
+	while (n && (tail[n - 1] == '\n' || tail[n - 1] == '\r')) n--;
+	tail[n] = 0;
+	char *line = strrchr(tail, '\n');
+	line = line ? line + 1 : tail;
+	char *end;
+	unsigned long id = strtoul(line, &end, 10);
+	return end != line ? id + 1 : 0;
+}
+
+// Writes the archive being compacted
+class ArchiveFile : public SampleArchiveOutput
+{
+  public:
+	ArchiveFile(fs::File &file) : _file(file) {}
+
+	bool write(const uint8_t *data, size_t len)
+	{
+		return _file.write(data, len) == len;
+	}
+
+  private:
+	fs::File &_file;
+};
+
+void SegmentInput::begin(fs::File *file, size_t limit)
+{
+	_file = file;
+	_length = _pos = 0;
+	_left = limit;
+}
+
+int SegmentInput::peek(void)
+{
+	if (_pos == _length) {
+		size_t n = _file->read(_buf, _left < sizeof(_buf) ? _left : sizeof(_buf));
+		if (n == 0 || n > _left) return -1;
+		_left -= n;
+		_length = n;
+		_pos = 0;
+	}
+	return _buf[_pos];
+}
+
+int SegmentInput::getByte(void)
+{
+	int c = peek();
+	if (c >= 0) _pos++;
+	return c;
+}
+
+bool SegmentInput::skip(size_t len)
+{
+	size_t buffered = _length - _pos;
+
+	if (len <= buffered) {
+		_pos += len;
+		return true;
+	}
+	len -= buffered;
+	_pos = _length;
+	if (len > _left) return false;
+	_left -= len;
+	return _file->seek(_file->position() + len);
+}
+
+size_t SegmentInput::read(uint8_t *buf, size_t len)
+{
+	size_t n = 0;
+
+	while (n < len) {
+		if (_pos == _length && peek() < 0) break;
+		size_t chunk = _length - _pos;
+		if (chunk > len - n) chunk = len - n;
+		memcpy(buf + n, _buf + _pos, chunk);
+		_pos += chunk;
+		n += chunk;
+	}
+	return n;
+}
+
+SegmentedLog::SegmentedLog(fs::FS &fs, const char *dir, const char *header)
+  : _fs(fs), _dir(dir), _header(header), _headerLength(header ? strlen(header) : 0),
+    _segmentSize(SEGMENTED_LOG_SEGMENT_SIZE), _maxAge(0), _maxBytes(0), _now(0),
+    _count(0), _nextId(1), _sequence(0), _readers(0), _compacting(false)
+{
+#ifdef ESP32
+	_lock = xSemaphoreCreateMutex();
+	_compactor = NULL;
+#endif
+}
+
+SegmentedLog::~SegmentedLog()
+{
+#ifdef ESP32
+	if (_compactor) vTaskDelete(_compactor);
+	vSemaphoreDelete(_lock);
+#endif
+}
+
+void SegmentedLog::lock(void)
+{
+#ifdef ESP32
+	xSemaphoreTake(_lock, portMAX_DELAY);
+#endif
+}
+
+void SegmentedLog::unlock(void)
+{
+#ifdef ESP32
+	xSemaphoreGive(_lock);
+#endif
+}
+
+void SegmentedLog::setRetention(uint32_t maxAge, uint32_t maxBytes)
+{
+	_maxAge = maxAge;
+	_maxBytes = maxBytes;
+}
+
+void SegmentedLog::path(char *buf, uint32_t id, const char *extension)
+{
+	snprintf(buf, SEGMENTED_LOG_PATH_MAX, "%s/%08lu.%s", _dir, (unsigned long)id, extension);
+}
+
+void SegmentedLog::segmentPath(char *buf, const Segment &segment)
+{
+	path(buf, segment.id, segment.state == SEGMENT_COLUMNS ? "col" : "csv");
+}
+
+void SegmentedLog::manifestPath(char *buf, bool temporary)
+{
+	snprintf(buf, SEGMENTED_LOG_PATH_MAX, "%s/manifest.%s", _dir, temporary ? "tmp" : "txt");
+}
+
+// one segment per line: id state first last bytes next
+bool SegmentedLog::loadManifest(void)
+{
+	char name[SEGMENTED_LOG_PATH_MAX];
+	char line[80];
+	uint8_t block[256];
+	size_t length = 0, pos = 0, n = 0;
+	int c;
+
+	manifestPath(name, false);
+	fs::File file = _fs.open(name, FILE_READ);
+	if (!file) return false;
+
+	// read a block at a time: it is read on every begin(), after every wake
+	_count = 0;
+	do {
+		if (pos == n) {
+			n = file.read(block, sizeof(block));
+			pos = 0;
+		}
+		c = pos < n ? block[pos++] : -1;
+		if (c >= 0 && c != '\n') {
+			if (length < sizeof(line) - 1) line[length++] = c;
+			continue;
+		}
+		line[length] = 0;
+		length = 0;
+
+		char *p = line;
+		Segment s;
+		s.id = strtoul(p, &p, 10);
+		while (*p == ' ') p++;
+		s.state = *p ? *p++ : 0;
+		s.first = strtoul(p, &p, 10);
+		s.last = strtoul(p, &p, 10);
+		s.bytes = strtoul(p, &p, 10);
+		s.next = strtoul(p, &p, 10);
+		if (s.state != SEGMENT_ACTIVE && s.state != SEGMENT_SEALED && s.state != SEGMENT_COLUMNS) continue;
+		if (_count && s.id <= _segments[_count - 1].id) continue;
+		if (_count == SEGMENTED_LOG_MAX_SEGMENTS) break;
+		_segments[_count++] = s;
+		_nextId = s.id + 1;
+	} while (c >= 0);
+	file.close();
+	return true;
+}
+
+bool SegmentedLog::saveManifest(void)
+{
+	char name[SEGMENTED_LOG_PATH_MAX];
+	char temporary[SEGMENTED_LOG_PATH_MAX];
+	char line[80];
+	bool ok = true;
+
+	manifestPath(name, false);
+	manifestPath(temporary, true);
+	fs::File file = _fs.open(temporary, FILE_WRITE);
+	if (!file) return false;
+	for (uint8_t i = 0; i < _count; i++) {
+		const Segment &s = _segments[i];
+		int n = snprintf(line, sizeof(line), "%lu %c %lu %lu %lu %lu\n", (unsigned long)s.id, s.state,
+		                 (unsigned long)s.first, (unsigned long)s.last, (unsigned long)s.bytes,
+		                 (unsigned long)s.next);
+		if (file.write((const uint8_t *)line, n) != (size_t)n) ok = false;
+	}
+	file.close();
+	if (!ok) return false;
+
+	// FAT does not rename over an existing file; a reset in between is
+	// picked up by begin()
+	_fs.remove(name);
+	return _fs.rename(temporary, name);
+}
+
+// Puts right what a reset during rotation, compaction or retention left
+// behind.  Compaction always takes the oldest sealed segment and
+// retention the oldest segments, so only a few files need a look.
+void SegmentedLog::recover(void)
+{
+	char name[SEGMENTED_LOG_PATH_MAX];
+	bool changed = false;
+
+	// retention removes the files before it saves the manifest
+	while (_count > 1) {
+		segmentPath(name, _segments[0]);
+		if (_fs.exists(name)) break;
+		memmove(_segments, _segments + 1, --_count * sizeof(Segment));
+		changed = true;
+	}
+
+	for (uint8_t i = 0; i < _count; i++) {
+		Segment &s = _segments[i];
+		if (s.state == SEGMENT_COLUMNS) {
+			// the last archive may still have its raw segment
+			if (i + 1 < _count && _segments[i + 1].state == SEGMENT_COLUMNS) continue;
+			path(name, s.id, "csv");
+			if (_fs.exists(name)) _fs.remove(name);
+			continue;
+		}
+		// the first sealed segment may have a half written archive
+		path(name, s.id, "tmp");
+		if (_fs.exists(name)) _fs.remove(name);
+		path(name, s.id, "col");
+		if (_fs.exists(name)) _fs.remove(name);
+		break;
+	}
+
+	// only the last segment is active
+	for (uint8_t i = 0; i + 1 < _count; i++) {
+		if (_segments[i].state == SEGMENT_ACTIVE) {
+			_segments[i].state = SEGMENT_SEALED;
+			changed = true;
+		}
+	}
+	for (uint8_t i = 0; i < _count; i++) {
+		if (_segments[i].next > _sequence) _sequence = _segments[i].next;
+	}
+	if (!_count || _segments[_count - 1].state != SEGMENT_ACTIVE) {
+		addActive(0);
+		changed = true;
+	}
+	if (changed) saveManifest();
+}
+
+// Finds where the intact records of the active segment end and the
+// sequence number of the last one.  Anything after it is a torn append;
+// the segment is sealed in front of it and a new one started.  A plain
+// text segment from before records is sealed as it is.
+//
+// If the segment does not read back, it is sealed whole and kept: its
+// torn end, if any, is where a reader stops.  The sequence goes on past
+// any number of records the segment could hold, so that none repeats.
+void SegmentedLog::recoverActive(void)
+{
+	char name[SEGMENTED_LOG_PATH_MAX];
+	Segment &s = _segments[_count - 1];
+	uint32_t sequence = 0;
+	size_t end = 0;
+
+	segmentPath(name, s);
+	fs::File file = _fs.open(name, FILE_READ);
+	if (!file) return;
+	size_t size = file.size();
+	if (!size) return;
+
+	uint8_t first = 0;
+	bool readable = file.read(&first, 1) == 1;
+	if (readable && first != RECORD_MAGIC) {
+		sequence = lastTextSequence(file, size);
+		end = size;
+	} else if (readable) {
+		readable = lastRecord(file, size, &end, &sequence);
+		if (end) sequence++;
+	}
+	file.close();
+
+	if (!readable) {
+		end = size;
+		sequence = s.next + size / RECORD_OVERHEAD;
+	}
+	if (end && sequence > _sequence) _sequence = sequence;
+	if (readable && first == RECORD_MAGIC && end == size) return;
+
+	if (!end) {
+		// nothing intact, start the same segment again
+		_fs.remove(name);
+		s.bytes = 0;
+		return;
+	}
+	s.state = SEGMENT_SEALED;
+	s.bytes = end;
+	s.next = _sequence;
+	addActive(s.last);
+	saveManifest();
+}
+
+bool SegmentedLog::begin(const char *legacy)
+{
+	char name[SEGMENTED_LOG_PATH_MAX];
+	char temporary[SEGMENTED_LOG_PATH_MAX];
+
+	lock();
+	if (!_fs.exists(_dir)) _fs.mkdir(_dir);
+
+	manifestPath(name, false);
+	manifestPath(temporary, true);
+	if (_fs.exists(temporary)) {
+		if (_fs.exists(name)) _fs.remove(temporary);
+		else _fs.rename(temporary, name);
+	}
+
+	if (!loadManifest()) {
+		_count = 0;
+		if (legacy && _fs.exists(legacy)) {
+			Segment &s = _segments[_count];
+			s.id = _nextId++;
+			s.state = SEGMENT_SEALED;
+			s.first = s.last = 0;
+			path(name, s.id, "csv");
+			if (_fs.rename(legacy, name)) {
+				fs::File file = _fs.open(name, FILE_READ);
+				s.bytes = file.size();
+				s.next = lastTextSequence(file, s.bytes);
+				file.close();
+				_count++;
+			}
+		}
+	}
+	recover();
+	recoverActive();
+	bool ok = openActive();
+	unlock();
+	wake();
+	return ok;
+}
+
+bool SegmentedLog::openActive(void)
+{
+	char name[SEGMENTED_LOG_PATH_MAX];
+	Segment &s = _segments[_count - 1];
+
+	segmentPath(name, s);
+	_active = _fs.open(name, FILE_APPEND);
+	if (!_active) return false;
+	s.bytes = _active.size();
+	return true;
+}
+
+// drops the oldest segment if there is no room
+void SegmentedLog::addActive(uint32_t time)
+{
+	if (_count == SEGMENTED_LOG_MAX_SEGMENTS) removeSegment(0);
+
+	Segment &s = _segments[_count++];
+	s.id = _nextId++;
+	s.state = SEGMENT_ACTIVE;
+	s.first = s.last = time;
+	s.bytes = 0;
+	s.next = _sequence;
+}
+
+// Seals the active segment and starts the next one.  The manifest lists
+// the new segment before its file exists.
+bool SegmentedLog::rotate(uint32_t time)
+{
+	if (_count == SEGMENTED_LOG_MAX_SEGMENTS) {
+		if (_readers || _compacting) return false;
+		removeSegment(0);
+	}
+
+	Segment &sealed = _segments[_count - 1];
+	_active.close();
+	sealed.state = SEGMENT_SEALED;
+	sealed.next = _sequence;
+	if (time) sealed.last = time;
+
+	addActive(time);
+	saveManifest();
+	if (!openActive()) return false;
+	retain(_now);
+	return true;
+}
+
+void SegmentedLog::removeSegment(uint8_t index)
+{
+	char name[SEGMENTED_LOG_PATH_MAX];
+
+	segmentPath(name, _segments[index]);
+	_fs.remove(name);
+	_count--;
+	memmove(_segments + index, _segments + index + 1, (_count - index) * sizeof(Segment));
+}
+
+void SegmentedLog::retain(uint32_t now)
+{
+	uint32_t total = 0;
+	bool changed = false;
+
+	if (_readers || _compacting) return;
+	for (uint8_t i = 0; i < _count; i++) total += _segments[i].bytes;
+
+	while (_count > 1) {
+		const Segment &s = _segments[0];
+		bool tooBig = _maxBytes && total > _maxBytes;
+		bool tooOld = _maxAge && s.last && now > s.last && now - s.last > _maxAge;
+		if (!tooBig && !tooOld) break;
+		total -= s.bytes;
+		removeSegment(0);
+		changed = true;
+	}
+	if (changed) saveManifest();
+}
+
+bool SegmentedLog::append(const char *line, uint32_t time)
+{
+	uint8_t record[SEGMENTED_LOG_RECORD_MAX + RECORD_OVERHEAD];
+	size_t length = strlen(line);
+	size_t total = length + RECORD_OVERHEAD;
+	bool rotated = false;
+
+	if (length > SEGMENTED_LOG_RECORD_MAX) return false;
+
+	lock();
+	if (!_count) {
+		unlock();
+		return false;
+	}
+	if (time > _now) _now = time;
+	if (!_active && !openActive()) {
+		unlock();
+		return false;
+	}
+
+	Segment *s = &_segments[_count - 1];
+	if (s->bytes + total > _segmentSize && s->bytes) {
+		rotated = rotate(time);
+		s = &_segments[_count - 1];
+		if (!_active && !openActive()) {
+			unlock();
+			return false;
+		}
+		// a reader holding up rotation gets one more segment size of room
+		if (!rotated && s->bytes + total > 2 * _segmentSize) {
+			unlock();
+			return false;
+		}
+	}
+
+	record[0] = RECORD_MAGIC;
+	put16(record + 1, length);
+	put32(record + 3, _sequence);
+	memcpy(record + RECORD_HEAD, line, length);
+	put32(record + RECORD_HEAD + length, sampleCrc32(0, record, RECORD_HEAD + length));
+	put16(record + RECORD_HEAD + length + 4, length);
+
+	bool ok = _active.write(record, total) == total;
+	_active.flush();
+	if (ok) {
+		s->bytes += total;
+		_sequence++;
+		if (time) {
+			if (!s->first) s->first = time;
+			s->last = time;
+		}
+	} else {
+		// whatever part of the record made it out is behind the end of
+		// the segment once it is sealed
+		rotated = rotate(time) || rotated;
+	}
+	unlock();
+
+	if (rotated) wake();
+	return ok;
+}
+
+bool SegmentedLog::clear(void)
+{
+	lock();
+	if (_readers || _compacting) {
+		unlock();
+		return false;
+	}
+	_active.close();
+	while (_count) removeSegment(_count - 1);
+
+	addActive(0);
+	saveManifest();
+	bool ok = openActive();
+	unlock();
+	return ok;
+}
+
+bool SegmentedLog::busy(void)
+{
+	lock();
+	bool busy = _readers || _compacting;
+	unlock();
+	return busy;
+}
+
+bool SegmentedLog::compactOne(void)
+{
+	char name[SEGMENTED_LOG_PATH_MAX];
+	char temporary[SEGMENTED_LOG_PATH_MAX];
+	uint32_t id = 0;
+	size_t limit = 0;
+
+	lock();
+	if (_readers || _compacting) {
+		unlock();
+		return false;
+	}
+	for (uint8_t i = 0; i < _count; i++) {
+		if (_segments[i].state == SEGMENT_SEALED) {
+			id = _segments[i].id;
+			limit = _segments[i].bytes;
+			break;
+		}
+	}
+	if (!id) {
+		unlock();
+		return false;
+	}
+	_compacting = true;
+	unlock();
+
+	// the sealed segment does not change any more, encode it unlocked
+	path(name, id, "csv");
+	path(temporary, id, "tmp");
+	fs::File in = _fs.open(name, FILE_READ);
+	fs::File file = _fs.open(temporary, FILE_WRITE);
+	bool ok = in && file;
+	size_t bytes = 0;
+
+	if (ok) {
+		// a few KB, more than the compactor's stack should carry
+		ArchiveFile output(file);
+		SampleArchiveEncoder *out = new SampleArchiveEncoder(&output);
+		SegmentInput input;
+		input.begin(&in, limit);
+
+		if (input.peek() == RECORD_MAGIC) {
+			char line[SEGMENTED_LOG_RECORD_MAX];
+			size_t length;
+			uint32_t sequence;
+			uint8_t r;
+			out->feed((const uint8_t *)_header, _headerLength);
+			while ((r = nextRecord(input, line, &length, &sequence)) != RECORD_END) {
+				if (r == RECORD_OK) out->feed((const uint8_t *)line, length);
+				yield();
+			}
+		} else {
+			uint8_t block[256];
+			size_t n;
+			while ((n = input.read(block, sizeof(block))) > 0) {
+				out->feed(block, n);
+				yield();
+			}
+		}
+		ok = out->finish();
+		bytes = out->total();
+		delete out;
+	}
+	in.close();
+	file.close();
+
+	lock();
+	_compacting = false;
+	// a reader may have opened the raw segment meanwhile
+	if (ok && !_readers) {
+		char archive[SEGMENTED_LOG_PATH_MAX];
+		path(archive, id, "col");
+		ok = _fs.rename(temporary, archive);
+	} else {
+		ok = false;
+	}
+	if (ok) {
+		for (uint8_t i = 0; i < _count; i++) {
+			if (_segments[i].id != id) continue;
+			_segments[i].state = SEGMENT_COLUMNS;
+			_segments[i].bytes = bytes;
+			break;
+		}
+		saveManifest();
+		_fs.remove(name);
+		retain(_now);
+	} else {
+		_fs.remove(temporary);
+	}
+	unlock();
+	return ok;
+}
+
+void SegmentedLog::wake(void)
+{
+#ifdef ESP32
+	if (_compactor) xTaskNotifyGive(_compactor);
+#endif
+}
+
+#ifdef ESP32
+void SegmentedLog::compactorTask(void *arg)
+{
+	SegmentedLog *log = (SegmentedLog *)arg;
+
+	for (;;) {
+		while (log->compactOne()) {
+		}
+		// also retry now and then, a reader may have been in the way
+		ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(60000));
+	}
+}
+
+bool SegmentedLog::startCompactor(UBaseType_t priority, BaseType_t core)
+{
+	if (_compactor) return true;
+	return xTaskCreatePinnedToCore(compactorTask, "log_compact", 4096, this, priority, &_compactor, core) == pdPASS;
+}
+#endif
+
+uint32_t SegmentedLog::size(void)
+{
+	uint32_t total = 0;
+
+	lock();
+	for (uint8_t i = 0; i < _count; i++) total += _segments[i].bytes;
+	unlock();
+	return total;
+}
+
+uint8_t SegmentedLog::segmentCount(void)
+{
+	return _count;
+}
+
+SegmentedLogReader::SegmentedLogReader(SegmentedLog *log, uint32_t from, uint32_t to)
+  : _log(log), _from(from), _to(to), _nextId(0), _format(FORMAT_TEXT), _first(true), _skip(0),
+    _lineLength(0), _linePos(0)
+{
+	_log->lock();
+	_log->_readers++;
+	_log->unlock();
+}
+
+SegmentedLogReader::~SegmentedLogReader()
+{
+	_file.close();
+	_log->lock();
+	_log->_readers--;
+	_log->unlock();
+}
+
+// opens the segment after the one read last
+bool SegmentedLogReader::next(void)
+{
+	char name[SEGMENTED_LOG_PATH_MAX];
+	size_t limit = 0;
+
+	_file.close();
+	_log->lock();
+	for (uint8_t i = 0; i < _log->_count; i++) {
+		const SegmentedLog::Segment &s = _log->_segments[i];
+		if (s.id < _nextId) continue;
+		_nextId = s.id + 1;
+		// segments without times are read in case
+		if ((s.first && s.first > _to) || (s.last && s.last < _from)) continue;
+		_log->segmentPath(name, s);
+		_file = _log->_fs.open(name, FILE_READ);
+		if (!_file) continue;
+		_format = s.state == SegmentedLog::SEGMENT_COLUMNS ? FORMAT_COLUMNS : FORMAT_TEXT;
+		limit = s.bytes;
+		break;
+	}
+	_log->unlock();
+	if (!_file) return false;
+
+	_input.begin(&_file, limit);
+	if (_format == FORMAT_COLUMNS) _columns.begin(&_input, _from, _to);
+	// plain text segments start with the header line, empty ones are new
+	if (_format == FORMAT_TEXT) {
+		int c = _input.peek();
+		if (c == RECORD_MAGIC || c < 0) _format = FORMAT_RECORDS;
+	}
+	_lineLength = _linePos = 0;
+
+	// the header line only once; record segments have none of their own
+	_skip = (_first || _format == FORMAT_RECORDS) ? 0 : _log->_headerLength;
+	if (_first && _format == FORMAT_RECORDS) {
+		_lineLength = _log->_headerLength < sizeof(_line) ? _log->_headerLength : sizeof(_line);
+		memcpy(_line, _log->_header, _lineLength);
+	}
+	_first = false;
+	return true;
+}
+
+// false if the line in _line is a sample outside of the time range
+bool SegmentedLogReader::inRange(void)
+{
+	Sample sample;
+
+	if (!_from && _to == 0xFFFFFFFF) return true;
+	if (!parseSample(_line, _lineLength, &sample)) return true;
+	return sample.time >= _from && sample.time <= _to;
+}
+
+// records and archives, a line at a time
+size_t SegmentedLogReader::readLines(uint8_t *buf, size_t len)
+{
+	size_t n = 0;
+	uint32_t sequence;
+
+	while (n < len) {
+		if (_linePos < _lineLength) {
+			size_t chunk = _lineLength - _linePos;
+			if (chunk > len - n) chunk = len - n;
+			memcpy(buf + n, _line + _linePos, chunk);
+			_linePos += chunk;
+			n += chunk;
+		} else if (_format == FORMAT_RECORDS) {
+			uint8_t r = nextRecord(_input, _line, &_lineLength, &sequence);
+			if (r == RECORD_END) {
+				// nothing more of this segment
+				_input.begin(&_file, 0);
+				break;
+			}
+			if (r == RECORD_DAMAGED || !inRange()) _lineLength = 0;
+			_linePos = 0;
+		} else {
+			const char *line;
+			if (!_columns.next(&line, &_lineLength)) break;
+			memcpy(_line, line, _lineLength);
+			_linePos = 0;
+		}
+	}
+	return n;
+}
+
+size_t SegmentedLogReader::read(uint8_t *buf, size_t len)
+{
+	size_t n = 0;
+
+	while (n < len) {
+		if (!_file && !next()) break;
+		size_t got = (_format == FORMAT_TEXT) ? _input.read(buf + n, len - n) : readLines(buf + n, len - n);
+		if (!got) {
+			_file.close();
+			continue;
+		}
+		if (_skip) {
+			size_t drop = got < _skip ? got : _skip;
+			memmove(buf + n, buf + n + drop, got - drop);
+			_skip -= drop;
+			got -= drop;
+		}
+		n += got;
+	}
+	return n;
+}
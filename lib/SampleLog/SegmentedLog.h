@@ -0,0 +1,240 @@
+#ifndef SegmentedLog_h
+#define SegmentedLog_h
+
+// Append-only text log split into fixed-size segments.
+//
+// Lines go to the active segment, a file in the log directory named after
+// its number (00000012.csv).  Once a line would take the active segment
+// over the segment size, it is sealed and a new one is started, so an
+// append never has to walk a FAT chain longer than one segment and its
+// latency stays the same however long the log gets.
+//
+// Every line is written as one record:
+//
+//   0xA5, length (2), sequence (4), line, CRC32 (4), length (2)
+//
+// little endian, the CRC over everything before it.  A reset in the
+// middle of an append leaves a torn record at the end of the active
+// segment.  begin() finds the end of the last intact record by going
+// backward from the end of the file a block at a time (the length at the
+// end of each record says where it starts), seals the segment there and
+// carries on in a new one.  The sequence number continues from that
+// record, so it never repeats after a power loss and is known after
+// reading one block instead of the whole segment.  Segments written
+// before records were introduced are plain text and read as they are.
+//
+// The manifest (manifest.txt) lists every segment with its state, the
+// time of its first and last line, its size and the next sequence number
+// after it.  It is rewritten (to a temporary file, then renamed) on
+// rotation, compaction and retention only, never on a plain append.
+//
+// Sealed segments are compacted into columnar archives (00000012.col,
+// see SampleArchive.h) by a low-priority task; a sample line takes one to
+// three bytes there.
+//
+// Retention drops the oldest segments once the log is larger than
+// maxBytes, or once their last line is older than maxAge seconds.  The
+// active segment is never dropped.  Segments are not touched (neither
+// compacted nor dropped) while a reader is open.  Once the segment table
+// is full that holds up rotation too: the active segment then takes up to
+// one more segment size, and after that append() turns lines away until
+// the last reader is gone.
+//
+// SegmentedLogReader streams all segments back as one CSV file, with the
+// header line once at the top, optionally only the samples of a time
+// range.
+
+#include <Arduino.h>
+#include <FS.h>
+#include "SampleArchive.h"
+
+#ifdef ESP32
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#endif
+
+#ifndef SEGMENTED_LOG_MAX_SEGMENTS
+#define SEGMENTED_LOG_MAX_SEGMENTS 128
+#endif
+
+#define SEGMENTED_LOG_SEGMENT_SIZE  (64 * 1024)
+
+// longest line append() takes
+#define SEGMENTED_LOG_RECORD_MAX    256
+
+// bytes read at a time when looking for the last intact record
+#ifndef SEGMENTED_LOG_RECOVERY_BLOCK
+#define SEGMENTED_LOG_RECOVERY_BLOCK 1024
+#endif
+
+// a path in the log directory: dir + "/00000000.csv"
+#define SEGMENTED_LOG_PATH_MAX      48
+
+class SegmentedLogReader;
+
+// Buffered reading of the first 'limit' bytes of a segment
+class SegmentInput : public SampleArchiveInput
+{
+  public:
+    SegmentInput() : _file(0), _length(0), _pos(0), _left(0) {}
+
+    void begin(fs::File *file, size_t limit);
+    int peek(void);
+    int getByte(void);
+    size_t read(uint8_t *buf, size_t len);
+    bool skip(size_t len);
+
+  private:
+    fs::File *_file;
+    uint8_t _buf[256];
+    size_t _length;
+    size_t _pos;
+    size_t _left;
+};
+
+class SegmentedLog
+{
+  public:
+    SegmentedLog(fs::FS &fs, const char *dir, const char *header);
+    ~SegmentedLog();
+
+    // before begin()
+    void setSegmentSize(size_t bytes) { _segmentSize = bytes; }
+
+    // 0 turns the respective limit off
+    void setRetention(uint32_t maxAge, uint32_t maxBytes);
+
+    // Loads the manifest, finishes whatever a reset interrupted and opens
+    // the active segment.  If there is no log yet but a file at 'legacy'
+    // (the old single-file log), it becomes the first sealed segment.
+    bool begin(const char *legacy = 0);
+
+    // One line including its line end, at most SEGMENTED_LOG_RECORD_MAX
+    // bytes.  'time' is the time of the line in seconds (e.g. the NTP
+    // epoch), used for retention only.
+    bool append(const char *line, uint32_t time);
+
+    // sequence number the next line gets
+    uint32_t sequence(void) { return _sequence; }
+
+    // Drops every segment and starts over with an empty one.  Fails while
+    // busy(): a download in progress keeps what it is reading.
+    bool clear(void);
+
+    // a reader is open or a segment is being compacted
+    bool busy(void);
+
+    // Compacts the oldest sealed segment; false if there is none or a
+    // reader is open.  Called by the compaction task, or directly if
+    // there is none.
+    bool compactOne(void);
+
+#ifdef ESP32
+    // Starts the compaction task.  It sleeps until a segment is sealed.
+    bool startCompactor(UBaseType_t priority = 1, BaseType_t core = tskNO_AFFINITY);
+#endif
+
+    // total size on the card
+    uint32_t size(void);
+    uint8_t segmentCount(void);
+
+  private:
+    friend class SegmentedLogReader;
+
+    enum { SEGMENT_ACTIVE = 'A', SEGMENT_SEALED = 'S', SEGMENT_COLUMNS = 'C' };
+
+    struct Segment {
+      uint32_t id;
+      uint32_t first;
+      uint32_t last;
+      uint32_t bytes;
+      uint32_t next;
+      uint8_t state;
+    };
+
+    void lock(void);
+    void unlock(void);
+
+    void path(char *buf, uint32_t id, const char *extension);
+    void segmentPath(char *buf, const Segment &segment);
+    void manifestPath(char *buf, bool temporary);
+    bool loadManifest(void);
+    bool saveManifest(void);
+    void recover(void);
+    void recoverActive(void);
+    bool openActive(void);
+    void addActive(uint32_t time);
+    bool rotate(uint32_t time);
+    void removeSegment(uint8_t index);
+    void retain(uint32_t now);
+    void wake(void);
+
+    fs::FS &_fs;
+    const char *_dir;
+    const char *_header;
+    size_t _headerLength;
+    size_t _segmentSize;
+    uint32_t _maxAge;
+    uint32_t _maxBytes;
+    uint32_t _now;
+
+    Segment _segments[SEGMENTED_LOG_MAX_SEGMENTS];
+    uint8_t _count;
+    uint32_t _nextId;
+    uint32_t _sequence;
+    fs::File _active;
+    uint8_t _readers;
+    bool _compacting;
+
+#ifdef ESP32
+    static void compactorTask(void *);
+
+    SemaphoreHandle_t _lock;
+    TaskHandle_t _compactor;
+#endif
+};
+
+// Reads the whole log, oldest line first, as one CSV stream.  Segments
+// stay where they are while the reader exists.
+//
+// With a time range (seconds since 1970, both ends included) segments are
+// skipped by the times given to append(), archive blocks by their
+// headers and sample lines by their date and hour; the two should be the
+// same clock.  Lines that are not samples are always read, and so are
+// plain text segments from before records.
+class SegmentedLogReader
+{
+  public:
+    SegmentedLogReader(SegmentedLog *log, uint32_t from = 0, uint32_t to = 0xFFFFFFFF);
+    ~SegmentedLogReader();
+
+    // 0 at the end
+    size_t read(uint8_t *buf, size_t len);
+
+  private:
+    enum { FORMAT_TEXT, FORMAT_RECORDS, FORMAT_COLUMNS };
+
+    bool next(void);
+    bool inRange(void);
+    size_t readLines(uint8_t *buf, size_t len);
+
+    SegmentedLog *_log;
+    uint32_t _from;
+    uint32_t _to;
+    uint32_t _nextId;
+    fs::File _file;
+    SegmentInput _input;
+    SampleArchiveDecoder _columns;
+    uint8_t _format;
+    bool _first;
+    size_t _skip;
+
+    // the line being handed out (a record or a decoded archive line) and
+    // how much of it is out
+    char _line[SEGMENTED_LOG_RECORD_MAX];
+    size_t _lineLength;
+    size_t _linePos;
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef SpscQueue_h
+#define SpscQueue_h
+
+// Bounded queue between exactly one producer and one consumer task.
+//
+// Neither side ever waits for the other or takes a lock: push() fails if
+// the queue is full, pop() if it is empty.  _head is only written by the
+// producer and _tail only by the consumer, both count up forever and are
+// masked to find the slot.  Each side reads the other's counter with
+// acquire and publishes its own with release ordering, so an item is
+// completely written before the consumer sees it and completely read
+// before the producer reuses its slot.  All N slots can be used.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+template <typename T, size_t N>
+class SpscQueue
+{
+    static_assert(N && !(N & (N - 1)), "SpscQueue size must be a power of two");
+
+  public:
+    SpscQueue() : _head(0), _tail(0) {}
+
+    // producer only
+    bool push(const T &item)
+    {
+      uint32_t head = _head.load(std::memory_order_relaxed);
+
+      if (head - _tail.load(std::memory_order_acquire) == N) return false;
+      _items[head & (N - 1)] = item;
+      _head.store(head + 1, std::memory_order_release);
+      return true;
+    }
+
+    // consumer only
+    bool pop(T *item)
+    {
+      uint32_t tail = _tail.load(std::memory_order_relaxed);
+
+      if (_head.load(std::memory_order_acquire) == tail) return false;
+      *item = _items[tail & (N - 1)];
+      _tail.store(tail + 1, std::memory_order_release);
+      return true;
+    }
+
+    // from either side; only a snapshot while the other side is running
+    size_t size(void) const
+    {
+      // tail first: it never passes the head read after it
+      uint32_t tail = _tail.load(std::memory_order_acquire);
+
+      return _head.load(std::memory_order_acquire) - tail;
+    }
+
+    bool isEmpty(void) const { return size() == 0; }
+
+  private:
+    T _items[N];
+    std::atomic<uint32_t> _head;
+    std::atomic<uint32_t> _tail;
+};
+
+#endif
@@ -0,0 +1,279 @@
+// Sampling, storage and publishing tasks, see TelemetryPipeline.h.
+
+#include "TelemetryPipeline.h"
+
+#ifdef ESP32
+#include <esp_timer.h>
+
+static uint32_t microsNow(void)
+{
+	return (uint32_t)esp_timer_get_time();
+}
+#else
+#include <chrono>
+
+static uint32_t microsNow(void)
+{
+	return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+void TelemetryHistogram::add(uint32_t us)
+{
+	uint8_t i = 0;
+
+	while (i < TELEMETRY_HISTOGRAM_BUCKETS - 1 && us >> i) i++;
+	_buckets[i]++;
+	_count++;
+	if (us > _max) _max = us;
+}
+
+void TelemetryHistogram::clear(void)
+{
+	for (uint8_t i = 0; i < TELEMETRY_HISTOGRAM_BUCKETS; i++) _buckets[i] = 0;
+	_count = 0;
+	_max = 0;
+}
+
+uint32_t TelemetryHistogram::percentile(uint8_t percent) const
+{
+	uint32_t count = _count;
+	uint32_t rank = ((uint64_t)count * percent + 99) / 100;
+	uint32_t seen = 0;
+
+	if (!count) return 0;
+	if (!rank) rank = 1;
+	for (uint8_t i = 0; i < TELEMETRY_HISTOGRAM_BUCKETS - 1; i++) {
+		seen += _buckets[i];
+		if (seen >= rank) return i ? (1UL << i) - 1 : 0;
+	}
+	return _max;
+}
+
+TelemetryPipeline::TelemetryPipeline()
+  : _acquire(0), _store(0), _publish(0), _acquired(0), _running(false)
+{
+	static const TelemetryTaskConfig defaults[TELEMETRY_STAGES] = {
+		{ TELEMETRY_ACQUIRE_STACK, TELEMETRY_ACQUIRE_PRIORITY, TELEMETRY_ACQUIRE_CORE, TELEMETRY_ACQUIRE_PERIOD },
+		{ TELEMETRY_STORE_STACK, TELEMETRY_STORE_PRIORITY, TELEMETRY_STORE_CORE, TELEMETRY_STORE_PERIOD },
+		{ TELEMETRY_PUBLISH_STACK, TELEMETRY_PUBLISH_PRIORITY, TELEMETRY_PUBLISH_CORE, TELEMETRY_PUBLISH_PERIOD },
+	};
+
+	for (uint8_t i = 0; i < TELEMETRY_STAGES; i++) {
+		Task &task = _tasks[i];
+
+		task.pipeline = this;
+		task.stage = (TelemetryStage)i;
+		task.config = defaults[i];
+		task.idle = 0;
+		task.dropped = 0;
+		task.done = true;
+#ifdef ESP32
+		task.handle = 0;
+#else
+		task.woken = false;
+#endif
+	}
+}
+
+TelemetryPipeline::~TelemetryPipeline()
+{
+	end();
+}
+
+void TelemetryPipeline::configure(TelemetryStage stage, const TelemetryTaskConfig &config)
+{
+	_tasks[stage].config = config;
+}
+
+bool TelemetryPipeline::begin(void)
+{
+	static const char *names[TELEMETRY_STAGES] = { "tm_acquire", "tm_store", "tm_publish" };
+
+	if (_running) return true;
+	_running = true;
+	// consumers first, the acquisition task signals them from its first sample
+	for (uint8_t i = TELEMETRY_STAGES; i-- > 0;) {
+		if (!start(_tasks[i], names[i])) {
+			end();
+			return false;
+		}
+	}
+	return true;
+}
+
+void TelemetryPipeline::end(void)
+{
+	_running = false;
+	// acquisition first, so that nothing is queued once the consumers are gone
+	for (uint8_t i = 0; i < TELEMETRY_STAGES; i++) stop(_tasks[i]);
+}
+
+#ifdef ESP32
+uint32_t TelemetryPipeline::stackFree(TelemetryStage stage)
+{
+	TaskHandle_t handle = _tasks[stage].handle;
+
+	return handle ? uxTaskGetStackHighWaterMark(handle) : 0;
+}
+#endif
+
+void TelemetryPipeline::taskMain(void *arg)
+{
+	Task *task = (Task *)arg;
+	TelemetryPipeline *pipeline = task->pipeline;
+
+	switch (task->stage) {
+	case TELEMETRY_ACQUIRE:
+		pipeline->acquireLoop(*task);
+		break;
+	case TELEMETRY_STORE:
+		pipeline->consumeLoop(*task, pipeline->_queues[0], pipeline->_store);
+		break;
+	default:
+		pipeline->consumeLoop(*task, pipeline->_queues[1], pipeline->_publish);
+		break;
+	}
+	task->done = true;
+#ifdef ESP32
+	// deleted by stop(), which may still signal the task until it sees done
+	for (;;) vTaskDelay(portMAX_DELAY);
+#endif
+}
+
+bool TelemetryPipeline::start(Task &task, const char *name)
+{
+	task.done = false;
+#ifdef ESP32
+	BaseType_t core = task.config.core < 0 ? tskNO_AFFINITY : task.config.core;
+
+	if (xTaskCreatePinnedToCore(taskMain, name, task.config.stackSize, &task, task.config.priority, &task.handle, core) == pdPASS) return true;
+	task.handle = 0;
+#else
+	(void)name;
+	task.woken = false;
+	task.thread = std::thread(taskMain, &task);
+	if (task.thread.joinable()) return true;
+#endif
+	task.done = true;
+	return false;
+}
+
+void TelemetryPipeline::stop(Task &task)
+{
+#ifdef ESP32
+	if (!task.handle) return;
+	while (!task.done) {
+		signal(task);
+		vTaskDelay(1);
+	}
+	vTaskDelete(task.handle);
+	task.handle = 0;
+#else
+	if (!task.thread.joinable()) return;
+	signal(task);
+	task.thread.join();
+#endif
+}
+
+void TelemetryPipeline::signal(Task &task)
+{
+#ifdef ESP32
+	xTaskNotifyGive(task.handle);
+#else
+	std::lock_guard<std::mutex> lock(task.mutex);
+	task.woken = true;
+	task.wake.notify_one();
+#endif
+}
+
+// sleeps for at most 'us' (rounded up to a tick) or until signalled; a
+// signal given before the call ends the next wait at once
+void TelemetryPipeline::wait(Task &task, uint32_t us)
+{
+#ifdef ESP32
+	(void)task;
+	TickType_t ticks = portMAX_DELAY;
+
+	if (us != WAIT_FOREVER) {
+		ticks = ((uint64_t)us + portTICK_PERIOD_MS * 1000 - 1) / (portTICK_PERIOD_MS * 1000);
+		if (!ticks) ticks = 1;
+	}
+	ulTaskNotifyTake(pdTRUE, ticks);
+#else
+	std::unique_lock<std::mutex> lock(task.mutex);
+
+	if (us == WAIT_FOREVER) {
+		task.wake.wait(lock, [&task] { return task.woken; });
+	} else {
+		task.wake.wait_for(lock, std::chrono::microseconds(us), [&task] { return task.woken; });
+	}
+	task.woken = false;
+#endif
+}
+
+void TelemetryPipeline::acquireLoop(Task &task)
+{
+	uint32_t period = task.config.period * 1000;
+	uint32_t due = microsNow();
+
+	while (_running) {
+		uint32_t now = microsNow();
+		int32_t early = (int32_t)(due - now);
+
+		if (early > 0) {
+			wait(task, early);
+			continue;
+		}
+		task.latency.add(now - due);
+
+		TelemetrySample sample;
+		if (_acquire && _acquire(&sample)) {
+			sample.taken = microsNow();
+			_acquired++;
+			for (uint8_t i = TELEMETRY_STORE; i < TELEMETRY_STAGES; i++) {
+				if (_queues[i - TELEMETRY_STORE].push(sample)) {
+					signal(_tasks[i]);
+				} else {
+					_tasks[i].dropped++;
+				}
+			}
+		}
+
+		// an overrun skips the periods it missed instead of catching up
+		// with a burst
+		due += period;
+		uint32_t late = microsNow() - due;
+		if (period && (int32_t)late >= (int32_t)period) due += late / period * period;
+	}
+}
+
+void TelemetryPipeline::consumeLoop(Task &task, Queue &queue, SampleHandler *handler)
+{
+	uint32_t period = task.config.period * 1000;
+	uint32_t busy = microsNow();
+
+	// once stopped, only what is already queued
+	while (_running || !queue.isEmpty()) {
+		TelemetrySample sample;
+
+		if (queue.pop(&sample)) {
+			if (handler) handler(sample);
+			busy = microsNow();
+			task.latency.add(busy - sample.taken);
+			continue;
+		}
+		if (!period) {
+			wait(task, WAIT_FOREVER);
+			continue;
+		}
+		uint32_t idle = microsNow() - busy;
+		if (idle >= period) {
+			if (task.idle) task.idle();
+			busy = microsNow();
+			continue;
+		}
+		wait(task, period - idle);
+	}
+}
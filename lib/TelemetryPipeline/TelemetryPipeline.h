@@ -0,0 +1,218 @@
+#ifndef TelemetryPipeline_h
+#define TelemetryPipeline_h
+
+// Sampling, storage and publishing as three tasks.
+//
+// The acquisition task calls the acquire handler once per period, on a
+// fixed schedule, and hands every sample it returns to two queues: one
+// read by the storage task, one by the publishing task.  Those sleep
+// until a sample arrives and pass it to the store and publish handlers.
+// The queues are lock-free single-producer single-consumer rings (see
+// SpscQueue.h), so nothing a consumer does, a slow SD write or a Wi-Fi
+// retry, can hold up sampling: if a consumer falls so far behind that its
+// queue is full, the sample is dropped for that consumer only and
+// counted.
+//
+// Each task has its own stack size, priority and core.  By default
+// acquisition and storage run on the application core (1), acquisition
+// at the higher priority so that it preempts an SD write when a sample is
+// due, and publishing runs on the protocol core (0) next to Wi-Fi, lwIP
+// and AsyncTCP.  A consumer that has had no sample for its period calls
+// its idle handler, e.g. to keep the clock in sync.
+//
+// The pipeline keeps a histogram of how late the acquire handler was
+// called against its schedule and, for each consumer, of the time from
+// the end of the acquire handler to the end of the store or publish
+// handler.
+//
+// Without FreeRTOS (a host build) the tasks are std::threads; stack size,
+// priority and core are ignored there.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include "SpscQueue.h"
+
+#ifdef ESP32
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#else
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+
+// samples a consumer can fall behind before they are dropped for it
+#ifndef TELEMETRY_QUEUE_DEPTH
+#define TELEMETRY_QUEUE_DEPTH 16
+#endif
+
+#ifndef TELEMETRY_ACQUIRE_STACK
+#define TELEMETRY_ACQUIRE_STACK    4096
+#endif
+#ifndef TELEMETRY_ACQUIRE_PRIORITY
+#define TELEMETRY_ACQUIRE_PRIORITY 5
+#endif
+#ifndef TELEMETRY_ACQUIRE_CORE
+#define TELEMETRY_ACQUIRE_CORE     1
+#endif
+#ifndef TELEMETRY_ACQUIRE_PERIOD
+#define TELEMETRY_ACQUIRE_PERIOD   1000
+#endif
+
+#ifndef TELEMETRY_STORE_STACK
+#define TELEMETRY_STORE_STACK      6144
+#endif
+#ifndef TELEMETRY_STORE_PRIORITY
+#define TELEMETRY_STORE_PRIORITY   2
+#endif
+#ifndef TELEMETRY_STORE_CORE
+#define TELEMETRY_STORE_CORE       1
+#endif
+#ifndef TELEMETRY_STORE_PERIOD
+#define TELEMETRY_STORE_PERIOD     60000
+#endif
+
+#ifndef TELEMETRY_PUBLISH_STACK
+#define TELEMETRY_PUBLISH_STACK    4096
+#endif
+#ifndef TELEMETRY_PUBLISH_PRIORITY
+#define TELEMETRY_PUBLISH_PRIORITY 3
+#endif
+#ifndef TELEMETRY_PUBLISH_CORE
+#define TELEMETRY_PUBLISH_CORE     0
+#endif
+#ifndef TELEMETRY_PUBLISH_PERIOD
+#define TELEMETRY_PUBLISH_PERIOD   10000
+#endif
+
+// bucket i counts times below 2^i us, from 2^(i-1) us on; the last one
+// everything from 2^22 us (about 4 s) on
+#define TELEMETRY_HISTOGRAM_BUCKETS 24
+
+enum TelemetryStage { TELEMETRY_ACQUIRE, TELEMETRY_STORE, TELEMETRY_PUBLISH, TELEMETRY_STAGES };
+
+struct TelemetrySample {
+    uint32_t taken;     // micros, set by the pipeline after the acquire handler
+    uint32_t time;      // seconds since 1970
+    int32_t raw;        // 1/128 degrees C
+    uint8_t probe;
+};
+
+struct TelemetryTaskConfig {
+    uint32_t stackSize; // bytes
+    uint8_t priority;
+    int8_t core;        // -1 for either
+    uint32_t period;    // ms, the sampling period or a consumer's idle period (0: never idle), at most half an hour
+};
+
+// Written by one task only, read by any; a reader on the other core may
+// see one sample more in some buckets than in count().
+class TelemetryHistogram
+{
+  public:
+    TelemetryHistogram() { clear(); }
+
+    void add(uint32_t us);
+    void clear(void);
+
+    uint32_t count(void) const { return _count; }
+    uint32_t bucket(uint8_t i) const { return _buckets[i]; }
+    uint32_t max(void) const { return _max; }
+
+    // upper end in us of the bucket the given percentile falls into,
+    // 0 if nothing was added yet
+    uint32_t percentile(uint8_t percent) const;
+
+  private:
+    volatile uint32_t _buckets[TELEMETRY_HISTOGRAM_BUCKETS];
+    volatile uint32_t _count;
+    volatile uint32_t _max;
+};
+
+class TelemetryPipeline
+{
+  public:
+    // fills in the sample, false if there is none this period
+    typedef bool AcquireHandler(TelemetrySample *sample);
+    typedef void SampleHandler(const TelemetrySample &sample);
+    typedef void IdleHandler(void);
+
+    TelemetryPipeline();
+    ~TelemetryPipeline();
+
+    // before begin()
+    void configure(TelemetryStage stage, const TelemetryTaskConfig &config);
+    const TelemetryTaskConfig &config(TelemetryStage stage) const { return _tasks[stage].config; }
+    void onAcquire(AcquireHandler *handler) { _acquire = handler; }
+    void onStore(SampleHandler *handler) { _store = handler; }
+    void onPublish(SampleHandler *handler) { _publish = handler; }
+    // for TELEMETRY_STORE and TELEMETRY_PUBLISH
+    void onIdle(TelemetryStage stage, IdleHandler *handler) { _tasks[stage].idle = handler; }
+
+    // Starts the tasks, false (and none running) if one could not be
+    // created.
+    bool begin(void);
+
+    // Stops sampling, lets the consumers finish the samples already
+    // queued and waits for all three tasks to end.
+    void end(void);
+
+    // TELEMETRY_ACQUIRE: how late the acquire handler was called;
+    // consumers: end of acquire to end of store or publish
+    const TelemetryHistogram &latency(TelemetryStage stage) const { return _tasks[stage].latency; }
+
+    // samples the acquire handler returned, and those dropped for a full
+    // consumer queue
+    uint32_t acquired(void) const { return _acquired; }
+    uint32_t dropped(TelemetryStage stage) const { return _tasks[stage].dropped; }
+
+#ifdef ESP32
+    // least free stack a task had so far, in bytes
+    uint32_t stackFree(TelemetryStage stage);
+#endif
+
+  private:
+    typedef SpscQueue<TelemetrySample, TELEMETRY_QUEUE_DEPTH> Queue;
+
+    struct Task {
+      TelemetryPipeline *pipeline;
+      TelemetryStage stage;
+      TelemetryTaskConfig config;
+      IdleHandler *idle;
+      TelemetryHistogram latency;
+      volatile uint32_t dropped;
+      std::atomic<bool> done;
+#ifdef ESP32
+      TaskHandle_t handle;
+#else
+      std::thread thread;
+      std::mutex mutex;
+      std::condition_variable wake;
+      bool woken;
+#endif
+    };
+
+    static void taskMain(void *arg);
+
+    bool start(Task &task, const char *name);
+    void stop(Task &task);
+    // wait() until signalled, however long that takes
+    static const uint32_t WAIT_FOREVER = 0xFFFFFFFF;
+
+    void signal(Task &task);
+    void wait(Task &task, uint32_t us);
+
+    void acquireLoop(Task &task);
+    void consumeLoop(Task &task, Queue &queue, SampleHandler *handler);
+
+    Task _tasks[TELEMETRY_STAGES];
+    Queue _queues[TELEMETRY_STAGES - 1];
+    AcquireHandler *_acquire;
+    SampleHandler *_store;
+    SampleHandler *_publish;
+    volatile uint32_t _acquired;
+    std::atomic<bool> _running;
+};
+
+#endif
@@ -5,6 +5,11 @@
  * This code connects to a Wi-Fi network, reads temperature data from a DS18B20 sensor,
  * logs the data to an SD card, and provides a web interface with WebSocket support.
  * It also allows for deep sleep mode and button interrupt to wake up the device.
+ *
+ * Sampling, SD logging and WebSocket publishing run in tasks of their own (see
+ * TelemetryPipeline.h): sampling on the application core, publishing on the
+ * protocol core next to Wi-Fi and AsyncTCP, so that neither a slow SD write nor
+ * a Wi-Fi retry delays a reading. loop() only handles the button and sleep.
  */
 
 #include "FS.h"
@@ -12,18 +17,25 @@
 #include <SPI.h>
 #include <SPIFFS.h>
 #include <OneWire.h>
+#include <OneWireTopology.h>
 #include <DallasTemperature.h>
+#include <DallasAlarmSampler.h>
+#include <DallasFilter.h>
 #include <WiFi.h>
 #include <NTPClient.h>
 #include <WiFiUdp.h>
 #include <ESPAsyncWebServer.h>
+#include <SegmentedLog.h>
+#include <TelemetryPipeline.h>
+#include <atomic>
+#include <memory>
 
 // Prototypes
-void getReadings();
-void getTimeStamp();
-void logSDCard();
-void writeFile(fs::FS &fs, const char *path, const char *message);
-void appendFile(fs::FS &fs, const char *path, const char *message);
+bool getReadings();
+bool acquireSample(TelemetrySample *sample);
+void logSDCard(const TelemetrySample &sample);
+void publishReading(const TelemetrySample &sample);
+void keepTime();
 
 // Define deep sleep options
 uint64_t uS_TO_S_FACTOR = 1000000; // Conversion factor for microseconds to seconds
@@ -41,37 +53,70 @@ const char *password = "HIDDEN PASSWORD";
 // Define CS pin for the SD card module
 #define SD_CS 5
 
-// Save reading number on RTC memory
-RTC_DATA_ATTR int readingID = 0;
+// Reading number, taken from the sample log's sequence so that it carries
+// on after a reset or power loss
+uint32_t readingID = 0;
 
 String dataMessage;
 
+// Samples are kept in fixed-size segments under /log on the SD card, old
+// segments are compacted in the background and dropped after a year or
+// once the log takes more than 256 MB
+SegmentedLog sampleLog(SD, "/log", "Reading ID, Date, Hour, Temperature \r\n");
+
 #define BUTTON_PIN GPIO_NUM_14 // GPIO 14
 RTC_DATA_ATTR int buttonPressed = 0;
 
 // Data wire is connected to ESP32 GPIO 21
 #define ONE_WIRE_BUS 4
-// Setup a oneWire instance to communicate with a OneWire device
-OneWire oneWire(ONE_WIRE_BUS);
+// Setup a oneWire instance to communicate with a OneWire device.
+// The bus is driven by the RMT peripheral so that 1-Wire traffic does not
+// hold the CPU with interrupts disabled while WiFi and AsyncTCP are running.
+OneWireEsp32RmtChannel oneWireChannel(ONE_WIRE_BUS);
+OneWireRmt oneWireRmt(&oneWireChannel);
+OneWire oneWire(&oneWireRmt);
 // Pass our oneWire reference to Dallas Temperature sensor
 DallasTemperature sensors(&oneWire);
-
-// Temperature Sensor variables
-float temperatureC;
+// Keeps track of probes being plugged in or removed while running
+OneWireTopology topology(&oneWire, DS18B20MODEL);
+// Only reads out probes whose alarm flag says they changed since last time
+DallasAlarmSampler sampler(&sensors);
+// Keeps fault codes and power-on glitches of the first probe out of the
+// WebSocket messages and the log
+DallasFilter temperatureFilter(5);
+
+// Temperature Sensor variables, kept in fixed point (1/128 degrees C) up
+// to the point where they are turned into text
+int32_t temperatureRaw = DEVICE_DISCONNECTED_RAW;
 
 // Define NTP Client to get time
 WiFiUDP ntpUDP;
 NTPClient timeClient(ntpUDP);
 
-// Variables to save date and time
+// The NTP client belongs to the publishing task, which keeps the epoch at
+// millis() = 0 here so that the sampling task can timestamp readings
+// without touching the client
+std::atomic<uint32_t> epochBase(0);
+
+// Variables to save date and time, used by the storage task only
 String formattedDate;
 String dayStamp;
 String timeStamp;
 
+// Sampling, storage and publishing tasks
+TelemetryPipeline pipeline;
+
 // Create AsyncWebServer object on port 80
 AsyncWebServer server(80);
 AsyncWebSocket ws("/ws");
 
+unsigned long lastExecutionTime = 0; // Initialize a variable to track the last execution time
+unsigned long lastSampleTime = 0; // When the probes were last sampled
+const unsigned long delayInterval = 30000; // ½ minute in milliseconds: a log record at least this often
+const unsigned long sampleInterval = 5000; // alarm-gated sample of the bus every 5 s
+
+const unsigned long topologyInterval = 1000; // one guided search pass per second
+
 /**
  * @brief WebSocket event handler.
  *
@@ -101,6 +146,27 @@ void onEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType
   }
 }
 
+/**
+ * @brief Bus topology event handler.
+ *
+ * Called by the topology tracker when a probe appears on or disappears from
+ * the 1-Wire bus, keeps the sensor count up to date without a full re-scan.
+ *
+ * @param rom ROM code of the probe.
+ * @param added True if the probe was added, false if it was removed.
+ */
+void onTopologyChange(const uint8_t *rom, bool added) {
+  Serial.printf("Probe %02X%02X%02X%02X%02X%02X%02X%02X %s\n", rom[0], rom[1], rom[2], rom[3],
+                rom[4], rom[5], rom[6], rom[7], added ? "added" : "removed");
+  if (added) {
+    sensors.deviceAdded(rom);
+    sampler.addProbe(rom);
+  } else {
+    sensors.deviceRemoved(rom);
+    sampler.removeProbe(rom);
+  }
+}
+
 /**
  * @brief Initialize WebSocket.
  *
@@ -143,6 +209,11 @@ void setup() {
   timeClient.begin();
   // Set offset time in seconds to adjust for your timezone
   timeClient.setTimeOffset(7200);
+  // The first reading already needs the time
+  while (!timeClient.update()) {
+    timeClient.forceUpdate();
+  }
+  keepTime();
 
   // Initialize SD card
   SD.begin(SD_CS);
@@ -161,22 +232,33 @@ void setup() {
     return; // init failed
   }
 
-  // If the data.txt file doesn't exist, create it and write data labels
-  File file = SD.open("/data.txt");
-  if (!file) {
-    Serial.println("File doesn't exist");
-    Serial.println("Creating file...");
-    writeFile(SD, "/data.txt", "Reading ID, Date, Hour, Temperature \r\n");
-  } else {
-    Serial.println("File already exists");
+  // Open the sample log, an existing data.txt becomes its first segment
+  sampleLog.setSegmentSize(64 * 1024);
+  sampleLog.setRetention(365UL * 24 * 3600, 256UL * 1024 * 1024);
+  if (!sampleLog.begin("/data.txt")) {
+    Serial.println("Failed to open the sample log");
   }
-  file.close();
+  sampleLog.startCompactor();
 
   // Enable Timer wake_up
   esp_sleep_enable_timer_wakeup(TIME_TO_SLEEP * uS_TO_S_FACTOR);
 
-  // Start the DallasTemperature library
+  // Start the DallasTemperature library, falling back to bit-banging the
+  // bus if the RMT channels cannot be claimed
+  if (!oneWireChannel.begin()) {
+    Serial.println("RMT unavailable, bit-banging the 1-Wire bus");
+    oneWire.begin(ONE_WIRE_BUS);
+  }
   sensors.begin();
+  topology.begin();
+  for (uint8_t i = 0; i < topology.count(); i++) {
+    sampler.addProbe(topology.address(i));
+  }
+  topology.setHandler(onTopologyChange);
+  // Read every probe once per logging period anyway, so that drift within
+  // the alarm band still reaches the log and the dashboard
+  sampler.setRefreshInterval(delayInterval / sampleInterval);
+  temperatureFilter.setHampel(3);
 
   initWebSocket();
 
@@ -185,19 +267,31 @@ void setup() {
     request->send(SPIFFS, "/index.html");
   });
 
+  // All segments back to back as one CSV file, ?from= and ?to= (epoch
+  // seconds, local time like the log) leave out samples outside of them
   server.on("/downloadCSV", HTTP_GET, [](AsyncWebServerRequest *request) {
-    File file = SD.open("/data.txt");
-    if (!file) {
-      request->send(404, "text/plain", "CSV file not found");
-    } else {
-      request->send(SD, "/data.txt", "text/csv", false);
-      file.close();
+    uint32_t from = 0;
+    uint32_t to = 0xFFFFFFFF;
+    if (request->hasParam("from")) {
+      from = strtoul(request->getParam("from")->value().c_str(), NULL, 10);
+    }
+    if (request->hasParam("to")) {
+      to = strtoul(request->getParam("to")->value().c_str(), NULL, 10);
     }
+    std::shared_ptr<SegmentedLogReader> reader(new SegmentedLogReader(&sampleLog, from, to));
+    request->sendChunkedGzip("text/csv", [reader](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+      return reader->read(buffer, maxLen);
+    });
   });
 
   server.on("/clearCSV", HTTP_GET, [](AsyncWebServerRequest *request) {
-    if (SD.remove("/data.txt")) {
+    if (sampleLog.clear()) {
       request->send(200, "text/plain", "CSV file cleared successfully");
+    } else if (sampleLog.busy()) {
+      // a CSV download keeps the segments it reads until it is done
+      AsyncWebServerResponse *response = request->beginResponse(503, "text/plain", "CSV file is being downloaded, try again when that is done");
+      response->addHeader("Retry-After", "10");
+      request->send(response);
     } else {
       request->send(500, "text/plain", "Failed to clear CSV file");
     }
@@ -205,17 +299,32 @@ void setup() {
 
   Serial.println(WiFi.localIP());
 
+  // Keep the web server from starving the logger: a burst of dashboard tabs
+  // gets 503s instead of fragmenting the heap, /ws keeps a share of its own
+  server.setMemoryBudget(48 * 1024, 12 * 1024);
+  server.setHeapFloor(16 * 1024);
+
   // Start server
   server.begin();
 
+  // Run once per topology interval (the bus is sampled every
+  // sampleInterval), keep NTP in sync whenever no reading went out for 10 s
+  TelemetryTaskConfig acquireConfig = pipeline.config(TELEMETRY_ACQUIRE);
+  acquireConfig.period = topologyInterval;
+  pipeline.configure(TELEMETRY_ACQUIRE, acquireConfig);
+  pipeline.onAcquire(acquireSample);
+  pipeline.onStore(logSDCard);
+  pipeline.onPublish(publishReading);
+  pipeline.onIdle(TELEMETRY_PUBLISH, keepTime);
+  if (!pipeline.begin()) {
+    Serial.println("Failed to start the telemetry tasks");
+  }
+
   // Store the current time as the start time
   startTime = millis();
   Serial.println("DONE! Going to sleep in 5 minutes.");
 }
 
-unsigned long lastExecutionTime = 0; // Initialize a variable to track the last execution time
-const unsigned long delayInterval = 30000; // ½ minute in milliseconds
-
 /**
  * @brief Button ISR (Interrupt Service Routine).
  *
@@ -238,11 +347,9 @@ void setupButtonInterrupt() {
 /**
  * @brief Arduino loop function.
  *
- * Monitors button press, logs temperature data, and manages deep sleep.
+ * Monitors button press and manages deep sleep.
  */
 void loop() {
-  unsigned long currentTime = millis();
-
   if (buttonPressed) {
     // You can perform some action when the button is pressed here
     // For example, send a signal or perform a specific task
@@ -253,124 +360,132 @@ void loop() {
   // Check if it's time to go to sleep
   if (millis() - startTime >= sleepDelay) {
     Serial.println("Going to sleep now.");
+    // Let the storage task finish the readings it still has
+    pipeline.end();
     esp_deep_sleep_start();
   }
 
-  // If it's not time to sleep, periodically read and log data
-  if (currentTime - lastExecutionTime >= delayInterval) {
-    lastExecutionTime = currentTime; // Update the last execution time
-    getReadings();
-    getTimeStamp();
-    logSDCard();
-    // Increment readingID on every new reading
-    readingID++;
-  }
+  delay(100);
 }
 
-float lastTemperatureSent = 0.0;
-
 /**
- * @brief Get temperature readings from DS18B20 sensor.
+ * @brief Acquisition stage, called by the sampling task once per topology interval.
+ *
+ * Checks one branch of the bus for added or removed probes and, every
+ * sampleInterval, samples the bus. A reading goes out when the filtered
+ * temperature changed, and every delayInterval in any case, so that the log
+ * keeps a record per period.
  *
- * Reads temperature data from the DS18B20 sensor and sends it to connected WebSocket clients.
+ * @param sample Filled in with the reading.
+ * @return True if there is a reading to log and publish.
  */
-void getReadings() {
-  sensors.requestTemperatures();
-  temperatureC = sensors.getTempCByIndex(0);
-
-  if (temperatureC != lastTemperatureSent) {
-    Serial.print("Temperature: ");
-    Serial.println(temperatureC);
-    lastTemperatureSent = temperatureC;
-
-    // Send temperature data to all connected WebSocket clients
-    String temperatureString = String(temperatureC);
-    ws.textAll(temperatureString);
+bool acquireSample(TelemetrySample *sample) {
+  unsigned long currentTime = millis();
+
+  // Check one branch of the bus for added or removed probes
+  topology.poll();
+
+  if (currentTime - lastSampleTime < sampleInterval) {
+    return false;
   }
+  lastSampleTime = currentTime;
+  // Log when a probe has moved, and once per period when none did
+  if (!getReadings() && currentTime - lastExecutionTime < delayInterval) {
+    return false;
+  }
+  lastExecutionTime = currentTime; // Update the last execution time
+  sample->time = epochBase + currentTime / 1000;
+  sample->raw = temperatureRaw;
+  sample->probe = 0;
+  return true;
 }
 
 /**
- * @brief Get date and time from NTP server.
+ * @brief Get temperature readings from DS18B20 sensor.
+ *
+ * Runs one conversion on the bus and reads out only the probes whose alarm
+ * band was left, then passes the first probe's value through the de-glitch
+ * filter.
  *
- * Retrieves date and time information from the NTP server and formats it for logging.
+ * @return True if the filtered temperature changed since the last reading.
  */
-void getTimeStamp() {
-  while (!timeClient.update()) {
-    timeClient.forceUpdate();
+bool getReadings() {
+  sampler.sample();
+  // The filter sees every cycle, with the last value read while the probe
+  // stays within its band: fed only the exceptions, a Hampel window would
+  // hold nothing but the jumps and keep rejecting a real step.
+  int32_t raw = temperatureFilter.add(sampler.getTemp(0));
+  if (raw == temperatureRaw) {
+    return false;
   }
-  // The formattedDate comes with the following format: "2018-05-28T16:00:13Z"
-  // We need to extract date and time
-  formattedDate = timeClient.getFormattedDate();
-  Serial.println(formattedDate);
-
-  // Extract date
-  int splitT = formattedDate.indexOf("T");
-  dayStamp = formattedDate.substring(0, splitT);
-  Serial.println(dayStamp);
-  // Extract time
-  timeStamp = formattedDate.substring(splitT + 1, formattedDate.length() - 1);
-  Serial.println(timeStamp);
+  temperatureRaw = raw;
+  return true;
 }
 
 /**
- * @brief Log sensor data to SD card.
+ * @brief Publishing stage, called by the network task for every reading.
  *
- * Formats sensor data and logs it to the SD card.
+ * Sends the temperature to all connected WebSocket clients.
+ *
+ * @param sample The reading.
  */
-void logSDCard() {
-  dataMessage = String(readingID) + "," + String(dayStamp) + "," + String(timeStamp) + "," +
-                String(temperatureC) + "\r\n";
-  Serial.print("Save data: ");
-  Serial.println(dataMessage);
-  appendFile(SD, "/data.txt", dataMessage.c_str());
+void publishReading(const TelemetrySample &sample) {
+  char temperatureText[12];
+
+  DallasTemperature::formatCelsius(sample.raw, temperatureText);
+  Serial.print("Temperature: ");
+  Serial.println(temperatureText);
+
+  // Send temperature data to all connected WebSocket clients; textAll()
+  // holds the lock that the AsyncTCP task takes for the clients, so it
+  // may be called from this task
+  ws.textAll(temperatureText);
 }
 
 /**
- * @brief Write to the SD card.
- *
- * Writes data to the specified file on the SD card.
+ * @brief Keep the clock in sync, called by the network task when it is idle.
  *
- * @param fs The file system to use (e.g., SD or SPIFFS).
- * @param path The path to the file.
- * @param message The data to write.
+ * Asks the NTP server for the time once its update interval is over and
+ * passes the result on to the sampling task.
  */
-void writeFile(fs::FS &fs, const char *path, const char *message) {
-  Serial.printf("Writing file: %s\n", path);
-
-  File file = fs.open(path, FILE_WRITE);
-  if (!file) {
-    Serial.println("Failed to open file for writing");
-    return;
-  }
-  if (file.print(message)) {
-    Serial.println("File written");
-  } else {
-    Serial.println("Write failed");
+void keepTime() {
+  if (timeClient.update()) {
+    epochBase = timeClient.getEpochTime() - millis() / 1000;
   }
-  file.close();
 }
 
 /**
- * @brief Append data to the SD card.
+ * @brief Storage stage, called by the storage task for every reading.
  *
- * Appends data to the specified file on the SD card.
+ * Formats the reading with its date and time and appends it to the sample
+ * log on the SD card.
  *
- * @param fs The file system to use (e.g., SD or SPIFFS).
- * @param path The path to the file.
- * @param message The data to append.
+ * @param sample The reading.
  */
-void appendFile(fs::FS &fs, const char *path, const char *message) {
-  Serial.printf("Appending to file: %s\n", path);
+void logSDCard(const TelemetrySample &sample) {
+  char temperatureText[12];
 
-  File file = fs.open(path, FILE_APPEND);
-  if (!file) {
-    Serial.println("Failed to open file for appending");
-    return;
-  }
-  if (file.print(message)) {
-    Serial.println("Message appended");
-  } else {
+  DallasTemperature::formatCelsius(sample.raw, temperatureText);
+
+  // The formattedDate comes with the following format: "2018-05-28T16:00:13Z"
+  // We need to extract date and time
+  formattedDate = timeClient.getFormattedDate(sample.time);
+  Serial.println(formattedDate);
+
+  // Extract date
+  int splitT = formattedDate.indexOf("T");
+  dayStamp = formattedDate.substring(0, splitT);
+  Serial.println(dayStamp);
+  // Extract time
+  timeStamp = formattedDate.substring(splitT + 1, formattedDate.length() - 1);
+  Serial.println(timeStamp);
+
+  readingID = sampleLog.sequence();
+  dataMessage = String(readingID) + "," + String(dayStamp) + "," + String(timeStamp) + "," +
+                temperatureText + "\r\n";
+  Serial.print("Save data: ");
+  Serial.println(dataMessage);
+  if (!sampleLog.append(dataMessage.c_str(), sample.time)) {
     Serial.println("Append failed");
   }
-  file.close();
-}
\ No newline at end of file
+}
@@ -0,0 +1,251 @@
+// DallasAlarmSampler against the simulated bus: TH/TL re-arming around
+// the last value, exception detection through the alarm search, refresh
+// and probes that drop off.
+//
+// test_benchmark prints the bus time of a sample of 30 probes on
+// OneWireSim's clock, steady and with one exception, against reading every
+// scratchpad after the same conversion.
+
+#include <Arduino.h>
+#include <OneWire.h>
+#include <DallasTemperature.h>
+#include <DallasAlarmSampler.h>
+#include <OneWireSim.h>
+#include <DS18B20Sim.h>
+#include <unity.h>
+
+#define BUS_PIN     4
+#define PROBES      6
+
+static OneWireSimBus *bus;
+static DS18B20Sim *probes[PROBES];
+static OneWire *wire;
+static DallasTemperature *sensors;
+static DallasAlarmSampler *sampler;
+
+static uint8_t handled[PROBES];
+
+static void onSample(uint8_t index, const uint8_t *deviceAddress, int32_t raw)
+{
+	(void)deviceAddress;
+	(void)raw;
+	handled[index]++;
+}
+
+void setUp(void)
+{
+	OneWireSimClock::reset();
+	bus = new OneWireSimBus(BUS_PIN);
+	wire = new OneWire(BUS_PIN);
+	sensors = new DallasTemperature(wire);
+	sampler = new DallasAlarmSampler(sensors);
+	for (uint8_t i = 0; i < PROBES; i++) {
+		uint8_t rom[8];
+
+		OneWireSimDevice::makeRom(0x28, 0x77000 + i, rom);
+		probes[i] = new DS18B20Sim(rom);
+		probes[i]->setTemperature(20.25f + i);
+		bus->attach(probes[i]);
+		handled[i] = 0;
+	}
+	sensors->begin();
+	for (uint8_t i = 0; i < PROBES; i++) sampler->addProbe(probes[i]->rom());
+	sampler->setSampleHandler(onSample);
+}
+
+void tearDown(void)
+{
+	delete sampler;
+	delete sensors;
+	delete wire;
+	for (uint8_t i = 0; i < PROBES; i++) delete probes[i];
+	delete bus;
+}
+
+// whole degrees programmed into a probe's scratchpad
+static int8_t th(uint8_t i) { return (int8_t)probes[i]->scratchpad()[2]; }
+static int8_t tl(uint8_t i) { return (int8_t)probes[i]->scratchpad()[3]; }
+
+void test_first_sample_reads_and_arms_every_probe(void)
+{
+	TEST_ASSERT_EQUAL(PROBES, sampler->sample());
+	for (uint8_t i = 0; i < PROBES; i++) {
+		TEST_ASSERT_TRUE(sampler->changed(i));
+		TEST_ASSERT_EQUAL(1, handled[i]);
+		TEST_ASSERT_FLOAT_WITHIN(0.0625f, 20.25f + i, sampler->getTempC(i));
+		// band 0: TH/TL one degree either side of the whole degrees
+		TEST_ASSERT_EQUAL(20 + i + 1, th(i));
+		TEST_ASSERT_EQUAL(20 + i - 1, tl(i));
+	}
+}
+
+void test_steady_bus_reads_nothing(void)
+{
+	sampler->sample();
+	uint32_t reads = probes[0]->scratchpadReads();
+
+	for (uint8_t n = 0; n < 5; n++) {
+		// moves within the whole degree do not alarm
+		probes[0]->setTemperature(20.25f + 0.125f * n);
+		TEST_ASSERT_EQUAL(0, sampler->sample());
+		for (uint8_t i = 0; i < PROBES; i++) TEST_ASSERT_FALSE(sampler->changed(i));
+	}
+	TEST_ASSERT_EQUAL(reads, probes[0]->scratchpadReads());
+	TEST_ASSERT_FLOAT_WITHIN(0.0625f, 20.25f, sampler->getTempC(0));
+}
+
+void test_exception_reads_only_that_probe_and_rearms_it(void)
+{
+	sampler->sample();
+
+	// up one whole degree
+	probes[2]->setTemperature(23.5f);
+	TEST_ASSERT_EQUAL(1, sampler->sample());
+	TEST_ASSERT_TRUE(sampler->changed(2));
+	TEST_ASSERT_FALSE(sampler->changed(1));
+	TEST_ASSERT_FLOAT_WITHIN(0.0625f, 23.5f, sampler->getTempC(2));
+	TEST_ASSERT_EQUAL(24, th(2));
+	TEST_ASSERT_EQUAL(22, tl(2));
+
+	// re-armed: quiet at the new value
+	TEST_ASSERT_EQUAL(0, sampler->sample());
+
+	// and down, below zero, where whole degrees round towards minus infinity
+	probes[2]->setTemperature(-0.5f);
+	probes[4]->setTemperature(10.0f);
+	TEST_ASSERT_EQUAL(2, sampler->sample());
+	TEST_ASSERT_FLOAT_WITHIN(0.0625f, -0.5f, sampler->getTempC(2));
+	TEST_ASSERT_EQUAL(0, th(2));
+	TEST_ASSERT_EQUAL(-2, tl(2));
+	TEST_ASSERT_EQUAL(0, sampler->sample());
+	TEST_ASSERT_EQUAL(3, handled[2]);
+}
+
+void test_band_adds_hysteresis(void)
+{
+	sampler->setBand(2);
+	sampler->sample();
+	TEST_ASSERT_EQUAL(23, th(0));
+	TEST_ASSERT_EQUAL(17, tl(0));
+
+	probes[0]->setTemperature(22.9f);
+	probes[1]->setTemperature(19.0f);
+	TEST_ASSERT_EQUAL(0, sampler->sample());
+
+	probes[0]->setTemperature(23.0f);
+	TEST_ASSERT_EQUAL(1, sampler->sample());
+	TEST_ASSERT_TRUE(sampler->changed(0));
+}
+
+void test_rearming_does_not_touch_eeprom(void)
+{
+	sampler->sample();
+	for (uint8_t n = 0; n < 10; n++) {
+		probes[3]->setTemperature(n & 1 ? 30.0f : 20.0f);
+		TEST_ASSERT_EQUAL(1, sampler->sample());
+	}
+	for (uint8_t i = 0; i < PROBES; i++) TEST_ASSERT_EQUAL(0, probes[i]->eepromWrites());
+	// the factory alarm values are still in EEPROM
+	TEST_ASSERT_EQUAL_HEX8(0x4B, probes[3]->eeprom()[0]);
+}
+
+void test_refresh_reads_every_probe(void)
+{
+	sampler->setRefreshInterval(3);
+	sampler->sample();
+	TEST_ASSERT_EQUAL(0, sampler->sample());
+	TEST_ASSERT_EQUAL(PROBES, sampler->sample());
+	TEST_ASSERT_EQUAL(0, sampler->sample());
+}
+
+void test_probe_that_drops_off_is_retried(void)
+{
+	sampler->sample();
+	bus->detach(probes[5]);
+	probes[5]->setTemperature(40.0f);
+
+	// an absent probe does not take part in the alarm search ...
+	TEST_ASSERT_EQUAL(0, sampler->sample());
+
+	// ... but a refresh finds it gone and keeps retrying it
+	sampler->setRefreshInterval(1);
+	TEST_ASSERT_EQUAL(PROBES, sampler->sample());
+	TEST_ASSERT_EQUAL_INT32(DEVICE_DISCONNECTED_RAW, sampler->getTemp(5));
+	sampler->setRefreshInterval(0);
+	TEST_ASSERT_EQUAL(1, sampler->sample());
+
+	bus->attach(probes[5]);
+	TEST_ASSERT_EQUAL(1, sampler->sample());
+	TEST_ASSERT_FLOAT_WITHIN(0.0625f, 40.0f, sampler->getTempC(5));
+	TEST_ASSERT_EQUAL(0, sampler->sample());
+}
+
+void test_benchmark(void)
+{
+	const uint8_t extra = 24;
+	DS18B20Sim *more[extra];
+	uint64_t start;
+
+	for (uint8_t i = 0; i < extra; i++) {
+		uint8_t rom[8];
+
+		OneWireSimDevice::makeRom(0x28, 0x78000 + i * 3, rom);
+		more[i] = new DS18B20Sim(rom);
+		more[i]->setTemperature(18.5f + i / 4.0f);
+		bus->attach(more[i]);
+	}
+	sensors->begin();
+	sampler->setSampleHandler(nullptr);
+	for (uint8_t i = 0; i < extra; i++) sampler->addProbe(more[i]->rom());
+	TEST_ASSERT_EQUAL(PROBES + extra, sampler->getProbeCount());
+	TEST_ASSERT_EQUAL(PROBES + extra, sampler->sample());
+
+	// the conversion alone, which every way of sampling pays
+	start = OneWireSimClock::now();
+	sensors->requestTemperatures();
+	uint64_t convert = OneWireSimClock::now() - start;
+
+	// a steady bus
+	start = OneWireSimClock::now();
+	TEST_ASSERT_EQUAL(0, sampler->sample());
+	uint64_t steady = OneWireSimClock::now() - start - convert;
+
+	// one probe left its band
+	more[10]->setTemperature(25.0f);
+	start = OneWireSimClock::now();
+	TEST_ASSERT_EQUAL(1, sampler->sample());
+	uint64_t exception = OneWireSimClock::now() - start - convert;
+
+	// every scratchpad read after a conversion, as without the sampler
+	start = OneWireSimClock::now();
+	sensors->requestTemperatures();
+	for (uint8_t i = 0; i < PROBES + extra; i++) TEST_ASSERT_TRUE(sensors->getTemp(sampler->getAddress(i)) != DEVICE_DISCONNECTED_RAW);
+	uint64_t readAll = OneWireSimClock::now() - start - convert;
+
+	printf("30 probes, bus time after the %.0f ms conversion: steady %.1f ms, one exception %.1f ms, "
+		"every scratchpad %.1f ms\n", convert / 1000.0, steady / 1000.0, exception / 1000.0, readAll / 1000.0);
+	TEST_ASSERT_TRUE(steady * 20 < readAll);
+	TEST_ASSERT_TRUE(exception * 5 < readAll);
+
+	for (uint8_t i = 0; i < extra; i++) {
+		sampler->removeProbe(more[i]->rom());
+		bus->detach(more[i]);
+		delete more[i];
+	}
+}
+
+int main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+	UNITY_BEGIN();
+	RUN_TEST(test_first_sample_reads_and_arms_every_probe);
+	RUN_TEST(test_steady_bus_reads_nothing);
+	RUN_TEST(test_exception_reads_only_that_probe_and_rearms_it);
+	RUN_TEST(test_band_adds_hysteresis);
+	RUN_TEST(test_rearming_does_not_touch_eeprom);
+	RUN_TEST(test_refresh_reads_every_probe);
+	RUN_TEST(test_probe_that_drops_off_is_retried);
+	RUN_TEST(test_benchmark);
+	return UNITY_END();
+}
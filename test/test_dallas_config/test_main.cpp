@@ -0,0 +1,225 @@
+// DallasTemperature's config shadow against the simulated bus: a shadow
+// hit skips the scratchpad read but not the presence check, and a probe
+// that stops answering loses its shadow.
+//
+// Config batches: several settings on several probes cost one EEPROM copy
+// per probe, made by commitConfigBatch() and none before; without a batch
+// autoSaveScratchPad copies every setting.  With more probes written in a
+// batch than the shadow holds, the ones past it are copied right away,
+// and nothing a read does, isConnected() of a probe without a shadow
+// included, copies another probe's scratchpad.
+
+#include <Arduino.h>
+#include <OneWire.h>
+#include <DallasTemperature.h>
+#include <OneWireSim.h>
+#include <DS18B20Sim.h>
+#include <unity.h>
+
+#define BUS_PIN     4
+
+static OneWireSimBus *bus;
+static DS18B20Sim *probe;
+static OneWire *wire;
+static DallasTemperature *sensors;
+
+void setUp(void)
+{
+	uint8_t rom[8];
+
+	OneWireSimClock::reset();
+	bus = new OneWireSimBus(BUS_PIN);
+	OneWireSimDevice::makeRom(0x28, 0x31000, rom);
+	probe = new DS18B20Sim(rom);
+	bus->attach(probe);
+	wire = new OneWire(BUS_PIN);
+	sensors = new DallasTemperature(wire);
+	sensors->begin();
+	sensors->setAutoSaveScratchPad(false);
+}
+
+void tearDown(void)
+{
+	delete sensors;
+	delete wire;
+	delete probe;
+	delete bus;
+}
+
+void test_shadow_hit_skips_the_scratchpad_read(void)
+{
+	TEST_ASSERT_TRUE(sensors->setResolution(probe->rom(), 10, true));
+	TEST_ASSERT_EQUAL(10, probe->resolution());
+
+	uint32_t reads = probe->scratchpadReads();
+	TEST_ASSERT_TRUE(sensors->setResolution(probe->rom(), 11, true));
+	TEST_ASSERT_TRUE(sensors->setResolution(probe->rom(), 11, true));
+	TEST_ASSERT_EQUAL(11, probe->resolution());
+	TEST_ASSERT_EQUAL_UINT32(reads, probe->scratchpadReads());
+}
+
+void test_shadow_hit_on_an_empty_bus_fails(void)
+{
+	TEST_ASSERT_TRUE(sensors->setResolution(probe->rom(), 10, true));
+
+	// nothing answers the reset, so the shadow is not trusted
+	bus->detach(probe);
+	TEST_ASSERT_FALSE(sensors->setResolution(probe->rom(), 9, true));
+	TEST_ASSERT_FALSE(sensors->setAlarmTemps(probe->rom(), 10, 30));
+}
+
+void test_failed_read_drops_the_shadow(void)
+{
+	TEST_ASSERT_TRUE(sensors->setResolution(probe->rom(), 9, true));
+	bus->detach(probe);
+	TEST_ASSERT_EQUAL_INT32(DEVICE_DISCONNECTED_RAW, sensors->getTemp(probe->rom()));
+
+	// power cycled: back at its EEPROM resolution
+	uint8_t rom[8];
+	memcpy(rom, probe->rom(), 8);
+	delete probe;
+	probe = new DS18B20Sim(rom);
+	bus->attach(probe);
+	TEST_ASSERT_EQUAL(12, probe->resolution());
+
+	TEST_ASSERT_TRUE(sensors->setResolution(probe->rom(), 9, true));
+	TEST_ASSERT_EQUAL(9, probe->resolution());
+}
+
+#define MANY (CONFIGCACHESIZE + 2)
+
+static DS18B20Sim *many[MANY];
+
+static void attachMany(uint8_t n)
+{
+	for (uint8_t i = 0; i < n; i++) {
+		uint8_t rom[8];
+
+		OneWireSimDevice::makeRom(0x28, 0x32000 + i * 7, rom);
+		many[i] = new DS18B20Sim(rom);
+		TEST_ASSERT_TRUE(bus->attach(many[i]));
+	}
+	sensors->begin();
+	sensors->setAutoSaveScratchPad(true);
+}
+
+static void detachMany(uint8_t n)
+{
+	for (uint8_t i = 0; i < n; i++) {
+		bus->detach(many[i]);
+		delete many[i];
+	}
+}
+
+static uint32_t copies(uint8_t n)
+{
+	uint32_t total = 0;
+
+	for (uint8_t i = 0; i < n; i++) total += many[i]->eepromWrites();
+	return total;
+}
+
+// three settings on a probe
+static void configure(uint8_t i)
+{
+	TEST_ASSERT_TRUE(sensors->setResolution(many[i]->rom(), 10, true));
+	sensors->setHighAlarmTemp(many[i]->rom(), 40 + i % 10);
+	sensors->setLowAlarmTemp(many[i]->rom(), -5 - i % 10);
+}
+
+void test_autosave_copies_every_setting(void)
+{
+	attachMany(4);
+	for (uint8_t i = 0; i < 4; i++) configure(i);
+	for (uint8_t i = 0; i < 4; i++) TEST_ASSERT_EQUAL_UINT32(3, many[i]->eepromWrites());
+	detachMany(4);
+}
+
+void test_batch_copies_once_per_probe(void)
+{
+	attachMany(8);
+	sensors->beginConfigBatch();
+	for (uint8_t i = 0; i < 8; i++) configure(i);
+	TEST_ASSERT_EQUAL_UINT32(0, copies(8));
+	// the scratchpads already hold the settings
+	for (uint8_t i = 0; i < 8; i++) TEST_ASSERT_EQUAL(10, many[i]->resolution());
+
+	TEST_ASSERT_EQUAL(8, sensors->commitConfigBatch());
+	for (uint8_t i = 0; i < 8; i++) {
+		TEST_ASSERT_EQUAL_UINT32(1, many[i]->eepromWrites());
+		TEST_ASSERT_EQUAL_INT8(40 + i % 10, (int8_t)many[i]->eeprom()[0]);
+		TEST_ASSERT_EQUAL_INT8(-5 - i % 10, (int8_t)many[i]->eeprom()[1]);
+		TEST_ASSERT_EQUAL_HEX8(0x3F, many[i]->eeprom()[2]);   // 10 bit
+	}
+
+	// nothing left to copy, and unchanged settings cost nothing
+	TEST_ASSERT_EQUAL(0, sensors->commitConfigBatch());
+	sensors->beginConfigBatch();
+	for (uint8_t i = 0; i < 8; i++) configure(i);
+	TEST_ASSERT_EQUAL(0, sensors->commitConfigBatch());
+	TEST_ASSERT_EQUAL_UINT32(8, copies(8));
+	detachMany(8);
+}
+
+void test_batch_larger_than_the_shadow(void)
+{
+	attachMany(MANY);
+	sensors->beginConfigBatch();
+	for (uint8_t i = 0; i < CONFIGCACHESIZE; i++) configure(i);
+	TEST_ASSERT_EQUAL_UINT32(0, copies(MANY));
+
+	// reads of probes the full shadow has no room for copy nothing
+	for (uint8_t i = CONFIGCACHESIZE; i < MANY; i++) {
+		TEST_ASSERT_TRUE(sensors->isConnected(many[i]->rom()));
+		TEST_ASSERT_EQUAL(12, sensors->getResolution(many[i]->rom()));
+	}
+	TEST_ASSERT_EQUAL_UINT32(0, copies(MANY));
+
+	// settings on them are copied as they are written, once per setting
+	for (uint8_t i = CONFIGCACHESIZE; i < MANY; i++) {
+		configure(i);
+		TEST_ASSERT_EQUAL_UINT32(3, many[i]->eepromWrites());
+	}
+	TEST_ASSERT_EQUAL_UINT32(3 * (MANY - CONFIGCACHESIZE), copies(MANY));
+
+	// and the batch itself still costs one copy per probe
+	TEST_ASSERT_EQUAL(CONFIGCACHESIZE, sensors->commitConfigBatch());
+	for (uint8_t i = 0; i < CONFIGCACHESIZE; i++) {
+		TEST_ASSERT_EQUAL_UINT32(1, many[i]->eepromWrites());
+		TEST_ASSERT_EQUAL_HEX8(0x3F, many[i]->eeprom()[2]);   // 10 bit
+	}
+	detachMany(MANY);
+}
+
+void test_shadow_holds_a_whole_bus(void)
+{
+	// a bus of 30 and more probes: a second round of settings reads no
+	// scratchpad
+	const uint8_t n = 40;
+
+	TEST_ASSERT_TRUE(CONFIGCACHESIZE >= n);
+	attachMany(n);
+	sensors->setAutoSaveScratchPad(false);
+	for (uint8_t i = 0; i < n; i++) TEST_ASSERT_TRUE(sensors->setResolution(many[i]->rom(), 11, true));
+	uint32_t reads = 0;
+	for (uint8_t i = 0; i < n; i++) reads += many[i]->scratchpadReads();
+	for (uint8_t i = 0; i < n; i++) TEST_ASSERT_TRUE(sensors->setResolution(many[i]->rom(), 9, true));
+	for (uint8_t i = 0; i < n; i++) reads -= many[i]->scratchpadReads();
+	TEST_ASSERT_EQUAL_UINT32(0, reads);
+	detachMany(n);
+}
+
+int main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+	UNITY_BEGIN();
+	RUN_TEST(test_shadow_hit_skips_the_scratchpad_read);
+	RUN_TEST(test_shadow_hit_on_an_empty_bus_fails);
+	RUN_TEST(test_failed_read_drops_the_shadow);
+	RUN_TEST(test_autosave_copies_every_setting);
+	RUN_TEST(test_batch_copies_once_per_probe);
+	RUN_TEST(test_batch_larger_than_the_shadow);
+	RUN_TEST(test_shadow_holds_a_whole_bus);
+	return UNITY_END();
+}
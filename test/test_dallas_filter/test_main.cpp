@@ -0,0 +1,102 @@
+// DallasFilter fed once per acquisition cycle with the last value of an
+// exception sampler, as main.cpp does: a real step gets through, a one
+// cycle spike does not, and faults are passed on after the fault limit.
+
+#include <Arduino.h>
+#include <DallasTemperature.h>
+#include <DallasFilter.h>
+#include <OneWireSim.h>   // OneWire's host pin layer, unused here
+#include <unity.h>
+
+#define C(x) ((int32_t)((x) * 128))
+
+static DallasFilter *filter;
+
+void setUp(void)
+{
+	filter = new DallasFilter(5);
+	filter->setHampel(3);
+}
+
+void tearDown(void)
+{
+	delete filter;
+}
+
+// cycles until the output reaches 'raw', 0 if it does not within 'limit'
+static uint8_t cyclesUntil(int32_t raw, uint8_t limit)
+{
+	for (uint8_t n = 1; n <= limit; n++) {
+		if (filter->add(raw) == raw) return n;
+	}
+	return 0;
+}
+
+void test_step_gets_through(void)
+{
+	for (uint8_t n = 0; n < 10; n++) filter->add(C(20.5));
+	TEST_ASSERT_EQUAL_INT32(C(20.5), filter->get());
+
+	// the sampler reads the probe once, then repeats its value every cycle
+	uint8_t cycles = cyclesUntil(C(25.0), 20);
+	TEST_ASSERT_NOT_EQUAL(0, cycles);
+	// outliers until the new value is the median of the window
+	TEST_ASSERT_EQUAL(3, cycles);
+	TEST_ASSERT_EQUAL_INT32(C(25.0), filter->get());
+
+	// and back down
+	TEST_ASSERT_EQUAL(3, cyclesUntil(C(20.5), 20));
+}
+
+void test_single_cycle_spike_is_rejected(void)
+{
+	for (uint8_t n = 0; n < 10; n++) filter->add(C(20.5));
+
+	TEST_ASSERT_EQUAL_INT32(C(20.5), filter->add(C(30.5)));
+	for (uint8_t n = 0; n < 10; n++) TEST_ASSERT_EQUAL_INT32(C(20.5), filter->add(C(20.5)));
+	TEST_ASSERT_EQUAL_UINT32(1, filter->getRejectCount());
+}
+
+void test_noise_passes_unchanged(void)
+{
+	static const float trace[] = { 20.5, 20.5625, 20.5, 20.4375, 20.5, 20.5625, 20.625, 20.5625 };
+
+	for (uint8_t n = 0; n < 5; n++) filter->add(C(20.5));
+	for (uint8_t n = 0; n < sizeof trace / sizeof trace[0]; n++)
+		TEST_ASSERT_EQUAL_INT32(C(trace[n]), filter->add(C(trace[n])));
+	TEST_ASSERT_EQUAL_UINT32(0, filter->getRejectCount());
+}
+
+void test_fault_is_passed_on_after_the_limit(void)
+{
+	for (uint8_t n = 0; n < 10; n++) filter->add(C(20.5));
+
+	// a failed read stays in the sampler until the probe answers again
+	TEST_ASSERT_EQUAL_INT32(C(20.5), filter->add(DEVICE_DISCONNECTED_RAW));
+	TEST_ASSERT_EQUAL_INT32(C(20.5), filter->add(DEVICE_DISCONNECTED_RAW));
+	TEST_ASSERT_EQUAL_INT32(DEVICE_DISCONNECTED_RAW, filter->add(DEVICE_DISCONNECTED_RAW));
+
+	// back: the window still holds the value from before the fault
+	TEST_ASSERT_EQUAL_INT32(C(20.5), filter->add(C(20.5)));
+}
+
+void test_power_on_value_is_held_back(void)
+{
+	for (uint8_t n = 0; n < 10; n++) filter->add(C(20.5));
+
+	TEST_ASSERT_EQUAL_INT32(C(20.5), filter->add(DALLAS_FILTER_POWERON_RAW));
+	TEST_ASSERT_EQUAL_INT32(C(20.5), filter->add(C(20.5)));
+}
+
+int main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+	UNITY_BEGIN();
+	RUN_TEST(test_step_gets_through);
+	RUN_TEST(test_single_cycle_spike_is_rejected);
+	RUN_TEST(test_noise_passes_unchanged);
+	RUN_TEST(test_fault_is_passed_on_after_the_limit);
+	RUN_TEST(test_power_on_value_is_held_back);
+	return UNITY_END();
+}
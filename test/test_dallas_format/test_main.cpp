@@ -0,0 +1,88 @@
+// DallasTemperature::formatCelsius(): ties to even and the sign of values
+// that round to zero, both as printf prints rawToCelsius(), plus the
+// fault codes and the decimals limit.
+
+#include <Arduino.h>
+#include <DallasTemperature.h>
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+static void assertFormat(const char *expected, int32_t raw, uint8_t decimals)
+{
+	char buf[12];
+	uint8_t len = DallasTemperature::formatCelsius(raw, buf, decimals);
+
+	TEST_ASSERT_EQUAL_STRING(expected, buf);
+	TEST_ASSERT_EQUAL(strlen(expected), len);
+}
+
+void test_ties_round_to_even(void)
+{
+	// 0.125 and 0.375 sit on the 0.005 boundary at two decimals
+	assertFormat("0.12", 16, 2);
+	assertFormat("0.38", 48, 2);
+	assertFormat("-0.12", -16, 2);
+	assertFormat("-0.38", -48, 2);
+	assertFormat("0.1", 16, 1);
+	assertFormat("0.5", 64, 1);
+	assertFormat("0", 64, 0);
+	assertFormat("2", 320, 0);
+	assertFormat("255.99", 32767, 2);
+}
+
+void test_negative_values_keep_their_sign(void)
+{
+	// -0.0625 at every precision, including when it rounds to zero
+	assertFormat("-0", -8, 0);
+	assertFormat("-0.1", -8, 1);
+	assertFormat("-0.06", -8, 2);
+	assertFormat("-0.062", -8, 3);
+	assertFormat("-0.0625", -8, 4);
+	// the smallest step either side of zero
+	assertFormat("-0.01", -1, 2);
+	assertFormat("-0.0", -1, 1);
+	assertFormat("0.01", 1, 2);
+	assertFormat("0.00", 0, 2);
+}
+
+void test_fault_codes_and_limits(void)
+{
+	assertFormat("-127.00", DEVICE_DISCONNECTED_RAW, 2);
+	assertFormat("-127.00", DEVICE_FAULT_OPEN_RAW, 2);
+	assertFormat("-127", INT32_MIN, 0);
+	// more than 4 decimals are clamped
+	assertFormat("0.0078", 1, 9);
+}
+
+void test_matches_printf_over_the_whole_range(void)
+{
+	char expected[24];
+
+	for (uint8_t decimals = 0; decimals <= 4; decimals++) {
+		for (int32_t raw = DEVICE_DISCONNECTED_RAW + 1; raw <= 32767; raw++) {
+			snprintf(expected, sizeof expected, "%.*f", decimals, DallasTemperature::rawToCelsius(raw));
+			assertFormat(expected, raw, decimals);
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+	UNITY_BEGIN();
+	RUN_TEST(test_ties_round_to_even);
+	RUN_TEST(test_negative_values_keep_their_sign);
+	RUN_TEST(test_fault_codes_and_limits);
+	RUN_TEST(test_matches_printf_over_the_whole_range);
+	return UNITY_END();
+}
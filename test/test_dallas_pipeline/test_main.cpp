@@ -0,0 +1,202 @@
+// DallasBusPipeline against four simulated buses: overlapping
+// conversions, the external pullup on a parasite bus, and a faulted bus
+// that does not hold up the others.
+//
+// test_throughput_against_serial prints each bus's conversion rate in the
+// pipeline against converting and reading the buses one after the other,
+// and asserts every bus gets at least three times the serial rate.
+
+#include <Arduino.h>
+#include <OneWire.h>
+#include <DallasTemperature.h>
+#include <DallasBusPipeline.h>
+#include <OneWireSim.h>
+#include <DS18B20Sim.h>
+#include <unity.h>
+
+#define BUSES       4
+#define PROBES      4
+#define PULLUP_PIN  7
+
+static const uint8_t pins[BUSES] = { 4, 6, 8, 9 };
+
+static OneWireSimBus *buses[BUSES];
+static DS18B20Sim *probes[BUSES][PROBES];
+static OneWire *wires[BUSES];
+static DallasTemperature *sensors[BUSES];
+static DallasBusPipeline *pipeline;
+
+static uint32_t readsOnPullup;
+
+static void onReading(uint8_t bus, uint8_t index, const uint8_t *deviceAddress, int32_t raw)
+{
+	(void)index;
+	(void)deviceAddress;
+	(void)raw;
+	if (buses[bus]->externalPullupOn()) readsOnPullup++;
+}
+
+static const DS18B20Sim *probeAt(uint8_t bus, const uint8_t *address)
+{
+	for (uint8_t i = 0; i < PROBES; i++) {
+		if (address && memcmp(probes[bus][i]->rom(), address, 8) == 0) return probes[bus][i];
+	}
+	return 0;
+}
+
+void setUp(void)
+{
+	OneWireSimClock::reset();
+	pipeline = new DallasBusPipeline();
+	for (uint8_t b = 0; b < BUSES; b++) {
+		// bus 1 is parasite powered, with an external pullup
+		bool parasite = b == 1;
+
+		buses[b] = new OneWireSimBus(pins[b]);
+		for (uint8_t i = 0; i < PROBES; i++) {
+			uint8_t rom[8];
+
+			OneWireSimDevice::makeRom(0x28, 0x62000 + b * 100 + i, rom);
+			probes[b][i] = new DS18B20Sim(rom, parasite);
+			probes[b][i]->setTemperature(10.0f * b + i + 0.5f);
+			buses[b]->attach(probes[b][i]);
+		}
+		wires[b] = new OneWire(pins[b]);
+		if (parasite) {
+			buses[b]->setPullupPin(PULLUP_PIN);
+			sensors[b] = new DallasTemperature(wires[b], PULLUP_PIN);
+		} else {
+			sensors[b] = new DallasTemperature(wires[b]);
+		}
+		pipeline->addBus(sensors[b]);
+	}
+	pipeline->setReadingHandler(onReading);
+	readsOnPullup = 0;
+}
+
+void tearDown(void)
+{
+	delete pipeline;
+	for (uint8_t b = 0; b < BUSES; b++) {
+		delete sensors[b];
+		delete wires[b];
+		for (uint8_t i = 0; i < PROBES; i++) delete probes[b][i];
+		delete buses[b];
+	}
+}
+
+void test_buses_convert_in_parallel(void)
+{
+	pipeline->begin();
+	TEST_ASSERT_TRUE(sensors[1]->isParasitePowerMode());
+
+	unsigned long end = millis() + 5000;
+	while (millis() < end) {
+		pipeline->run();
+		delay(1);
+	}
+	for (uint8_t n = 0; n < BUSES; n++) {
+		// 12 bit, 750ms windows: about 6 cycles each
+		TEST_ASSERT_GREATER_OR_EQUAL(5, pipeline->getCycleCount(n));
+		for (uint8_t i = 0; i < PROBES; i++) {
+			// the pipeline lists probes in search order
+			const DS18B20Sim *probe = probeAt(n, pipeline->getAddress(n, i));
+			TEST_ASSERT_NOT_NULL(probe);
+			TEST_ASSERT_FLOAT_WITHIN(0.0625f, probe->temperature(),
+			                         DallasTemperature::rawToCelsius(pipeline->getTemp(n, i)));
+		}
+	}
+}
+
+void test_parasite_bus_converts_on_the_external_pullup(void)
+{
+	pipeline->begin();
+
+	uint32_t ticks = 0, held = 0;
+	unsigned long end = millis() + 5000;
+	while (millis() < end) {
+		pipeline->run();
+		ticks++;
+		if (buses[1]->externalPullupOn()) held++;
+		delay(1);
+	}
+	TEST_ASSERT_GREATER_OR_EQUAL(5, pipeline->getCycleCount(1));
+	// on for every conversion window, off for the read-outs
+	TEST_ASSERT_GREATER_THAN(ticks * 9 / 10, held);
+	TEST_ASSERT_EQUAL_UINT32(0, readsOnPullup);
+	TEST_ASSERT_FALSE(buses[0]->externalPullupOn());
+}
+
+void test_faulted_bus_does_not_hold_up_the_others(void)
+{
+	pipeline->begin();
+	for (uint8_t i = 0; i < PROBES; i++) buses[0]->detach(probes[0][i]);
+
+	unsigned long end = millis() + 5000;
+	while (millis() < end) {
+		pipeline->run();
+		delay(1);
+	}
+	TEST_ASSERT_TRUE(pipeline->isFaulted(0));
+	for (uint8_t n = 1; n < BUSES; n++) {
+		TEST_ASSERT_FALSE(pipeline->isFaulted(n));
+		TEST_ASSERT_GREATER_OR_EQUAL(5, pipeline->getCycleCount(n));
+	}
+	TEST_ASSERT_EQUAL_INT32(DEVICE_DISCONNECTED_RAW, pipeline->getTemp(0, 0));
+
+	// plugged back in, picked up on a retry
+	for (uint8_t i = 0; i < PROBES; i++) buses[0]->attach(probes[0][i]);
+	end = millis() + 5000;
+	while (millis() < end) {
+		pipeline->run();
+		delay(1);
+	}
+	TEST_ASSERT_FALSE(pipeline->isFaulted(0));
+	TEST_ASSERT_NOT_EQUAL(DEVICE_DISCONNECTED_RAW, pipeline->getTemp(0, 0));
+}
+
+void test_throughput_against_serial(void)
+{
+	const unsigned long ms = 30000;
+	uint32_t serial[BUSES] = {};
+
+	// one bus after the other, each converting while the others wait
+	for (uint8_t b = 0; b < BUSES; b++) sensors[b]->begin();
+	unsigned long end = millis() + ms;
+	while (millis() < end) {
+		for (uint8_t b = 0; b < BUSES; b++) {
+			sensors[b]->requestTemperatures();
+			for (uint8_t i = 0; i < PROBES; i++)
+				TEST_ASSERT_NOT_EQUAL(DEVICE_DISCONNECTED_RAW, sensors[b]->getTemp(probes[b][i]->rom()));
+			serial[b]++;
+		}
+	}
+
+	pipeline->begin();
+	end = millis() + ms;
+	while (millis() < end) {
+		pipeline->run();
+		delay(1);
+	}
+
+	for (uint8_t b = 0; b < BUSES; b++) {
+		double serialRate = serial[b] * 1000.0 / ms;
+		double pipelineRate = pipeline->getCycleCount(b) * 1000.0 / ms;
+		printf("bus %u%s: %.2f conversions/s, %.1f readings/s in the pipeline; %.2f conversions/s serially\n",
+			b, b == 1 ? " (parasite)" : "", pipelineRate, pipeline->getSampleCount(b) * 1000.0 / ms, serialRate);
+		TEST_ASSERT_TRUE(pipelineRate >= 3 * serialRate);
+		TEST_ASSERT_EQUAL_UINT32(pipeline->getCycleCount(b) * PROBES, pipeline->getSampleCount(b));
+	}
+}
+
+int main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+	UNITY_BEGIN();
+	RUN_TEST(test_buses_convert_in_parallel);
+	RUN_TEST(test_parasite_bus_converts_on_the_external_pullup);
+	RUN_TEST(test_faulted_bus_does_not_hold_up_the_others);
+	RUN_TEST(test_throughput_against_serial);
+	return UNITY_END();
+}
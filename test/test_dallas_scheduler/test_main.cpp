@@ -0,0 +1,308 @@
+// DallasResolutionScheduler against the simulated bus: conversions start
+// without a scratchpad read, resolutions are programmed and re-programmed
+// after a power cycle, and parasite probes convert on the external pullup.
+//
+// test_against_fixed_12_bit runs 8 probes for 30 s of bus time, 2 of them
+// ramping at 0.2 C/s, once through the scheduler and once converted
+// together at 12 bit and read as soon as the conversion is done.  Every
+// reading is compared with the probe's temperature at the time it is
+// read: the scheduler has to take at least 1.5 times as many readings per
+// second and keep each one within its error budget.
+
+#include <Arduino.h>
+#include <OneWire.h>
+#include <DallasTemperature.h>
+#include <DallasResolutionScheduler.h>
+#include <OneWireSim.h>
+#include <DS18B20Sim.h>
+#include <unity.h>
+
+#include <math.h>
+#include <algorithm>
+
+#define BUS_PIN     4
+#define PULLUP_PIN  5
+#define PROBES      4
+
+static OneWireSimBus *bus;
+static DS18B20Sim *probes[PROBES];
+static OneWire *wire;
+static DallasTemperature *sensors;
+static DallasResolutionScheduler *scheduler;
+
+static uint32_t readsOnPullup;
+
+static void onSample(uint8_t index, const uint8_t *deviceAddress, int32_t raw)
+{
+	(void)index;
+	(void)deviceAddress;
+	(void)raw;
+	if (bus->externalPullupOn()) readsOnPullup++;
+}
+
+static void attachProbes(bool parasite)
+{
+	for (uint8_t i = 0; i < PROBES; i++) {
+		uint8_t rom[8];
+
+		OneWireSimDevice::makeRom(0x28, 0x5100 + i * 3, rom);
+		probes[i] = new DS18B20Sim(rom, parasite);
+		probes[i]->setTemperature(18.5f + i);
+		bus->attach(probes[i]);
+	}
+}
+
+static void start(void)
+{
+	sensors->begin();
+	sensors->setWaitForConversion(false);
+	scheduler = new DallasResolutionScheduler(sensors);
+	for (uint8_t i = 0; i < PROBES; i++) scheduler->addProbe(probes[i]->rom());
+}
+
+static uint32_t scratchpadReads(void)
+{
+	uint32_t n = 0;
+
+	for (uint8_t i = 0; i < PROBES; i++) n += probes[i]->scratchpadReads();
+	return n;
+}
+
+static void runFor(unsigned long ms)
+{
+	unsigned long end = millis() + ms;
+
+	while (millis() < end) {
+		scheduler->run();
+		delay(1);
+	}
+}
+
+void setUp(void)
+{
+	OneWireSimClock::reset();
+	bus = new OneWireSimBus(BUS_PIN);
+	for (uint8_t i = 0; i < PROBES; i++) probes[i] = 0;
+	wire = 0;
+	sensors = 0;
+	scheduler = 0;
+}
+
+void tearDown(void)
+{
+	delete scheduler;
+	delete sensors;
+	delete wire;
+	for (uint8_t i = 0; i < PROBES; i++) delete probes[i];
+	delete bus;
+}
+
+void test_conversions_start_without_scratchpad_reads(void)
+{
+	attachProbes(false);
+	wire = new OneWire(BUS_PIN);
+	sensors = new DallasTemperature(wire);
+	start();
+
+	uint32_t before = scratchpadReads();
+	runFor(2000);
+
+	// one read per reading taken, none for starting conversions
+	TEST_ASSERT_GREATER_THAN(4 * PROBES, scheduler->getSampleCount());
+	TEST_ASSERT_EQUAL_UINT32(scheduler->getSampleCount(), scratchpadReads() - before);
+	for (uint8_t i = 0; i < PROBES; i++) {
+		TEST_ASSERT_EQUAL(scheduler->getResolution(i), probes[i]->resolution());
+		TEST_ASSERT_FLOAT_WITHIN(0.5f, 18.5f + i, scheduler->getTempC(i));
+		TEST_ASSERT_EQUAL(0, probes[i]->eepromWrites());
+	}
+}
+
+void test_power_cycled_probe_is_reprogrammed(void)
+{
+	attachProbes(false);
+	wire = new OneWire(BUS_PIN);
+	sensors = new DallasTemperature(wire);
+	start();
+	runFor(500);
+	TEST_ASSERT_EQUAL(9, probes[1]->resolution());
+
+	// unplugged: the read fails ...
+	bus->detach(probes[1]);
+	runFor(500);
+	TEST_ASSERT_EQUAL_INT32(DEVICE_DISCONNECTED_RAW, scheduler->getTemp(1));
+
+	// ... and it comes back with its EEPROM resolution, 12 bit
+	uint8_t rom[8];
+	memcpy(rom, probes[1]->rom(), 8);
+	delete probes[1];
+	probes[1] = new DS18B20Sim(rom);
+	probes[1]->setTemperature(19.5f);
+	TEST_ASSERT_EQUAL(12, probes[1]->resolution());
+	bus->attach(probes[1]);
+
+	runFor(1000);
+	TEST_ASSERT_EQUAL(scheduler->getResolution(1), probes[1]->resolution());
+	TEST_ASSERT_FLOAT_WITHIN(0.5f, 19.5f, scheduler->getTempC(1));
+}
+
+void test_parasite_probes_convert_on_the_external_pullup(void)
+{
+	attachProbes(true);
+	bus->setPullupPin(PULLUP_PIN);
+	wire = new OneWire(BUS_PIN);
+	sensors = new DallasTemperature(wire, PULLUP_PIN);
+	start();
+	TEST_ASSERT_TRUE(sensors->isParasitePowerMode());
+	readsOnPullup = 0;
+	scheduler->setSampleHandler(onSample);
+
+	unsigned long end = millis() + 3000;
+	while (millis() < end) {
+		scheduler->run();
+		// one probe is always converting, on the pullup
+		TEST_ASSERT_TRUE(bus->externalPullupOn());
+		delay(1);
+	}
+	TEST_ASSERT_GREATER_THAN(2 * PROBES, scheduler->getSampleCount());
+	// ... which is released for every read-out
+	TEST_ASSERT_EQUAL_UINT32(0, readsOnPullup);
+	for (uint8_t i = 0; i < PROBES; i++) {
+		// a conversion without the pullup would have read 85 C
+		TEST_ASSERT_FLOAT_WITHIN(0.5f, 18.5f + i, scheduler->getTempC(i));
+	}
+}
+
+#define BENCH_PROBES  8
+#define BENCH_MS      30000
+#define RAMP          0.2   // C/s
+
+static DS18B20Sim *bench[BENCH_PROBES];
+static double maxError;
+static uint32_t readings;
+
+// where probe i is at the current time
+static double truth(uint8_t i)
+{
+	double t = millis() / 1000.0;
+
+	if (i == 0) return 20.0 + RAMP * t;
+	if (i == 1) return 25.0 - RAMP * t;
+	return 18.5 + i;
+}
+
+static void moveProbes(void)
+{
+	for (uint8_t i = 0; i < BENCH_PROBES; i++) bench[i]->setTemperature((float)truth(i));
+}
+
+static void check(uint8_t i, int32_t raw)
+{
+	TEST_ASSERT_TRUE(raw != DEVICE_DISCONNECTED_RAW);
+	maxError = std::max(maxError, fabs(raw / 128.0 - truth(i)));
+	readings++;
+}
+
+static void onBenchSample(uint8_t index, const uint8_t *deviceAddress, int32_t raw)
+{
+	(void)deviceAddress;
+	check(index, raw);
+}
+
+static void attachBench(void)
+{
+	for (uint8_t i = 0; i < BENCH_PROBES; i++) {
+		uint8_t rom[8];
+
+		OneWireSimDevice::makeRom(0x28, 0x5200 + i * 5, rom);
+		bench[i] = new DS18B20Sim(rom);
+		bus->attach(bench[i]);
+	}
+	moveProbes();
+	wire = new OneWire(BUS_PIN);
+	sensors = new DallasTemperature(wire);
+	sensors->begin();
+	sensors->setWaitForConversion(false);
+	maxError = 0;
+	readings = 0;
+}
+
+static void detachBench(void)
+{
+	for (uint8_t i = 0; i < BENCH_PROBES; i++) {
+		bus->detach(bench[i]);
+		delete bench[i];
+	}
+}
+
+// readings per second through the scheduler at the given budget
+static double scheduled(float budget)
+{
+	attachBench();
+	scheduler = new DallasResolutionScheduler(sensors, budget);
+	for (uint8_t i = 0; i < BENCH_PROBES; i++) scheduler->addProbe(bench[i]->rom());
+	scheduler->setSampleHandler(onBenchSample);
+	while (millis() < BENCH_MS) {
+		moveProbes();
+		scheduler->run();
+		delay(1);
+	}
+	TEST_ASSERT_EQUAL_UINT32(readings, scheduler->getSampleCount());
+	delete scheduler;
+	scheduler = 0;
+	delete sensors;
+	sensors = 0;
+	delete wire;
+	wire = 0;
+	detachBench();
+	return readings * 1000.0 / BENCH_MS;
+}
+
+// readings per second with every probe at 12 bit, converted together
+static double fixed12(void)
+{
+	attachBench();
+	sensors->setResolution(12);
+	while (millis() < BENCH_MS) {
+		sensors->requestTemperatures();
+		unsigned long done = millis() + DallasTemperature::millisToWaitForConversion(12);
+		while (millis() < done) {
+			moveProbes();
+			delay(1);
+		}
+		moveProbes();
+		for (uint8_t i = 0; i < BENCH_PROBES; i++) check(i, sensors->getTemp(bench[i]->rom()));
+	}
+	delete sensors;
+	sensors = 0;
+	delete wire;
+	wire = 0;
+	detachBench();
+	return readings * 1000.0 / BENCH_MS;
+}
+
+void test_against_fixed_12_bit(void)
+{
+	double fixedRate = fixed12();
+	double fixedError = maxError;
+
+	for (float budget : { 0.5f, 0.1f }) {
+		OneWireSimClock::reset();
+		double rate = scheduled(budget);
+		printf("budget %.1f C: %.1f readings/s, max error %.3f C; fixed 12 bit: %.1f readings/s, max error %.3f C\n",
+			budget, rate, maxError, fixedRate, fixedError);
+		TEST_ASSERT_TRUE(rate > fixedRate * 1.5);
+		TEST_ASSERT_TRUE(maxError <= budget);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+	UNITY_BEGIN();
+	RUN_TEST(test_conversions_start_without_scratchpad_reads);
+	RUN_TEST(test_power_cycled_probe_is_reprogrammed);
+	RUN_TEST(test_parasite_probes_convert_on_the_external_pullup);
+	RUN_TEST(test_against_fixed_12_bit);
+	return UNITY_END();
+}
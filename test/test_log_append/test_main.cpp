@@ -0,0 +1,219 @@
+// SegmentedLog on HostFS over long runs: the cost of an append does not
+// grow with the log.  A run is cut into buckets of appends, and every
+// bucket must take about the same time per append, and make the same file
+// system operations (opens, bytes read and written) per append, as the
+// first one did, with rotation, compaction and retention going on
+// throughout.  The same for a log that is opened again every few lines,
+// as after a deep-sleep wake.  Each test prints its buckets.
+//
+// The manifest, rewritten on rotation and read by begin(), grows with the
+// segments until the segment table is full, so the runs start from a log
+// that has filled it: from then on, every segment sealed drops one.
+
+#include <Arduino.h>
+#include <HostFS.h>
+#include <SegmentedLog.h>
+#include <unity.h>
+
+#include <time.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#define FS_ROOT "/tmp/test_log_append"
+#define HEADER "Reading ID, Date, Hour, Temperature \r\n"
+#define START 1700000000UL
+
+static HostFS *disk;
+
+// what compaction read and wrote since the last bucket, which is not the
+// appends'
+static uint32_t compactionOpens;
+static uint64_t compactionRead;
+static uint64_t compactionWritten;
+
+struct Bucket {
+	double median;     // us per append
+	double p99;
+	double opens;      // per append
+	double read;       // bytes per append
+	double written;
+};
+
+// the line main.cpp writes for sample i, a minute apart
+static void sampleLine(uint32_t i, char *line, size_t size, uint32_t *time)
+{
+	time_t t = START + i * 60UL;
+	struct tm tm;
+
+	gmtime_r(&t, &tm);
+	snprintf(line, size, "%lu,%04d-%02d-%02d,%02d:%02d:%02d,%d.%02d\r\n", (unsigned long)i,
+		tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec,
+		18 + (int)(i / 97 % 8), (int)(i * 25 % 100));
+	*time = (uint32_t)t;
+}
+
+static Bucket summarize(std::vector<double> &us)
+{
+	uint32_t n = us.size();
+	Bucket b;
+
+	std::sort(us.begin(), us.end());
+	b.median = us[n / 2];
+	b.p99 = us[n * 99 / 100];
+	b.opens = (double)(disk->opens() - compactionOpens) / n;
+	b.read = (double)(disk->bytesRead() - compactionRead) / n;
+	b.written = (double)(disk->bytesWritten() - compactionWritten) / n;
+	us.clear();
+	disk->resetStats();
+	compactionOpens = 0;
+	compactionRead = compactionWritten = 0;
+	return b;
+}
+
+// what the compaction task does once a segment is sealed, outside of
+// the appends' time and counts
+static void compact(SegmentedLog &log)
+{
+	uint32_t opens = disk->opens();
+	uint64_t read = disk->bytesRead(), written = disk->bytesWritten();
+
+	while (log.compactOne()) {
+	}
+	compactionOpens += disk->opens() - opens;
+	compactionRead += disk->bytesRead() - read;
+	compactionWritten += disk->bytesWritten() - written;
+}
+
+// appends until the segment table is full, as it is after a few days
+static uint32_t fill(SegmentedLog &log)
+{
+	char line[64];
+	uint32_t i, time;
+
+	for (i = 0; log.segmentCount() < SEGMENTED_LOG_MAX_SEGMENTS; i++) {
+		sampleLine(i, line, sizeof line, &time);
+		TEST_ASSERT_TRUE(log.append(line, time));
+		compact(log);
+	}
+	disk->resetStats();
+	compactionOpens = 0;
+	compactionRead = compactionWritten = 0;
+	return i;
+}
+
+static void print(const char *what, const std::vector<Bucket> &buckets, uint32_t size)
+{
+	printf("%s, %u appends per bucket:\n", what, (unsigned)size);
+	for (size_t i = 0; i < buckets.size(); i++) {
+		const Bucket &b = buckets[i];
+		printf("  %2u: median %5.2f us, p99 %6.2f us, %.4f opens, %6.1f bytes read, %6.1f written per append\n",
+			(unsigned)i, b.median, b.p99, b.opens, b.read, b.written);
+	}
+}
+
+// every bucket against the first: the time within a factor of two (or a
+// microsecond, for a host that is fast enough to make that the noise),
+// the file system operations within a tenth
+static void assertFlat(const std::vector<Bucket> &buckets)
+{
+	const Bucket &first = buckets[0];
+
+	for (const Bucket &b : buckets) {
+		TEST_ASSERT_TRUE(b.median <= std::max(2 * first.median, first.median + 1));
+		TEST_ASSERT_TRUE(b.opens <= first.opens * 1.1 + 0.001);
+		TEST_ASSERT_TRUE(b.read <= first.read * 1.1 + 1);
+		TEST_ASSERT_TRUE(b.written <= first.written * 1.1);
+	}
+}
+
+void setUp(void)
+{
+	HostClock::reset();
+	disk->clear();
+	disk->resetStats();
+	compactionOpens = 0;
+	compactionRead = compactionWritten = 0;
+}
+
+void tearDown(void)
+{
+}
+
+void test_append_latency_stays_flat(void)
+{
+	const uint32_t buckets = 20, size = 25000;
+	SegmentedLog log(*disk, "/log", HEADER);
+	std::vector<Bucket> result;
+	std::vector<double> us;
+	char line[64];
+	uint32_t time;
+
+	// a few MB kept: segments are dropped from the second bucket on
+	log.setRetention(0, 2UL * 1024 * 1024);
+	TEST_ASSERT_TRUE(log.begin());
+	uint32_t filled = fill(log);
+	us.reserve(size);
+	for (uint32_t i = filled; i < filled + buckets * size; i++) {
+		sampleLine(i, line, sizeof line, &time);
+		auto start = std::chrono::steady_clock::now();
+		TEST_ASSERT_TRUE(log.append(line, time));
+		us.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+
+		compact(log);
+		if (us.size() == size) result.push_back(summarize(us));
+	}
+	print("open log", result, size);
+	assertFlat(result);
+	TEST_ASSERT_EQUAL_UINT32(filled + buckets * size, log.sequence());
+	TEST_ASSERT_TRUE(log.size() <= 2UL * 1024 * 1024 + SEGMENTED_LOG_SEGMENT_SIZE);
+}
+
+void test_wake_and_append_stays_flat(void)
+{
+	const uint32_t buckets = 10, size = 10000, perWake = 20;
+	std::vector<Bucket> result;
+	std::vector<double> us;
+	char line[64];
+	uint32_t time;
+
+	uint32_t filled;
+	{
+		SegmentedLog log(*disk, "/log", HEADER);
+		log.setRetention(0, 1024UL * 1024);
+		TEST_ASSERT_TRUE(log.begin());
+		filled = fill(log);
+	}
+	us.reserve(size);
+	for (uint32_t i = filled; i < filled + buckets * size; i += perWake) {
+		// begin() and the lines of one wake, counted per line
+		auto start = std::chrono::steady_clock::now();
+		SegmentedLog log(*disk, "/log", HEADER);
+		log.setRetention(0, 1024UL * 1024);
+		TEST_ASSERT_TRUE(log.begin());
+		TEST_ASSERT_EQUAL_UINT32(i, log.sequence());
+		for (uint32_t j = i; j < i + perWake; j++) {
+			sampleLine(j, line, sizeof line, &time);
+			TEST_ASSERT_TRUE(log.append(line, time));
+		}
+		double perLine = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / perWake;
+		compact(log);
+		for (uint32_t j = 0; j < perWake; j++) us.push_back(perLine);
+		if (us.size() == size) result.push_back(summarize(us));
+	}
+	print("woken every 20 lines", result, size);
+	assertFlat(result);
+}
+
+int main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+	disk = new HostFS(FS_ROOT);
+	UNITY_BEGIN();
+	RUN_TEST(test_append_latency_stays_flat);
+	RUN_TEST(test_wake_and_append_stays_flat);
+	int failures = UNITY_END();
+	delete disk;
+	return failures;
+}
@@ -0,0 +1,176 @@
+// SampleArchive on realistic traces: every trace comes back from the
+// archive byte for byte, and test_benchmark prints bytes per sample and
+// encode and decode speed in MB of CSV per second.  The traces are what a
+// DS18B20 at 12 bits reads, in steps of 8/128 degrees:
+//
+//   indoor     a minute apart, a slow daily swing and a step of noise
+//   outdoor    ten seconds apart, sun and clouds, wider swings
+//   irregular  a minute apart, give or take a few seconds, with samples
+//              missed and the reading ID starting over after a reset
+
+#include <SampleArchive.h>
+#include <unity.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+
+#define HEADER "Reading ID, Date, Hour, Temperature \r\n"
+#define START 1700000000UL
+#define SAMPLES 200000
+
+class StringOutput : public SampleArchiveOutput
+{
+  public:
+	std::string data;
+
+	bool write(const uint8_t *p, size_t len)
+	{
+		data.append((const char *)p, len);
+		return true;
+	}
+};
+
+class StringInput : public SampleArchiveInput
+{
+  public:
+	StringInput(const std::string &data) : _data(data), _pos(0) {}
+
+	size_t read(uint8_t *buf, size_t len)
+	{
+		size_t n = std::min(len, _data.size() - _pos);
+		memcpy(buf, _data.data() + _pos, n);
+		_pos += n;
+		return n;
+	}
+
+  private:
+	const std::string &_data;
+	size_t _pos;
+};
+
+enum Trace { INDOOR, OUTDOOR, IRREGULAR };
+
+static const char *const names[] = { "indoor", "outdoor", "irregular" };
+
+static std::string trace(Trace kind)
+{
+	std::string csv = HEADER;
+	char line[SAMPLE_LINE_MAX];
+	Sample s = { 0, START, 0 };
+	double cloud = 0;
+
+	srand(kind + 1);
+	for (uint32_t i = 0; i < SAMPLES; i++) {
+		double hours = (s.time - START) / 3600.0;
+		double c;
+
+		if (kind == OUTDOOR) {
+			if (rand() % 200 == 0) cloud = (rand() % 100) / 25.0;
+			c = 12 + 8 * sin(hours * M_PI / 12) - cloud + (rand() % 3 - 1) * 0.0625;
+		} else {
+			c = 21 + 1.5 * sin(hours * M_PI / 12) + (rand() % 3 - 1) * 0.0625;
+		}
+		// what the probe reads: 1/16 degree steps, in 1/128 degrees
+		s.value = (int32_t)lround(c * 16) * 8;
+		formatSample(s, line);
+		csv += line;
+
+		s.id++;
+		if (kind == OUTDOOR) {
+			s.time += 10;
+		} else if (kind == INDOOR) {
+			s.time += 60;
+		} else {
+			s.time += 57 + rand() % 7;
+			if (rand() % 50 == 0) s.time += 60 * (1 + rand() % 5);
+			if (rand() % 5000 == 0) s.id = 0;
+		}
+	}
+	return csv;
+}
+
+static std::string encode(const std::string &csv)
+{
+	StringOutput out;
+	SampleArchiveEncoder *encoder = new SampleArchiveEncoder(&out);
+
+	// as the compactor feeds it, a few hundred bytes at a time
+	for (size_t at = 0; at < csv.size(); at += 256)
+		encoder->feed((const uint8_t *)csv.data() + at, std::min((size_t)256, csv.size() - at));
+	TEST_ASSERT_TRUE(encoder->finish());
+	TEST_ASSERT_EQUAL_UINT32(out.data.size(), encoder->total());
+	delete encoder;
+	return out.data;
+}
+
+static std::string decode(const std::string &archive)
+{
+	StringInput in(archive);
+	SampleArchiveDecoder *decoder = new SampleArchiveDecoder();
+	std::string csv;
+	const char *line;
+	size_t length;
+
+	csv.reserve(archive.size() * 16);
+	decoder->begin(&in);
+	while (decoder->next(&line, &length)) csv.append(line, length);
+	delete decoder;
+	return csv;
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_traces_come_back_as_they_were(void)
+{
+	for (Trace kind : { INDOOR, OUTDOOR, IRREGULAR }) {
+		std::string csv = trace(kind);
+		std::string archive = encode(csv);
+		TEST_ASSERT_TRUE(decode(archive) == csv);
+		// a few bytes a sample, against some 30 as text
+		TEST_ASSERT_TRUE(archive.size() < (size_t)SAMPLES * 4);
+	}
+}
+
+void test_benchmark(void)
+{
+	for (Trace kind : { INDOOR, OUTDOOR, IRREGULAR }) {
+		std::string csv = trace(kind);
+		std::string archive, back;
+		double encodeS = 1e9, decodeS = 1e9;
+
+		// the best of a few runs
+		for (int run = 0; run < 3; run++) {
+			auto start = std::chrono::steady_clock::now();
+			archive = encode(csv);
+			auto middle = std::chrono::steady_clock::now();
+			back = decode(archive);
+			auto end = std::chrono::steady_clock::now();
+			encodeS = std::min(encodeS, std::chrono::duration<double>(middle - start).count());
+			decodeS = std::min(decodeS, std::chrono::duration<double>(end - middle).count());
+		}
+		TEST_ASSERT_TRUE(back == csv);
+		printf("%-9s %.2f bytes/sample (text %.2f, %.1fx), encode %.0f MB/s, decode %.0f MB/s\n",
+			names[kind], (double)archive.size() / SAMPLES, (double)csv.size() / SAMPLES,
+			(double)csv.size() / archive.size(), csv.size() / encodeS / 1e6, csv.size() / decodeS / 1e6);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+	UNITY_BEGIN();
+	RUN_TEST(test_traces_come_back_as_they_were);
+	RUN_TEST(test_benchmark);
+	return UNITY_END();
+}
@@ -0,0 +1,142 @@
+// SegmentedLog with a reader open on HostFS: clear() fails and busy()
+// says why, the reader still gets every line it started with, and clear()
+// works once the reader is gone.  With the segment table full a reader
+// holds up rotation; the active segment takes one more segment size and
+// then append() turns lines away, until the reader is gone and the next
+// line rotates.
+
+#include <Arduino.h>
+#include <HostFS.h>
+#include <SegmentedLog.h>
+#include <unity.h>
+
+#include <string>
+
+#define FS_ROOT "/tmp/test_log_readers"
+#define HEADER "Reading ID, Date, Hour, Temperature \r\n"
+#define SEGMENT 512
+// the last segment there is room for in the table, with ids from 1
+#define ACTIVE "/log/00000128.csv"
+
+static HostFS *disk;
+static SegmentedLog *sampleLog;
+static std::string written;
+
+static std::string sampleLine(uint32_t i)
+{
+	char line[64];
+
+	snprintf(line, sizeof line, "%lu,2026-10-18,%02lu:%02lu:00,21.%02lu\r\n", (unsigned long)i,
+		(unsigned long)(i / 60 % 24), (unsigned long)(i % 60), (unsigned long)(i * 7 % 100));
+	return line;
+}
+
+static bool append(uint32_t i)
+{
+	std::string line = sampleLine(i);
+
+	if (!sampleLog->append(line.c_str(), 0)) return false;
+	written += line;
+	return true;
+}
+
+static std::string readRest(SegmentedLogReader &reader)
+{
+	std::string out;
+	uint8_t buf[97];
+	size_t n;
+
+	while ((n = reader.read(buf, sizeof buf)) > 0) out.append((const char *)buf, n);
+	return out;
+}
+
+void setUp(void)
+{
+	HostClock::reset();
+	disk->clear();
+	written = HEADER;
+	sampleLog = new SegmentedLog(*disk, "/log", HEADER);
+	sampleLog->setSegmentSize(SEGMENT);
+	TEST_ASSERT_TRUE(sampleLog->begin());
+}
+
+void tearDown(void)
+{
+	delete sampleLog;
+}
+
+void test_clear_waits_for_the_reader(void)
+{
+	uint32_t i;
+
+	for (i = 0; sampleLog->segmentCount() < 4; i++) TEST_ASSERT_TRUE(append(i));
+	TEST_ASSERT_FALSE(sampleLog->busy());
+	{
+		SegmentedLogReader reader(sampleLog);
+		uint8_t first[16];
+
+		TEST_ASSERT_EQUAL_UINT32(sizeof first, reader.read(first, sizeof first));
+		TEST_ASSERT_TRUE(sampleLog->busy());
+		TEST_ASSERT_FALSE(sampleLog->clear());
+		TEST_ASSERT_EQUAL_UINT32(4, sampleLog->segmentCount());
+		TEST_ASSERT_EQUAL_STRING(written.c_str(), (std::string((const char *)first, sizeof first) + readRest(reader)).c_str());
+	}
+	TEST_ASSERT_FALSE(sampleLog->busy());
+	TEST_ASSERT_TRUE(sampleLog->clear());
+	TEST_ASSERT_EQUAL_UINT32(1, sampleLog->segmentCount());
+
+	SegmentedLogReader reader(sampleLog);
+	TEST_ASSERT_EQUAL_STRING(HEADER, readRest(reader).c_str());
+}
+
+void test_full_table_caps_the_active_segment(void)
+{
+	uint32_t i, count;
+
+	TEST_ASSERT_EQUAL(128, SEGMENTED_LOG_MAX_SEGMENTS);
+
+	for (i = 0; sampleLog->segmentCount() < SEGMENTED_LOG_MAX_SEGMENTS; i++) TEST_ASSERT_TRUE(append(i));
+	written = HEADER;
+	{
+		SegmentedLogReader reader(sampleLog);
+		std::string seen;
+
+		// lines go on into the active segment, up to twice its size
+		for (count = 0; append(i); i++) count++;
+		TEST_ASSERT_EQUAL_UINT32(SEGMENTED_LOG_MAX_SEGMENTS, sampleLog->segmentCount());
+		TEST_ASSERT_TRUE(count > 0);
+		size_t active = disk->fileSize(ACTIVE);
+		TEST_ASSERT_TRUE(active > SEGMENT);
+		TEST_ASSERT_TRUE(active <= 2 * SEGMENT);
+		TEST_ASSERT_FALSE(append(i));
+		TEST_ASSERT_EQUAL_UINT32(active, disk->fileSize(ACTIVE));
+
+		// and the reader still reads what it found
+		seen = readRest(reader);
+		TEST_ASSERT_TRUE(seen.find(sampleLine(0)) != std::string::npos);
+	}
+
+	// the next line rotates, dropping the oldest segment
+	TEST_ASSERT_TRUE(append(i));
+	TEST_ASSERT_EQUAL_UINT32(SEGMENTED_LOG_MAX_SEGMENTS, sampleLog->segmentCount());
+	SegmentedLogReader reader(sampleLog);
+	std::string all = readRest(reader);
+	TEST_ASSERT_TRUE(all.find(sampleLine(0)) == std::string::npos);
+	TEST_ASSERT_TRUE(all.size() > written.size());
+	// ending with the lines taken while the reader was open, and that one
+	std::string taken = written.substr(strlen(HEADER));
+	TEST_ASSERT_EQUAL(all.size() - taken.size(), all.find(taken));
+}
+
+int main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+	disk = new HostFS(FS_ROOT);
+	UNITY_BEGIN();
+	RUN_TEST(test_clear_waits_for_the_reader);
+	RUN_TEST(test_full_table_caps_the_active_segment);
+	int failures = UNITY_END();
+	delete disk;
+	return failures;
+}
@@ -0,0 +1,186 @@
+// SegmentedLog's recovery on HostFS.  The active segment is cut short at
+// every byte offset, as a reset in the middle of an append leaves it, and
+// begin() must find the last whole record: the log reads back exactly the
+// lines before the cut and numbers the next one right after them.  Reads
+// and seeks made to fail during begin() must cost no line and no sequence
+// number: the segment is kept whole, and the next line is numbered past
+// every one it could hold.
+
+#include <Arduino.h>
+#include <HostFS.h>
+#include <SegmentedLog.h>
+#include <unity.h>
+
+#include <string>
+#include <vector>
+
+#define FS_ROOT "/tmp/test_log_recovery"
+#define HEADER "Reading ID, Date, Hour, Temperature \r\n"
+#define ACTIVE "/log/00000001.csv"
+#define LINES 80
+#define RECORD_OVERHEAD 13
+
+static HostFS *disk;
+static std::vector<std::string> lines;
+static std::vector<size_t> ends;   // where each line's record ends
+
+static std::string sampleLine(uint32_t i)
+{
+	char line[64];
+
+	// lengths vary, so that record ends fall everywhere in a block
+	snprintf(line, sizeof line, "%lu,2026-10-18,%02lu:%02lu:00,%s21.%02lu\r\n", (unsigned long)i,
+		(unsigned long)(i / 60 % 24), (unsigned long)(i % 60), std::string(i % 11, ' ').c_str(),
+		(unsigned long)(i * 7 % 100));
+	return line;
+}
+
+// a log of LINES lines, all in the active segment
+static void writeLog(void)
+{
+	SegmentedLog log(*disk, "/log", HEADER);
+
+	disk->clear();
+	TEST_ASSERT_TRUE(log.begin());
+	for (const std::string &line : lines) TEST_ASSERT_TRUE(log.append(line.c_str(), 0));
+	TEST_ASSERT_EQUAL_UINT32(ends.back(), disk->fileSize(ACTIVE));
+}
+
+static std::string readAll(SegmentedLog &log)
+{
+	SegmentedLogReader reader(&log);
+	std::string out;
+	uint8_t buf[97];
+	size_t n;
+
+	while ((n = reader.read(buf, sizeof buf)) > 0) out.append((const char *)buf, n);
+	return out;
+}
+
+static std::string expected(size_t count)
+{
+	std::string out = HEADER;
+
+	for (size_t i = 0; i < count; i++) out += lines[i];
+	return out;
+}
+
+void setUp(void)
+{
+	HostClock::reset();
+	disk->clearFaults();
+}
+
+void tearDown(void)
+{
+	disk->clearFaults();
+}
+
+void test_cut_at_every_offset(void)
+{
+	for (size_t cut = 0; cut <= ends.back(); cut++) {
+		writeLog();
+		TEST_ASSERT_TRUE(disk->truncate(ACTIVE, cut));
+		size_t whole = 0;
+		while (whole < LINES && ends[whole] <= cut) whole++;
+
+		SegmentedLog log(*disk, "/log", HEADER);
+		TEST_ASSERT_TRUE(log.begin());
+		TEST_ASSERT_EQUAL_UINT32(whole, log.sequence());
+		TEST_ASSERT_EQUAL_STRING(expected(whole).c_str(), readAll(log).c_str());
+
+		// and carries on behind them
+		std::string next = sampleLine(whole);
+		TEST_ASSERT_TRUE(log.append(next.c_str(), 0));
+		TEST_ASSERT_EQUAL_UINT32(whole + 1, log.sequence());
+		TEST_ASSERT_EQUAL_STRING((expected(whole) + next).c_str(), readAll(log).c_str());
+	}
+}
+
+void test_cut_and_reopened_twice(void)
+{
+	// the sealed torn segment is not looked at again, and the sequence
+	// survives a second begin() in the new segment
+	for (size_t cut = ends[LINES / 2] - 5; cut <= ends[LINES / 2] + 5; cut++) {
+		writeLog();
+		TEST_ASSERT_TRUE(disk->truncate(ACTIVE, cut));
+		size_t whole = 0;
+		while (whole < LINES && ends[whole] <= cut) whole++;
+		{
+			SegmentedLog log(*disk, "/log", HEADER);
+			TEST_ASSERT_TRUE(log.begin());
+			TEST_ASSERT_TRUE(log.append(sampleLine(whole).c_str(), 0));
+		}
+		SegmentedLog log(*disk, "/log", HEADER);
+		TEST_ASSERT_TRUE(log.begin());
+		TEST_ASSERT_EQUAL_UINT32(whole + 1, log.sequence());
+		TEST_ASSERT_EQUAL_STRING((expected(whole) + sampleLine(whole)).c_str(), readAll(log).c_str());
+	}
+}
+
+static void faultDuringBegin(HostFSFault fault, size_t cut)
+{
+	bool struck = false;
+
+	// from the first read or seek of begin() to past its last one
+	for (uint32_t after = 0; after < 64; after++) {
+		writeLog();
+		TEST_ASSERT_TRUE(disk->truncate(ACTIVE, cut));
+		size_t whole = 0;
+		while (whole < LINES && ends[whole] <= cut) whole++;
+
+		SegmentedLog log(*disk, "/log", HEADER);
+		disk->injectFault(fault, after);
+		TEST_ASSERT_TRUE(log.begin());
+		disk->clearFaults();
+
+		// whatever begin() could not read, nothing is gone ...
+		TEST_ASSERT_EQUAL_UINT32(cut, disk->fileSize(ACTIVE));
+		// ... no number is given twice ...
+		uint32_t sequence = log.sequence();
+		TEST_ASSERT_TRUE(sequence >= whole);
+		if (sequence > whole) {
+			struck = true;
+			TEST_ASSERT_TRUE(sequence >= cut / RECORD_OVERHEAD);
+		}
+		// ... and every line before the cut reads back, followed by the next
+		std::string next = sampleLine(sequence);
+		TEST_ASSERT_TRUE(log.append(next.c_str(), 0));
+		TEST_ASSERT_EQUAL_STRING((expected(whole) + next).c_str(), readAll(log).c_str());
+	}
+	TEST_ASSERT_TRUE(struck);
+}
+
+void test_read_fault_during_recovery(void)
+{
+	faultDuringBegin(HOST_FS_FAULT_READ, ends.back());
+	faultDuringBegin(HOST_FS_FAULT_READ, ends[LINES - 1] - 3);
+	faultDuringBegin(HOST_FS_FAULT_READ, ends[10] + 1);
+}
+
+void test_seek_fault_during_recovery(void)
+{
+	faultDuringBegin(HOST_FS_FAULT_SEEK, ends.back());
+	faultDuringBegin(HOST_FS_FAULT_SEEK, ends[LINES - 1] - 3);
+}
+
+int main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+	disk = new HostFS(FS_ROOT);
+	size_t end = 0;
+	for (uint32_t i = 0; i < LINES; i++) {
+		lines.push_back(sampleLine(i));
+		end += lines.back().size() + RECORD_OVERHEAD;
+		ends.push_back(end);
+	}
+	UNITY_BEGIN();
+	RUN_TEST(test_cut_at_every_offset);
+	RUN_TEST(test_cut_and_reopened_twice);
+	RUN_TEST(test_read_fault_during_recovery);
+	RUN_TEST(test_seek_fault_during_recovery);
+	int failures = UNITY_END();
+	delete disk;
+	return failures;
+}
@@ -0,0 +1,147 @@
+// OneWire::crc8()/crc16() of the kernel selected by ONEWIRE_CRC8_TABLE
+// against a bitwise reference, plus per-call timings.  The native_crc*
+// environments in platformio.ini run this test once per kernel.
+
+#include <Arduino.h>
+#include <OneWire.h>
+#include <OneWireSim.h>   // OneWire's host pin layer, unused here
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <unity.h>
+
+static uint8_t refCrc8(const uint8_t *addr, uint8_t len)
+{
+	uint8_t crc = 0;
+
+	while (len--) {
+		uint8_t inbyte = *addr++;
+		for (uint8_t i = 8; i; i--) {
+			uint8_t mix = (crc ^ inbyte) & 0x01;
+			crc >>= 1;
+			if (mix) crc ^= 0x8C;
+			inbyte >>= 1;
+		}
+	}
+	return crc;
+}
+
+static uint16_t refCrc16(const uint8_t *input, uint16_t len, uint16_t crc)
+{
+	while (len--) {
+		crc ^= *input++;
+		for (uint8_t i = 8; i; i--) crc = crc & 1 ? (crc >> 1) ^ 0xA001 : crc >> 1;
+	}
+	return crc;
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_known_vectors(void)
+{
+	// a DS18B20 ROM and a DS18B20 power-up scratchpad (85 C)
+	static const uint8_t rom[8] = { 0x28, 0xFF, 0x4C, 0x2B, 0x62, 0x16, 0x04, 0x5D };
+	static const uint8_t pad[9] = { 0x50, 0x05, 0x4B, 0x46, 0x7F, 0xFF, 0x0C, 0x10, 0x1C };
+	// CRC-16/ARC check value
+	static const uint8_t check[9] = { '1', '2', '3', '4', '5', '6', '7', '8', '9' };
+
+	TEST_ASSERT_EQUAL_HEX8(refCrc8(rom, 7), OneWire::crc8(rom, 7));
+	TEST_ASSERT_EQUAL_HEX8(pad[8], OneWire::crc8(pad, 8));
+	TEST_ASSERT_EQUAL_HEX8(0, OneWire::crc8(pad, 9));
+	TEST_ASSERT_EQUAL_HEX16(0xBB3D, OneWire::crc16(check, 9));
+}
+
+void test_all_short_inputs(void)
+{
+	uint8_t buf[2];
+
+	for (uint32_t v = 0; v < 0x10000; v++) {
+		buf[0] = v;
+		buf[1] = v >> 8;
+		TEST_ASSERT_EQUAL_HEX8(refCrc8(buf, 1), OneWire::crc8(buf, 1));
+		TEST_ASSERT_EQUAL_HEX8(refCrc8(buf, 2), OneWire::crc8(buf, 2));
+		// every start value, as used to chain crc16 over memory pages
+		TEST_ASSERT_EQUAL_HEX16(refCrc16(buf, 1, v), OneWire::crc16(buf, 1, v));
+		TEST_ASSERT_EQUAL_HEX16(refCrc16(buf, 2, v), OneWire::crc16(buf, 2, v));
+	}
+}
+
+void test_random_buffers(void)
+{
+	uint8_t buf[40];
+
+	srand(34);
+	for (uint32_t n = 0; n < 200000; n++) {
+		uint8_t len = rand() % sizeof buf;
+		uint16_t start = rand();
+
+		for (uint8_t i = 0; i < len; i++) buf[i] = rand();
+		TEST_ASSERT_EQUAL_HEX8(refCrc8(buf, len), OneWire::crc8(buf, len));
+		TEST_ASSERT_EQUAL_HEX16(refCrc16(buf, len, start), OneWire::crc16(buf, len, start));
+	}
+}
+
+void test_check_crc16(void)
+{
+	uint8_t buf[11] = { 0xAA, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07 };
+	uint16_t crc = ~refCrc16(buf, 9, 0);
+
+	buf[9] = crc & 0xFF;
+	buf[10] = crc >> 8;
+	TEST_ASSERT_TRUE(OneWire::check_crc16(buf, 9, buf + 9));
+	buf[3] ^= 0x10;
+	TEST_ASSERT_FALSE(OneWire::check_crc16(buf, 9, buf + 9));
+}
+
+// not a pass/fail check: ns per call for the buffers 1-Wire actually sees
+void test_benchmark(void)
+{
+	static const uint8_t lengths[] = { 8, 11, 32 };
+	uint8_t buf[32];
+	volatile uint16_t sink = 0;
+	char line[96];
+
+	for (uint8_t i = 0; i < sizeof buf; i++) buf[i] = i * 37 + 11;
+	for (uint8_t l = 0; l < sizeof lengths; l++) {
+		const uint32_t calls = 2000000;
+		uint8_t len = lengths[l];
+
+		auto t0 = std::chrono::steady_clock::now();
+		for (uint32_t n = 0; n < calls; n++) {
+			buf[0] = n;
+			sink += OneWire::crc8(buf, len);
+		}
+		auto t1 = std::chrono::steady_clock::now();
+		for (uint32_t n = 0; n < calls; n++) {
+			buf[0] = n;
+			sink += OneWire::crc16(buf, len);
+		}
+		auto t2 = std::chrono::steady_clock::now();
+
+		snprintf(line, sizeof line, "kernel %d, %2u bytes: crc8 %.1f ns, crc16 %.1f ns",
+		         ONEWIRE_CRC8_TABLE, len,
+		         std::chrono::duration<double, std::nano>(t1 - t0).count() / calls,
+		         std::chrono::duration<double, std::nano>(t2 - t1).count() / calls);
+		TEST_MESSAGE(line);
+	}
+	(void)sink;
+}
+
+int main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+	UNITY_BEGIN();
+	RUN_TEST(test_known_vectors);
+	RUN_TEST(test_all_short_inputs);
+	RUN_TEST(test_random_buffers);
+	RUN_TEST(test_check_crc16);
+	RUN_TEST(test_benchmark);
+	return UNITY_END();
+}
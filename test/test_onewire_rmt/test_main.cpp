@@ -0,0 +1,136 @@
+// OneWireRmt against the simulated RMT channel: slot encoding, search and
+// scratchpad reads, and the strong pullup for parasite powered devices.
+
+#include <Arduino.h>
+#include <OneWire.h>
+#include <DallasTemperature.h>
+#include <OneWireSim.h>
+#include <DS18B20Sim.h>
+#include <unity.h>
+
+#define BUS_PIN     4
+#define PROBES      4
+
+static OneWireSimBus *bus;
+static DS18B20Sim *probes[PROBES];
+static OneWireSimRmtChannel *channel;
+static OneWireRmt *rmt;
+static OneWire *wire;
+static DallasTemperature *sensors;
+
+void setUp(void)
+{
+	OneWireSimClock::reset();
+	bus = new OneWireSimBus(BUS_PIN);
+	for (uint8_t i = 0; i < PROBES; i++) {
+		uint8_t rom[8];
+
+		OneWireSimDevice::makeRom(0x28, 0x1000 + i * 0x11, rom);
+		probes[i] = new DS18B20Sim(rom, true);
+		probes[i]->setTemperature(-10.5f + i * 10);
+		bus->attach(probes[i]);
+	}
+	channel = new OneWireSimRmtChannel(bus);
+	rmt = new OneWireRmt(channel);
+	wire = new OneWire(rmt);
+	sensors = new DallasTemperature(wire);
+}
+
+void tearDown(void)
+{
+	delete sensors;
+	delete wire;
+	delete rmt;
+	delete channel;
+	for (uint8_t i = 0; i < PROBES; i++) delete probes[i];
+	delete bus;
+}
+
+void test_encode_slots(void)
+{
+	OneWireRmtSymbol tx[ONEWIRE_RMT_MAX_SYMBOLS];
+
+	TEST_ASSERT_EQUAL(9, OneWireRmt::encodeSlots(tx, 0xA5, 8));
+	for (uint8_t i = 0; i < 8; i++) {
+		uint16_t low = (0xA5 >> i) & 1 ? ONEWIRE_RMT_WRITE1_LOW : ONEWIRE_RMT_WRITE0_LOW;
+
+		TEST_ASSERT_EQUAL(0, tx[i].level0);
+		TEST_ASSERT_EQUAL(low, tx[i].duration0);
+		TEST_ASSERT_EQUAL(ONEWIRE_RMT_SLOT, tx[i].duration0 + tx[i].duration1);
+	}
+	TEST_ASSERT_EQUAL(0, tx[8].duration0);
+
+	// read slots release the bus earlier than write-1 slots
+	TEST_ASSERT_EQUAL(3, OneWireRmt::encodeSlots(tx, 0xFF, 2, ONEWIRE_RMT_READ_LOW));
+	TEST_ASSERT_EQUAL(ONEWIRE_RMT_READ_LOW, tx[0].duration0);
+	TEST_ASSERT_EQUAL(ONEWIRE_RMT_READ_LOW, tx[1].duration0);
+}
+
+void test_search_and_read_over_rmt(void)
+{
+	sensors->begin();
+	TEST_ASSERT_EQUAL(PROBES, sensors->getDeviceCount());
+	TEST_ASSERT_TRUE(sensors->isParasitePowerMode());
+
+	sensors->requestTemperatures();
+	for (uint8_t i = 0; i < PROBES; i++) {
+		TEST_ASSERT_FLOAT_WITHIN(0.0625f, -10.5f + i * 10, sensors->getTempC(probes[i]->rom()));
+	}
+}
+
+void test_write_with_power_holds_the_bus_high(void)
+{
+	sensors->begin();
+	wire->reset();
+	wire->select(probes[2]->rom());
+	wire->write(0x44, 1);
+	delay(750);
+	wire->depower();
+	TEST_ASSERT_EQUAL(1, probes[2]->conversions());
+	TEST_ASSERT_FLOAT_WITHIN(0.0625f, 9.5f, sensors->getTempC(probes[2]->rom()));
+
+	// write_bytes() with power set, a Skip ROM + Convert T in one go
+	static const uint8_t convert[2] = { 0xCC, 0x44 };
+	for (uint8_t i = 0; i < PROBES; i++) probes[i]->setTemperature(30.0f + i);
+	wire->reset();
+	wire->write_bytes(convert, 2, true);
+	delay(750);
+	for (uint8_t i = 0; i < PROBES; i++) {
+		TEST_ASSERT_FLOAT_WITHIN(0.0625f, 30.0f + i, sensors->getTempC(probes[i]->rom()));
+	}
+}
+
+void test_write_without_power_browns_out(void)
+{
+	sensors->begin();
+	wire->reset();
+	wire->select(probes[1]->rom());
+	wire->write(0x44, 0);
+	delay(750);
+	TEST_ASSERT_FLOAT_WITHIN(0.0625f, 85.0f, sensors->getTempC(probes[1]->rom()));
+}
+
+void test_depower_ends_the_strong_pullup(void)
+{
+	sensors->begin();
+	wire->reset();
+	wire->select(probes[3]->rom());
+	wire->write(0x44, 1);
+	delay(10);
+	wire->depower();
+	delay(750);
+	TEST_ASSERT_FLOAT_WITHIN(0.0625f, 85.0f, sensors->getTempC(probes[3]->rom()));
+}
+
+int main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+	UNITY_BEGIN();
+	RUN_TEST(test_encode_slots);
+	RUN_TEST(test_search_and_read_over_rmt);
+	RUN_TEST(test_write_with_power_holds_the_bus_high);
+	RUN_TEST(test_write_without_power_browns_out);
+	RUN_TEST(test_depower_ends_the_strong_pullup);
+	return UNITY_END();
+}
@@ -0,0 +1,226 @@
+// OneWire and DallasTemperature against the simulated bus: search, ROM
+// and scratchpad CRCs, conditional (alarm) search and conversion timing.
+
+#include <Arduino.h>
+#include <OneWire.h>
+#include <DallasTemperature.h>
+#include <OneWireSim.h>
+#include <DS18B20Sim.h>
+#include <unity.h>
+
+#define BUS_PIN     4
+#define PROBES      10
+
+static OneWireSimBus *bus;
+static DS18B20Sim *probes[PROBES];
+static OneWire *wire;
+static DallasTemperature *sensors;
+
+void setUp(void)
+{
+	OneWireSimClock::reset();
+	bus = new OneWireSimBus(BUS_PIN);
+	for (uint8_t i = 0; i < PROBES; i++) {
+		uint8_t rom[8];
+
+		// serials close together so that the search has to branch deep
+		OneWireSimDevice::makeRom(0x28, 0x0000A5A50000ULL + i * 0x0101, rom);
+		probes[i] = new DS18B20Sim(rom);
+		probes[i]->setTemperature(20.0f + i);
+		bus->attach(probes[i]);
+	}
+	wire = new OneWire(BUS_PIN);
+	sensors = new DallasTemperature(wire);
+}
+
+void tearDown(void)
+{
+	delete sensors;
+	delete wire;
+	for (uint8_t i = 0; i < PROBES; i++) delete probes[i];
+	delete bus;
+}
+
+static int findProbe(const uint8_t *rom)
+{
+	for (uint8_t i = 0; i < PROBES; i++) {
+		if (!memcmp(probes[i]->rom(), rom, 8)) return i;
+	}
+	return -1;
+}
+
+static uint8_t searchAll(bool conditional, bool found[PROBES])
+{
+	uint8_t rom[8];
+	uint8_t n = 0;
+
+	for (uint8_t i = 0; i < PROBES; i++) found[i] = false;
+	wire->reset_search();
+	while (wire->search(rom, !conditional)) {
+		int i = findProbe(rom);
+
+		TEST_ASSERT_TRUE(i >= 0);
+		TEST_ASSERT_FALSE(found[i]);
+		found[i] = true;
+		n++;
+	}
+	return n;
+}
+
+void test_search_finds_every_device(void)
+{
+	bool found[PROBES];
+
+	TEST_ASSERT_EQUAL(PROBES, searchAll(false, found));
+	sensors->begin();
+	TEST_ASSERT_EQUAL(PROBES, sensors->getDeviceCount());
+	TEST_ASSERT_EQUAL(PROBES, sensors->getDS18Count());
+}
+
+void test_search_follows_detach_and_attach(void)
+{
+	bool found[PROBES];
+
+	bus->detach(probes[3]);
+	bus->detach(probes[7]);
+	TEST_ASSERT_EQUAL(PROBES - 2, searchAll(false, found));
+	TEST_ASSERT_FALSE(found[3]);
+	TEST_ASSERT_FALSE(found[7]);
+
+	bus->attach(probes[7]);
+	TEST_ASSERT_EQUAL(PROBES - 1, searchAll(false, found));
+	TEST_ASSERT_TRUE(found[7]);
+}
+
+void test_search_on_empty_bus(void)
+{
+	uint8_t rom[8];
+
+	for (uint8_t i = 0; i < PROBES; i++) bus->detach(probes[i]);
+	TEST_ASSERT_EQUAL(0, wire->reset());
+	wire->reset_search();
+	TEST_ASSERT_FALSE(wire->search(rom));
+}
+
+void test_rom_crc(void)
+{
+	// Maxim application note 27: family 0x02, serial 0x00000001B81C
+	static const uint8_t an27[7] = { 0x02, 0x1C, 0xB8, 0x01, 0x00, 0x00, 0x00 };
+	uint8_t rom[8];
+
+	TEST_ASSERT_EQUAL_HEX8(0xA2, OneWire::crc8(an27, 7));
+	OneWireSimDevice::makeRom(0x02, 0x00000001B81CULL, rom);
+	TEST_ASSERT_EQUAL_HEX8(0xA2, rom[7]);
+
+	wire->reset_search();
+	while (wire->search(rom)) {
+		TEST_ASSERT_EQUAL_HEX8(rom[7], OneWire::crc8(rom, 7));
+		TEST_ASSERT_TRUE(sensors->validAddress(rom));
+	}
+}
+
+void test_scratchpad_crc_error_is_detected(void)
+{
+	uint8_t sp[9];
+
+	sensors->begin();
+	probes[2]->injectCrcErrors(1);
+	TEST_ASSERT_FALSE(sensors->isConnected(probes[2]->rom(), sp));
+	TEST_ASSERT_TRUE(sensors->isConnected(probes[2]->rom(), sp));
+	TEST_ASSERT_EQUAL_HEX8(sp[8], OneWire::crc8(sp, 8));
+}
+
+void test_alarm_search_returns_only_alarmed_devices(void)
+{
+	uint8_t rom[8];
+	bool found[PROBES];
+
+	sensors->begin();
+	for (uint8_t i = 0; i < PROBES; i++) {
+		// window 22..26 C: probes 0..2 (20..22 C) and 6..9 (26..29 C) alarm
+		sensors->setAlarmTemps(probes[i]->rom(), 22, 26);
+	}
+	sensors->requestTemperatures();
+
+	TEST_ASSERT_EQUAL(7, searchAll(true, found));
+	for (uint8_t i = 0; i < PROBES; i++) {
+		TEST_ASSERT_EQUAL(i <= 2 || i >= 6, found[i]);
+	}
+
+	uint8_t n = 0;
+	sensors->resetAlarmSearch();
+	while (sensors->alarmSearch(rom)) n++;
+	TEST_ASSERT_EQUAL(7, n);
+
+	// nothing alarms once the window covers everything
+	for (uint8_t i = 0; i < PROBES; i++) sensors->setAlarmTemps(probes[i]->rom(), 0, 40);
+	sensors->requestTemperatures();
+	TEST_ASSERT_EQUAL(0, searchAll(true, found));
+	TEST_ASSERT_FALSE(sensors->hasAlarm());
+}
+
+void test_conversion_time_follows_resolution(void)
+{
+	sensors->begin();
+	for (uint8_t resolution = 9; resolution <= 12; resolution++) {
+		uint32_t expected = DS18B20Sim::conversionMicros(resolution);
+
+		sensors->setResolution(resolution);
+		TEST_ASSERT_EQUAL(resolution, probes[0]->resolution());
+
+		// polled: done within a few slots of the datasheet time
+		sensors->setCheckForConversion(true);
+		OneWireSimStats before = bus->stats();
+		sensors->requestTemperatures();
+		uint64_t polled = (bus->stats() - before).micros;
+		TEST_ASSERT_GREATER_OR_EQUAL(expected, polled);
+		TEST_ASSERT_LESS_OR_EQUAL(expected + 5000, polled);
+
+		// fixed delay: millisToWaitForConversion() covers the datasheet time
+		sensors->setCheckForConversion(false);
+		before = bus->stats();
+		sensors->requestTemperatures();
+		uint64_t fixed = (bus->stats() - before).micros;
+		TEST_ASSERT_GREATER_OR_EQUAL(expected, fixed);
+		TEST_ASSERT_GREATER_OR_EQUAL(expected, sensors->millisToWaitForConversion() * 1000UL);
+
+		TEST_ASSERT_EQUAL_INT32(probes[4]->scratchpad()[0] | probes[4]->scratchpad()[1] << 8,
+		                        sensors->getTemp(probes[4]->rom()) >> 3);
+	}
+	TEST_ASSERT_FLOAT_WITHIN(0.0625f, 24.0f, sensors->getTempC(probes[4]->rom()));
+}
+
+void test_parasite_conversion_needs_strong_pullup(void)
+{
+	for (uint8_t i = 0; i < PROBES; i++) probes[i]->setParasite(true);
+	sensors->begin();
+	TEST_ASSERT_TRUE(sensors->isParasitePowerMode());
+
+	// DallasTemperature keeps the pin driven high while converting
+	sensors->requestTemperatures();
+	TEST_ASSERT_FLOAT_WITHIN(0.0625f, 21.0f, sensors->getTempC(probes[1]->rom()));
+
+	// without it the probe browns out and comes back with 85 C
+	probes[1]->setTemperature(30.0f);
+	wire->reset();
+	wire->select(probes[1]->rom());
+	wire->write(0x44, 0);
+	delay(750);
+	TEST_ASSERT_FLOAT_WITHIN(0.0625f, 85.0f, sensors->getTempC(probes[1]->rom()));
+}
+
+int main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+	UNITY_BEGIN();
+	RUN_TEST(test_search_finds_every_device);
+	RUN_TEST(test_search_follows_detach_and_attach);
+	RUN_TEST(test_search_on_empty_bus);
+	RUN_TEST(test_rom_crc);
+	RUN_TEST(test_scratchpad_crc_error_is_detected);
+	RUN_TEST(test_alarm_search_returns_only_alarmed_devices);
+	RUN_TEST(test_conversion_time_follows_resolution);
+	RUN_TEST(test_parasite_conversion_needs_strong_pullup);
+	return UNITY_END();
+}
@@ -0,0 +1,268 @@
+// OneWireTopology against the simulated bus: enumeration, hot-plug in
+// both directions, family filtering and the removal debounce.
+//
+// test_bus_time puts 32 probes on the bus and checks on OneWireSim's clock
+// that a poll costs a single search pass, some 15 ms of bus time, against
+// the hundreds of ms a full search() of the bus takes.
+
+#include <Arduino.h>
+#include <OneWire.h>
+#include <OneWireTopology.h>
+#include <OneWireSim.h>
+#include <DS18B20Sim.h>
+#include <unity.h>
+
+#include <algorithm>
+
+#define BUS_PIN     4
+#define PROBES      12
+#define DS18B20     0x28
+
+static OneWireSimBus *bus;
+static DS18B20Sim *probes[PROBES];
+static OneWire *wire;
+static OneWireTopology *topology;
+
+static uint8_t added, removed;
+static uint8_t lastRom[8];
+
+static void onChange(const uint8_t *rom, bool isAdded)
+{
+	if (isAdded) added++;
+	else removed++;
+	memcpy(lastRom, rom, 8);
+}
+
+void setUp(void)
+{
+	OneWireSimClock::reset();
+	bus = new OneWireSimBus(BUS_PIN);
+	for (uint8_t i = 0; i < PROBES; i++) {
+		uint8_t rom[8];
+
+		OneWireSimDevice::makeRom(DS18B20, 0x3C5A00 + i * 37, rom);
+		probes[i] = new DS18B20Sim(rom);
+	}
+	// the last two are plugged in by the tests
+	for (uint8_t i = 0; i < PROBES - 2; i++) bus->attach(probes[i]);
+	wire = new OneWire(BUS_PIN);
+	topology = new OneWireTopology(wire, DS18B20);
+	topology->setHandler(onChange);
+	added = removed = 0;
+}
+
+void tearDown(void)
+{
+	delete topology;
+	delete wire;
+	for (uint8_t i = 0; i < PROBES; i++) delete probes[i];
+	delete bus;
+}
+
+// polls until something is reported or 'limit' polls have passed,
+// returns the number of polls
+static uint8_t pollUntilEvent(uint8_t limit)
+{
+	for (uint8_t n = 1; n <= limit; n++) {
+		if (topology->poll()) return n;
+	}
+	return 0;
+}
+
+void test_begin_enumerates_the_bus(void)
+{
+	TEST_ASSERT_EQUAL(PROBES - 2, topology->begin());
+	TEST_ASSERT_EQUAL(PROBES - 2, added);
+	for (uint8_t i = 0; i < PROBES - 2; i++) TEST_ASSERT_TRUE(topology->contains(probes[i]->rom()));
+	TEST_ASSERT_FALSE(topology->contains(probes[PROBES - 1]->rom()));
+}
+
+void test_quiet_bus_reports_nothing(void)
+{
+	topology->begin();
+	added = 0;
+	for (uint8_t i = 0; i < 3 * PROBES; i++) TEST_ASSERT_EQUAL(0, topology->poll());
+	TEST_ASSERT_EQUAL(0, added);
+	TEST_ASSERT_EQUAL(0, removed);
+}
+
+void test_attached_device_is_found_within_one_round(void)
+{
+	topology->begin();
+	added = 0;
+	bus->attach(probes[PROBES - 1]);
+	TEST_ASSERT_NOT_EQUAL(0, pollUntilEvent(PROBES));
+	TEST_ASSERT_EQUAL(1, added);
+	TEST_ASSERT_EQUAL_MEMORY(probes[PROBES - 1]->rom(), lastRom, 8);
+	TEST_ASSERT_EQUAL(PROBES - 1, topology->count());
+
+	// and one more, on a different branch
+	bus->attach(probes[PROBES - 2]);
+	TEST_ASSERT_NOT_EQUAL(0, pollUntilEvent(PROBES));
+	TEST_ASSERT_EQUAL(2, added);
+	TEST_ASSERT_EQUAL(PROBES, topology->count());
+}
+
+void test_detached_device_is_removed_after_two_misses(void)
+{
+	topology->begin();
+	bus->detach(probes[4]);
+
+	// the guided passes notice the gap, then the directed pass has to miss twice
+	uint8_t polls = pollUntilEvent(2 * PROBES);
+	TEST_ASSERT_NOT_EQUAL(0, polls);
+	TEST_ASSERT_EQUAL(1, removed);
+	TEST_ASSERT_EQUAL_MEMORY(probes[4]->rom(), lastRom, 8);
+	TEST_ASSERT_FALSE(topology->contains(probes[4]->rom()));
+	TEST_ASSERT_EQUAL(PROBES - 3, topology->count());
+
+	// a suspect is verified on the next poll: the first miss is kept,
+	// the second removes it
+	topology->suspect(probes[5]->rom());
+	bus->detach(probes[5]);
+	TEST_ASSERT_EQUAL(0, topology->poll());
+	TEST_ASSERT_TRUE(topology->contains(probes[5]->rom()));
+	TEST_ASSERT_EQUAL(1, topology->poll());
+	TEST_ASSERT_FALSE(topology->contains(probes[5]->rom()));
+	TEST_ASSERT_EQUAL(2, removed);
+}
+
+void test_single_miss_does_not_remove(void)
+{
+	topology->begin();
+	topology->suspect(probes[6]->rom());
+
+	// one directed pass misses (the probe drops off for a moment) ...
+	bus->detach(probes[6]);
+	TEST_ASSERT_EQUAL(0, topology->poll());
+	bus->attach(probes[6]);
+
+	// ... the next finds it again, which clears the miss
+	TEST_ASSERT_EQUAL(0, topology->poll());
+	TEST_ASSERT_TRUE(topology->contains(probes[6]->rom()));
+
+	// so a later single miss starts counting from zero again
+	topology->suspect(probes[6]->rom());
+	bus->detach(probes[6]);
+	TEST_ASSERT_EQUAL(0, topology->poll());
+	bus->attach(probes[6]);
+	for (uint8_t i = 0; i < 2 * PROBES; i++) topology->poll();
+	TEST_ASSERT_EQUAL(0, removed);
+	TEST_ASSERT_EQUAL(PROBES - 2, topology->count());
+}
+
+void test_suspect_of_a_present_device_is_cleared(void)
+{
+	topology->begin();
+	topology->suspect(probes[2]->rom());
+	for (uint8_t i = 0; i < 3; i++) TEST_ASSERT_EQUAL(0, topology->poll());
+	TEST_ASSERT_EQUAL(0, removed);
+}
+
+void test_other_families_are_ignored(void)
+{
+	uint8_t rom[8];
+
+	OneWireSimDevice::makeRom(0x10, 0x3C5A00, rom);
+	DS18B20Sim other(rom);
+	bus->attach(&other);
+
+	TEST_ASSERT_EQUAL(PROBES - 2, topology->begin());
+	for (uint8_t i = 0; i < 3 * PROBES; i++) topology->poll();
+	TEST_ASSERT_FALSE(topology->contains(rom));
+	TEST_ASSERT_EQUAL(PROBES - 2, added);
+	bus->detach(&other);
+}
+
+void test_empty_bus(void)
+{
+	for (uint8_t i = 0; i < PROBES; i++) bus->detach(probes[i]);
+	TEST_ASSERT_EQUAL(0, topology->begin());
+	TEST_ASSERT_EQUAL(0, topology->poll());
+
+	bus->attach(probes[0]);
+	TEST_ASSERT_EQUAL(1, topology->poll());
+	TEST_ASSERT_EQUAL(1, topology->count());
+
+	// everything unplugged: no presence pulse at all
+	bus->detach(probes[0]);
+	TEST_ASSERT_NOT_EQUAL(0, pollUntilEvent(4));
+	TEST_ASSERT_EQUAL(0, topology->count());
+}
+
+void test_bus_time(void)
+{
+	const uint8_t extra = 22;
+	DS18B20Sim *more[extra];
+	uint8_t rom[8];
+
+	for (uint8_t i = 0; i < extra; i++) {
+		OneWireSimDevice::makeRom(DS18B20, 0x7A0000 + i * 101, rom);
+		more[i] = new DS18B20Sim(rom);
+		bus->attach(more[i]);
+	}
+	TEST_ASSERT_EQUAL(PROBES - 2 + extra, topology->begin());
+
+	// a full search, as a poll without the tracker would do
+	uint64_t start = OneWireSimClock::now();
+	uint8_t found = 0;
+	wire->reset_search();
+	while (wire->search(rom)) found++;
+	uint64_t search = OneWireSimClock::now() - start;
+	TEST_ASSERT_EQUAL(PROBES - 2 + extra, found);
+
+	// a round of polls over the known set, the slowest one
+	uint64_t slowest = 0;
+	for (uint8_t i = 0; i < topology->count(); i++) {
+		start = OneWireSimClock::now();
+		TEST_ASSERT_EQUAL(0, topology->poll());
+		slowest = std::max(slowest, OneWireSimClock::now() - start);
+	}
+
+	// a verification of a suspect
+	topology->suspect(more[7]->rom());
+	start = OneWireSimClock::now();
+	TEST_ASSERT_EQUAL(0, topology->poll());
+	uint64_t verify = OneWireSimClock::now() - start;
+
+	// a probe plugged in is found within a round, each poll one pass
+	bus->attach(probes[PROBES - 1]);
+	uint8_t polls = 0;
+	uint64_t pass;
+	do {
+		TEST_ASSERT_TRUE(polls++ <= topology->count());
+		start = OneWireSimClock::now();
+	} while (!topology->poll());
+	pass = OneWireSimClock::now() - start;
+
+	printf("32 probes: full search %.1f ms, poll at most %.1f ms, verification %.1f ms, "
+		"new probe found in poll %u by a pass of %.1f ms\n",
+		search / 1000.0, slowest / 1000.0, verify / 1000.0, polls, pass / 1000.0);
+	// one pass of the 32 a search needs
+	TEST_ASSERT_TRUE(slowest < 20000);
+	TEST_ASSERT_TRUE(slowest * 16 < search);
+	TEST_ASSERT_TRUE(verify < 20000);
+	TEST_ASSERT_TRUE(pass < 20000);
+
+	for (uint8_t i = 0; i < extra; i++) {
+		bus->detach(more[i]);
+		delete more[i];
+	}
+}
+
+int main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+	UNITY_BEGIN();
+	RUN_TEST(test_begin_enumerates_the_bus);
+	RUN_TEST(test_quiet_bus_reports_nothing);
+	RUN_TEST(test_attached_device_is_found_within_one_round);
+	RUN_TEST(test_detached_device_is_removed_after_two_misses);
+	RUN_TEST(test_single_miss_does_not_remove);
+	RUN_TEST(test_suspect_of_a_present_device_is_cleared);
+	RUN_TEST(test_other_families_are_ignored);
+	RUN_TEST(test_empty_bus);
+	RUN_TEST(test_bus_time);
+	return UNITY_END();
+}
@@ -0,0 +1,297 @@
+// TelemetryPipeline on host threads.  SpscQueue between two threads
+// keeps every item and their order; every sample reaches both consumers
+// in order; a consumer that falls behind loses samples only for itself,
+// counted, and end() still hands it what was queued; a consumer idles
+// every period and never with period 0; an overrun of the acquire handler
+// skips the periods it missed instead of catching up in a burst.
+//
+// Run under ThreadSanitizer with pio test -e native_tsan.
+//
+// test_benchmark prints what an item through the SpscQueue costs and the
+// latency histograms of a pipeline sampling every millisecond.
+
+#include <TelemetryPipeline.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static TelemetryPipeline *pipeline;
+static uint32_t next;
+static std::vector<int32_t> stored, published;
+static std::vector<Clock::time_point> calls;
+static uint32_t storeIdle, publishIdle;
+static uint32_t overrunAt, storeDelay, publishDelay;
+
+static bool acquire(TelemetrySample *sample)
+{
+	calls.push_back(Clock::now());
+	if (overrunAt && calls.size() == overrunAt) std::this_thread::sleep_for(std::chrono::milliseconds(75));
+	sample->time = 1700000000 + next;
+	sample->raw = next++;
+	sample->probe = 0;
+	return true;
+}
+
+static bool acquireNothing(TelemetrySample *sample)
+{
+	(void)sample;
+	return false;
+}
+
+static void store(const TelemetrySample &sample)
+{
+	stored.push_back(sample.raw);
+	if (storeDelay) std::this_thread::sleep_for(std::chrono::milliseconds(storeDelay));
+}
+
+static void publish(const TelemetrySample &sample)
+{
+	published.push_back(sample.raw);
+	if (publishDelay) std::this_thread::sleep_for(std::chrono::milliseconds(publishDelay));
+}
+
+static void storeIdleHandler(void)
+{
+	storeIdle++;
+}
+
+static void publishIdleHandler(void)
+{
+	publishIdle++;
+}
+
+static void configure(TelemetryStage stage, uint32_t period)
+{
+	TelemetryTaskConfig config = pipeline->config(stage);
+
+	config.period = period;
+	pipeline->configure(stage, config);
+}
+
+// runs the pipeline for 'ms'; everything the tasks wrote may be read after
+static void run(uint32_t ms)
+{
+	TEST_ASSERT_TRUE(pipeline->begin());
+	std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+	pipeline->end();
+}
+
+// what a consumer got: increasing, and all of them if none was dropped
+static void assertInOrder(const std::vector<int32_t> &got, uint32_t dropped)
+{
+	TEST_ASSERT_EQUAL_UINT32(pipeline->acquired() - dropped, got.size());
+	for (size_t i = 1; i < got.size(); i++) TEST_ASSERT_TRUE(got[i] > got[i - 1]);
+	if (!dropped) {
+		for (size_t i = 0; i < got.size(); i++) TEST_ASSERT_EQUAL_INT32(i, got[i]);
+	}
+}
+
+void setUp(void)
+{
+	next = 0;
+	stored.clear();
+	published.clear();
+	calls.clear();
+	storeIdle = publishIdle = 0;
+	overrunAt = storeDelay = publishDelay = 0;
+	pipeline = new TelemetryPipeline();
+	pipeline->onAcquire(acquire);
+	pipeline->onStore(store);
+	pipeline->onPublish(publish);
+	pipeline->onIdle(TELEMETRY_STORE, storeIdleHandler);
+	pipeline->onIdle(TELEMETRY_PUBLISH, publishIdleHandler);
+	configure(TELEMETRY_ACQUIRE, 1);
+	configure(TELEMETRY_STORE, 0);
+	configure(TELEMETRY_PUBLISH, 0);
+}
+
+void tearDown(void)
+{
+	delete pipeline;
+}
+
+void test_spsc_queue_between_threads(void)
+{
+	const uint32_t items = 1000000;
+	SpscQueue<uint32_t, 16> queue;
+	uint32_t item;
+
+	// all N slots, then full
+	for (uint32_t i = 0; i < 16; i++) TEST_ASSERT_TRUE(queue.push(i));
+	TEST_ASSERT_FALSE(queue.push(16));
+	TEST_ASSERT_EQUAL_UINT32(16, queue.size());
+	for (uint32_t i = 0; i < 16; i++) {
+		TEST_ASSERT_TRUE(queue.pop(&item));
+		TEST_ASSERT_EQUAL_UINT32(i, item);
+	}
+	TEST_ASSERT_FALSE(queue.pop(&item));
+	TEST_ASSERT_TRUE(queue.isEmpty());
+
+	// a producer that retries on full, a consumer that checks each one;
+	// both yield rather than spin, for a host with a single core
+	uint32_t wrong = 0;
+	std::thread consumer([&queue, &wrong, items] {
+		uint32_t expected = 0, got;
+		while (expected < items) {
+			if (!queue.pop(&got)) {
+				std::this_thread::yield();
+				continue;
+			}
+			if (got != expected) wrong++;
+			expected++;
+		}
+	});
+	for (uint32_t i = 0; i < items; i++) {
+		while (!queue.push(i)) std::this_thread::yield();
+	}
+	consumer.join();
+	TEST_ASSERT_EQUAL_UINT32(0, wrong);
+	TEST_ASSERT_TRUE(queue.isEmpty());
+}
+
+void test_histogram(void)
+{
+	TelemetryHistogram h;
+
+	TEST_ASSERT_EQUAL_UINT32(0, h.percentile(50));
+	h.add(0);
+	h.add(1);
+	h.add(2);
+	h.add(3);
+	h.add(4);
+	TEST_ASSERT_EQUAL_UINT32(1, h.bucket(0));
+	TEST_ASSERT_EQUAL_UINT32(1, h.bucket(1));
+	TEST_ASSERT_EQUAL_UINT32(2, h.bucket(2));
+	TEST_ASSERT_EQUAL_UINT32(1, h.bucket(3));
+	TEST_ASSERT_EQUAL_UINT32(5, h.count());
+	TEST_ASSERT_EQUAL_UINT32(4, h.max());
+
+	// 90 fast, 9 slower, one very slow
+	h.clear();
+	for (int i = 0; i < 90; i++) h.add(100);
+	for (int i = 0; i < 9; i++) h.add(3000);
+	h.add(10000000);
+	TEST_ASSERT_EQUAL_UINT32(127, h.percentile(50));
+	TEST_ASSERT_EQUAL_UINT32(127, h.percentile(90));
+	TEST_ASSERT_EQUAL_UINT32(4095, h.percentile(99));
+	// the last bucket has no upper end but the largest one seen
+	TEST_ASSERT_EQUAL_UINT32(10000000, h.percentile(100));
+	TEST_ASSERT_EQUAL_UINT32(1, h.bucket(TELEMETRY_HISTOGRAM_BUCKETS - 1));
+}
+
+void test_every_sample_reaches_both_consumers(void)
+{
+	run(200);
+	TEST_ASSERT_TRUE(pipeline->acquired() > 50);
+	TEST_ASSERT_EQUAL_UINT32(0, pipeline->dropped(TELEMETRY_STORE));
+	TEST_ASSERT_EQUAL_UINT32(0, pipeline->dropped(TELEMETRY_PUBLISH));
+	assertInOrder(stored, 0);
+	assertInOrder(published, 0);
+	TEST_ASSERT_EQUAL_UINT32(pipeline->acquired(), pipeline->latency(TELEMETRY_STORE).count());
+	TEST_ASSERT_EQUAL_UINT32(pipeline->acquired(), pipeline->latency(TELEMETRY_PUBLISH).count());
+}
+
+void test_slow_consumer_drops_only_its_own(void)
+{
+	// publishing takes 20 samples' time for each one
+	publishDelay = 20;
+	run(300);
+	uint32_t dropped = pipeline->dropped(TELEMETRY_PUBLISH);
+	TEST_ASSERT_TRUE(dropped > 0);
+	TEST_ASSERT_EQUAL_UINT32(0, pipeline->dropped(TELEMETRY_STORE));
+	assertInOrder(stored, 0);
+	// what was queued when end() came was still published
+	assertInOrder(published, dropped);
+	TEST_ASSERT_TRUE(published.size() > TELEMETRY_QUEUE_DEPTH);
+	// and sampling kept its schedule
+	TEST_ASSERT_TRUE(pipeline->acquired() > 100);
+}
+
+void test_idle_every_period_and_never_with_period_0(void)
+{
+	pipeline->onAcquire(acquireNothing);
+	configure(TELEMETRY_STORE, 5);
+	run(200);
+	TEST_ASSERT_EQUAL_UINT32(0, pipeline->acquired());
+	// some 40, fewer if the host is busy, never more
+	TEST_ASSERT_TRUE(storeIdle >= 10);
+	TEST_ASSERT_TRUE(storeIdle <= 42);
+	TEST_ASSERT_EQUAL_UINT32(0, publishIdle);
+}
+
+void test_overrun_skips_periods(void)
+{
+	// the third call takes almost four periods
+	configure(TELEMETRY_ACQUIRE, 20);
+	overrunAt = 3;
+	run(300);
+	TEST_ASSERT_TRUE(calls.size() > overrunAt + 3);
+	// one call right after the overrun for the period it ended in, none
+	// for the three it missed, and back on the schedule after that
+	for (size_t i = 1; i < calls.size(); i++) {
+		double gap = std::chrono::duration<double, std::milli>(calls[i] - calls[i - 1]).count();
+		TEST_ASSERT_TRUE(gap > 2.5);
+	}
+	TEST_ASSERT_TRUE(pipeline->latency(TELEMETRY_ACQUIRE).max() >= 1000);
+	TEST_ASSERT_TRUE(pipeline->latency(TELEMETRY_ACQUIRE).max() < 20000);
+}
+
+static void printHistogram(const char *name, const TelemetryHistogram &h)
+{
+	printf("%-8s %6lu samples: p50 < %lu us, p99 < %lu us, max %lu us\n", name, (unsigned long)h.count(),
+		(unsigned long)h.percentile(50) + 1, (unsigned long)h.percentile(99) + 1, (unsigned long)h.max());
+}
+
+void test_benchmark(void)
+{
+	const uint32_t items = 2000000;
+	SpscQueue<TelemetrySample, TELEMETRY_QUEUE_DEPTH> queue;
+	TelemetrySample sample = {};
+
+	auto start = Clock::now();
+	std::thread consumer([&queue, items] {
+		TelemetrySample got;
+		for (uint32_t n = 0; n < items;) {
+			if (queue.pop(&got)) {
+				n++;
+			} else {
+				std::this_thread::yield();
+			}
+		}
+	});
+	for (uint32_t i = 0; i < items; i++) {
+		sample.raw = i;
+		while (!queue.push(sample)) std::this_thread::yield();
+	}
+	consumer.join();
+	double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / items;
+	printf("SpscQueue of %u samples between two threads: %.1f ns a sample\n", TELEMETRY_QUEUE_DEPTH, ns);
+
+	// a sample every millisecond for two seconds
+	run(2000);
+	for (uint8_t stage = 0; stage < TELEMETRY_STAGES; stage++) {
+		static const char *names[TELEMETRY_STAGES] = { "acquire", "store", "publish" };
+		printHistogram(names[stage], pipeline->latency((TelemetryStage)stage));
+	}
+	TEST_ASSERT_EQUAL_UINT32(0, pipeline->dropped(TELEMETRY_STORE) + pipeline->dropped(TELEMETRY_PUBLISH));
+}
+
+int main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+	UNITY_BEGIN();
+	RUN_TEST(test_spsc_queue_between_threads);
+	RUN_TEST(test_histogram);
+	RUN_TEST(test_every_sample_reaches_both_consumers);
+	RUN_TEST(test_slow_consumer_drops_only_its_own);
+	RUN_TEST(test_idle_every_period_and_never_with_period_0);
+	RUN_TEST(test_overrun_skips_periods);
+	RUN_TEST(test_benchmark);
+	return UNITY_END();
+}
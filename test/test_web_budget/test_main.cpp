@@ -0,0 +1,421 @@
+// AsyncWebServer's memory budget against AsyncTCPSim: whatever way a
+// connection ends, rejected, refused on probation, dropped mid-headers,
+// mid-body or mid-response, timed out, kept alive, pipelined or upgraded
+// to a WebSocket, everything it charged goes back, no more and no less.
+//
+// An idle connection holds its charge throughout each test, so a release
+// of more than was charged shows up as less than that, and is not hidden
+// by the budget's floor at zero.
+//
+// test_burst_of_hundreds_of_connections opens 300 connections at once,
+// a quarter of them WebSocket upgrades and the rest bulk downloads left
+// half sent, then fills the reserve with connections that never speak;
+// it prints how many were served, refused and turned away at once, and
+// the peak against the budget.
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <AsyncTCP.h>
+#include <unity.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#define PORT 80
+
+static const size_t COST = sizeof(AsyncWebServerRequest) + WEB_SERVER_REQUEST_OVERHEAD;
+
+static AsyncWebServer *server;
+static AsyncWebSocket *ws;
+static AsyncTCPSimPeer *idle;
+static size_t chunkedSize;
+static std::string uploaded;
+
+static size_t used(void)
+{
+	return server->stats().used;
+}
+
+static size_t fillChunk(uint8_t *buffer, size_t maxLen, size_t index)
+{
+	size_t n = std::min(maxLen, chunkedSize - index);
+
+	for (size_t i = 0; i < n; i++) buffer[i] = 'a' + (index + i) % 26;
+	return n;
+}
+
+static void connect(AsyncTCPSimPeer &peer, size_t window = 1460)
+{
+	peer.window = window;
+	TEST_ASSERT_TRUE(AsyncTCPSim::connect(PORT, &peer));
+}
+
+static void drain(AsyncTCPSimPeer &peer)
+{
+	while (peer.client && peer.unacked) peer.ack();
+}
+
+void setUp(void)
+{
+	HostClock::reset();
+	chunkedSize = 100000;
+	uploaded.clear();
+	server = new AsyncWebServer(PORT);
+	server->on("/page", HTTP_GET, [](AsyncWebServerRequest *request) {
+		request->send(200, "text/plain", "page");
+	});
+	server->on("/prio", HTTP_GET, [](AsyncWebServerRequest *request) {
+		request->send(200, "text/plain", "prio");
+	}).setPriority(true);
+	server->on("/chunked", HTTP_GET, [](AsyncWebServerRequest *request) {
+		request->sendChunked("text/plain", fillChunk);
+	});
+	server->on("/gzip", HTTP_GET, [](AsyncWebServerRequest *request) {
+		request->sendChunkedGzip("text/plain", fillChunk);
+	});
+	server->on("/upload", HTTP_POST, [](AsyncWebServerRequest *request) {
+		request->send(200, "text/plain", "ok");
+	}, [](AsyncWebServerRequest *request, const String &filename, size_t index, uint8_t *data, size_t len, bool final) {
+		(void)request;
+		(void)filename;
+		(void)index;
+		(void)final;
+		uploaded.append((const char *)data, len);
+	});
+	ws = new AsyncWebSocket("/ws");
+	server->addHandler(ws);
+	server->begin();
+
+	idle = new AsyncTCPSimPeer;
+	connect(*idle);
+}
+
+void tearDown(void)
+{
+	if (idle->client) idle->close();
+	delete idle;
+	// nothing is left charged once every connection is gone
+	TEST_ASSERT_EQUAL_UINT32(0, used());
+	delete server;
+}
+
+void test_rejected_connections_charge_nothing(void)
+{
+	server->setMemoryBudget(2 * COST);
+	AsyncTCPSimPeer second;
+	connect(second);
+	TEST_ASSERT_EQUAL_UINT32(2 * COST, used());
+
+	for (int i = 0; i < 3; i++) {
+		AsyncTCPSimPeer over;
+		connect(over);
+		TEST_ASSERT_EQUAL(0, over.received.find("HTTP/1.1 503 Service Unavailable\r\n"));
+		TEST_ASSERT_TRUE(over.closed);
+		TEST_ASSERT_NULL(over.client);
+		TEST_ASSERT_EQUAL_UINT32(2 * COST, used());
+	}
+	TEST_ASSERT_EQUAL_UINT32(3, server->stats().rejected);
+	TEST_ASSERT_EQUAL_UINT32(2, server->stats().admitted);
+
+	second.close();
+	TEST_ASSERT_EQUAL_UINT32(COST, used());
+}
+
+void test_probation_is_released_whether_refused_or_served(void)
+{
+	// the idle connection and one more fill the budget outside the reserve
+	server->setMemoryBudget(3 * COST + 8192, COST + 8192);
+	AsyncTCPSimPeer second;
+	connect(second);
+	TEST_ASSERT_EQUAL_UINT32(2 * COST, used());
+
+	// refused once it asks for an ordinary handler
+	AsyncTCPSimPeer refused;
+	connect(refused);
+	TEST_ASSERT_EQUAL_UINT32(3 * COST, used());
+	refused.send("GET /page HTTP/1.1\r\nHost: esp\r\n\r\n");
+	drain(refused);
+	TEST_ASSERT_EQUAL(0, refused.received.find("HTTP/1.1 503"));
+	if (refused.client) refused.close();
+	TEST_ASSERT_EQUAL_UINT32(2 * COST, used());
+
+	// served from the reserve for a priority handler, twice over
+	AsyncTCPSimPeer served;
+	connect(served);
+	served.send("GET /prio HTTP/1.1\r\nHost: esp\r\n\r\n");
+	drain(served);
+	TEST_ASSERT_EQUAL(0, served.received.find("HTTP/1.1 200 OK\r\n"));
+	TEST_ASSERT_EQUAL_UINT32(3 * COST, used());
+	served.clear();
+	served.send("GET /prio HTTP/1.1\r\nHost: esp\r\n\r\n");
+	drain(served);
+	TEST_ASSERT_EQUAL(0, served.received.find("HTTP/1.1 200 OK\r\n"));
+	TEST_ASSERT_EQUAL_UINT32(3 * COST, used());
+	served.close();
+
+	second.close();
+	TEST_ASSERT_EQUAL_UINT32(COST, used());
+}
+
+void test_over_budget_headers_are_released(void)
+{
+	// room for the request but not for all of its headers
+	server->setMemoryBudget(2 * COST + 200);
+	AsyncTCPSimPeer peer;
+	connect(peer);
+	std::string request = "GET /page HTTP/1.1\r\nHost: esp\r\n";
+	for (int i = 0; i < 20; i++) request += "X-Padding-" + std::to_string(i) + ": " + std::string(40, 'p') + "\r\n";
+	peer.send((request + "\r\n").c_str());
+	drain(peer);
+	TEST_ASSERT_EQUAL(0, peer.received.find("HTTP/1.1 503"));
+	if (peer.client) peer.close();
+	TEST_ASSERT_EQUAL_UINT32(COST, used());
+}
+
+void test_disconnects_release_everything(void)
+{
+	server->setMemoryBudget(64 * 1024);
+
+	// mid-headers
+	{
+		AsyncTCPSimPeer peer;
+		connect(peer);
+		peer.send("GET /page HTTP/1.1\r\nHost: esp\r\nX-Long: ");
+		TEST_ASSERT_TRUE(used() > 2 * COST);
+		peer.close();
+		TEST_ASSERT_EQUAL_UINT32(COST, used());
+	}
+
+	// mid-body, with the multipart buffers charged
+	{
+		AsyncTCPSimPeer peer;
+		connect(peer);
+		peer.send("POST /upload HTTP/1.1\r\nHost: esp\r\n"
+			"Content-Type: multipart/form-data; boundary=XyZzy\r\n"
+			"Content-Length: 100000\r\n\r\n"
+			"--XyZzy\r\nContent-Disposition: form-data; name=\"f\"; filename=\"a\"\r\n\r\n"
+			"0123456789");
+		size_t parsing = used();
+		TEST_ASSERT_TRUE(parsing > 2 * COST + MULTIPART_ARENA_SIZE);
+		peer.close();
+		TEST_ASSERT_EQUAL_UINT32(COST, used());
+	}
+
+	// mid-response, with the send buffer charged
+	{
+		AsyncTCPSimPeer peer;
+		connect(peer);
+		peer.send("GET /chunked HTTP/1.1\r\nHost: esp\r\n\r\n");
+		peer.ack();
+		TEST_ASSERT_TRUE(used() > 2 * COST + 1460);
+		peer.close();
+		TEST_ASSERT_EQUAL_UINT32(COST, used());
+	}
+
+	// mid-response, compressing
+	{
+		AsyncTCPSimPeer peer;
+		connect(peer);
+		peer.send("GET /gzip HTTP/1.1\r\nHost: esp\r\nAccept-Encoding: gzip\r\n\r\n");
+		peer.ack();
+		TEST_ASSERT_TRUE(peer.received.find("Content-Encoding: gzip\r\n") != std::string::npos);
+		peer.close();
+		TEST_ASSERT_EQUAL_UINT32(COST, used());
+	}
+
+	// a response the client stops acking, until the ack timeout
+	{
+		AsyncTCPSimPeer peer;
+		connect(peer);
+		peer.send("GET /chunked HTTP/1.1\r\nHost: esp\r\n\r\n");
+		for (int i = 0; i < 100 && peer.client; i++) {
+			HostClock::advance(1000000);
+			peer.poll();
+		}
+		TEST_ASSERT_NULL(peer.client);
+		TEST_ASSERT_EQUAL_UINT32(COST, used());
+	}
+
+	// headers that never end, until the rx timeout
+	{
+		AsyncTCPSimPeer peer;
+		connect(peer);
+		peer.send("GET /page HTTP/1.1\r\n");
+		for (int i = 0; i < 100 && peer.client; i++) {
+			HostClock::advance(1000000);
+			peer.poll();
+		}
+		TEST_ASSERT_NULL(peer.client);
+		TEST_ASSERT_EQUAL_UINT32(COST, used());
+	}
+}
+
+void test_kept_alive_connection_keeps_only_its_own_charge(void)
+{
+	server->setMemoryBudget(64 * 1024);
+	AsyncTCPSimPeer peer;
+	connect(peer);
+
+	for (int i = 0; i < 5; i++) {
+		peer.clear();
+		peer.send("GET /chunked HTTP/1.1\r\nHost: esp\r\n\r\n");
+		drain(peer);
+		// all of it, up to the last chunk
+		TEST_ASSERT_TRUE(peer.received.find("\r\n0   \r\n\r\n") == peer.received.size() - 10);
+		TEST_ASSERT_EQUAL_UINT32(2 * COST, used());
+	}
+
+	// pipelined: the buffer that held the second request stays with it
+	peer.clear();
+	peer.send("GET /page HTTP/1.1\r\nHost: esp\r\n\r\nGET /page HTTP/1.1\r\nHost: esp\r\n\r\n");
+	drain(peer);
+	TEST_ASSERT_EQUAL(0, peer.received.find("HTTP/1.1 200 OK\r\n"));
+	TEST_ASSERT_TRUE(peer.received.find("HTTP/1.1 200 OK\r\n", 1) != std::string::npos);
+	TEST_ASSERT_EQUAL_UINT32(2 * COST + WEB_SERVER_PIPELINE_SIZE, used());
+
+	// and the last request of the connection, which closes it
+	peer.send("GET /page HTTP/1.1\r\nHost: esp\r\nConnection: close\r\n\r\n");
+	drain(peer);
+	TEST_ASSERT_TRUE(peer.closed);
+	TEST_ASSERT_NULL(peer.client);
+	TEST_ASSERT_EQUAL_UINT32(COST, used());
+}
+
+void test_websocket_upgrade_releases_the_request(void)
+{
+	server->setMemoryBudget(64 * 1024);
+	AsyncTCPSimPeer peer;
+	connect(peer);
+	peer.send("GET /ws HTTP/1.1\r\nHost: esp\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+		"Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n");
+	drain(peer);
+	TEST_ASSERT_EQUAL(0, peer.received.find("HTTP/1.1 101 Switching Protocols\r\n"));
+	TEST_ASSERT_EQUAL_UINT32(1, ws->count());
+	// WebSocket clients are not charged
+	TEST_ASSERT_EQUAL_UINT32(COST, used());
+	peer.close();
+	TEST_ASSERT_EQUAL_UINT32(0, ws->count());
+	TEST_ASSERT_EQUAL_UINT32(COST, used());
+}
+
+static bool upgrade(AsyncTCPSimPeer &peer)
+{
+	peer.send("GET /ws HTTP/1.1\r\nHost: esp\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+		"Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n");
+	peer.ack();
+	return peer.received.find("HTTP/1.1 101 Switching Protocols\r\n") == 0;
+}
+
+void test_burst_of_hundreds_of_connections(void)
+{
+	const size_t PEERS = 300, SILENT = 40, OVER = 50;
+	const size_t budget = 40 * COST, reserve = 8 * COST;
+	static const char turnedAway[] = "HTTP/1.1 503 Service Unavailable\r\nRetry-After: 1\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+	std::vector<AsyncTCPSimPeer> peers(PEERS), silent(SILENT);
+	uint32_t upgraded = 0, downloading = 0, refused = 0, turned = 0;
+	typedef std::chrono::steady_clock Clock;
+
+	server->setMemoryBudget(budget, reserve);
+	chunkedSize = 1000000;
+
+	// every fourth a WebSocket, which a priority handler takes from the
+	// reserve once the rest is spent; the bulk downloads take what is left
+	// outside it, then are refused after their headers
+	for (size_t i = 0; i < PEERS; i++) {
+		AsyncTCPSimPeer &peer = peers[i];
+		connect(peer);
+		TEST_ASSERT_NOT_NULL(peer.client);
+		if (i % 4 == 0) {
+			TEST_ASSERT_TRUE(upgrade(peer));
+			upgraded++;
+		} else {
+			peer.send("GET /chunked HTTP/1.1\r\nHost: esp\r\n\r\n");
+			peer.ack();
+			if (peer.received.find("HTTP/1.1 200 OK\r\n") == 0) {
+				downloading++;
+			} else {
+				TEST_ASSERT_EQUAL(0, peer.received.find("HTTP/1.1 503"));
+				refused++;
+			}
+		}
+		TEST_ASSERT_TRUE(used() <= budget);
+	}
+	TEST_ASSERT_EQUAL_UINT32(PEERS / 4, ws->count());
+	TEST_ASSERT_TRUE(downloading > 0);
+	TEST_ASSERT_TRUE(refused > 0);
+	TEST_ASSERT_EQUAL_UINT32(PEERS - PEERS / 4, downloading + refused);
+	// the downloads hold no more than the budget outside the reserve
+	TEST_ASSERT_TRUE(used() <= budget - reserve);
+
+	// WebSocket traffic goes on while the downloads hold the budget
+	ws->textAll("21.5");
+	for (size_t i = 0; i < PEERS; i += 4) {
+		peers[i].ack();
+		TEST_ASSERT_TRUE(peers[i].received.find("21.5") != std::string::npos);
+	}
+
+	// connections that never send a request line fill the reserve ...
+	size_t held = 0;
+	for (; held < SILENT; held++) {
+		connect(silent[held]);
+		if (!silent[held].client) break;
+	}
+	TEST_ASSERT_TRUE(held < SILENT);
+	turned++;
+
+	// ... and from then on connections are turned away as they come, with
+	// the 503 written before anything is read and nothing charged
+	size_t full = used();
+	auto start = Clock::now();
+	for (size_t i = 0; i < OVER; i++) {
+		AsyncTCPSimPeer over;
+		connect(over);
+		TEST_ASSERT_NULL(over.client);
+		TEST_ASSERT_TRUE(over.closed);
+		TEST_ASSERT_EQUAL_STRING(turnedAway, over.received.c_str());
+		TEST_ASSERT_EQUAL_UINT32(full, used());
+		turned++;
+	}
+	double us = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / OVER;
+	TEST_ASSERT_EQUAL_UINT32(turned, server->stats().rejected);
+
+	// two silent connections gone, a WebSocket gets their place in the
+	// reserve, the headers of its upgrade included
+	silent[0].close();
+	silent[1].close();
+	AsyncTCPSimPeer late;
+	connect(late);
+	TEST_ASSERT_NOT_NULL(late.client);
+	TEST_ASSERT_TRUE(upgrade(late));
+
+	printf("%u connections: %u WebSockets, %u downloads, %u refused after their headers, "
+		"%u turned away in %.1f us each; peak %u of %u bytes\n", (unsigned)(PEERS + held + turned + 1),
+		(unsigned)upgraded + 1, (unsigned)downloading, (unsigned)refused, (unsigned)turned, us,
+		(unsigned)server->stats().peak, (unsigned)budget);
+	TEST_ASSERT_TRUE(server->stats().peak <= budget);
+
+	// and all of it comes back, however each one ends
+	late.close();
+	for (size_t i = 2; i < held; i++) silent[i].close();
+	for (size_t i = 0; i < PEERS; i++) {
+		if (peers[i].client) peers[i].close();
+	}
+	TEST_ASSERT_EQUAL_UINT32(0, ws->count());
+	TEST_ASSERT_EQUAL_UINT32(COST, used());
+}
+
+int main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+	UNITY_BEGIN();
+	RUN_TEST(test_rejected_connections_charge_nothing);
+	RUN_TEST(test_probation_is_released_whether_refused_or_served);
+	RUN_TEST(test_over_budget_headers_are_released);
+	RUN_TEST(test_disconnects_release_everything);
+	RUN_TEST(test_kept_alive_connection_keeps_only_its_own_charge);
+	RUN_TEST(test_websocket_upgrade_releases_the_request);
+	RUN_TEST(test_burst_of_hundreds_of_connections);
+	return UNITY_END();
+}
@@ -0,0 +1,338 @@
+// AsyncClientRegistry against a model kept in insertion order: 400,000
+// random adds, removes, lookups and connection changes, with ids of
+// clients long gone, every slot taken, loops that remove the client they
+// stand on or another one and add behind themselves, and a remove callback
+// that removes its client's partner.  Ids of removed clients never find
+// the client that reuses their slot.
+//
+// test_benchmark runs 256 WebSocket clients over AsyncTCPSim: a round is
+// a text to each of them by id, 8 of them leaving and 8 new ones coming,
+// and count().  It prints the time of a round, and of a lookup by id in
+// the registry against a walk of a std::list of 256.
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <AsyncClientRegistry.h>
+#include <AsyncTCP.h>
+#include <unity.h>
+
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <list>
+#include <map>
+#include <vector>
+
+#define PORT 80
+#define SLOTS (1 << ASYNC_CLIENT_REGISTRY_SLOT_BITS)
+
+struct Client {
+	uint32_t n;         // in the order added, so the model's order
+	uint32_t id;
+	bool connected;
+};
+
+typedef AsyncClientRegistry<Client> Registry;
+
+static Registry *registry;
+static std::map<uint32_t, Client *> model;       // by n
+static std::vector<uint32_t> stale;              // ids of removed clients
+static std::vector<uint32_t> removed;            // n given to the callback
+static std::vector<uint32_t> modelRemoved;
+static uint32_t next;
+
+// an even client takes the odd one after it along when it goes
+static void onRemove(Client *c)
+{
+	removed.push_back(c->n);
+	stale.push_back(c->id);
+	auto partner = model.find(c->n + 1);
+	model.erase(c->n);
+	if (c->n % 2 == 0 && partner != model.end()) TEST_ASSERT_TRUE(registry->remove(partner->second->id));
+	delete c;
+}
+
+// the model's side of a remove, done before the registry's
+static void expectRemoved(uint32_t n)
+{
+	modelRemoved.push_back(n);
+	if (n % 2 == 0 && model.count(n + 1)) modelRemoved.push_back(n + 1);
+}
+
+static bool add(void)
+{
+	Client *c = new Client{ next, 0, true };
+	c->id = registry->add(c);
+	if (model.size() == SLOTS) {
+		TEST_ASSERT_EQUAL_UINT32(0, c->id);
+		TEST_ASSERT_TRUE(registry->full());
+		delete c;
+		return false;
+	}
+	TEST_ASSERT_TRUE(c->id != 0);
+	model[next++] = c;
+	return true;
+}
+
+static void remove(Client *c)
+{
+	uint32_t id = c->id;
+
+	expectRemoved(c->n);
+	TEST_ASSERT_TRUE(registry->remove(id));
+	TEST_ASSERT_NULL(registry->get(id));
+}
+
+static void assertSame(void)
+{
+	size_t connected = 0;
+
+	TEST_ASSERT_EQUAL_UINT32(model.size(), registry->length());
+	TEST_ASSERT_EQUAL(model.empty(), registry->isEmpty());
+	auto it = model.begin();
+	for (Client *c : *registry) {
+		TEST_ASSERT_TRUE(it != model.end());
+		TEST_ASSERT_TRUE(it->second == c);
+		TEST_ASSERT_TRUE(c == registry->get(c->id));
+		if (c->connected) connected++;
+		it++;
+	}
+	TEST_ASSERT_TRUE(it == model.end());
+	TEST_ASSERT_EQUAL_UINT32(connected, registry->connected());
+	TEST_ASSERT_TRUE((model.empty() ? NULL : model.begin()->second) == registry->front());
+	TEST_ASSERT_TRUE(removed == modelRemoved);
+}
+
+// a loop over the registry that removes the client it visits or another
+// one and adds behind itself; it visits what the model says, in order.
+// Slots of clients removed in the loop are only free once it is over.
+static void iterate(void)
+{
+	std::vector<uint32_t> visited, expected;
+	std::map<uint32_t, bool> alive;
+	size_t taken = model.size();
+	uint32_t nextN = next;
+	int added = 0;
+
+	// the model's walk first: the next client is the first one added after
+	// the last one visited that is still there
+	for (auto &m : model) alive[m.first] = true;
+	auto kill = [&](uint32_t n) {
+		if (!alive.count(n) || !alive[n]) return;
+		alive[n] = false;
+		if (n % 2 == 0 && alive.count(n + 1)) alive[n + 1] = false;
+	};
+	for (auto it = alive.begin(); it != alive.end(); it = alive.upper_bound(it->first)) {
+		if (!it->second) continue;
+		uint32_t at = it->first;
+		expected.push_back(at);
+		if (at % 5 == 0) {
+			kill(at);
+		} else if (at % 7 == 0) {
+			kill(at + 3);
+		}
+		if (at % 11 == 0 && added < 3 && taken < SLOTS) {
+			alive[nextN++] = true;
+			taken++;
+			added++;
+		}
+	}
+
+	// then the registry's
+	taken = model.size();
+	added = 0;
+	for (Client *c : *registry) {
+		uint32_t at = c->n;
+		visited.push_back(at);
+		if (at % 5 == 0) {
+			remove(c);
+		} else if (at % 7 == 0 && model.count(at + 3)) {
+			remove(model[at + 3]);
+		}
+		if (at % 11 == 0 && added < 3 && taken < SLOTS) {
+			TEST_ASSERT_TRUE(add());
+			taken++;
+			added++;
+		}
+	}
+	TEST_ASSERT_TRUE(visited == expected);
+}
+
+void setUp(void)
+{
+	model.clear();
+	stale.clear();
+	removed.clear();
+	modelRemoved.clear();
+	next = 0;
+	registry = new Registry(onRemove);
+}
+
+void tearDown(void)
+{
+	while (!model.empty()) remove(model.begin()->second);
+	delete registry;
+}
+
+void test_matches_the_model(void)
+{
+	srand(11);
+	for (uint32_t op = 0; op < 400000; op++) {
+		int r = rand() % 100;
+		if (r < 35 || model.size() < 2) {
+			add();
+		} else if (r < 55) {
+			auto it = model.begin();
+			std::advance(it, rand() % model.size());
+			remove(it->second);
+		} else if (r < 70) {
+			// a live id finds its client, a stale one nothing, even where
+			// its slot was taken again
+			auto it = model.begin();
+			std::advance(it, rand() % model.size());
+			TEST_ASSERT_TRUE(it->second == registry->get(it->second->id));
+			if (!stale.empty()) {
+				uint32_t id = stale[rand() % stale.size()];
+				TEST_ASSERT_NULL(registry->get(id));
+				TEST_ASSERT_FALSE(registry->remove(id));
+			}
+			TEST_ASSERT_NULL(registry->get(0));
+			TEST_ASSERT_NULL(registry->get(SLOTS * 2 - 1));
+		} else if (r < 80) {
+			auto it = model.begin();
+			std::advance(it, rand() % model.size());
+			it->second->connected = rand() % 2;
+			registry->setConnected(it->second->id, it->second->connected);
+		} else if (r < 95) {
+			iterate();
+		} else if (r < 97) {
+			// every slot taken, and one more refused
+			while (add()) {
+			}
+			TEST_ASSERT_EQUAL_UINT32(SLOTS, registry->length());
+		} else if (r < 99 || model.size() > 300) {
+			// most leave at once, as on a Wi-Fi drop
+			while (model.size() > 5) {
+				auto it = model.begin();
+				std::advance(it, rand() % model.size());
+				remove(it->second);
+			}
+		}
+		if (stale.size() > 10000) stale.erase(stale.begin(), stale.begin() + 5000);
+		if (op % 101 == 0) assertSame();
+	}
+	assertSame();
+}
+
+static AsyncWebServer *server;
+static AsyncWebSocket *ws;
+static std::map<AsyncClient *, uint32_t> ids;
+
+static void onEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t len)
+{
+	(void)server;
+	(void)arg;
+	(void)data;
+	(void)len;
+	if (type == WS_EVT_CONNECT) ids[client->client()] = client->id();
+	if (type == WS_EVT_DISCONNECT) ids.erase(client->client());
+}
+
+static void upgrade(AsyncTCPSimPeer &peer)
+{
+	TEST_ASSERT_TRUE(AsyncTCPSim::connect(PORT, &peer));
+	peer.send("GET /ws HTTP/1.1\r\nHost: esp\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+		"Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n");
+	peer.ack();
+	TEST_ASSERT_EQUAL(0, peer.received.find("HTTP/1.1 101 Switching Protocols\r\n"));
+	peer.clear();
+}
+
+void test_benchmark(void)
+{
+	const uint32_t clients = 256, rounds = 200;
+	std::vector<AsyncTCPSimPeer *> peers(clients);
+	volatile size_t sink = 0;
+
+	server = new AsyncWebServer(PORT);
+	ws = new AsyncWebSocket("/ws");
+	ws->onEvent(onEvent);
+	server->addHandler(ws);
+	server->begin();
+	for (AsyncTCPSimPeer *&peer : peers) {
+		peer = new AsyncTCPSimPeer;
+		upgrade(*peer);
+	}
+	TEST_ASSERT_EQUAL_UINT32(clients, ws->count());
+
+	double best = 1e9;
+	for (uint32_t round = 0; round < rounds; round++) {
+		auto start = std::chrono::steady_clock::now();
+		for (AsyncTCPSimPeer *peer : peers) ws->text(ids[peer->client], "21.5");
+		for (uint32_t i = 0; i < 8; i++) {
+			AsyncTCPSimPeer *&peer = peers[(round * 37 + i * 31) % clients];
+			peer->close();
+			delete peer;
+			peer = new AsyncTCPSimPeer;
+			upgrade(*peer);
+		}
+		sink += ws->count();
+		best = std::min(best, std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+		for (AsyncTCPSimPeer *peer : peers) {
+			peer->ack();
+			peer->clear();
+		}
+	}
+	TEST_ASSERT_EQUAL_UINT32(clients, ws->count());
+	TEST_ASSERT_EQUAL_UINT32(clients, ids.size());
+	// every client got its text, and only its own
+	for (AsyncTCPSimPeer *peer : peers) {
+		ws->text(ids[peer->client], "21.5");
+		peer->ack();
+		TEST_ASSERT_EQUAL_STRING("\x81\x04" "21.5", peer->received.c_str());
+	}
+	printf("256 clients: %.1f us a round of 256 texts by id, 8 leaving, 8 coming and count()\n", best);
+
+	// the lookup alone
+	Registry lookup(nullptr);
+	std::list<Client *> list;
+	std::vector<Client> all(clients);
+	for (uint32_t i = 0; i < clients; i++) {
+		all[i].n = i;
+		all[i].id = lookup.add(&all[i]);
+		list.push_back(&all[i]);
+	}
+	auto start = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < 1000000; i++) sink += lookup.get(all[i % clients].id)->n;
+	double registryNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / 1e6;
+	start = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < 1000000; i++) {
+		uint32_t id = all[i % clients].id;
+		for (Client *c : list) {
+			if (c->id == id) {
+				sink += c->n;
+				break;
+			}
+		}
+	}
+	double listNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / 1e6;
+	printf("lookup by id among 256: %.1f ns in the registry, %.1f ns walking a list\n", registryNs, listNs);
+	(void)sink;
+
+	for (AsyncTCPSimPeer *peer : peers) {
+		peer->close();
+		delete peer;
+	}
+	TEST_ASSERT_EQUAL_UINT32(0, ws->count());
+	delete server;
+}
+
+int main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+	UNITY_BEGIN();
+	RUN_TEST(test_matches_the_model);
+	RUN_TEST(test_benchmark);
+	return UNITY_END();
+}
@@ -0,0 +1,241 @@
+// SPIFFSEditor's ?list= against HostFS and AsyncTCPSim, in a directory of
+// 10,000 files: every file is listed once, offset/limit pages add up to
+// the whole listing, an .exclude.files written between listings counts
+// from the next one on, and a listing takes no more memory for 10,000
+// entries than for a thousand.  HostFS opens every entry it lists, as the
+// ESP32 core does, so a listing costs one open per file and one for the
+// directory.
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <SPIFFSEditor.h>
+#include <AsyncTCP.h>
+#include <HostFS.h>
+#include <unity.h>
+
+#include <malloc.h>
+#include <stdlib.h>
+#include <set>
+#include <string>
+#include <vector>
+
+#define PORT 80
+#define FILES 10000
+#define FS_ROOT "/tmp/test_web_editor"
+
+static HostFS *disk;
+static AsyncWebServer *server;
+
+// bytes allocated and not yet freed, with glibc, and the most there were
+static size_t live;
+static size_t peak;
+
+#ifdef __GLIBC__
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t n, size_t size);
+extern "C" void *__libc_realloc(void *p, size_t size);
+extern "C" void __libc_free(void *p);
+
+static void *counted(void *p)
+{
+	if (p) live += malloc_usable_size(p);
+	if (live > peak) peak = live;
+	return p;
+}
+
+extern "C" void *malloc(size_t size)
+{
+	return counted(__libc_malloc(size));
+}
+
+extern "C" void *calloc(size_t n, size_t size)
+{
+	return counted(__libc_calloc(n, size));
+}
+
+extern "C" void *realloc(void *p, size_t size)
+{
+	if (p) live -= malloc_usable_size(p);
+	return counted(__libc_realloc(p, size));
+}
+
+extern "C" void free(void *p)
+{
+	if (p) live -= malloc_usable_size(p);
+	__libc_free(p);
+}
+#endif
+
+static std::string fileName(unsigned i)
+{
+	char name[16];
+
+	snprintf(name, sizeof name, "%05u.log", i);
+	return name;
+}
+
+// the body of ?list=... and the most memory the server held while sending it
+static std::string list(const std::string &query, size_t *held = NULL)
+{
+	AsyncTCPSimPeer peer;
+
+	// allocated up front, so that only the server's allocations move the peak
+	peer.received.reserve(1 << 20);
+	TEST_ASSERT_TRUE(AsyncTCPSim::connect(PORT, &peer));
+	size_t before = live;
+	peak = live;
+	peer.send(("GET /edit?list=" + query + " HTTP/1.1\r\nHost: esp\r\n\r\n").c_str());
+	while (peer.unacked) peer.ack();
+	if (held) *held = peak - before;
+
+	const std::string &r = peer.received;
+	TEST_ASSERT_EQUAL(0, r.find("HTTP/1.1 200 OK\r\n"));
+	TEST_ASSERT_TRUE(r.find("Content-Type: application/json\r\n") != std::string::npos);
+	size_t at = r.find("\r\n\r\n") + 4;
+	std::string body;
+	for (;;) {
+		size_t size = strtoul(r.c_str() + at, NULL, 16);
+		at = r.find("\r\n", at) + 2;
+		if (!size) break;
+		body.append(r, at, size);
+		at += size + 2;
+	}
+	peer.close();
+	return body;
+}
+
+// the names in a listing, in order, checking the JSON around them
+static std::vector<std::string> names(const std::string &body)
+{
+	std::vector<std::string> out;
+	size_t at = 1;
+
+	TEST_ASSERT_TRUE(body.size() >= 2 && body[0] == '[' && body[body.size() - 1] == ']');
+	while (at < body.size() - 1) {
+		if (!out.empty()) TEST_ASSERT_EQUAL(',', body[at++]);
+		TEST_ASSERT_EQUAL(at, body.find("{\"type\":\"file\",\"name\":\"", at));
+		at += 23;
+		size_t end = body.find('"', at);
+		out.push_back(body.substr(at, end - at));
+		TEST_ASSERT_EQUAL(end, body.find("\",\"size\":3}", at));
+		at = end + 11;
+	}
+	return out;
+}
+
+void setUp(void)
+{
+	HostClock::reset();
+	disk->remove("/.exclude.files");
+	server = new AsyncWebServer(PORT);
+	server->addHandler(new SPIFFSEditor(*disk));
+	server->begin();
+}
+
+void tearDown(void)
+{
+	delete server;
+}
+
+void test_every_file_is_listed_once(void)
+{
+	disk->resetStats();
+	std::vector<std::string> all = names(list("/logs"));
+	TEST_ASSERT_EQUAL_UINT32(FILES, all.size());
+	std::set<std::string> unique(all.begin(), all.end());
+	TEST_ASSERT_EQUAL_UINT32(FILES, unique.size());
+	TEST_ASSERT_TRUE(unique.count(fileName(0)) && unique.count(fileName(FILES - 1)));
+	// the directory and every entry, and nothing more: the exclude file
+	// that is not there is looked for once
+	TEST_ASSERT_EQUAL_UINT32(FILES + 1, disk->opens());
+
+	TEST_ASSERT_EQUAL_STRING("[]", list("/empty").c_str());
+}
+
+void test_pages_add_up_to_the_listing(void)
+{
+	std::vector<std::string> all = names(list("/logs"));
+	std::vector<std::string> paged;
+
+	for (size_t offset = 0; offset < FILES; offset += 777) {
+		std::vector<std::string> page = names(list("/logs&offset=" + std::to_string(offset) + "&limit=777"));
+		TEST_ASSERT_EQUAL_UINT32(std::min((size_t)777, FILES - offset), page.size());
+		paged.insert(paged.end(), page.begin(), page.end());
+	}
+	TEST_ASSERT_TRUE(paged == all);
+
+	TEST_ASSERT_EQUAL_STRING("[]", list("/logs&limit=0").c_str());
+	TEST_ASSERT_EQUAL_STRING("[]", list("/logs&offset=" + std::to_string(FILES)).c_str());
+	TEST_ASSERT_EQUAL_UINT32(1, names(list("/logs&offset=" + std::to_string(FILES - 1))).size());
+	// negative is as if not given
+	TEST_ASSERT_TRUE(names(list("/logs&offset=-5&limit=-1")) == all);
+}
+
+void test_exclude_file_counts_from_the_next_listing(void)
+{
+	TEST_ASSERT_EQUAL_UINT32(FILES, names(list("/logs")).size());
+
+	// written after the first listing
+	File f = disk->open("/.exclude.files", FILE_WRITE);
+	f.print("*7.log\r\n0000?.log\n");
+	f.close();
+	disk->resetStats();
+	std::vector<std::string> left = names(list("/logs"));
+	TEST_ASSERT_EQUAL_UINT32(FILES + 2, disk->opens());
+	for (const std::string &name : left) {
+		TEST_ASSERT_FALSE(name[4] == '7');
+		TEST_ASSERT_FALSE(name.compare(0, 4, "0000") == 0);
+	}
+	// a tenth end in 7, and 0000? takes nine more
+	TEST_ASSERT_EQUAL_UINT32(FILES - FILES / 10 - 9, left.size());
+
+	// excluded files are not counted by offset
+	std::vector<std::string> page = names(list("/logs&offset=1&limit=2"));
+	TEST_ASSERT_EQUAL_UINT32(2, page.size());
+	TEST_ASSERT_EQUAL_STRING(left[1].c_str(), page[0].c_str());
+
+	// and gone again with the file
+	disk->remove("/.exclude.files");
+	TEST_ASSERT_EQUAL_UINT32(FILES, names(list("/logs")).size());
+}
+
+void test_memory_does_not_grow_with_the_directory(void)
+{
+#ifndef __GLIBC__
+	TEST_IGNORE_MESSAGE("counts allocations through glibc's malloc");
+#else
+	size_t some, all;
+
+	// a thousand entries fill the window as 10,000 do, so the send
+	// buffers on both sides are as large in either
+	list("/logs&limit=1000");
+	TEST_ASSERT_EQUAL_UINT32(1000, names(list("/logs&limit=1000", &some)).size());
+	TEST_ASSERT_EQUAL_UINT32(FILES, names(list("/logs", &all)).size());
+	printf("held while listing: %u bytes for 1000 entries, %u for %u\n", (unsigned)some, (unsigned)all, FILES);
+	// the same, give or take the heap's rounding
+	TEST_ASSERT_UINT32_WITHIN(512, some, all);
+#endif
+}
+
+int main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+	disk = new HostFS(FS_ROOT);
+	disk->clear();
+	for (unsigned i = 0; i < FILES; i++) {
+		File f = disk->open(("/logs/" + fileName(i)).c_str(), FILE_WRITE, true);
+		f.print("abc");
+		f.close();
+	}
+	disk->mkdir("/empty");
+
+	UNITY_BEGIN();
+	RUN_TEST(test_every_file_is_listed_once);
+	RUN_TEST(test_pages_add_up_to_the_listing);
+	RUN_TEST(test_exclude_file_counts_from_the_next_listing);
+	RUN_TEST(test_memory_does_not_grow_with_the_directory);
+	int failures = UNITY_END();
+	delete disk;
+	return failures;
+}
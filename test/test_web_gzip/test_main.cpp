@@ -0,0 +1,357 @@
+// AsyncGzipEncoder against zlib: a CSV log, a JSON history, random bytes,
+// runs and the empty and one byte bodies come back from zlib's inflate as
+// they went in, fed and read in pieces from a byte to 100 KB.  Random
+// bytes go out in stored blocks and grow by their headers only.  Through
+// AsyncTCPSim, sendChunkedGzip() answers gzip chunked to a client that
+// takes it, close-delimited to HTTP/1.0, and plain to one that does not.
+// test_benchmark prints the ratio against zlib's level 6, CPU time per MB
+// and the most heap a response holds with and without the encoder.
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <AsyncGzip.h>
+#include <AsyncTCP.h>
+#include <unity.h>
+
+#include <malloc.h>
+#include <stdlib.h>
+#include <zlib.h>
+#include <chrono>
+#include <string>
+
+#define PORT 80
+#define START 1700000000UL
+
+static AsyncWebServer *server;
+static std::string body;
+
+// bytes allocated and not yet freed, with glibc, and the most there were
+static size_t live;
+static size_t peak;
+
+#ifdef __GLIBC__
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t n, size_t size);
+extern "C" void *__libc_realloc(void *p, size_t size);
+extern "C" void __libc_free(void *p);
+
+static void *counted(void *p)
+{
+	if (p) live += malloc_usable_size(p);
+	if (live > peak) peak = live;
+	return p;
+}
+
+extern "C" void *malloc(size_t size)
+{
+	return counted(__libc_malloc(size));
+}
+
+extern "C" void *calloc(size_t n, size_t size)
+{
+	return counted(__libc_calloc(n, size));
+}
+
+extern "C" void *realloc(void *p, size_t size)
+{
+	if (p) live -= malloc_usable_size(p);
+	return counted(__libc_realloc(p, size));
+}
+
+extern "C" void free(void *p)
+{
+	if (p) live -= malloc_usable_size(p);
+	__libc_free(p);
+}
+#endif
+
+// what /downloadCSV sends: a sample a minute
+static std::string csvLog(uint32_t lines)
+{
+	std::string out = "Reading ID, Date, Hour, Temperature \r\n";
+	char line[64];
+
+	srand(1);
+	for (uint32_t i = 0; i < lines; i++) {
+		time_t t = START + i * 60UL;
+		struct tm tm;
+		gmtime_r(&t, &tm);
+		int centi = 2100 + (int)(150 * sin(i * M_PI / 720)) + rand() % 13 - 6;
+		snprintf(line, sizeof line, "%lu,%04d-%02d-%02d,%02d:%02d:%02d,%d.%02d\r\n", (unsigned long)i,
+			tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, centi / 100, centi % 100);
+		out += line;
+	}
+	return out;
+}
+
+// what the dashboard's history is: two probes, ten seconds apart
+static std::string jsonHistory(uint32_t samples)
+{
+	std::string out = "[";
+	char item[160];
+
+	srand(2);
+	for (uint32_t i = 0; i < samples; i++) {
+		snprintf(item, sizeof item, "%s{\"time\":%lu,\"probes\":[{\"id\":\"28ff4a1c0416035e\",\"c\":%.2f},{\"id\":\"28ff9d2c04160371\",\"c\":%.2f}]}",
+			i ? "," : "", START + i * 10UL, 20 + (rand() % 400) / 100.0, 4 + (rand() % 900) / 100.0);
+		out += item;
+	}
+	return out + "]";
+}
+
+static std::string randomBytes(size_t len)
+{
+	std::string out(len, 0);
+
+	srand(3);
+	for (char &c : out) c = rand();
+	return out;
+}
+
+// 'in' through the encoder, put in 'inPiece' bytes and read 'outPiece'
+// bytes at a time
+static std::string gzip(const std::string &in, size_t inPiece, size_t outPiece)
+{
+	AsyncGzipEncoder *gz = new AsyncGzipEncoder();
+	std::string out;
+	std::string buf(outPiece, 0);
+	size_t at = 0;
+
+	for (;;) {
+		size_t n = gz->read((uint8_t *)&buf[0], outPiece);
+		out.append(buf, 0, n);
+		if (gz->done()) break;
+		if (n == outPiece) continue;
+		size_t space;
+		uint8_t *p = gz->input(&space);
+		TEST_ASSERT_TRUE(space > 0);
+		if (at == in.size()) {
+			gz->finish();
+			continue;
+		}
+		size_t len = std::min(std::min(space, inPiece), in.size() - at);
+		memcpy(p, in.data() + at, len);
+		gz->commit(len);
+		at += len;
+	}
+	TEST_ASSERT_EQUAL_UINT32(in.size(), gz->totalIn());
+	delete gz;
+	return out;
+}
+
+// a gzip member inflated by zlib, which must find it whole and checked
+static std::string gunzip(const std::string &in)
+{
+	z_stream z;
+	std::string out;
+	char buf[16384];
+
+	memset(&z, 0, sizeof z);
+	TEST_ASSERT_EQUAL(Z_OK, inflateInit2(&z, 16 + 15));
+	z.next_in = (Bytef *)in.data();
+	z.avail_in = in.size();
+	int ret;
+	do {
+		z.next_out = (Bytef *)buf;
+		z.avail_out = sizeof buf;
+		ret = inflate(&z, Z_NO_FLUSH);
+		TEST_ASSERT_TRUE(ret == Z_OK || ret == Z_STREAM_END);
+		out.append(buf, sizeof buf - z.avail_out);
+	} while (ret != Z_STREAM_END);
+	// and nothing after it
+	TEST_ASSERT_EQUAL_UINT32(0, z.avail_in);
+	inflateEnd(&z);
+	return out;
+}
+
+static size_t zlibSize(const std::string &in, int level)
+{
+	z_stream z;
+	std::string out;
+
+	memset(&z, 0, sizeof z);
+	deflateInit2(&z, level, Z_DEFLATED, 16 + 15, 8, Z_DEFAULT_STRATEGY);
+	out.resize(deflateBound(&z, in.size()));
+	z.next_in = (Bytef *)in.data();
+	z.avail_in = in.size();
+	z.next_out = (Bytef *)&out[0];
+	z.avail_out = out.size();
+	TEST_ASSERT_EQUAL(Z_STREAM_END, deflate(&z, Z_FINISH));
+	size_t size = z.total_out;
+	deflateEnd(&z);
+	return size;
+}
+
+static size_t fillBody(uint8_t *buffer, size_t maxLen, size_t index)
+{
+	size_t len = std::min(maxLen, body.size() - index);
+
+	memcpy(buffer, body.data() + index, len);
+	return len;
+}
+
+static void onBody(AsyncWebServerRequest *request)
+{
+	request->sendChunkedGzip("text/csv", fillBody);
+}
+
+// the response to 'request' and the most memory the server held for it
+static std::string get(const std::string &request, size_t *held = NULL)
+{
+	AsyncTCPSimPeer peer;
+
+	peer.received.reserve(4 << 20);
+	TEST_ASSERT_TRUE(AsyncTCPSim::connect(PORT, &peer));
+	size_t before = live;
+	peak = live;
+	peer.send(request.c_str());
+	while (peer.client && peer.unacked) peer.ack();
+	if (held) *held = peak - before;
+	std::string r = peer.received;
+	if (peer.client) peer.close();
+	return r;
+}
+
+static std::string unchunk(const std::string &r, size_t at)
+{
+	std::string out;
+
+	for (;;) {
+		size_t size = strtoul(r.c_str() + at, NULL, 16);
+		at = r.find("\r\n", at) + 2;
+		if (!size) break;
+		out.append(r, at, size);
+		at += size + 2;
+	}
+	return out;
+}
+
+void setUp(void)
+{
+	HostClock::reset();
+	server = new AsyncWebServer(PORT);
+	server->on("/body", HTTP_GET, onBody);
+	server->begin();
+}
+
+void tearDown(void)
+{
+	delete server;
+}
+
+void test_round_trip_through_zlib(void)
+{
+	const std::string inputs[] = { csvLog(5000), jsonHistory(2000), randomBytes(20000),
+		std::string(100000, 'a'), std::string(), std::string(1, 'x'),
+		// compressible, then not, then again: stored and coded blocks
+		// one after the other
+		csvLog(300) + randomBytes(9000) + csvLog(300) };
+	const size_t pieces[] = { 1, 7, 100, 1436, 100000 };
+
+	for (const std::string &in : inputs) {
+		for (size_t inPiece : pieces) {
+			for (size_t outPiece : pieces) {
+				// a byte at a time both ways only for the small ones
+				if (inPiece * outPiece < 10 && in.size() > 20000) continue;
+				TEST_ASSERT_TRUE(gunzip(gzip(in, inPiece, outPiece)) == in);
+			}
+		}
+	}
+}
+
+void test_incompressible_input_is_stored(void)
+{
+	std::string in = randomBytes(300000);
+	std::string out = gzip(in, 1436, 1436);
+
+	TEST_ASSERT_TRUE(gunzip(out) == in);
+	// the gzip header and trailer, and 5 bytes a block of at least half
+	// the window
+	TEST_ASSERT_TRUE(out.size() <= in.size() + 18 + 5 * (in.size() / (ASYNC_GZIP_WINDOW / 2) + 1));
+	printf("300000 random bytes: %u gzipped\n", (unsigned)out.size());
+
+	// and compressible input is not stored
+	std::string csv = csvLog(5000);
+	TEST_ASSERT_TRUE(gzip(csv, 1436, 1436).size() * 4 < csv.size());
+}
+
+void test_response_is_gzipped_for_clients_taking_it(void)
+{
+	body = csvLog(3000);
+
+	std::string r = get("GET /body HTTP/1.1\r\nHost: esp\r\nAccept-Encoding: gzip, deflate\r\nConnection: close\r\n\r\n");
+	size_t head = r.find("\r\n\r\n") + 4;
+	std::string headers = r.substr(0, head);
+	TEST_ASSERT_TRUE(headers.find("Content-Encoding: gzip\r\n") != std::string::npos);
+	TEST_ASSERT_TRUE(headers.find("Transfer-Encoding: chunked\r\n") != std::string::npos);
+	TEST_ASSERT_TRUE(headers.find("Vary: Accept-Encoding\r\n") != std::string::npos);
+	TEST_ASSERT_TRUE(gunzip(unchunk(r, head)) == body);
+
+	// HTTP/1.0 cannot take chunks: the end of the body is the end of the
+	// connection
+	r = get("GET /body HTTP/1.0\r\nAccept-Encoding: gzip\r\n\r\n");
+	head = r.find("\r\n\r\n") + 4;
+	TEST_ASSERT_TRUE(r.substr(0, head).find("Content-Encoding: gzip\r\n") != std::string::npos);
+	TEST_ASSERT_TRUE(r.substr(0, head).find("Transfer-Encoding") == std::string::npos);
+	TEST_ASSERT_TRUE(gunzip(r.substr(head)) == body);
+
+	// q=0 refuses it, as does not asking
+	for (const char *request : { "GET /body HTTP/1.1\r\nHost: esp\r\nConnection: close\r\n\r\n",
+			 "GET /body HTTP/1.1\r\nHost: esp\r\nAccept-Encoding: gzip;q=0\r\nConnection: close\r\n\r\n" }) {
+		r = get(request);
+		head = r.find("\r\n\r\n") + 4;
+		TEST_ASSERT_TRUE(r.substr(0, head).find("Content-Encoding") == std::string::npos);
+		TEST_ASSERT_TRUE(unchunk(r, head) == body);
+	}
+}
+
+void test_benchmark(void)
+{
+	struct { const char *name; std::string data; } inputs[] = {
+		{ "CSV log, 60k lines", csvLog(60000) },
+		{ "JSON history", jsonHistory(20000) },
+		{ "random bytes", randomBytes(300000) },
+	};
+
+	printf("encoder %u bytes, %u byte window\n", (unsigned)sizeof(AsyncGzipEncoder), ASYNC_GZIP_WINDOW);
+	for (auto &input : inputs) {
+		const std::string &in = input.data;
+		std::string out;
+		double seconds = 1e9;
+
+		// the best of a few runs, in pieces of a TCP segment
+		for (int run = 0; run < 3; run++) {
+			auto start = std::chrono::steady_clock::now();
+			out = gzip(in, 1436, 1436);
+			seconds = std::min(seconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+		}
+		TEST_ASSERT_TRUE(gunzip(out) == in);
+		printf("%-20s %8u bytes, ratio %5.2f (zlib -6 %5.2f), %5.1f ms CPU per MB\n", input.name, (unsigned)in.size(),
+			(double)in.size() / out.size(), (double)in.size() / zlibSize(in, 6), seconds * 1e3 / (in.size() / 1e6));
+	}
+
+#ifndef __GLIBC__
+	TEST_IGNORE_MESSAGE("counts allocations through glibc's malloc");
+#else
+	size_t plain, gzipped;
+
+	body = inputs[0].data;
+	get("GET /body HTTP/1.1\r\nHost: esp\r\nConnection: close\r\n\r\n", &plain);
+	get("GET /body HTTP/1.1\r\nHost: esp\r\nAccept-Encoding: gzip\r\nConnection: close\r\n\r\n", &gzipped);
+	printf("most heap held for the CSV log: %u bytes plain, %u gzipped\n", (unsigned)plain, (unsigned)gzipped);
+	// the encoder, and nothing that grows with the body
+	TEST_ASSERT_TRUE(gzipped <= plain + sizeof(AsyncGzipEncoder) + 1024);
+#endif
+}
+
+int main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+	UNITY_BEGIN();
+	RUN_TEST(test_round_trip_through_zlib);
+	RUN_TEST(test_incompressible_input_is_stored);
+	RUN_TEST(test_response_is_gzipped_for_clients_taking_it);
+	RUN_TEST(test_benchmark);
+	return UNITY_END();
+}
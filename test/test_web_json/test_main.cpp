@@ -0,0 +1,472 @@
+// AsyncJson against ArduinoJson 6 and AsyncTCPSim: the streamed response
+// is byte for byte what serializeJson() writes, in any send window; a
+// document nested too deep for the serializer resets the connection
+// rather than ending a truncated response; and request bodies parse into
+// the same document as deserializeJson() would make of them, integers
+// beyond 2^53 included, however the body is split.
+//
+// test_benchmark takes a document of 200 KB of readings and prints the CPU
+// time and the most heap held by serializeJson() into one string, by the
+// streamed serializer in TCP segments, by GET of it as an
+// AsyncJsonResponse and by POST of it to an AsyncCallbackJsonWebHandler.
+// Neither the response nor the request body may hold the text whole, only
+// the document itself.
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <ESPAsyncWebServer.h>
+#include <AsyncJson.h>
+#include <AsyncTCP.h>
+#include <unity.h>
+
+#include <malloc.h>
+#include <stdlib.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#define PORT 80
+#define BIG_TEXT (200 * 1024)           // what the readings serialize to, at least
+#define BIG_CAPACITY (2 * 1024 * 1024)  // the document that holds them
+
+typedef std::chrono::steady_clock Clock;
+
+// bytes allocated and not yet freed, with glibc, and the most there were
+static size_t live;
+static size_t peak;
+
+#ifdef __GLIBC__
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t n, size_t size);
+extern "C" void *__libc_realloc(void *p, size_t size);
+extern "C" void __libc_free(void *p);
+
+static void *counted(void *p)
+{
+	if (p) live += malloc_usable_size(p);
+	if (live > peak) peak = live;
+	return p;
+}
+
+extern "C" void *malloc(size_t size)
+{
+	return counted(__libc_malloc(size));
+}
+
+extern "C" void *calloc(size_t n, size_t size)
+{
+	return counted(__libc_calloc(n, size));
+}
+
+extern "C" void *realloc(void *p, size_t size)
+{
+	if (p) live -= malloc_usable_size(p);
+	return counted(__libc_realloc(p, size));
+}
+
+extern "C" void free(void *p)
+{
+	if (p) live -= malloc_usable_size(p);
+	__libc_free(p);
+}
+#endif
+
+static AsyncWebServer *server;
+static int depth;               // nesting of the document /json sends
+static std::string parsed;      // what /echo got, serialized
+static uint32_t requests;
+static size_t bigReadings;      // elements of the array /bigecho got
+
+static void fill(JsonVariant root)
+{
+	JsonObject o = root.as<JsonObject>();
+
+	o["name"] = "probe \"kitchen\"\\\n\t\x01";
+	o["id"] = 42;
+	o["negative"] = -7;
+	o["big"] = (int64_t)9007199254740993LL;
+	o["unsigned"] = (uint64_t)18446744073709551615ULL;
+	o["ratio"] = 0.25;
+	o["on"] = true;
+	o["off"] = false;
+	o["none"] = (const char *)nullptr;
+	JsonArray a = o.createNestedArray("samples");
+	for (int i = 0; i < 40; i++) {
+		JsonObject s = a.createNestedObject();
+		s["t"] = 1700000000 + i;
+		s["c"] = 21.5 + i / 8.0;
+		s["tag"] = std::string(i % 7, 'x');
+	}
+	o.createNestedArray("empty");
+	o.createNestedObject("nothing");
+}
+
+static void nest(JsonVariant root, int levels)
+{
+	JsonArray a = root.as<JsonArray>();
+
+	for (int i = 1; i < levels; i++) a = a.createNestedArray();
+	a.add(1);
+}
+
+// readings as the logger lists them, in batches until they make BIG_TEXT
+static void readings(JsonVariant root)
+{
+	static const char *probes[] = { "28-000001", "28-000002", "28-000003", "28-000004",
+		"28-000005", "28-000006", "28-000007", "28-000008" };
+	JsonArray a = root.as<JsonArray>();
+	uint32_t i = 0;
+
+	while (measureJson(root) < BIG_TEXT) {
+		for (int batch = 0; batch < 100; batch++, i++) {
+			JsonObject o = a.createNestedObject();
+			o["id"] = i;
+			o["time"] = 1700000000UL + i * 60;
+			o["probe"] = probes[i % 8];
+			o["c"] = 20 + (i % 40) / 4.0;
+			o["ok"] = true;
+		}
+	}
+}
+
+static void onJson(AsyncWebServerRequest *request)
+{
+	AsyncJsonResponse *response = new AsyncJsonResponse(depth > 0, 16384);
+
+	if (depth > 0) nest(response->getRoot(), depth);
+	else fill(response->getRoot());
+	request->send(response);
+}
+
+static void onBig(AsyncWebServerRequest *request)
+{
+	AsyncJsonResponse *response = new AsyncJsonResponse(true, BIG_CAPACITY);
+
+	readings(response->getRoot());
+	request->send(response);
+}
+
+static void onBigEcho(AsyncWebServerRequest *request, JsonVariant &json)
+{
+	bigReadings = json.as<JsonArray>().size();
+	request->send(204);
+}
+
+static void onEcho(AsyncWebServerRequest *request, JsonVariant &json)
+{
+	requests++;
+	parsed.clear();
+	serializeJson(json, parsed);
+	request->send(204);
+}
+
+static std::string expected(void)
+{
+	DynamicJsonDocument doc(16384);
+	std::string s;
+
+	doc.to<JsonObject>();
+	fill(doc.as<JsonVariant>());
+	serializeJson(doc, s);
+	return s;
+}
+
+// the response to GET /json in the given window, acked as it comes
+static std::string get(size_t window, bool http10 = false, AsyncTCPSimPeer *out = nullptr)
+{
+	AsyncTCPSimPeer local;
+	AsyncTCPSimPeer &peer = out ? *out : local;
+
+	peer.window = window;
+	TEST_ASSERT_TRUE(AsyncTCPSim::connect(PORT, &peer));
+	peer.send(http10 ? "GET /json HTTP/1.0\r\n\r\n" : "GET /json HTTP/1.1\r\nHost: esp\r\n\r\n");
+	for (int i = 0; i < 100000 && peer.unacked; i++) peer.ack();
+	return peer.received;
+}
+
+// the body of a chunked response; false unless it ends with the last chunk
+static bool dechunk(const std::string &response, std::string &content)
+{
+	size_t at = response.find("\r\n\r\n");
+
+	content.clear();
+	if (at == std::string::npos) return false;
+	at += 4;
+	for (;;) {
+		size_t eol = response.find("\r\n", at);
+		if (eol == std::string::npos) return false;
+		size_t size = strtoul(response.c_str() + at, NULL, 16);
+		at = eol + 2;
+		if (!size) return response.compare(at, std::string::npos, "\r\n") == 0;
+		if (at + size + 2 > response.size()) return false;
+		content.append(response, at, size);
+		at += size + 2;
+	}
+}
+
+static std::string post(const std::string &body, const std::vector<size_t> &splits, const char *uri = "/echo")
+{
+	AsyncTCPSimPeer peer;
+
+	TEST_ASSERT_TRUE(AsyncTCPSim::connect(PORT, &peer));
+	peer.send((std::string("POST ") + uri + " HTTP/1.1\r\nHost: esp\r\n"
+		+ "Content-Type: application/json\r\n"
+		+ "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n").c_str());
+	size_t at = 0;
+	for (size_t s : splits) {
+		peer.send(body.data() + at, s - at);
+		at = s;
+	}
+	peer.send(body.data() + at, body.size() - at);
+	peer.ack();
+	std::string response = peer.received;
+	peer.close();
+	return response;
+}
+
+void setUp(void)
+{
+	HostClock::reset();
+	depth = 0;
+	parsed.clear();
+	requests = 0;
+	bigReadings = 0;
+	server = new AsyncWebServer(PORT);
+	server->on("/json", HTTP_GET, onJson);
+	server->on("/big", HTTP_GET, onBig);
+	server->addHandler(new AsyncCallbackJsonWebHandler("/echo", onEcho, 4096));
+	AsyncCallbackJsonWebHandler *big = new AsyncCallbackJsonWebHandler("/bigecho", onBigEcho, BIG_CAPACITY);
+	big->setMaxContentLength(1024 * 1024);
+	server->addHandler(big);
+	server->begin();
+}
+
+void tearDown(void)
+{
+	delete server;
+}
+
+void test_serializer_matches_serializeJson_in_every_buffer_size(void)
+{
+	DynamicJsonDocument doc(16384);
+	std::string want = expected();
+
+	doc.to<JsonObject>();
+	fill(doc.as<JsonVariant>());
+	for (size_t size = 1; size <= 64; size++) {
+		AsyncJsonSerializer serializer(doc.as<JsonVariant>());
+		std::vector<uint8_t> buf(size);
+		std::string got;
+		size_t n;
+
+		while ((n = serializer.read(buf.data(), size)) > 0) {
+			TEST_ASSERT_TRUE(n <= size);
+			got.append((const char *)buf.data(), n);
+		}
+		TEST_ASSERT_TRUE(serializer.done());
+		TEST_ASSERT_FALSE(serializer.failed());
+		TEST_ASSERT_EQUAL_STRING(want.c_str(), got.c_str());
+	}
+}
+
+void test_chunked_response_matches_serializeJson_in_every_window(void)
+{
+	std::string want = expected();
+
+	for (size_t window = 9; window <= 600; window += window < 80 ? 1 : 37) {
+		std::string content;
+		std::string response = get(window);
+
+		TEST_ASSERT_EQUAL(0, response.find("HTTP/1.1 200 OK\r\n"));
+		TEST_ASSERT_TRUE(response.find("Transfer-Encoding: chunked\r\n") != std::string::npos);
+		TEST_ASSERT_TRUE(dechunk(response, content));
+		TEST_ASSERT_EQUAL_STRING(want.c_str(), content.c_str());
+	}
+}
+
+void test_response_to_http10_is_sent_until_close(void)
+{
+	std::string want = expected();
+	AsyncTCPSimPeer peer;
+	std::string response = get(300, true, &peer);
+	size_t at = response.find("\r\n\r\n");
+
+	TEST_ASSERT_TRUE(at != std::string::npos);
+	std::string content = response.substr(at + 4);
+	TEST_ASSERT_EQUAL_STRING(want.c_str(), content.c_str());
+	TEST_ASSERT_TRUE(peer.closed);
+	TEST_ASSERT_FALSE(peer.reset);
+}
+
+void test_too_deep_a_document_resets_the_connection(void)
+{
+	// as deep as it follows is fine
+	depth = ASYNC_JSON_MAX_DEPTH;
+	std::string content;
+	TEST_ASSERT_TRUE(dechunk(get(200), content));
+	TEST_ASSERT_EQUAL_STRING((std::string(ASYNC_JSON_MAX_DEPTH, '[') + "1" + std::string(ASYNC_JSON_MAX_DEPTH, ']')).c_str(), content.c_str());
+
+	// one more and no response may look complete, in any window
+	depth = ASYNC_JSON_MAX_DEPTH + 1;
+	for (size_t window = 9; window <= 64; window++) {
+		AsyncTCPSimPeer peer;
+		std::string response = get(window, false, &peer);
+
+		TEST_ASSERT_TRUE(peer.reset);
+		TEST_ASSERT_FALSE(dechunk(response, content));
+		// the error reaches the request with the next event, which frees it
+		peer.poll();
+		TEST_ASSERT_NULL(peer.client);
+	}
+
+	// nor does one sent until close
+	AsyncTCPSimPeer peer;
+	get(64, true, &peer);
+	TEST_ASSERT_TRUE(peer.reset);
+	peer.poll();
+	TEST_ASSERT_NULL(peer.client);
+
+	// and the server still answers
+	depth = 0;
+	TEST_ASSERT_TRUE(dechunk(get(600), content));
+}
+
+void test_body_parses_as_deserializeJson_at_every_split(void)
+{
+	const char *body = "{\"a\":9007199254740993,\"b\":-9223372036854775808,"
+		"\"c\":18446744073709551615,\"d\":18446744073709551616,"
+		"\"e\":-9223372036854775809,\"f\":1e3,\"g\":-0.5,\"h\":0,"
+		"\"s\":\"\\u00e9\\ud83d\\ude00\\\"\",\"l\":[true,false,null,[{}]]}";
+	DynamicJsonDocument doc(4096);
+	std::string want;
+
+	TEST_ASSERT_TRUE(deserializeJson(doc, body) == DeserializationError::Ok);
+	serializeJson(doc, want);
+	// integers that fit stay integers ...
+	TEST_ASSERT_TRUE(doc["a"].is<int64_t>());
+	TEST_ASSERT_TRUE(doc["b"].is<int64_t>());
+	TEST_ASSERT_TRUE(doc["c"].is<uint64_t>());
+	// ... the others are doubles, as are fractions and exponents
+	TEST_ASSERT_TRUE(doc["d"].is<double>() && !doc["d"].is<uint64_t>());
+	TEST_ASSERT_TRUE(doc["f"].is<double>() && !doc["f"].is<int64_t>());
+
+	std::string b(body);
+	for (size_t at = 0; at < b.size(); at++) {
+		std::vector<size_t> splits;
+		if (at) splits.push_back(at);
+		std::string response = post(b, splits);
+		TEST_ASSERT_EQUAL(0, response.find("HTTP/1.1 204"));
+		TEST_ASSERT_EQUAL_STRING(want.c_str(), parsed.c_str());
+	}
+	TEST_ASSERT_EQUAL_UINT32(b.size(), requests);
+}
+
+static double since(Clock::time_point start)
+{
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void test_benchmark(void)
+{
+	DynamicJsonDocument doc(BIG_CAPACITY);
+	std::vector<uint8_t> segment(1460);
+	std::string text, streamed, content;
+	size_t before, held;
+	Clock::time_point start;
+	double seconds;
+
+	doc.to<JsonArray>();
+	readings(doc.as<JsonVariant>());
+	TEST_ASSERT_FALSE(doc.overflowed());
+	size_t size = measureJson(doc);
+	size_t count = doc.as<JsonArray>().size();
+	TEST_ASSERT_TRUE(size >= BIG_TEXT);
+	streamed.reserve(size);
+
+	// the whole text at once, as a response that sets its length would need
+	before = peak = live;
+	start = Clock::now();
+	serializeJson(doc, text);
+	seconds = since(start);
+	held = peak - before;
+	TEST_ASSERT_EQUAL_UINT32(size, text.size());
+	printf("%u readings, %u bytes: serializeJson()    %6.2f ms, %7u bytes of heap\n", (unsigned)count,
+		(unsigned)size, seconds * 1e3, (unsigned)held);
+#ifdef __GLIBC__
+	TEST_ASSERT_TRUE(held >= size);
+#endif
+
+	// a TCP segment at a time, each sent before the next is written
+	before = peak = live;
+	start = Clock::now();
+	{
+		AsyncJsonSerializer serializer(doc.as<JsonVariant>());
+		size_t n;
+
+		while ((n = serializer.read(segment.data(), segment.size())) > 0) streamed.append((const char *)segment.data(), n);
+		TEST_ASSERT_TRUE(serializer.done());
+	}
+	seconds = since(start);
+	held = peak - before;
+	TEST_ASSERT_TRUE(text == streamed);
+	printf("%u readings, %u bytes: AsyncJsonSerializer %6.2f ms, %7u bytes of heap\n", (unsigned)count,
+		(unsigned)size, seconds * 1e3, (unsigned)held);
+#ifdef __GLIBC__
+	TEST_ASSERT_EQUAL_UINT32(0, held);
+#endif
+
+	// GET as an AsyncJsonResponse: its document, and the response in pieces
+	{
+		AsyncTCPSimPeer peer;
+
+		peer.window = 4 * 1460;
+		peer.received.reserve(size + size / 8);
+		before = peak = live;
+		start = Clock::now();
+		TEST_ASSERT_TRUE(AsyncTCPSim::connect(PORT, &peer));
+		peer.send("GET /big HTTP/1.1\r\nHost: esp\r\n\r\n");
+		for (int i = 0; i < 100000 && peer.unacked; i++) peer.ack();
+		seconds = since(start);
+		held = peak - before;
+		TEST_ASSERT_TRUE(dechunk(peer.received, content));
+		TEST_ASSERT_TRUE(text == content);
+		peer.close();
+	}
+	printf("GET  /big:     %6.2f ms, %7u bytes of heap over the %u byte document\n", seconds * 1e3,
+		(unsigned)(held > BIG_CAPACITY ? held - BIG_CAPACITY : 0), BIG_CAPACITY);
+#ifdef __GLIBC__
+	TEST_ASSERT_TRUE(held >= BIG_CAPACITY);
+	TEST_ASSERT_TRUE(held < BIG_CAPACITY + size / 4);
+#endif
+
+	// POST in TCP segments to a handler: its document and the tokenizer
+	std::vector<size_t> splits;
+	for (size_t at = 1460; at < size; at += 1460) splits.push_back(at);
+	before = peak = live;
+	start = Clock::now();
+	std::string response = post(text, splits, "/bigecho");
+	seconds = since(start);
+	held = peak - before;
+	TEST_ASSERT_EQUAL(0, response.find("HTTP/1.1 204"));
+	TEST_ASSERT_EQUAL_UINT32(count, bigReadings);
+	printf("POST /bigecho: %6.2f ms, %7u bytes of heap over the %u byte document, %.0f MB/s\n", seconds * 1e3,
+		(unsigned)(held > BIG_CAPACITY ? held - BIG_CAPACITY : 0), BIG_CAPACITY, size / seconds / 1e6);
+#ifdef __GLIBC__
+	TEST_ASSERT_TRUE(held >= BIG_CAPACITY);
+	TEST_ASSERT_TRUE(held < BIG_CAPACITY + size / 4);
+#endif
+}
+
+int main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+	UNITY_BEGIN();
+	RUN_TEST(test_serializer_matches_serializeJson_in_every_buffer_size);
+	RUN_TEST(test_chunked_response_matches_serializeJson_in_every_window);
+	RUN_TEST(test_response_to_http10_is_sent_until_close);
+	RUN_TEST(test_too_deep_a_document_resets_the_connection);
+	RUN_TEST(test_body_parses_as_deserializeJson_at_every_split);
+	RUN_TEST(test_benchmark);
+	return UNITY_END();
+}
@@ -0,0 +1,309 @@
+// AsyncJsonTokenizer fed in chunks: a document split at every byte offset,
+// and fed a byte at a time, gives the same events as in one piece, through
+// escapes, surrogate pairs, numbers and literals cut in half; and number
+// text converts to integers where it fits.
+//
+// test_heap_does_not_grow_with_the_body feeds bodies of 1 KB, 64 KB and
+// 1 MB in TCP segments of 1460 bytes and prints the most heap the
+// tokenizer held and MB/s; the heap has to be the same for all three.
+
+#include <Arduino.h>
+#include <AsyncJsonTokenizer.h>
+#include <unity.h>
+
+#include <malloc.h>
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// bytes allocated and not yet freed, with glibc, and the most there were
+static size_t live;
+static size_t peak;
+
+#ifdef __GLIBC__
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t n, size_t size);
+extern "C" void *__libc_realloc(void *p, size_t size);
+extern "C" void __libc_free(void *p);
+
+static void *counted(void *p)
+{
+	if (p) live += malloc_usable_size(p);
+	if (live > peak) peak = live;
+	return p;
+}
+
+extern "C" void *malloc(size_t size)
+{
+	return counted(__libc_malloc(size));
+}
+
+extern "C" void *calloc(size_t n, size_t size)
+{
+	return counted(__libc_calloc(n, size));
+}
+
+extern "C" void *realloc(void *p, size_t size)
+{
+	if (p) live -= malloc_usable_size(p);
+	return counted(__libc_realloc(p, size));
+}
+
+extern "C" void free(void *p)
+{
+	if (p) live -= malloc_usable_size(p);
+	__libc_free(p);
+}
+#endif
+
+// the events as text, one per line
+class Recorder : public AsyncJsonListener
+{
+  public:
+    std::string events;
+
+    bool beginObject(const char *key) override { add("{", key); return true; }
+    bool beginArray(const char *key) override { add("[", key); return true; }
+    bool end() override { events += "end\n"; return true; }
+    bool value(const char *key, AsyncJsonToken type, const char *text, size_t len) override
+    {
+        static const char *types[] = { "s", "n", "t", "f", "0" };
+        add(types[type], key);
+        events.pop_back();
+        events += "=" + std::string(text, len) + "\n";
+        return true;
+    }
+
+  private:
+    void add(const char *what, const char *key)
+    {
+        events += what;
+        if (key) events += std::string(" ") + key;
+        events += "\n";
+    }
+};
+
+static const char DOCUMENT[] =
+	"{\"id\":4294967296,\"neg\":-9223372036854775808,\"max\":18446744073709551615,"
+	"\"t\":-12.5e-3,\"zero\":0,\"ok\":true,\"off\":false,\"none\":null,"
+	"\"s\":\"tab\\there \\\"quoted\\\" \\\\ \\/ \\u00e9\\u20AC\\uD83D\\uDE00\","
+	"\"nested\":{\"a\":[1,[2,[3,{}]],[]],\"b\":{\"c\":\"\"}},"
+	"\"list\" : [ 1 , -0.5 , 1e10 , \"x\" , true , null ] }";
+
+static std::string parse(const std::string &doc, const std::vector<size_t> &splits, bool *ok)
+{
+	Recorder r;
+	AsyncJsonTokenizer t(&r);
+	size_t at = 0;
+
+	*ok = true;
+	for (size_t s : splits) {
+		*ok &= t.feed((const uint8_t *)doc.data() + at, s - at);
+		at = s;
+	}
+	*ok &= t.feed((const uint8_t *)doc.data() + at, doc.size() - at);
+	*ok &= t.finish();
+	return r.events;
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_document_in_one_piece(void)
+{
+	bool ok;
+	std::string e = parse(DOCUMENT, {}, &ok);
+
+	TEST_ASSERT_TRUE(ok);
+	TEST_ASSERT_NOT_EQUAL(std::string::npos, e.find("n id=4294967296\n"));
+	TEST_ASSERT_NOT_EQUAL(std::string::npos, e.find("n t=-12.5e-3\n"));
+	TEST_ASSERT_NOT_EQUAL(std::string::npos, e.find("s s=tab\there \"quoted\" \\ / \xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80\n"));
+	TEST_ASSERT_NOT_EQUAL(std::string::npos, e.find("[ a\nn=1\n[\nn=2\n[\nn=3\n{\nend\nend\nend\n[\nend\nend\n"));
+	TEST_ASSERT_NOT_EQUAL(std::string::npos, e.find("s c=\n"));
+}
+
+void test_split_at_every_offset(void)
+{
+	std::string doc = DOCUMENT;
+	bool ok;
+	std::string expected = parse(doc, {}, &ok);
+
+	for (size_t at = 1; at < doc.size(); at++) {
+		std::string e = parse(doc, { at }, &ok);
+		TEST_ASSERT_EQUAL_STRING(expected.c_str(), e.c_str());
+		TEST_ASSERT_TRUE(ok);
+	}
+}
+
+void test_one_byte_at_a_time(void)
+{
+	std::string doc = DOCUMENT;
+	std::vector<size_t> splits;
+	bool ok;
+	std::string expected = parse(doc, {}, &ok);
+
+	for (size_t at = 1; at < doc.size(); at++) splits.push_back(at);
+	std::string e = parse(doc, splits, &ok);
+	TEST_ASSERT_EQUAL_STRING(expected.c_str(), e.c_str());
+	TEST_ASSERT_TRUE(ok);
+}
+
+void test_top_level_number_ends_with_the_input(void)
+{
+	bool ok;
+
+	std::string e = parse("12345678901", { 5 }, &ok);
+	TEST_ASSERT_EQUAL_STRING("n=12345678901\n", e.c_str());
+	TEST_ASSERT_TRUE(ok);
+	e = parse("true", { 2 }, &ok);
+	TEST_ASSERT_EQUAL_STRING("t=true\n", e.c_str());
+	TEST_ASSERT_TRUE(ok);
+}
+
+void test_malformed_input_fails_wherever_it_is_split(void)
+{
+	static const char *bad[] = {
+		"{\"a\":01}", "{\"a\":1.}", "{\"a\":-}", "{\"a\":tru}", "{\"a\" 1}",
+		"[1,]x", "{\"a\":\"\\x\"}", "{\"a\":\"\\u12G4\"}", "[1] 2", "{\"a\":\"\x01\"}",
+	};
+
+	for (const char *doc : bad) {
+		for (size_t at = 1; at < strlen(doc); at++) {
+			bool ok;
+			parse(doc, { at }, &ok);
+			TEST_ASSERT_FALSE_MESSAGE(ok, doc);
+		}
+	}
+}
+
+void test_numbers_convert_to_integers_where_they_fit(void)
+{
+	AsyncJsonNumber n;
+
+	// ten digits and more are still integers
+	n = asyncJsonNumber("1234567890");
+	TEST_ASSERT_EQUAL(AJSON_UNSIGNED, n.type);
+	TEST_ASSERT_TRUE(n.u == 1234567890ULL);
+	n = asyncJsonNumber("4294967296");
+	TEST_ASSERT_EQUAL(AJSON_UNSIGNED, n.type);
+	TEST_ASSERT_TRUE(n.u == 4294967296ULL);
+	n = asyncJsonNumber("18446744073709551615");
+	TEST_ASSERT_EQUAL(AJSON_UNSIGNED, n.type);
+	TEST_ASSERT_TRUE(n.u == UINT64_MAX);
+	n = asyncJsonNumber("-9223372036854775808");
+	TEST_ASSERT_EQUAL(AJSON_INTEGER, n.type);
+	TEST_ASSERT_TRUE(n.i == INT64_MIN);
+	n = asyncJsonNumber("-0");
+	TEST_ASSERT_EQUAL(AJSON_INTEGER, n.type);
+	TEST_ASSERT_TRUE(n.i == 0);
+
+	// past 64 bits, a fraction or an exponent: double
+	n = asyncJsonNumber("18446744073709551616");
+	TEST_ASSERT_EQUAL(AJSON_DOUBLE, n.type);
+	TEST_ASSERT_TRUE(n.d == 18446744073709551616.0);
+	n = asyncJsonNumber("-9223372036854775809");
+	TEST_ASSERT_EQUAL(AJSON_DOUBLE, n.type);
+	n = asyncJsonNumber("2.5");
+	TEST_ASSERT_EQUAL(AJSON_DOUBLE, n.type);
+	TEST_ASSERT_TRUE(n.d == 2.5);
+	n = asyncJsonNumber("1E3");
+	TEST_ASSERT_EQUAL(AJSON_DOUBLE, n.type);
+	TEST_ASSERT_TRUE(n.d == 1000.0);
+}
+
+// counts what a handler would act on, keeps nothing
+class Counter : public AsyncJsonListener
+{
+  public:
+    uint32_t values = 0;
+    uint32_t depth = 0;
+
+    bool beginObject(const char *key) override { (void)key; depth++; return true; }
+    bool beginArray(const char *key) override { (void)key; depth++; return true; }
+    bool end() override { depth--; return true; }
+    bool value(const char *key, AsyncJsonToken type, const char *text, size_t len) override
+    {
+        (void)key;
+        (void)type;
+        (void)text;
+        (void)len;
+        values++;
+        return true;
+    }
+};
+
+// what a settings or history upload looks like, about 'size' bytes
+static std::string body(size_t size, uint32_t *values)
+{
+	std::string doc = "{\"samples\":[";
+	char item[128];
+
+	*values = 0;
+	for (uint32_t i = 0; doc.size() < size; i++) {
+		snprintf(item, sizeof item, "%s{\"id\":%lu,\"time\":%lu,\"probe\":\"28-%06lx\",\"c\":%d.%02d,\"ok\":true}",
+			i ? "," : "", (unsigned long)i, 1700000000UL + i * 60, (unsigned long)(i % 8), 20 + (int)(i % 5), (int)(i % 100));
+		doc += item;
+		*values += 5;
+	}
+	doc += "]}";
+	return doc;
+}
+
+void test_heap_does_not_grow_with_the_body(void)
+{
+	const size_t sizes[] = { 1024, 64 * 1024, 1024 * 1024 };
+	size_t held[3];
+
+	for (int i = 0; i < 3; i++) {
+		uint32_t values;
+		std::string doc = body(sizes[i], &values);
+		Counter counter;
+		double seconds = 1e9;
+
+		for (int run = 0; run < 3; run++) {
+			counter.values = 0;
+			size_t before = live;
+			peak = live;
+			auto start = std::chrono::steady_clock::now();
+			AsyncJsonTokenizer *t = new AsyncJsonTokenizer(&counter);
+			for (size_t at = 0; at < doc.size(); at += 1460)
+				TEST_ASSERT_TRUE(t->feed((const uint8_t *)doc.data() + at, std::min((size_t)1460, doc.size() - at)));
+			TEST_ASSERT_TRUE(t->finish());
+			delete t;
+			seconds = std::min(seconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+			held[i] = peak - before;
+		}
+		TEST_ASSERT_EQUAL_UINT32(values, counter.values);
+		TEST_ASSERT_EQUAL_UINT32(0, counter.depth);
+		printf("%7u byte body: %u bytes of heap held, %.0f MB/s\n", (unsigned)doc.size(), (unsigned)held[i],
+			doc.size() / seconds / 1e6);
+	}
+#ifdef __GLIBC__
+	// the tokenizer itself, nothing that grows with the body
+	TEST_ASSERT_TRUE(held[0] >= sizeof(AsyncJsonTokenizer));
+	TEST_ASSERT_EQUAL_UINT32(held[0], held[1]);
+	TEST_ASSERT_EQUAL_UINT32(held[0], held[2]);
+#endif
+}
+
+int main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+	UNITY_BEGIN();
+	RUN_TEST(test_document_in_one_piece);
+	RUN_TEST(test_split_at_every_offset);
+	RUN_TEST(test_one_byte_at_a_time);
+	RUN_TEST(test_top_level_number_ends_with_the_input);
+	RUN_TEST(test_malformed_input_fails_wherever_it_is_split);
+	RUN_TEST(test_numbers_convert_to_integers_where_they_fit);
+	RUN_TEST(test_heap_does_not_grow_with_the_body);
+	return UNITY_END();
+}
@@ -0,0 +1,368 @@
+// Persistent connections against AsyncTCPSim: requests pipelined in one
+// segment are answered in order on the same connection; a body and the
+// request after it come out the same however the segments split them;
+// HTTP/1.0 and Connection: close end the connection after the response,
+// and idle connections, too many requests or an overflowing pipeline
+// buffer end it too.
+//
+// test_benchmark sends 1000 requests one after another from one client,
+// once on persistent connections, opening a new one whenever the server
+// ends one, and once on a connection per request, and prints the time and
+// the heap allocations a request took each way.  Only the allocations are
+// asserted; the time on a shared host is only printed.
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <AsyncTCP.h>
+#include <unity.h>
+
+#include <malloc.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#define PORT 80
+
+// heap allocations made, and their bytes, with glibc
+static size_t allocations;
+static size_t allocated;
+
+#ifdef __GLIBC__
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t n, size_t size);
+extern "C" void *__libc_realloc(void *p, size_t size);
+
+static void *counted(void *p)
+{
+	if (p) {
+		allocations++;
+		allocated += malloc_usable_size(p);
+	}
+	return p;
+}
+
+extern "C" void *malloc(size_t size)
+{
+	return counted(__libc_malloc(size));
+}
+
+extern "C" void *calloc(size_t n, size_t size)
+{
+	return counted(__libc_calloc(n, size));
+}
+
+extern "C" void *realloc(void *p, size_t size)
+{
+	return counted(__libc_realloc(p, size));
+}
+#endif
+
+static AsyncWebServer *server;
+static std::string body;
+static std::vector<std::string> served;
+
+static void onPage(AsyncWebServerRequest *request)
+{
+	served.push_back(request->url().c_str());
+	request->send(200, "text/plain", request->url());
+}
+
+static void onEcho(AsyncWebServerRequest *request)
+{
+	served.push_back("echo:" + body);
+	request->send(200, "text/plain", body.c_str());
+}
+
+static void onBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+{
+	(void)request;
+	(void)total;
+	if (!index) body.clear();
+	body.append((const char *)data, len);
+}
+
+static void connect(AsyncTCPSimPeer &peer)
+{
+	TEST_ASSERT_TRUE(AsyncTCPSim::connect(PORT, &peer));
+}
+
+static void drain(AsyncTCPSimPeer &peer)
+{
+	while (peer.client && peer.unacked) peer.ack();
+}
+
+// the bodies of the Content-Length delimited responses in s, in order
+static std::vector<std::string> responses(const std::string &s)
+{
+	std::vector<std::string> out;
+	size_t at = 0;
+
+	while ((at = s.find("HTTP/1.", at)) != std::string::npos) {
+		size_t head = s.find("\r\n\r\n", at);
+		size_t length = s.find("Content-Length: ", at);
+		TEST_ASSERT_TRUE(head != std::string::npos && length < head);
+		size_t n = strtoul(s.c_str() + length + 16, NULL, 10);
+		out.push_back(s.substr(head + 4, n));
+		at = head + 4 + n;
+	}
+	return out;
+}
+
+static bool says(const std::string &s, const char *header)
+{
+	return s.find(std::string("\r\n") + header + "\r\n") != std::string::npos;
+}
+
+void setUp(void)
+{
+	HostClock::reset();
+	body.clear();
+	served.clear();
+	server = new AsyncWebServer(PORT);
+	server->on("/a", HTTP_GET, onPage);
+	server->on("/b", HTTP_GET, onPage);
+	server->on("/echo", HTTP_POST, onEcho, NULL, onBody);
+	server->begin();
+}
+
+void tearDown(void)
+{
+	delete server;
+}
+
+void test_two_requests_in_one_segment(void)
+{
+	AsyncTCPSimPeer peer;
+	connect(peer);
+	AsyncClient *client = peer.client;
+
+	peer.send("GET /a HTTP/1.1\r\nHost: esp\r\n\r\nGET /b HTTP/1.1\r\nHost: esp\r\n\r\n");
+	drain(peer);
+	std::vector<std::string> r = responses(peer.received);
+	TEST_ASSERT_EQUAL_UINT32(2, r.size());
+	TEST_ASSERT_EQUAL_STRING("/a", r[0].c_str());
+	TEST_ASSERT_EQUAL_STRING("/b", r[1].c_str());
+	TEST_ASSERT_TRUE(says(peer.received, "Connection: keep-alive"));
+
+	// still the same connection, and it takes more
+	TEST_ASSERT_TRUE(peer.client == client);
+	TEST_ASSERT_FALSE(peer.closed);
+	peer.clear();
+	peer.send("GET /a HTTP/1.1\r\nHost: esp\r\n\r\n");
+	drain(peer);
+	TEST_ASSERT_EQUAL_UINT32(1, responses(peer.received).size());
+	TEST_ASSERT_EQUAL_UINT32(1, server->stats().admitted);
+	peer.close();
+	TEST_ASSERT_NULL(peer.client);
+}
+
+void test_body_and_next_request_split_anywhere(void)
+{
+	const std::string stream = "POST /echo HTTP/1.1\r\nHost: esp\r\nContent-Type: text/plain\r\n"
+		"Content-Length: 11\r\n\r\nhello world"
+		"GET /b HTTP/1.1\r\nHost: esp\r\n\r\n"
+		"POST /echo HTTP/1.1\r\nHost: esp\r\nContent-Length: 3\r\n\r\nxyz";
+
+	// every pair of splits, so that the body's end, the next request's
+	// start and the lines between land at every place in a segment
+	for (size_t i = 1; i < stream.size(); i++) {
+		for (size_t j = i; j < stream.size(); j += (j < i + 40 ? 1 : 7)) {
+			AsyncTCPSimPeer peer;
+			served.clear();
+			connect(peer);
+			peer.send(stream.data(), i);
+			drain(peer);
+			if (j > i) {
+				peer.send(stream.data() + i, j - i);
+				drain(peer);
+			}
+			peer.send(stream.data() + j, stream.size() - j);
+			drain(peer);
+
+			std::vector<std::string> r = responses(peer.received);
+			TEST_ASSERT_EQUAL_UINT32(3, r.size());
+			TEST_ASSERT_EQUAL_STRING("hello world", r[0].c_str());
+			TEST_ASSERT_EQUAL_STRING("/b", r[1].c_str());
+			TEST_ASSERT_EQUAL_STRING("xyz", r[2].c_str());
+			TEST_ASSERT_EQUAL_UINT32(3, served.size());
+			TEST_ASSERT_FALSE(peer.closed);
+			peer.close();
+		}
+	}
+}
+
+void test_http10_closes_unless_kept_alive(void)
+{
+	AsyncTCPSimPeer peer;
+	connect(peer);
+	peer.send("GET /a HTTP/1.0\r\n\r\n");
+	drain(peer);
+	TEST_ASSERT_EQUAL(0, peer.received.find("HTTP/1.0 200 OK\r\n"));
+	TEST_ASSERT_TRUE(says(peer.received, "Connection: close"));
+	TEST_ASSERT_EQUAL_UINT32(1, responses(peer.received).size());
+	// the server ends it, the client need not
+	TEST_ASSERT_TRUE(peer.closed);
+	TEST_ASSERT_NULL(peer.client);
+
+	// a request pipelined behind it is not answered
+	AsyncTCPSimPeer pipelined;
+	connect(pipelined);
+	pipelined.send("GET /a HTTP/1.0\r\n\r\nGET /b HTTP/1.0\r\n\r\n");
+	drain(pipelined);
+	TEST_ASSERT_EQUAL_UINT32(1, responses(pipelined.received).size());
+	TEST_ASSERT_TRUE(pipelined.closed);
+
+	AsyncTCPSimPeer kept;
+	connect(kept);
+	kept.send("GET /a HTTP/1.0\r\nConnection: keep-alive\r\n\r\n");
+	drain(kept);
+	TEST_ASSERT_TRUE(says(kept.received, "Connection: keep-alive"));
+	TEST_ASSERT_FALSE(kept.closed);
+	kept.send("GET /b HTTP/1.0\r\n\r\n");
+	drain(kept);
+	std::vector<std::string> r = responses(kept.received);
+	TEST_ASSERT_EQUAL_UINT32(2, r.size());
+	TEST_ASSERT_EQUAL_STRING("/b", r[1].c_str());
+	// the second one did not ask to be kept alive
+	TEST_ASSERT_TRUE(kept.closed);
+}
+
+void test_connection_close_closes_after_the_response(void)
+{
+	AsyncTCPSimPeer peer;
+	connect(peer);
+	peer.send("GET /a HTTP/1.1\r\nHost: esp\r\n\r\nGET /b HTTP/1.1\r\nHost: esp\r\nConnection: close\r\n\r\n");
+	drain(peer);
+	std::vector<std::string> r = responses(peer.received);
+	TEST_ASSERT_EQUAL_UINT32(2, r.size());
+	TEST_ASSERT_TRUE(says(peer.received, "Connection: close"));
+	TEST_ASSERT_TRUE(peer.closed);
+	TEST_ASSERT_NULL(peer.client);
+}
+
+void test_idle_connection_times_out(void)
+{
+	AsyncTCPSimPeer peer;
+	connect(peer);
+	peer.send("GET /a HTTP/1.1\r\nHost: esp\r\n\r\n");
+	drain(peer);
+
+	HostClock::advance((WEB_SERVER_KEEPALIVE_TIMEOUT - 1) * 1000000ULL);
+	peer.poll();
+	TEST_ASSERT_NOT_NULL(peer.client);
+	HostClock::advance(1000000);
+	peer.poll();
+	TEST_ASSERT_NULL(peer.client);
+}
+
+void test_connection_ends_after_keepalive_max(void)
+{
+	AsyncTCPSimPeer peer;
+	connect(peer);
+
+	for (int i = 0; i < WEB_SERVER_KEEPALIVE_MAX; i++) {
+		TEST_ASSERT_NOT_NULL(peer.client);
+		peer.send("GET /a HTTP/1.1\r\nHost: esp\r\n\r\n");
+		drain(peer);
+	}
+	TEST_ASSERT_EQUAL_UINT32(WEB_SERVER_KEEPALIVE_MAX, responses(peer.received).size());
+	TEST_ASSERT_TRUE(peer.closed);
+	TEST_ASSERT_NULL(peer.client);
+}
+
+void test_pipeline_overflow_answers_then_closes(void)
+{
+	AsyncTCPSimPeer peer;
+	connect(peer);
+	std::string s = "GET /a HTTP/1.1\r\nHost: esp\r\n\r\n";
+	std::string more;
+	while (more.size() <= WEB_SERVER_PIPELINE_SIZE) more += "GET /b HTTP/1.1\r\nHost: esp\r\n\r\n";
+	peer.send((s + more).c_str());
+	drain(peer);
+	std::vector<std::string> r = responses(peer.received);
+	TEST_ASSERT_EQUAL_UINT32(1, r.size());
+	TEST_ASSERT_EQUAL_STRING("/a", r[0].c_str());
+	TEST_ASSERT_TRUE(peer.closed);
+	TEST_ASSERT_NULL(peer.client);
+}
+
+struct Run {
+	double seconds;
+	size_t allocations, allocated;
+	uint32_t connections;
+};
+
+// 'requests' GETs of /a in turn, each sent once the last is answered; the
+// client's own peers and buffers are made before, to count only the server
+static Run sequential(int requests, bool keepAlive)
+{
+	const char *request = keepAlive ? "GET /a HTTP/1.1\r\nHost: esp\r\n\r\n"
+		: "GET /a HTTP/1.1\r\nHost: esp\r\nConnection: close\r\n\r\n";
+	uint32_t admitted = server->stats().admitted;
+	std::vector<AsyncTCPSimPeer> peers(requests);
+	size_t used = 0;
+	Run run;
+
+	for (AsyncTCPSimPeer &peer : peers) peer.received.reserve(1024);
+	served.clear();
+	served.reserve(requests);
+	run.allocations = allocations;
+	run.allocated = allocated;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < requests; i++) {
+		if (!used || !peers[used - 1].client) connect(peers[used++]);
+		AsyncTCPSimPeer &peer = peers[used - 1];
+		peer.clear();
+		peer.send(request);
+		drain(peer);
+		TEST_ASSERT_EQUAL(0, peer.received.find("HTTP/1.1 200 OK\r\n"));
+	}
+	run.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	run.allocations = allocations - run.allocations;
+	run.allocated = allocated - run.allocated;
+	run.connections = server->stats().admitted - admitted;
+	TEST_ASSERT_EQUAL_UINT32(run.connections, used);
+	if (peers[used - 1].client) peers[used - 1].close();
+	TEST_ASSERT_EQUAL_UINT32(requests, served.size());
+	return run;
+}
+
+void test_benchmark(void)
+{
+	const int requests = 1000;
+
+	// warm up the host's allocator and caches, then time both
+	sequential(requests / 10, true);
+	Run kept = sequential(requests, true);
+	Run closed = sequential(requests, false);
+	const Run *runs[] = { &kept, &closed };
+	const char *names[] = { "keep-alive", "connection per request" };
+
+	for (int i = 0; i < 2; i++) {
+		printf("%-22s %d requests on %4u connections: %5.2f us, %5.1f allocations, %6.0f bytes a request\n",
+			names[i], requests, (unsigned)runs[i]->connections, runs[i]->seconds * 1e6 / requests,
+			(double)runs[i]->allocations / requests, (double)runs[i]->allocated / requests);
+	}
+	TEST_ASSERT_EQUAL_UINT32((requests + WEB_SERVER_KEEPALIVE_MAX - 1) / WEB_SERVER_KEEPALIVE_MAX, kept.connections);
+	TEST_ASSERT_EQUAL_UINT32(requests, closed.connections);
+#ifdef __GLIBC__
+	TEST_ASSERT_TRUE(kept.allocations < closed.allocations);
+	TEST_ASSERT_TRUE(kept.allocated < closed.allocated);
+#endif
+}
+
+int main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+	UNITY_BEGIN();
+	RUN_TEST(test_two_requests_in_one_segment);
+	RUN_TEST(test_body_and_next_request_split_anywhere);
+	RUN_TEST(test_http10_closes_unless_kept_alive);
+	RUN_TEST(test_connection_close_closes_after_the_response);
+	RUN_TEST(test_idle_connection_times_out);
+	RUN_TEST(test_connection_ends_after_keepalive_max);
+	RUN_TEST(test_pipeline_overflow_answers_then_closes);
+	RUN_TEST(test_benchmark);
+	return UNITY_END();
+}
@@ -0,0 +1,503 @@
+// LinkedList (StringArray.h) against a std::list model: 600,000 random
+// adds, removes, nth()s, copies and free()s, loops that remove the value
+// they stand on or another one and add behind themselves, and an
+// _onRemove that removes its value's partner, all leave the two holding
+// the same values in the same order and calling back in the same order.
+//
+// On the heap: a list kept across requests, as the headers of a kept-alive
+// connection are, allocates nothing after the first request however many
+// long-lived blocks land between requests, and a message queue that is
+// added to and popped allocates nothing once it found its size.
+//
+// Taking the front of a queue compares one value however long the queue,
+// also with an iterator holding dead slots in front; a list assigned to
+// inside a loop over it goes on with the new values and ends up holding
+// just those.
+// test_benchmark prints the hot paths against std::list.
+
+#include <Arduino.h>
+#include <StringArray.h>
+#include <unity.h>
+
+#include <malloc.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <list>
+#include <vector>
+
+// allocations made, with glibc
+static size_t allocations;
+
+#ifdef __GLIBC__
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t n, size_t size);
+extern "C" void *__libc_realloc(void *p, size_t size);
+extern "C" void __libc_free(void *p);
+
+extern "C" void *malloc(size_t size)
+{
+	allocations++;
+	return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t n, size_t size)
+{
+	allocations++;
+	return __libc_calloc(n, size);
+}
+
+extern "C" void *realloc(void *p, size_t size)
+{
+	allocations++;
+	return __libc_realloc(p, size);
+}
+
+extern "C" void free(void *p)
+{
+	__libc_free(p);
+}
+#endif
+
+typedef LinkedList<int> List;
+
+static List *list;
+static std::list<int> model;
+static std::vector<int> removed;        // what _onRemove was called with
+static std::vector<int> modelRemoved;
+
+// an even value takes the odd one after it along when it goes
+static void onRemove(const int &v)
+{
+	removed.push_back(v);
+	if (v % 2 == 0) list->remove(v + 1);
+}
+
+static void modelRemove(std::list<int>::iterator it)
+{
+	int v = *it;
+
+	model.erase(it);
+	modelRemoved.push_back(v);
+	if (v % 2 == 0) {
+		auto partner = std::find(model.begin(), model.end(), v + 1);
+		if (partner != model.end()) modelRemove(partner);
+	}
+}
+
+static void assertSame(const List &l)
+{
+	TEST_ASSERT_EQUAL_UINT32(model.size(), l.length());
+	TEST_ASSERT_EQUAL(model.empty(), l.isEmpty());
+	auto it = model.begin();
+	for (const int &v : l) {
+		TEST_ASSERT_TRUE(it != model.end());
+		TEST_ASSERT_EQUAL(*it++, v);
+	}
+	TEST_ASSERT_TRUE(it == model.end());
+	TEST_ASSERT_TRUE(removed == modelRemoved);
+}
+
+// a loop over the list that removes what it visits or something else, and
+// adds behind itself; the values visited must be the model's
+static void iterate(int *next)
+{
+	std::vector<int> visited, modelVisited;
+	int added = 0;
+
+	for (const int &v : *list) {
+		int at = v;
+		visited.push_back(at);
+		if (at % 5 == 0) {
+			list->remove(at);
+		} else if (at % 7 == 0) {
+			list->remove(at + 3);
+		}
+		if (at % 11 == 0 && added < 3) {
+			list->add((*next)++);
+			added++;
+		}
+	}
+	// the same again, on the model, with the values handed out again.
+	// Values are added in increasing order, so the next one to visit is
+	// the first one greater than the last, whatever was removed since.
+	*next -= added;
+	added = 0;
+	for (auto it = model.begin(); it != model.end(); it = std::upper_bound(model.begin(), model.end(), modelVisited.back())) {
+		int at = *it;
+		modelVisited.push_back(at);
+		if (at % 5 == 0) {
+			modelRemove(it);
+		} else if (at % 7 == 0) {
+			auto other = std::find(model.begin(), model.end(), at + 3);
+			if (other != model.end()) modelRemove(other);
+		}
+		if (at % 11 == 0 && added < 3) {
+			model.push_back((*next)++);
+			added++;
+		}
+	}
+	TEST_ASSERT_TRUE(visited == modelVisited);
+}
+
+void setUp(void)
+{
+	model.clear();
+	removed.clear();
+	modelRemoved.clear();
+	list = new List(onRemove);
+}
+
+void tearDown(void)
+{
+	delete list;
+}
+
+void test_matches_a_std_list_model(void)
+{
+	int next = 0;
+
+	srand(7);
+	for (uint32_t op = 0; op < 600000; op++) {
+		int r = rand() % 100;
+		if (r < 40 || model.size() < 2) {
+			list->add(next);
+			model.push_back(next++);
+		} else if (r < 60) {
+			// present or not
+			int v = next - 1 - rand() % (2 * model.size());
+			auto it = std::find(model.begin(), model.end(), v);
+			TEST_ASSERT_EQUAL(it != model.end(), list->remove(v));
+			if (it != model.end()) modelRemove(it);
+		} else if (r < 70) {
+			int k = rand() % 9;
+			bool found = list->remove_first([k](const int &v) { return v % 9 == k; });
+			auto it = std::find_if(model.begin(), model.end(), [k](int v) { return v % 9 == k; });
+			TEST_ASSERT_EQUAL(it != model.end(), found);
+			if (it != model.end()) modelRemove(it);
+		} else if (r < 85) {
+			size_t i = rand() % (model.size() + 1);
+			const int *v = list->nth(i);
+			if (i == model.size()) {
+				TEST_ASSERT_NULL(v);
+			} else {
+				TEST_ASSERT_NOT_NULL(v);
+				TEST_ASSERT_EQUAL(*std::next(model.begin(), i), *v);
+			}
+			TEST_ASSERT_EQUAL(model.front(), list->front());
+			TEST_ASSERT_EQUAL_UINT32(std::count_if(model.begin(), model.end(), [](int v) { return v % 3 == 0; }),
+				list->count_if([](const int &v) { return v % 3 == 0; }));
+		} else if (r < 97) {
+			iterate(&next);
+		} else if (r < 99) {
+			// copies hold the same values; destroying them calls nothing back
+			List copy(*list);
+			List assigned(nullptr);
+			assigned.add(-1);
+			assigned = copy;
+			assertSame(copy);
+			assertSame(assigned);
+		} else if (model.size() > 200 || rand() % 4 == 0) {
+			list->free();
+			while (!model.empty()) modelRemove(model.begin());
+		}
+		if (op % 97 == 0) assertSame(*list);
+	}
+	assertSame(*list);
+}
+
+void test_kept_list_allocates_once(void)
+{
+#ifndef __GLIBC__
+	TEST_IGNORE_MESSAGE("counts allocations through glibc's malloc");
+#else
+	LinkedList<int *> headers(nullptr);
+	std::vector<int *> pinned;
+	std::vector<int *> values(12);
+	size_t first = 0;
+
+	for (int *&v : values) v = new int(0);
+	// a kept-alive connection: a dozen headers a request, and between two
+	// requests a block that stays, where a freed node would be reused
+	for (uint32_t request = 0; request < 2000; request++) {
+		size_t before = allocations;
+		for (int *v : values) headers.add(v);
+		for (int *v : headers) {
+			if (v == values[3] || v == values[7]) headers.remove(v);
+		}
+		headers.free();
+		if (!request) {
+			first = allocations - before;
+		} else {
+			TEST_ASSERT_EQUAL_UINT32(0, allocations - before);
+		}
+		pinned.push_back((int *)malloc(200));
+	}
+	printf("12 headers: %u allocations on the first request, none after\n", (unsigned)first);
+	// 4 inline slots, then 8 and 16 on the heap
+	TEST_ASSERT_EQUAL_UINT32(2, first);
+
+	// a message queue: fills up to 16, then one in and one out
+	LinkedList<int *> queue(nullptr);
+	for (uint32_t i = 0; i < 100000; i++) {
+		size_t before = allocations;
+		queue.add(values[i % 12]);
+		if (queue.length() > 16) queue.remove(queue.front());
+		if (i > 32) TEST_ASSERT_EQUAL_UINT32(0, allocations - before);
+		if (i % 1000 == 0) pinned.push_back((int *)malloc(200));
+	}
+
+	for (int *p : pinned) free(p);
+	for (int *v : values) delete v;
+#endif
+}
+
+// an int that counts how often it is compared
+struct Counted {
+	static size_t compared;
+	int v;
+
+	Counted(int v = 0) : v(v) {}
+	bool operator==(const Counted &o) const
+	{
+		compared++;
+		return v == o.v;
+	}
+};
+
+size_t Counted::compared;
+
+void test_taking_the_front_compares_one(void)
+{
+	LinkedList<Counted> queue(nullptr);
+
+	for (int i = 0; i < 1000; i++) queue.add(Counted(i));
+	for (int i = 0; i < 500; i++) {
+		Counted::compared = 0;
+		TEST_ASSERT_TRUE(queue.remove(queue.front()));
+		TEST_ASSERT_EQUAL_UINT32(1, Counted::compared);
+	}
+
+	// the dead slots an iterator keeps in front are skipped, not compared
+	for (const Counted &c : queue) {
+		(void)c;
+		for (int i = 0; i < 100; i++) {
+			Counted::compared = 0;
+			TEST_ASSERT_TRUE(queue.remove(queue.front()));
+			TEST_ASSERT_EQUAL_UINT32(1, Counted::compared);
+		}
+		break;
+	}
+	TEST_ASSERT_EQUAL_UINT32(400, queue.length());
+	TEST_ASSERT_EQUAL(600, queue.front().v);
+
+	// anything else is a scan from the front
+	Counted::compared = 0;
+	TEST_ASSERT_TRUE(queue.remove(Counted(999)));
+	TEST_ASSERT_EQUAL_UINT32(400, Counted::compared);
+}
+
+void test_assignment_during_iteration(void)
+{
+	List other(nullptr);
+	std::vector<int> visited;
+
+	for (int i = 0; i < 6; i++) list->add(i);
+	for (int i = 100; i < 103; i++) other.add(i);
+
+	// assigned to on its second value: the loop carries on with the new ones
+	for (const int &v : *list) {
+		visited.push_back(v);
+		if (v == 1) *list = other;
+	}
+	TEST_ASSERT_TRUE(visited == std::vector<int>({ 0, 1, 100, 101, 102 }));
+	model.assign({ 100, 101, 102 });
+	assertSame(*list);
+
+	// and in nested loops, the outer one at its start: both go on with the
+	// new values, once
+	bool assigned = false;
+	visited.clear();
+	for (const int &v : *list) {
+		visited.push_back(v);
+		for (const int &w : *list) {
+			if (w == 101 && !assigned) {
+				*list = other;
+				assigned = true;
+			}
+		}
+	}
+	TEST_ASSERT_TRUE(visited == std::vector<int>({ 100, 100, 101, 102 }));
+	assertSame(*list);
+
+	// its gaps are closed once the loops are done
+	list->add(103);
+	model.push_back(103);
+	assertSame(*list);
+	TEST_ASSERT_EQUAL(100, *list->nth(0));
+	TEST_ASSERT_EQUAL(103, *list->nth(3));
+}
+
+template <typename F> static double nsPer(uint32_t runs, F f)
+{
+	double best = 1e9;
+
+	for (int round = 0; round < 5; round++) {
+		auto start = std::chrono::steady_clock::now();
+		for (uint32_t i = 0; i < runs; i++) f(i);
+		best = std::min(best, std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / runs);
+	}
+	return best;
+}
+
+static void print(const char *what, double ns, size_t allocs, double nsStd, size_t allocsStd, uint32_t runs)
+{
+	printf("%-34s %7.1f ns, %5.1f allocations   std::list %7.1f ns, %5.1f allocations\n", what, ns,
+		(double)allocs / runs / 5, nsStd, (double)allocsStd / runs / 5);
+}
+
+void test_benchmark(void)
+{
+	const uint32_t runs = 100000;
+	std::vector<String> names = { "Host", "User-Agent", "Accept", "Accept-Encoding", "Accept-Language", "Connection",
+		"Cookie", "Referer", "Cache-Control", "Pragma", "Upgrade-Insecure-Requests", "DNT" };
+	std::vector<String *> headers;
+	for (String &s : names) headers.push_back(&s);
+	volatile size_t sink = 0;
+	size_t before;
+	double ns, nsStd;
+	size_t allocs, allocsStd;
+
+	// a request's headers, on a kept-alive connection: added, looked up,
+	// the uninteresting ones dropped, freed
+	{
+		LinkedList<String *> list(nullptr);
+		std::list<String *> model;
+		before = allocations;
+		ns = nsPer(runs, [&](uint32_t) {
+			for (String *h : headers) list.add(h);
+			for (int look = 0; look < 4; look++) {
+				for (String *h : list) {
+					if (h == headers[look * 3]) {
+						sink += h->length();
+						break;
+					}
+				}
+			}
+			for (String *h : list) {
+				if (h->length() > 12) list.remove(h);
+			}
+			list.free();
+		});
+		allocs = allocations - before;
+		before = allocations;
+		nsStd = nsPer(runs, [&](uint32_t) {
+			for (String *h : headers) model.push_back(h);
+			for (int look = 0; look < 4; look++) {
+				for (String *h : model) {
+					if (h == headers[look * 3]) {
+						sink += h->length();
+						break;
+					}
+				}
+			}
+			model.remove_if([](String *h) { return h->length() > 12; });
+			model.clear();
+		});
+		allocsStd = allocations - before;
+		print("request headers, 12 add to free", ns, allocs, nsStd, allocsStd, runs);
+	}
+
+	// a WebSocket client's queue: 16 messages in, then out from the front
+	{
+		LinkedList<String *> list(nullptr);
+		std::list<String *> model;
+		before = allocations;
+		ns = nsPer(runs, [&](uint32_t) {
+			for (int i = 0; i < 16; i++) list.add(headers[i % 12]);
+			while (!list.isEmpty()) list.remove(list.front());
+		});
+		allocs = allocations - before;
+		before = allocations;
+		nsStd = nsPer(runs, [&](uint32_t) {
+			for (int i = 0; i < 16; i++) model.push_back(headers[i % 12]);
+			while (!model.empty()) model.pop_front();
+		});
+		allocsStd = allocations - before;
+		print("queue, 16 add and pop", ns, allocs, nsStd, allocsStd, runs);
+	}
+
+	// dispatch: the first of 24 handlers that takes the request
+	{
+		LinkedList<int *> list(nullptr);
+		std::list<int *> model;
+		std::vector<int> handlers(24);
+		for (int i = 0; i < 24; i++) {
+			handlers[i] = i;
+			list.add(&handlers[i]);
+			model.push_back(&handlers[i]);
+		}
+		before = allocations;
+		ns = nsPer(runs, [&](uint32_t i) {
+			for (int *h : list) {
+				if (*h == (int)(i % 24)) {
+					sink += *h;
+					break;
+				}
+			}
+		});
+		allocs = allocations - before;
+		before = allocations;
+		nsStd = nsPer(runs, [&](uint32_t i) {
+			for (int *h : model) {
+				if (*h == (int)(i % 24)) {
+					sink += *h;
+					break;
+				}
+			}
+		});
+		allocsStd = allocations - before;
+		print("dispatch over 24 handlers", ns, allocs, nsStd, allocsStd, runs);
+	}
+
+	// churn among 64 clients: one in the middle leaves, another comes
+	{
+		LinkedList<int> list(nullptr);
+		std::list<int> model;
+		for (int i = 0; i < 64; i++) {
+			list.add(i);
+			model.push_back(i);
+		}
+		before = allocations;
+		ns = nsPer(runs, [&](uint32_t) {
+			int v = *list.nth(32);
+			list.remove(v);
+			list.add(v);
+			sink += list.length();
+		});
+		allocs = allocations - before;
+		before = allocations;
+		nsStd = nsPer(runs, [&](uint32_t) {
+			int v = *std::next(model.begin(), 32);
+			model.remove(v);
+			model.push_back(v);
+			sink += model.size();
+		});
+		allocsStd = allocations - before;
+		print("64 clients, remove middle and add", ns, allocs, nsStd, allocsStd, runs);
+	}
+	(void)sink;
+}
+
+int main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+	UNITY_BEGIN();
+	RUN_TEST(test_matches_a_std_list_model);
+	RUN_TEST(test_kept_list_allocates_once);
+	RUN_TEST(test_taking_the_front_compares_one);
+	RUN_TEST(test_assignment_during_iteration);
+	RUN_TEST(test_benchmark);
+	return UNITY_END();
+}
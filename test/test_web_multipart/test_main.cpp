@@ -0,0 +1,459 @@
+// The multipart body parser against AsyncTCPSim: a body split at every
+// byte offset and fed in every block size parses the same, whatever the
+// split does to the delimiter, and the CRLF edge cases around delimiters
+// and part headers.
+//
+// test_benchmark uploads files of 1 MB and 10 MB in TCP segments of 1460
+// bytes and prints MB/s and the most heap the server held on top of what
+// it held before; that has to be the same for both sizes.
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <AsyncTCP.h>
+#include <unity.h>
+
+#include <malloc.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#define PORT 80
+
+struct Part
+{
+	std::string name;
+	std::string value;     // the field value, or the file name
+	bool file;
+	size_t size;
+};
+
+// bytes allocated and not yet freed, with glibc, and the most there were
+static size_t live;
+static size_t peak;
+
+#ifdef __GLIBC__
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t n, size_t size);
+extern "C" void *__libc_realloc(void *p, size_t size);
+extern "C" void __libc_free(void *p);
+
+static void *counted(void *p)
+{
+	if (p) live += malloc_usable_size(p);
+	if (live > peak) peak = live;
+	return p;
+}
+
+extern "C" void *malloc(size_t size)
+{
+	return counted(__libc_malloc(size));
+}
+
+extern "C" void *calloc(size_t n, size_t size)
+{
+	return counted(__libc_calloc(n, size));
+}
+
+extern "C" void *realloc(void *p, size_t size)
+{
+	if (p) live -= malloc_usable_size(p);
+	return counted(__libc_realloc(p, size));
+}
+
+extern "C" void free(void *p)
+{
+	if (p) live -= malloc_usable_size(p);
+	__libc_free(p);
+}
+#endif
+
+static AsyncWebServer *server;
+static std::vector<Part> parts;
+static std::string upload;
+static uint32_t finals;
+static uint32_t requests;
+
+static void onRequest(AsyncWebServerRequest *request)
+{
+	requests++;
+	for (size_t i = 0; i < request->params(); i++) {
+		AsyncWebParameter *p = request->getParam(i);
+		parts.push_back(Part{ p->name().c_str(), p->value().c_str(), p->isFile(), p->size() });
+	}
+	request->send(200, "text/plain", "ok");
+}
+
+static void onUpload(AsyncWebServerRequest *request, const String &filename, size_t index, uint8_t *data, size_t len, bool final)
+{
+	(void)request;
+	(void)filename;
+	// every call continues where the last one ended
+	TEST_ASSERT_EQUAL_UINT32(upload.size(), index);
+	upload.append((const char *)data, len);
+	if (final) finals++;
+}
+
+static std::string head(size_t length, const char *boundary = "XyZzy")
+{
+	return std::string("POST /upload HTTP/1.1\r\nHost: esp\r\n")
+		+ "Content-Type: multipart/form-data; boundary=" + boundary + "\r\n"
+		+ "Content-Length: " + std::to_string(length) + "\r\n\r\n";
+}
+
+// file content full of near-delimiters, including ones that a split can
+// make look like the real thing up to the last byte
+static std::string fileData(void)
+{
+	std::string f;
+
+	for (int i = 0; i < 6; i++) {
+		f += "line " + std::to_string(i) + "\r\n";
+		f += "\r\n--XyZzz\r\n";
+		f += "\r\n--XyZz";
+		f += "\r\r\n-";
+		f += "\n--XyZzy";    // a delimiter without its CR
+	}
+	f += "\r";                  // right before the delimiter
+	return f;
+}
+
+static std::string body(const std::string &file)
+{
+	return std::string("--XyZzy\r\n")
+		+ "Content-Disposition: form-data; name=\"title\"\r\n\r\n"
+		+ "Hello\r\nWorld\r\n"
+		+ "--XyZzy\r\n"
+		+ "Content-Disposition: form-data; name=\"data\"; filename=\"a.bin\"\r\n"
+		+ "Content-Type: application/octet-stream\r\n\r\n"
+		+ file + "\r\n"
+		+ "--XyZzy\r\n"
+		+ "Content-Disposition: form-data; name=\"n\"\r\n\r\n"
+		+ "42\r\n"
+		+ "--XyZzy--\r\n";
+}
+
+// send the request with its body split at the given offsets
+static std::string post(const std::string &b, const std::vector<size_t> &splits, const char *boundary = "XyZzy")
+{
+	AsyncTCPSimPeer peer;
+
+	TEST_ASSERT_TRUE(AsyncTCPSim::connect(PORT, &peer));
+	peer.send(head(b.size(), boundary).c_str());
+	size_t at = 0;
+	for (size_t s : splits) {
+		peer.send(b.data() + at, s - at);
+		at = s;
+	}
+	peer.send(b.data() + at, b.size() - at);
+	peer.ack();
+	std::string response = peer.received;
+	peer.close();
+	TEST_ASSERT_NULL(peer.client);
+	return response;
+}
+
+static void assertParts(const std::string &file)
+{
+	TEST_ASSERT_EQUAL_UINT32(1, requests);
+	TEST_ASSERT_EQUAL_UINT32(3, parts.size());
+	TEST_ASSERT_EQUAL_STRING("title", parts[0].name.c_str());
+	TEST_ASSERT_EQUAL_STRING("Hello\r\nWorld", parts[0].value.c_str());
+	TEST_ASSERT_FALSE(parts[0].file);
+	TEST_ASSERT_EQUAL_STRING("data", parts[1].name.c_str());
+	TEST_ASSERT_EQUAL_STRING("a.bin", parts[1].value.c_str());
+	TEST_ASSERT_TRUE(parts[1].file);
+	TEST_ASSERT_EQUAL_UINT32(file.size(), parts[1].size);
+	TEST_ASSERT_EQUAL_STRING("n", parts[2].name.c_str());
+	TEST_ASSERT_EQUAL_STRING("42", parts[2].value.c_str());
+	TEST_ASSERT_TRUE(upload == file);
+	TEST_ASSERT_EQUAL_UINT32(1, finals);
+}
+
+static void reset(void)
+{
+	parts.clear();
+	upload.clear();
+	finals = 0;
+	requests = 0;
+}
+
+void setUp(void)
+{
+	HostClock::reset();
+	reset();
+	server = new AsyncWebServer(PORT);
+	server->on("/upload", HTTP_POST, onRequest, onUpload);
+	server->begin();
+}
+
+void tearDown(void)
+{
+	delete server;
+}
+
+void test_body_in_one_block(void)
+{
+	std::string f = fileData();
+	std::string r = post(body(f), {});
+
+	TEST_ASSERT_EQUAL(0, r.find("HTTP/1.1 200 OK\r\n"));
+	assertParts(f);
+}
+
+void test_body_split_at_every_offset(void)
+{
+	std::string f = fileData();
+	std::string b = body(f);
+
+	for (size_t at = 1; at < b.size(); at++) {
+		reset();
+		post(b, { at });
+		assertParts(f);
+	}
+}
+
+void test_body_split_twice_around_every_delimiter_byte(void)
+{
+	std::string f = fileData();
+	std::string b = body(f);
+
+	// every pair of splits within reach of a delimiter, so that one
+	// delimiter is spread over three blocks
+	for (size_t at = b.find("\r\n--XyZzy"); at != std::string::npos; at = b.find("\r\n--XyZzy", at + 1)) {
+		for (size_t i = at; i < at + 9; i++) {
+			for (size_t j = i + 1; j <= at + 9 && j < b.size(); j++) {
+				reset();
+				post(b, { i, j });
+				assertParts(f);
+			}
+		}
+	}
+}
+
+void test_body_in_every_block_size(void)
+{
+	std::string f = fileData();
+	std::string b = body(f);
+
+	for (size_t size = 1; size <= 64; size++) {
+		std::vector<size_t> splits;
+		for (size_t at = size; at < b.size(); at += size) splits.push_back(at);
+		reset();
+		post(b, splits);
+		assertParts(f);
+	}
+}
+
+void test_preamble_and_epilogue_are_skipped(void)
+{
+	std::string f = fileData();
+	std::string b = "This is the preamble.\r\n\r\n--XyZzz is not it\r\n-\r\n" + body(f) + "This is the epilogue.\r\n--XyZzy\r\n";
+
+	for (size_t at = 1; at < 60; at++) {
+		reset();
+		post(b, { at });
+		assertParts(f);
+	}
+
+	// the epilogue belongs to the body, the next request on the
+	// connection starts after it
+	reset();
+	server->on("/next", HTTP_GET, [](AsyncWebServerRequest *request) { request->send(204); });
+	AsyncTCPSimPeer peer;
+	TEST_ASSERT_TRUE(AsyncTCPSim::connect(PORT, &peer));
+	size_t epilogue = b.find("This is the epilogue");
+	peer.send((head(b.size()) + b.substr(0, epilogue)).c_str());
+	peer.send((b.substr(epilogue) + "GET /next HTTP/1.1\r\n\r\n").c_str());
+	for (int i = 0; i < 4; i++) {
+		peer.ack();
+		peer.poll();
+	}
+	assertParts(f);
+	TEST_ASSERT_NOT_EQUAL(std::string::npos, peer.received.find("HTTP/1.1 204 No Content\r\n"));
+	peer.close();
+}
+
+void test_first_delimiter_with_its_crlf(void)
+{
+	std::string f = fileData();
+
+	for (size_t at = 1; at < 12; at++) {
+		reset();
+		post("\r\n" + body(f), { at });
+		assertParts(f);
+	}
+}
+
+void test_close_delimiter_without_crlf(void)
+{
+	std::string f = fileData();
+	std::string b = body(f);
+	b.resize(b.size() - 2);
+
+	std::string r = post(b, {});
+	TEST_ASSERT_EQUAL(0, r.find("HTTP/1.1 200 OK\r\n"));
+	assertParts(f);
+
+	// and with only the CR of it
+	reset();
+	b += "\r";
+	post(b, { b.size() - 1 });
+	assertParts(f);
+}
+
+void test_transport_padding_and_bare_lf_headers(void)
+{
+	std::string b = std::string("--XyZzy \t\r\n")
+		+ "Content-Disposition: form-data; name=\"a\"\n\n"
+		+ "1\r\n"
+		+ "--XyZzy\t\r\n"
+		+ "content-disposition: form-data; name=\"b\"\r\n\r\n"
+		+ "\r\n--XyZzy--\r\n";
+
+	for (size_t at = 1; at < b.size(); at++) {
+		reset();
+		post(b, { at });
+		TEST_ASSERT_EQUAL_UINT32(1, requests);
+		TEST_ASSERT_EQUAL_UINT32(2, parts.size());
+		TEST_ASSERT_EQUAL_STRING("a", parts[0].name.c_str());
+		TEST_ASSERT_EQUAL_STRING("1", parts[0].value.c_str());
+		TEST_ASSERT_EQUAL_STRING("b", parts[1].name.c_str());
+		// an empty value
+		TEST_ASSERT_EQUAL_STRING("", parts[1].value.c_str());
+	}
+}
+
+void test_garbage_after_delimiter_stops_parsing(void)
+{
+	std::string b = std::string("--XyZzy\r\n")
+		+ "Content-Disposition: form-data; name=\"a\"\r\n\r\n"
+		+ "1\r\n"
+		+ "--XyZzyX\r\n"    // a longer boundary is not this one
+		+ "Content-Disposition: form-data; name=\"b\"\r\n\r\n"
+		+ "2\r\n"
+		+ "--XyZzy--\r\n";
+
+	std::string r = post(b, {});
+	// the request still completes, without the broken part
+	TEST_ASSERT_EQUAL(0, r.find("HTTP/1.1 200 OK\r\n"));
+	TEST_ASSERT_EQUAL_UINT32(1, requests);
+	TEST_ASSERT_EQUAL_UINT32(1, parts.size());
+	TEST_ASSERT_EQUAL_STRING("1", parts[0].value.c_str());
+}
+
+void test_boundary_of_70_characters(void)
+{
+	std::string boundary(70, 'b');
+	std::string b = "--" + boundary + "\r\n"
+		+ "Content-Disposition: form-data; name=\"a\"\r\n\r\n"
+		+ "x\r\n--" + boundary.substr(0, 69) + "\r\n"
+		+ "\r\n--" + boundary + "--\r\n";
+
+	std::string value = "x\r\n--" + boundary.substr(0, 69) + "\r\n";
+
+	for (size_t at = 1; at < b.size(); at++) {
+		reset();
+		post(b, { at }, boundary.c_str());
+		TEST_ASSERT_EQUAL_UINT32(1, parts.size());
+		TEST_ASSERT_EQUAL_STRING(value.c_str(), parts[0].value.c_str());
+	}
+
+	// one more is over the RFC 2046 limit and nothing is parsed
+	boundary += "b";
+	reset();
+	post("--" + boundary + "\r\nContent-Disposition: form-data; name=\"a\"\r\n\r\nx\r\n--" + boundary + "--\r\n", {}, boundary.c_str());
+	TEST_ASSERT_EQUAL_UINT32(1, requests);
+	TEST_ASSERT_EQUAL_UINT32(0, parts.size());
+}
+
+static size_t sunk;
+
+// counts the file instead of keeping it, as a handler writing to flash
+static void onSink(AsyncWebServerRequest *request, const String &filename, size_t index, uint8_t *data, size_t len, bool final)
+{
+	(void)request;
+	(void)filename;
+	(void)data;
+	TEST_ASSERT_EQUAL_UINT32(sunk, index);
+	sunk += len;
+	if (final) finals++;
+}
+
+// uploads a file of 'size' random bytes; returns seconds, and the heap
+// held during the upload in 'held'
+static double uploadFile(size_t size, size_t *held)
+{
+	std::string file(size, 0);
+	AsyncTCPSimPeer peer;
+
+	srand(size);
+	for (char &c : file) c = rand();
+	std::string b = std::string("--XyZzy\r\n")
+		+ "Content-Disposition: form-data; name=\"data\"; filename=\"big.bin\"\r\n"
+		+ "Content-Type: application/octet-stream\r\n\r\n"
+		+ file + "\r\n--XyZzy--\r\n";
+	std::string h = head(b.size());
+	h.replace(h.find("/upload"), 7, "/sink");
+	file.clear();
+	file.shrink_to_fit();
+
+	reset();
+	sunk = 0;
+	auto start = std::chrono::steady_clock::now();
+	TEST_ASSERT_TRUE(AsyncTCPSim::connect(PORT, &peer));
+	size_t before = live;
+	peak = live;
+	peer.send(h.c_str());
+	for (size_t at = 0; at < b.size(); at += 1460) {
+		peer.send(b.data() + at, std::min((size_t)1460, b.size() - at));
+		peer.ack();
+	}
+	peer.ack();
+	*held = peak - before;
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	TEST_ASSERT_EQUAL(0, peer.received.find("HTTP/1.1 200 OK\r\n"));
+	peer.close();
+	TEST_ASSERT_EQUAL_UINT32(size, sunk);
+	TEST_ASSERT_EQUAL_UINT32(1, finals);
+	TEST_ASSERT_EQUAL_UINT32(1, requests);
+	return seconds;
+}
+
+void test_benchmark(void)
+{
+	size_t held[2];
+	const size_t sizes[2] = { 1 << 20, 10 << 20 };
+
+	server->on("/sink", HTTP_POST, onRequest, onSink);
+	for (int i = 0; i < 2; i++) {
+		double seconds = uploadFile(sizes[i], &held[i]);
+		printf("%2u MB upload: %.0f MB/s, %u bytes of heap held\n", (unsigned)(sizes[i] >> 20),
+			sizes[i] / seconds / 1e6, (unsigned)held[i]);
+	}
+#ifdef __GLIBC__
+	// the parser keeps a block and a delimiter's worth, whatever the size
+	TEST_ASSERT_EQUAL_UINT32(held[0], held[1]);
+	TEST_ASSERT_TRUE(held[1] < 16 * 1024);
+#endif
+}
+
+int main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+	UNITY_BEGIN();
+	RUN_TEST(test_body_in_one_block);
+	RUN_TEST(test_body_split_at_every_offset);
+	RUN_TEST(test_body_split_twice_around_every_delimiter_byte);
+	RUN_TEST(test_body_in_every_block_size);
+	RUN_TEST(test_preamble_and_epilogue_are_skipped);
+	RUN_TEST(test_first_delimiter_with_its_crlf);
+	RUN_TEST(test_close_delimiter_without_crlf);
+	RUN_TEST(test_transport_padding_and_bare_lf_headers);
+	RUN_TEST(test_garbage_after_delimiter_stops_parsing);
+	RUN_TEST(test_boundary_of_70_characters);
+	RUN_TEST(test_benchmark);
+	return UNITY_END();
+}
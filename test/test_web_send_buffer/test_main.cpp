@@ -0,0 +1,229 @@
+// AsyncAbstractResponse's send buffer and AsyncFileResponse's sector
+// aligned reads, against AsyncTCPSim and HostFS: file and chunked
+// responses come out intact in every window and ack pattern, a response
+// allocates the same whatever its size, and a file is read a sector at a
+// time, each sector once.  test_benchmark prints throughput, allocations
+// and sector reads per MB served.
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <AsyncTCP.h>
+#include <HostFS.h>
+#include <unity.h>
+
+#include <stdlib.h>
+#include <chrono>
+#include <string>
+
+#define PORT 80
+#define FILE_SIZE 200000
+#define FS_ROOT "/tmp/test_web_send_buffer"
+
+static HostFS *disk;
+static AsyncWebServer *server;
+static size_t chunkedSize;
+
+// every allocation, with glibc: the response's buffer is malloc()ed
+static uint64_t mallocs;
+
+#ifdef __GLIBC__
+extern "C" void *__libc_malloc(size_t size);
+
+extern "C" void *malloc(size_t size)
+{
+	mallocs++;
+	return __libc_malloc(size);
+}
+#endif
+
+static uint8_t pattern(size_t i)
+{
+	return (uint8_t)(i * 131 + (i >> 9) * 7);
+}
+
+static void writeFile(const char *path, size_t size)
+{
+	File f = disk->open(path, FILE_WRITE);
+	uint8_t buf[1000];
+
+	for (size_t at = 0; at < size; at += sizeof buf) {
+		size_t n = std::min(sizeof buf, size - at);
+		for (size_t i = 0; i < n; i++) buf[i] = pattern(at + i);
+		TEST_ASSERT_EQUAL_UINT32(n, f.write(buf, n));
+	}
+	f.close();
+}
+
+static bool isPattern(const std::string &body, size_t size)
+{
+	if (body.size() != size) return false;
+	for (size_t i = 0; i < size; i++) {
+		if ((uint8_t)body[i] != pattern(i)) return false;
+	}
+	return true;
+}
+
+// GET path in the given window, acking step bytes at a time (0: all that
+// is outstanding); returns the body, with a chunked one decoded
+static std::string get(const char *path, size_t window, size_t step = 0, size_t expect = 0)
+{
+	AsyncTCPSimPeer peer;
+
+	peer.window = window;
+	peer.received.reserve(expect + 4096);
+	TEST_ASSERT_TRUE(AsyncTCPSim::connect(PORT, &peer));
+	peer.send((std::string("GET ") + path + " HTTP/1.1\r\nHost: esp\r\n\r\n").c_str());
+	while (peer.unacked) peer.ack(step ? std::min(step, peer.unacked) : peer.unacked);
+
+	size_t at = peer.received.find("\r\n\r\n");
+	TEST_ASSERT_TRUE(at != std::string::npos);
+	TEST_ASSERT_EQUAL(0, peer.received.find("HTTP/1.1 200 OK\r\n"));
+	std::string body;
+	if (peer.received.find("Transfer-Encoding: chunked\r\n") < at) {
+		at += 4;
+		for (;;) {
+			size_t size = strtoul(peer.received.c_str() + at, NULL, 16);
+			at = peer.received.find("\r\n", at) + 2;
+			if (!size) break;
+			body.append(peer.received, at, size);
+			at += size + 2;
+		}
+	} else {
+		body = peer.received.substr(at + 4);
+	}
+	peer.close();
+	return body;
+}
+
+static size_t fillChunk(uint8_t *buffer, size_t maxLen, size_t index)
+{
+	size_t n = std::min(maxLen, chunkedSize - index);
+
+	for (size_t i = 0; i < n; i++) buffer[i] = pattern(index + i);
+	return n;
+}
+
+void setUp(void)
+{
+	HostClock::reset();
+	disk = new HostFS(FS_ROOT);
+	disk->clear();
+	writeFile("/f.bin", FILE_SIZE);
+	chunkedSize = FILE_SIZE;
+	server = new AsyncWebServer(PORT);
+	server->on("/f", HTTP_GET, [](AsyncWebServerRequest *request) {
+		request->send(*disk, "/f.bin", "application/octet-stream");
+	});
+	server->on("/big", HTTP_GET, [](AsyncWebServerRequest *request) {
+		request->send(*disk, "/big.bin", "application/octet-stream");
+	});
+	server->on("/chunked", HTTP_GET, [](AsyncWebServerRequest *request) {
+		request->sendChunked("application/octet-stream", fillChunk);
+	});
+	server->begin();
+}
+
+void tearDown(void)
+{
+	delete server;
+	delete disk;
+}
+
+void test_file_is_intact_in_every_window(void)
+{
+	static const size_t windows[] = { 1, 7, 100, 511, 512, 513, 1436, 1500, 2872, 4000, 5744, 8192 };
+	static const size_t steps[] = { 0, 1, 536, 1436 };
+
+	for (size_t w : windows) {
+		for (size_t s : steps) {
+			// acking a byte at a time is left to the small windows
+			if (s == 1 && w > 600) continue;
+			TEST_ASSERT_TRUE(isPattern(get("/f", w, s, FILE_SIZE), FILE_SIZE));
+		}
+	}
+}
+
+void test_chunked_is_intact_in_every_window(void)
+{
+	chunkedSize = 30000;
+	for (size_t w = 9; w <= 6000; w += w < 100 ? 1 : 211) {
+		TEST_ASSERT_TRUE(isPattern(get("/chunked", w, 0, 40000), chunkedSize));
+		TEST_ASSERT_TRUE(isPattern(get("/chunked", w, 536, 40000), chunkedSize));
+	}
+}
+
+void test_file_is_read_a_sector_at_a_time(void)
+{
+	static const size_t windows[] = { 1436, 2872, 3000, 5744, 8192 };
+	const uint64_t sectors = (FILE_SIZE + HOST_FS_SECTOR_SIZE - 1) / HOST_FS_SECTOR_SIZE;
+
+	for (size_t w : windows) {
+		disk->resetStats();
+		TEST_ASSERT_TRUE(isPattern(get("/f", w, 0, FILE_SIZE), FILE_SIZE));
+		TEST_ASSERT_EQUAL_UINT64(FILE_SIZE, disk->bytesRead());
+		// every read starts on a sector, so none is read twice
+		TEST_ASSERT_EQUAL_UINT64(sectors, disk->sectorReads());
+
+		// the same acked a segment at a time, which leaves windows of
+		// more than a sector but not a multiple of one
+		disk->resetStats();
+		TEST_ASSERT_TRUE(isPattern(get("/f", w, 1436, FILE_SIZE), FILE_SIZE));
+		TEST_ASSERT_EQUAL_UINT64(sectors, disk->sectorReads());
+	}
+}
+
+void test_allocations_do_not_grow_with_the_response(void)
+{
+#ifndef __GLIBC__
+	TEST_IGNORE_MESSAGE("counts allocations through glibc's malloc");
+#else
+	writeFile("/big.bin", 16 * FILE_SIZE);
+
+	for (size_t w : { (size_t)1436, (size_t)5744 }) {
+		// warm up, then one small and one large response
+		get("/f", w, 0, 16 * FILE_SIZE);
+		mallocs = 0;
+		get("/f", w, 0, 16 * FILE_SIZE);
+		uint64_t small = mallocs;
+		mallocs = 0;
+		get("/big", w, 0, 16 * FILE_SIZE);
+		uint64_t large = mallocs;
+
+		// one buffer per response: 3MB more cost no more allocations
+		// than there are windows in a megabyte, let alone per window
+		TEST_ASSERT_UINT64_WITHIN(2, small, large);
+	}
+#endif
+}
+
+void test_benchmark(void)
+{
+	const size_t size = 8 << 20;
+	static const size_t windows[] = { 1436, 2872, 5744 };
+
+	writeFile("/big.bin", size);
+	for (size_t w : windows) {
+		disk->resetStats();
+		mallocs = 0;
+		auto start = std::chrono::steady_clock::now();
+		std::string body = get("/big", w, 1436, size);
+		double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		TEST_ASSERT_EQUAL_UINT32(size, body.size());
+		printf("window %5u: %7.1f MB/s, %6.1f allocations/MB, %6.1f sector reads/MB (%u is one each)\n",
+			(unsigned)w, size / s / 1e6, mallocs / 8.0, disk->sectorReads() / 8.0, (1 << 20) / HOST_FS_SECTOR_SIZE);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+	UNITY_BEGIN();
+	RUN_TEST(test_file_is_intact_in_every_window);
+	RUN_TEST(test_chunked_is_intact_in_every_window);
+	RUN_TEST(test_file_is_read_a_sector_at_a_time);
+	RUN_TEST(test_allocations_do_not_grow_with_the_response);
+	RUN_TEST(test_benchmark);
+	return UNITY_END();
+}